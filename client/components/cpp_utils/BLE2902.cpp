@@ -29,6 +29,16 @@ bool BLE2902::getNotifications() {
 } // getNotifications
 
 
+/**
+ * @brief Get the notifications value of a client.
+ * @param [in] connId The connection of the client.
+ * @return True if the client has enabled notifications and false if not.
+ */
+bool BLE2902::getNotifications(uint16_t connId) {
+	return (getCCCD(connId) & (1 << 0)) != 0;
+} // getNotifications
+
+
 /**
  * @brief Get the indications value.
  * @return The indications value.  True if indications are enabled and false if not.
@@ -38,6 +48,16 @@ bool BLE2902::getIndications() {
 } // getIndications
 
 
+/**
+ * @brief Get the indications value of a client.
+ * @param [in] connId The connection of the client.
+ * @return True if the client has enabled indications and false if not.
+ */
+bool BLE2902::getIndications(uint16_t connId) {
+	return (getCCCD(connId) & (1 << 1)) != 0;
+} // getIndications
+
+
 /**
  * @brief Set the indications flag.
  * @param [in] flag The indications flag.
@@ -16,6 +16,8 @@
  * @brief Descriptor for Client Characteristic Configuration.
  *
  * This is a convenience descriptor for the Client Characteristic Configuration which has a UUID of 0x2902.
+ * Each connected client has its own configuration.  The forms of getNotifications() and getIndications()
+ * that take a connection id report that client's choice while those without report the most recent write.
  *
  * See also:
  * https://www.bluetooth.com/specifications/gatt/viewer?attributeXmlFile=org.bluetooth.descriptor.gatt.client_characteristic_configuration.xml
@@ -24,7 +26,9 @@ class BLE2902: public BLEDescriptor {
 public:
 	BLE2902();
 	bool getNotifications();
+	bool getNotifications(uint16_t connId);
 	bool getIndications();
+	bool getIndications(uint16_t connId);
 	void setNotifications(bool flag);
 	void setIndications(bool flag);
 
@@ -16,7 +16,9 @@
 #include <esp_log.h>
 #include <sstream>
 #include "BLEAdvertisedDevice.h"
+#include "BLEAdvertisementView.h"
 #include "BLEUtils.h"
+#include "GeneralUtils.h"
 #ifdef ARDUINO_ARCH_ESP32
 #include "esp32-hal-log.h"
 #endif
@@ -220,141 +222,130 @@ bool BLEAdvertisedDevice::haveTXPower() {
 /**
  * @brief Parse the advertising pay load.
  *
- * The pay load is a buffer of bytes that is either 31 bytes long or terminated by
+ * The pay load is a buffer of bytes that is either payloadLength bytes long or terminated by
  * a 0 length value.  Each entry in the buffer has the format:
  * [length][type][data...]
  *
  * The length does not include itself but does include everything after it until the next record.  A record
- * with a length value of 0 indicates a terminator.
+ * with a length value of 0 indicates a terminator.  Multi-byte values are little endian and need not be
+ * aligned, so they are assembled a byte at a time.
  *
  * https://www.bluetooth.com/specifications/assigned-numbers/generic-access-profile
+ *
+ * @param [in] payload The advertisement data followed by any scan response data.
+ * @param [in] payloadLength The number of valid bytes in the payload.
  */
-void BLEAdvertisedDevice::parseAdvertisement(uint8_t* payload) {
-	uint8_t length;
-	uint8_t ad_type;
-	uint8_t sizeConsumed = 0;
-	bool finished = false;
-
-	while(!finished) {
-		length = *payload;          // Retrieve the length of the record.
-		payload++;                  // Skip to type
-		sizeConsumed += 1 + length; // increase the size consumed.
+void BLEAdvertisedDevice::parseAdvertisement(uint8_t* payload, size_t payloadLength) {
+	BLEAdvertisementView         view(payload, payloadLength);
+	BLEAdvertisementView::Record record;
 
-		if (length != 0) { // A length of 0 indicates that we have reached the end.
-			ad_type = *payload;
-			payload++;
-			length--;
+	for (bool more = view.getFirst(record); more; more = view.getNext(record)) {
+		uint8_t        ad_type = record.type;
+		uint8_t        length  = record.length;
+		const uint8_t* pData   = record.pData;
 
-			char* pHex = BLEUtils::buildHexData(nullptr, payload, length);
+		if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+			char hexBuf[63];
 			ESP_LOGD(LOG_TAG, "Type: 0x%.2x (%s), length: %d, data: %s",
-					ad_type, BLEUtils::advTypeToString(ad_type), length, pHex);
-			free(pHex);
-
-			switch(ad_type) {
-				case ESP_BLE_AD_TYPE_NAME_CMPL: {   // Adv Data Type: 0x09
-					setName(std::string(reinterpret_cast<char*>(payload), length));
-					break;
-				} // ESP_BLE_AD_TYPE_NAME_CMPL
-
-				case ESP_BLE_AD_TYPE_TX_PWR: {      // Adv Data Type: 0x0A
-					setTXPower(*payload);
-					break;
-				} // ESP_BLE_AD_TYPE_TX_PWR
-
-				case ESP_BLE_AD_TYPE_APPEARANCE: { // Adv Data Type: 0x19
-					setAppearance(*reinterpret_cast<uint16_t*>(payload));
-					break;
-				} // ESP_BLE_AD_TYPE_APPEARANCE
-
-				case ESP_BLE_AD_TYPE_FLAG: {        // Adv Data Type: 0x01
-					setAdFlag(*payload);
-					break;
-				} // ESP_BLE_AD_TYPE_FLAG
-
-				case ESP_BLE_AD_TYPE_16SRV_CMPL:
-				case ESP_BLE_AD_TYPE_16SRV_PART: {   // Adv Data Type: 0x02
-					for (int var = 0; var < length/2; ++var) {
-						setServiceUUID(BLEUUID(*reinterpret_cast<uint16_t*>(payload+var*2)));
-					}
-					break;
-				} // ESP_BLE_AD_TYPE_16SRV_PART
+					ad_type, BLEUtils::advTypeToString(ad_type), length, GeneralUtils::toHex(hexBuf, sizeof(hexBuf), (uint8_t*)pData, length));
+		}
 
-				case ESP_BLE_AD_TYPE_32SRV_CMPL:
-				case ESP_BLE_AD_TYPE_32SRV_PART: {   // Adv Data Type: 0x04
-					for (int var = 0; var < length/4; ++var) {
-						setServiceUUID(BLEUUID(*reinterpret_cast<uint32_t*>(payload+var*4)));
-					}
-					break;
-				} // ESP_BLE_AD_TYPE_32SRV_PART
+		switch(ad_type) {
+			case ESP_BLE_AD_TYPE_NAME_CMPL: {   // Adv Data Type: 0x09
+				setName(std::string(reinterpret_cast<const char*>(pData), length));
+				break;
+			} // ESP_BLE_AD_TYPE_NAME_CMPL
+
+			case ESP_BLE_AD_TYPE_TX_PWR: {      // Adv Data Type: 0x0A
+				setTXPower(*pData);
+				break;
+			} // ESP_BLE_AD_TYPE_TX_PWR
+
+			case ESP_BLE_AD_TYPE_APPEARANCE: { // Adv Data Type: 0x19
+				setAppearance(BLEAdvertisementView::readUInt16(pData));
+				break;
+			} // ESP_BLE_AD_TYPE_APPEARANCE
+
+			case ESP_BLE_AD_TYPE_FLAG: {        // Adv Data Type: 0x01
+				setAdFlag(*pData);
+				break;
+			} // ESP_BLE_AD_TYPE_FLAG
+
+			case ESP_BLE_AD_TYPE_16SRV_CMPL:
+			case ESP_BLE_AD_TYPE_16SRV_PART: {   // Adv Data Type: 0x02
+				for (int var = 0; var < length/2; ++var) {
+					setServiceUUID(BLEUUID(BLEAdvertisementView::readUInt16(pData+var*2)));
+				}
+				break;
+			} // ESP_BLE_AD_TYPE_16SRV_PART
 
-				case ESP_BLE_AD_TYPE_128SRV_CMPL: { // Adv Data Type: 0x07
-					setServiceUUID(BLEUUID(payload, 16, false));
-					break;
-				} // ESP_BLE_AD_TYPE_128SRV_CMPL
+			case ESP_BLE_AD_TYPE_32SRV_CMPL:
+			case ESP_BLE_AD_TYPE_32SRV_PART: {   // Adv Data Type: 0x04
+				for (int var = 0; var < length/4; ++var) {
+					setServiceUUID(BLEUUID(BLEAdvertisementView::readUInt32(pData+var*4)));
+				}
+				break;
+			} // ESP_BLE_AD_TYPE_32SRV_PART
 
-				case ESP_BLE_AD_TYPE_128SRV_PART: { // Adv Data Type: 0x06
-					setServiceUUID(BLEUUID(payload, 16, false));
+			case ESP_BLE_AD_TYPE_128SRV_CMPL:
+			case ESP_BLE_AD_TYPE_128SRV_PART: { // Adv Data Type: 0x06
+				for (int var = 0; var < length/16; ++var) {
+					setServiceUUID(BLEUUID((uint8_t*)pData+var*16, 16, false));
+				}
+				break;
+			} // ESP_BLE_AD_TYPE_128SRV_PART
+
+			// See CSS Part A 1.4 Manufacturer Specific Data
+			case ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE: {
+				setManufacturerData(std::string(reinterpret_cast<const char*>(pData), length));
+				break;
+			} // ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE
+
+			case ESP_BLE_AD_TYPE_SERVICE_DATA: {  // Adv Data Type: 0x16 (Service Data) - 2 byte UUID
+				if (length < 2) {
+					ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_SERVICE_DATA");
 					break;
-				} // ESP_BLE_AD_TYPE_128SRV_PART
+				}
+				uint16_t uuid = BLEAdvertisementView::readUInt16(pData);
+				setServiceDataUUID(BLEUUID(uuid));
+				if (length > 2) {
+					setServiceData(std::string(reinterpret_cast<const char*>(pData+2), length-2));
+				}
+				break;
+			} //ESP_BLE_AD_TYPE_SERVICE_DATA
 
-				// See CSS Part A 1.4 Manufacturer Specific Data
-				case ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE: {
-					setManufacturerData(std::string(reinterpret_cast<char*>(payload), length));
-					break;
-				} // ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE
-
-				case ESP_BLE_AD_TYPE_SERVICE_DATA: {  // Adv Data Type: 0x16 (Service Data) - 2 byte UUID
-					if (length < 2) {
-						ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_SERVICE_DATA");
-						break;
-					}
-					uint16_t uuid = *(uint16_t *)payload;
-					setServiceDataUUID(BLEUUID(uuid));
-					if (length > 2) {
-						setServiceData(std::string(reinterpret_cast<char*>(payload+2), length-2));
-					}
-					break;
-				} //ESP_BLE_AD_TYPE_SERVICE_DATA
-
-				case ESP_BLE_AD_TYPE_32SERVICE_DATA: {  // Adv Data Type: 0x20 (Service Data) - 4 byte UUID
-					if (length < 4) {
-						ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_32SERVICE_DATA");
-						break;
-					}
-					uint32_t uuid = *(uint32_t *)payload;
-					setServiceDataUUID(BLEUUID(uuid));
-					if (length > 4) {
-						setServiceData(std::string(reinterpret_cast<char*>(payload+4), length-4));
-					}
-					break;
-				} //ESP_BLE_AD_TYPE_32SERVICE_DATA
-
-				case ESP_BLE_AD_TYPE_128SERVICE_DATA: {  // Adv Data Type: 0x21 (Service Data) - 16 byte UUID
-					if (length < 16) {
-						ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_128SERVICE_DATA");
-						break;
-					}
-
-					setServiceDataUUID(BLEUUID(payload, (size_t)16, false));
-					if (length > 16) {
-						setServiceData(std::string(reinterpret_cast<char*>(payload+16), length-16));
-					}
+			case ESP_BLE_AD_TYPE_32SERVICE_DATA: {  // Adv Data Type: 0x20 (Service Data) - 4 byte UUID
+				if (length < 4) {
+					ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_32SERVICE_DATA");
 					break;
-				} //ESP_BLE_AD_TYPE_32SERVICE_DATA
+				}
+				uint32_t uuid = BLEAdvertisementView::readUInt32(pData);
+				setServiceDataUUID(BLEUUID(uuid));
+				if (length > 4) {
+					setServiceData(std::string(reinterpret_cast<const char*>(pData+4), length-4));
+				}
+				break;
+			} //ESP_BLE_AD_TYPE_32SERVICE_DATA
 
-				default: {
-					ESP_LOGD(LOG_TAG, "Unhandled type: adType: %d - 0x%.2x", ad_type, ad_type);
+			case ESP_BLE_AD_TYPE_128SERVICE_DATA: {  // Adv Data Type: 0x21 (Service Data) - 16 byte UUID
+				if (length < 16) {
+					ESP_LOGE(LOG_TAG, "Length too small for ESP_BLE_AD_TYPE_128SERVICE_DATA");
 					break;
 				}
-			} // switch
-			payload += length;
-		} // Length <> 0
 
-
-		if (sizeConsumed >=31 || length == 0) {
-			finished = true;
-		}
-	} // !finished
+				setServiceDataUUID(BLEUUID((uint8_t*)pData, (size_t)16, false));
+				if (length > 16) {
+					setServiceData(std::string(reinterpret_cast<const char*>(pData+16), length-16));
+				}
+				break;
+			} //ESP_BLE_AD_TYPE_32SERVICE_DATA
+
+			default: {
+				ESP_LOGD(LOG_TAG, "Unhandled type: adType: %d - 0x%.2x", ad_type, ad_type);
+				break;
+			}
+		} // switch
+	} // for each record
 } // parseAdvertisement
 
 
@@ -394,9 +385,11 @@ void BLEAdvertisedDevice::setAppearance(uint16_t appearance) {
 void BLEAdvertisedDevice::setManufacturerData(std::string manufacturerData) {
 	m_manufacturerData     = manufacturerData;
 	m_haveManufacturerData = true;
-	char* pHex = BLEUtils::buildHexData(nullptr, (uint8_t*)m_manufacturerData.data(), (uint8_t)m_manufacturerData.length());
-	ESP_LOGD(LOG_TAG, "- manufacturer data: %s", pHex);
-	free(pHex);
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		char hexBuf[63];
+		ESP_LOGD(LOG_TAG, "- manufacturer data: %s",
+				GeneralUtils::toHex(hexBuf, sizeof(hexBuf), (uint8_t*)m_manufacturerData.data(), m_manufacturerData.length()));
+	}
 } // setManufacturerData
 
 
@@ -447,7 +440,9 @@ void BLEAdvertisedDevice::setServiceUUID(const char* serviceUUID) {
 void BLEAdvertisedDevice::setServiceUUID(BLEUUID serviceUUID) {
 	m_serviceUUIDs.push_back(serviceUUID);
 	m_haveServiceUUID = true;
-	ESP_LOGD(LOG_TAG, "- addServiceUUID(): serviceUUID: %s", serviceUUID.toString().c_str());
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, "- addServiceUUID(): serviceUUID: %s", serviceUUID.toString().c_str());
+	}
 } // setServiceUUID
 
 
@@ -14,6 +14,7 @@
 #include <map>
 
 #include "BLEAddress.h"
+#include "BLEAdvertisementView.h"
 #include "BLEScan.h"
 #include "BLEUUID.h"
 
@@ -54,8 +55,9 @@ public:
 
 private:
 	friend class BLEScan;
+	friend class BLEScanResults;
 
-	void parseAdvertisement(uint8_t* payload);
+	void parseAdvertisement(uint8_t* payload, size_t payloadLength);
 	void setAddress(BLEAddress address);
 	void setAdFlag(uint8_t adFlag);
 	void setAdvertizementResult(uint8_t* payload);
@@ -111,6 +113,20 @@ public:
 	 * device that was found.  During any individual scan, a device will only be detected one time.
 	 */
 	virtual void onResult(BLEAdvertisedDevice advertisedDevice) = 0;
+
+	/**
+	 * @brief Called to decide whether an advertisement is of interest.
+	 *
+	 * This is called for each advertisement heard, before it is parsed, with a view over its raw bytes.
+	 * Returning false discards the advertisement without building a BLEAdvertisedDevice for it; it is
+	 * neither passed to onResult() nor recorded in the scan results.  Looking for a service or manufacturer
+	 * prefix through the view does not allocate, so rejecting devices here is much cheaper than in onResult().
+	 * The default accepts every advertisement.
+	 *
+	 * @param [in] advertisement The raw advertisement and any scan response.
+	 * @return True if the advertisement should be parsed and reported.
+	 */
+	virtual bool onFilter(BLEAdvertisementView& advertisement) { return true; }
 };
 
 #endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,234 @@
+/*
+ * BLEAdvertisementView.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <string.h>
+#include <esp_gap_ble_api.h>
+#include "BLEAdvertisementView.h"
+
+
+/**
+ * @brief The first 12 bytes (least significant first) of the Bluetooth base UUID.
+ *
+ * A 16 or 32 bit UUID is shorthand for the base UUID with the short value in the remaining 4 bytes.
+ */
+static const uint8_t baseUUID[12] = { 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+
+
+/**
+ * @brief Construct a view over an advertisement.
+ * @param [in] pPayload The advertisement data followed by any scan response data.
+ * @param [in] length The number of valid bytes at pPayload.
+ */
+BLEAdvertisementView::BLEAdvertisementView(const uint8_t* pPayload, size_t length) {
+	m_pPayload = pPayload;
+	m_length   = length;
+} // BLEAdvertisementView
+
+
+/**
+ * @brief Find the first record of a given type.
+ * @param [in] type The AD type to look for.
+ * @param [out] record The record found.
+ * @return True if a record of the type was found.
+ */
+bool BLEAdvertisementView::find(uint8_t type, Record& record) {
+	for (bool more = getFirst(record); more; more = getNext(record)) {
+		if (record.type == type) {
+			return true;
+		}
+	}
+	return false;
+} // find
+
+
+/**
+ * @brief Get the first record in the advertisement.
+ * @param [out] record The first record.
+ * @return True if there is a first record.
+ */
+bool BLEAdvertisementView::getFirst(Record& record) {
+	return read(0, record);
+} // getFirst
+
+
+/**
+ * @brief Get the record that follows the one passed in.
+ * @param [in,out] record The current record, replaced by the next.
+ * @return True if there is a next record.
+ */
+bool BLEAdvertisementView::getNext(Record& record) {
+	return read(record.next, record);
+} // getNext
+
+
+/**
+ * @brief Does the advertisement carry manufacturer data that starts with the given bytes?
+ *
+ * The first two bytes of manufacturer data are the company identifier, least significant byte first.
+ *
+ * @param [in] pPrefix The bytes to look for.
+ * @param [in] length The number of bytes at pPrefix.
+ * @return True if manufacturer data starting with the prefix is present.
+ */
+bool BLEAdvertisementView::haveManufacturerData(const uint8_t* pPrefix, size_t length) {
+	Record record;
+	for (bool more = getFirst(record); more; more = getNext(record)) {
+		if (record.type == ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE && record.length >= length &&
+				::memcmp(record.pData, pPrefix, length) == 0) {
+			return true;
+		}
+	}
+	return false;
+} // haveManufacturerData
+
+
+/**
+ * @brief Does the advertisement carry a complete or shortened name that starts with the given text?
+ * @param [in] prefix The text to look for.
+ * @return True if a name starting with the prefix is present.
+ */
+bool BLEAdvertisementView::haveName(const char* prefix) {
+	return haveName(prefix, ::strlen(prefix));
+} // haveName
+
+
+/**
+ * @brief Does the advertisement carry a complete or shortened name that starts with the given bytes?
+ * @param [in] pPrefix The bytes to look for.
+ * @param [in] length The number of bytes at pPrefix.
+ * @return True if a name starting with the prefix is present.
+ */
+bool BLEAdvertisementView::haveName(const char* pPrefix, size_t length) {
+	Record record;
+	for (bool more = getFirst(record); more; more = getNext(record)) {
+		if ((record.type == ESP_BLE_AD_TYPE_NAME_CMPL || record.type == ESP_BLE_AD_TYPE_NAME_SHORT) &&
+				record.length >= length && ::memcmp(record.pData, pPrefix, length) == 0) {
+			return true;
+		}
+	}
+	return false;
+} // haveName
+
+
+/**
+ * @brief Does the advertisement list the given service?
+ *
+ * Each of the 16, 32 and 128 bit service lists is searched.  A 16 or 32 bit entry matches a UUID that
+ * is the same value expressed against the Bluetooth base UUID.
+ *
+ * @param [in] uuid The service to look for.
+ * @return True if the service is advertised.
+ */
+bool BLEAdvertisementView::isAdvertisingService(BLEUUID uuid) {
+	if (uuid.bitSize() == 0) {
+		return false;
+	}
+	uuid.to128();
+	return isAdvertisingService(uuid.getNative()->uuid.uuid128);
+} // isAdvertisingService
+
+
+/**
+ * @brief Does the advertisement list the given service?
+ * @param [in] pTarget The 16 bytes of the service's 128 bit UUID, least significant first.
+ * @return True if the service is advertised.
+ */
+bool BLEAdvertisementView::isAdvertisingService(const uint8_t* pTarget) {
+	bool isShort = ::memcmp(pTarget, baseUUID, sizeof(baseUUID)) == 0;
+
+	Record record;
+	for (bool more = getFirst(record); more; more = getNext(record)) {
+		switch(record.type) {
+			case ESP_BLE_AD_TYPE_16SRV_CMPL:
+			case ESP_BLE_AD_TYPE_16SRV_PART: {
+				if (!isShort || pTarget[14] != 0 || pTarget[15] != 0) {
+					break;
+				}
+				for (size_t i = 0; i + 2 <= record.length; i += 2) {
+					if (record.pData[i] == pTarget[12] && record.pData[i + 1] == pTarget[13]) {
+						return true;
+					}
+				}
+				break;
+			}
+
+			case ESP_BLE_AD_TYPE_32SRV_CMPL:
+			case ESP_BLE_AD_TYPE_32SRV_PART: {
+				if (!isShort) {
+					break;
+				}
+				for (size_t i = 0; i + 4 <= record.length; i += 4) {
+					if (::memcmp(record.pData + i, pTarget + 12, 4) == 0) {
+						return true;
+					}
+				}
+				break;
+			}
+
+			case ESP_BLE_AD_TYPE_128SRV_CMPL:
+			case ESP_BLE_AD_TYPE_128SRV_PART: {
+				for (size_t i = 0; i + 16 <= record.length; i += 16) {
+					if (::memcmp(record.pData + i, pTarget, 16) == 0) {
+						return true;
+					}
+				}
+				break;
+			}
+
+			default: {
+				break;
+			}
+		} // switch
+	}
+	return false;
+} // isAdvertisingService
+
+
+/**
+ * @brief Read the record at an offset.
+ *
+ * A zero length marks the end of the significant part of the advertisement.  A record that claims to
+ * run past the end of the data is treated as the end too.
+ *
+ * @param [in] offset The offset of the record's length byte.
+ * @param [out] record The record.
+ * @return True if a record was read.
+ */
+bool BLEAdvertisementView::read(size_t offset, Record& record) {
+	if (offset >= m_length || m_pPayload[offset] == 0) {
+		return false;
+	}
+	uint8_t length = m_pPayload[offset];
+	if (offset + 1 + length > m_length) {
+		return false;
+	}
+	record.type   = m_pPayload[offset + 1];
+	record.length = length - 1;
+	record.pData  = m_pPayload + offset + 2;
+	record.next   = offset + 1 + length;
+	return true;
+} // read
+
+
+/**
+ * @brief Read a little endian 16 bit value that may not be aligned.
+ * @param [in] pData The first byte of the value.
+ * @return The value.
+ */
+uint16_t BLEAdvertisementView::readUInt16(const uint8_t* pData) {
+	return pData[0] | (pData[1] << 8);
+} // readUInt16
+
+
+/**
+ * @brief Read a little endian 32 bit value that may not be aligned.
+ * @param [in] pData The first byte of the value.
+ * @return The value.
+ */
+uint32_t BLEAdvertisementView::readUInt32(const uint8_t* pData) {
+	return (uint32_t)pData[0] | ((uint32_t)pData[1] << 8) | ((uint32_t)pData[2] << 16) | ((uint32_t)pData[3] << 24);
+} // readUInt32
+
+#endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,56 @@
+/*
+ * BLEAdvertisementView.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEADVERTISEMENTVIEW_H_
+#define COMPONENTS_CPP_UTILS_BLEADVERTISEMENTVIEW_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <stddef.h>
+#include <stdint.h>
+
+#include "BLEUUID.h"
+
+/**
+ * @brief A read only view over the raw bytes of an advertisement.
+ *
+ * An advertisement is a sequence of AD structures, each of the form [length][type][data].  The view walks
+ * these structures in place as it is asked questions of them.  Nothing is copied and nothing is allocated,
+ * which makes it cheap enough to run against every advertisement heard while scanning.  A view is only
+ * valid for as long as the bytes it was constructed over.
+ */
+class BLEAdvertisementView {
+public:
+	/**
+	 * @brief A single AD structure within an advertisement.
+	 */
+	struct Record {
+		uint8_t        type;     // The AD type.
+		uint8_t        length;   // The length of the data, excluding the type.
+		const uint8_t* pData;    // The data within the advertisement.
+		size_t         next;     // The offset of the following record.
+	};
+
+	BLEAdvertisementView(const uint8_t* pPayload, size_t length);
+
+	bool            find(uint8_t type, Record& record);
+	bool            getFirst(Record& record);
+	bool            getNext(Record& record);
+	bool            haveManufacturerData(const uint8_t* pPrefix, size_t length);
+	bool            haveName(const char* prefix);
+	bool            haveName(const char* pPrefix, size_t length);
+	bool            isAdvertisingService(BLEUUID uuid);
+	bool            isAdvertisingService(const uint8_t* pTarget);
+
+	static uint16_t readUInt16(const uint8_t* pData);
+	static uint32_t readUInt32(const uint8_t* pData);
+
+private:
+	bool read(size_t offset, Record& record);
+
+	const uint8_t* m_pPayload;
+	size_t         m_length;
+}; // BLEAdvertisementView
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEADVERTISEMENTVIEW_H_ */
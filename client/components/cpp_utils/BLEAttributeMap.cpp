@@ -0,0 +1,214 @@
+/*
+ * BLEAttributeMap.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <sstream>
+#include <iomanip>
+#include <esp_log.h>
+#include "BLEServer.h"
+#include "BLECharacteristic.h"
+#include "BLEDescriptor.h"
+#include "GeneralUtils.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEAttributeMap";
+
+
+BLEAttributeMap::BLEAttributeMap() {
+	m_baseHandle = 0;
+} // BLEAttributeMap
+
+
+/**
+ * @brief Return the table slot for a handle.
+ * @param [in] handle The attribute handle.
+ * @return The slot or nullptr if the handle is outside of the table.
+ */
+BLEAttributeMap::Entry* BLEAttributeMap::getEntry(uint16_t handle) {
+	if (handle < m_baseHandle || handle - m_baseHandle >= m_table.size()) {
+		return nullptr;
+	}
+	return &m_table[handle - m_baseHandle];
+} // getEntry
+
+
+/**
+ * @brief Return the table slot for a handle, growing the table to cover it if needed.
+ * @param [in] handle The attribute handle.
+ * @return The slot for the handle.
+ */
+BLEAttributeMap::Entry* BLEAttributeMap::makeEntry(uint16_t handle) {
+	if (m_table.empty()) {
+		m_baseHandle = handle;
+	} else if (handle < m_baseHandle) {
+		// Handles are normally allocated in ascending order but a new service may be given a lower range.
+		m_table.insert(m_table.begin(), m_baseHandle - handle, Entry());
+		m_baseHandle = handle;
+	}
+	if (handle - m_baseHandle >= m_table.size()) {
+		m_table.resize(handle - m_baseHandle + 1);
+	}
+	return &m_table[handle - m_baseHandle];
+} // makeEntry
+
+
+/**
+ * @brief Return the characteristic that owns a handle.
+ * @param [in] handle The handle to look up.
+ * @return The characteristic or nullptr if the handle does not belong to a characteristic.
+ */
+BLECharacteristic* BLEAttributeMap::getCharacteristic(uint16_t handle) {
+	Entry* pEntry = getEntry(handle);
+	return pEntry == nullptr ? nullptr : pEntry->pCharacteristic;
+} // getCharacteristic
+
+
+/**
+ * @brief Return the descriptor that owns a handle.
+ * @param [in] handle The handle to look up.
+ * @return The descriptor or nullptr if the handle does not belong to a descriptor.
+ */
+BLEDescriptor* BLEAttributeMap::getDescriptor(uint16_t handle) {
+	Entry* pEntry = getEntry(handle);
+	return pEntry == nullptr ? nullptr : pEntry->pDescriptor;
+} // getDescriptor
+
+
+/**
+ * @brief Record the characteristic that owns a handle.
+ * @param [in] handle The handle of the characteristic value.
+ * @param [in] pCharacteristic The characteristic.
+ */
+void BLEAttributeMap::setByHandle(uint16_t handle, BLECharacteristic* pCharacteristic) {
+	Entry* pEntry = makeEntry(handle);
+	pEntry->pCharacteristic = pCharacteristic;
+	pEntry->pDescriptor     = nullptr;
+} // setByHandle
+
+
+/**
+ * @brief Record the descriptor that owns a handle.
+ * @param [in] handle The handle of the descriptor.
+ * @param [in] pDescriptor The descriptor.
+ */
+void BLEAttributeMap::setByHandle(uint16_t handle, BLEDescriptor* pDescriptor) {
+	Entry* pEntry = makeEntry(handle);
+	pEntry->pCharacteristic = nullptr;
+	pEntry->pDescriptor     = pDescriptor;
+} // setByHandle
+
+
+/**
+ * @brief Offer an event to the attribute it targets.
+ * @param [in] handle The handle of the target attribute.
+ * @param [in] event
+ * @param [in] gatts_if
+ * @param [in] param
+ * @return True if an attribute owns the handle.
+ */
+bool BLEAttributeMap::dispatch(
+		uint16_t                  handle,
+		esp_gatts_cb_event_t      event,
+		esp_gatt_if_t             gatts_if,
+		esp_ble_gatts_cb_param_t* param) {
+	Entry* pEntry = getEntry(handle);
+	if (pEntry == nullptr) {
+		return false;
+	}
+	if (pEntry->pCharacteristic != nullptr) {
+		pEntry->pCharacteristic->handleGATTServerEvent(event, gatts_if, param);
+		return true;
+	}
+	if (pEntry->pDescriptor != nullptr) {
+		pEntry->pDescriptor->handleGATTServerEvent(event, gatts_if, param);
+		return true;
+	}
+	return false;
+} // dispatch
+
+
+/**
+ * @brief Route an attribute level GATT server event to its target.
+ *
+ * Read, write and confirmation events are aimed at a single attribute.  Rather than offering them to every
+ * service, characteristic and descriptor, we look the target up by handle and pass the event only to its
+ * owner.  Execute write does not carry a handle; the server routes it using the prepared writes it holds
+ * for the connection.
+ *
+ * @param [in] event
+ * @param [in] gatts_if
+ * @param [in] param
+ * @return True if the event was an attribute level event and has been consumed, false if it should be
+ * broadcast to the services as before.
+ */
+bool BLEAttributeMap::handleGATTServerEvent(
+		esp_gatts_cb_event_t      event,
+		esp_gatt_if_t             gatts_if,
+		esp_ble_gatts_cb_param_t* param) {
+	switch(event) {
+		case ESP_GATTS_READ_EVT: {
+			if (!dispatch(param->read.handle, event, gatts_if, param)) {
+				ESP_LOGD(LOG_TAG, "No attribute for read of handle 0x%.2x", param->read.handle);
+			}
+			return true;
+		} // ESP_GATTS_READ_EVT
+
+		case ESP_GATTS_WRITE_EVT: {
+			if (!dispatch(param->write.handle, event, gatts_if, param)) {
+				ESP_LOGD(LOG_TAG, "No attribute for write of handle 0x%.2x", param->write.handle);
+			}
+			return true;
+		} // ESP_GATTS_WRITE_EVT
+
+		// Not every release of ESP-IDF fills in the handle of a confirmation.  If it doesn't name one of our
+		// characteristics then fall back to telling every characteristic.
+		case ESP_GATTS_CONF_EVT: {
+			if (getCharacteristic(param->conf.handle) != nullptr) {
+				dispatch(param->conf.handle, event, gatts_if, param);
+				return true;
+			}
+			for (auto &entry : m_table) {
+				if (entry.pCharacteristic != nullptr) {
+					entry.pCharacteristic->handleGATTServerEvent(event, gatts_if, param);
+				}
+			}
+			return true;
+		} // ESP_GATTS_CONF_EVT
+
+		default: {
+			return false;
+		}
+	} // switch
+} // handleGATTServerEvent
+
+
+/**
+ * @brief Return a string representation of the attribute map.
+ * @return A string representation of the attribute map.
+ */
+std::string BLEAttributeMap::toString() {
+	std::stringstream stringStream;
+	stringStream << std::hex << std::setfill('0');
+	int count = 0;
+	for (size_t i = 0; i < m_table.size(); i++) {
+		if (m_table[i].pCharacteristic == nullptr && m_table[i].pDescriptor == nullptr) {
+			continue;
+		}
+		if (count > 0) {
+			stringStream << "\n";
+		}
+		count++;
+		stringStream << "handle: 0x" << std::setw(2) << m_baseHandle + i;
+		if (m_table[i].pCharacteristic != nullptr) {
+			stringStream << ", characteristic: " << m_table[i].pCharacteristic->getUUID().toString();
+		} else {
+			stringStream << ", descriptor: " << m_table[i].pDescriptor->getUUID().toString();
+		}
+	}
+	return stringStream.str();
+} // toString
+
+#endif /* CONFIG_BT_ENABLED */
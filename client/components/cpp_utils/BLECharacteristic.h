@@ -41,9 +41,9 @@ public:
 	BLEDescriptor* getFirst();
 	BLEDescriptor* getNext();
 private:
-	std::map<std::string, BLEDescriptor *> m_uuidMap;
-	std::map<uint16_t,    BLEDescriptor *> m_handleMap;
-	std::map<std::string, BLEDescriptor *>::iterator m_iterator;
+	std::map<BLEUUID,  BLEDescriptor *> m_uuidMap;
+	std::map<uint16_t, BLEDescriptor *> m_handleMap;
+	std::map<BLEUUID,  BLEDescriptor *>::iterator m_iterator;
 };
 
 
@@ -68,6 +68,9 @@ public:
 
 	void indicate();
 	void notify();
+	size_t notifyAll(uint32_t timeoutMs = 0);
+	bool notifyAsync(uint32_t timeoutMs = portMAX_DELAY);
+	bool notifyAsync(uint16_t connId, uint32_t timeoutMs);
 	void setBroadcastProperty(bool value);
 	void setCallbacks(BLECharacteristicCallbacks* pCallbacks);
 	void setIndicateProperty(bool value);
@@ -75,6 +78,7 @@ public:
 	void setReadProperty(bool value);
 	void setValue(uint8_t* data, size_t size);
 	void setValue(std::string value);
+	bool setValueStorage(uint8_t* pStorage, size_t capacity);
 	void setWriteProperty(bool value);
 	void setWriteNoResponseProperty(bool value);
 	std::string toString();
@@ -94,6 +98,8 @@ private:
 	friend class BLEService;
 	friend class BLEDescriptor;
 	friend class BLECharacteristicMap;
+	friend class BLEAttributeMap;
+	friend class BLENotifyQueue;
 
 	BLEUUID                     m_bleUUID;
 	BLEDescriptorMap            m_descriptorMap;
@@ -102,6 +108,7 @@ private:
 	BLECharacteristicCallbacks* m_pCallbacks;
 	BLEService*                 m_pService;
 	BLEValue                    m_value;
+	SemaphoreHandle_t           m_valueLock;   // Held while the value is changed or copied into a read response or notification.
 	esp_gatt_perm_t             m_permissions = ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE;
 
 	void handleGATTServerEvent(
@@ -112,6 +119,7 @@ private:
 	void                 executeCreate(BLEService* pService);
 	esp_gatt_char_prop_t getProperties();
 	BLEService*          getService();
+	void                 notifyComplete(esp_gatt_status_t status);
 	void                 setHandle(uint16_t handle);
 	FreeRTOS::Semaphore m_semaphoreCreateEvt = FreeRTOS::Semaphore("CreateEvt");
 	FreeRTOS::Semaphore m_semaphoreConfEvt   = FreeRTOS::Semaphore("ConfEvt");
@@ -130,6 +138,8 @@ public:
 	virtual ~BLECharacteristicCallbacks();
 	virtual void onRead(BLECharacteristic* pCharacteristic);
 	virtual void onWrite(BLECharacteristic* pCharacteristic);
+	virtual void onWrite(BLECharacteristic* pCharacteristic, uint16_t connId);
+	virtual void onNotifyComplete(BLECharacteristic* pCharacteristic, esp_gatt_status_t status);
 };
 #endif /* CONFIG_BT_ENABLED */
 #endif /* COMPONENTS_CPP_UTILS_BLECHARACTERISTIC_H_ */
@@ -12,19 +12,63 @@
 #if defined(CONFIG_BT_ENABLED)
 
 #include <esp_gattc_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
 #include <string.h>
+#include <atomic>
 #include <map>
 #include <string>
 #include "BLEExceptions.h"
 #include "BLERemoteService.h"
 #include "BLEService.h"
 #include "BLEAddress.h"
-
+#include "BLEConnectionProfile.h"
+#include "BLEFuture.h"
+#include "BLEGattCache.h"
+#include "BLENotifyRing.h"
+#include "BLEOperationQueue.h"
+#include "BLEWriteWindow.h"
+
+class BLERemoteCharacteristic;
+class BLERemoteDescriptor;
 class BLERemoteService;
 class BLEClientCallbacks;
+class BLEReconnectTask;
+
+/**
+ * How long to wait before the first attempt to reconnect after a connection attempt fails.  The wait doubles
+ * with each failure up to BLE_CLIENT_RECONNECT_MAX_BACKOFF_MS.
+ */
+#define BLE_CLIENT_RECONNECT_MIN_BACKOFF_MS  250
+#define BLE_CLIENT_RECONNECT_MAX_BACKOFF_MS  30000
+/**
+ * The number of failed direct connection attempts after which we scan for the server before trying again.
+ */
+#define BLE_CLIENT_RECONNECT_DIRECT_ATTEMPTS 2
+/**
+ * How long each scan for a lost server lasts.
+ */
+#define BLE_CLIENT_RECONNECT_SCAN_SECONDS    5
+
+/**
+ * @brief Counts and timings of the connections made by a %BLE client.
+ */
+struct BLEConnectionStats {
+	uint32_t connects;         // Connections opened, including reconnections.
+	uint32_t linkLosses;       // Connections lost without our asking.
+	uint32_t attempts;         // Connection attempts made while reconnecting.
+	uint32_t scans;            // Scans made for the server while reconnecting.
+	uint32_t lastConnectMs;    // Time from asking for the most recent connection to it being open.
+	uint32_t maxConnectMs;     // The longest of these.
+	uint32_t lastOutageMs;     // Time from the most recent link loss to the connection being open again.
+	uint32_t maxOutageMs;      // The longest of these.
+};
 
 /**
  * @brief A model of a %BLE client.
+ *
+ * A client holds one connection to a server.  Any number of clients may exist at once, each registered
+ * with the %BLE stack in its own right, so one device can be connected to several servers.
  */
 class BLEClient {
 public:
@@ -32,10 +76,14 @@ public:
 	~BLEClient();
 
 	bool                                       connect(BLEAddress address);   // Connect to the remote BLE Server
+	bool                                       connectAsync(BLEAddress address, BLEFuture* pFuture);   // Start connecting to the remote BLE Server
 	void                                       disconnect();                  // Disconnect from the remote BLE Server
+	BLEConnectionParams                        getConnectionParams();         // Get the parameters the connection runs with
+	BLEConnectionStats                         getConnectionStats();          // Get counts and timings of our connections
 	BLEAddress                                 getPeerAddress();              // Get the address of the remote BLE Server
 	int                                        getRssi();                     // Get the RSSI of the remote BLE Server
-	std::map<std::string, BLERemoteService*>*  getServices();                 // Get a map of the services offered by the remote BLE Server
+	uint16_t                                   getMTU();                      // Get the MTU negotiated with the remote BLE Server
+	std::map<BLEUUID, BLERemoteService*>*      getServices();                 // Get a map of the services offered by the remote BLE Server
 	BLERemoteService*                          getService(const char* uuid);  // Get a reference to a specified service offered by the remote BLE server.
 	BLERemoteService*                          getService(BLEUUID uuid);      // Get a reference to a specified service offered by the remote BLE server.
 	std::string                                getValue(BLEUUID serviceUUID, BLEUUID characteristicUUID);   // Get the value of a given characteristic at a given service.
@@ -47,14 +95,21 @@ public:
 
 	bool                                       isConnected();                 // Return true if we are connected.
 
+	void                                       setAutoReconnect(bool autoReconnect);   // Reconnect whenever the connection is lost.
 	void                                       setClientCallbacks(BLEClientCallbacks *pClientCallbacks);
+	void                                       setConnectionProfile(const BLEConnectionProfile& profile);   // Ask for an interval and data length.
+	void                                       setGattCache(BLEGattCache* pGattCache);   // Keep discovered services across connections.
+	void                                       setNotifyRing(BLENotifyRing* pNotifyRing);   // Call notification callbacks from the ring's task.
 	void                                       setValue(BLEUUID serviceUUID, BLEUUID characteristicUUID, std::string value);   // Set the value of a given characteristic at a given service.
+	void                                       setWriteWindow(uint8_t size);  // Set how many writes without response may be outstanding.
 
 	std::string                                toString();                    // Return a string representation of this client.
 
 
 private:
 	friend class BLEDevice;
+	friend class BLEGattCache;
+	friend class BLEReconnectTask;
 	friend class BLERemoteService;
 	friend class BLERemoteCharacteristic;
 	friend class BLERemoteDescriptor;
@@ -64,21 +119,54 @@ private:
 		esp_gatt_if_t gattc_if,
 		esp_ble_gattc_cb_param_t* param);
 
+	void                                       addAttribute(BLERemoteCharacteristic* pRemoteCharacteristic);
+	void                                       addAttribute(BLERemoteDescriptor* pRemoteDescriptor);
 	uint16_t                                   getConnId();
 	esp_gatt_if_t                              getGattcIf();
+	BLEOperationQueue*                         getOperationQueue();
+	BLEWriteWindow*                            getWriteWindow();
+	bool                                       open(BLEAddress address);
+	std::string                                readDatabaseHash();
+	void                                       reconnect();
+	void                                       removeAttribute(BLERemoteCharacteristic* pRemoteCharacteristic);
+	void                                       removeAttribute(BLERemoteDescriptor* pRemoteDescriptor);
+	bool                                       requestOpen();
+	bool                                       scanForPeer();
 	BLEAddress    m_peerAddress = BLEAddress((uint8_t*)"\0\0\0\0\0\0");   // The BD address of the remote server.
+	BLEAddress    m_lastPeerAddress = BLEAddress((uint8_t*)"\0\0\0\0\0\0");   // The server we were last connected to.
+	uint16_t      m_appId;           // The app id we register with the BLE stack under.
 	uint16_t      m_conn_id;
 //	int           m_deviceType;
 	esp_gatt_if_t m_gattc_if;
 	bool          m_haveServices;    // Have we previously obtain the set of services from the remote server.
-	bool          m_isConnected;     // Are we currently connected.
+	bool          m_servicesUnverified;   // The services came from a cache record with no hash to check it by.
+	std::atomic<bool> m_isConnected;     // Are we currently connected.
+	uint16_t      m_mtu;             // The MTU negotiated on the connection.
+	std::atomic<bool> m_autoReconnect;   // Do we reconnect when the connection is lost?
+	std::atomic<bool> m_disconnectRequested;   // Did we ask for the connection to close?
+	bool          m_linkLost;        // Has the connection been lost and not yet regained?
+	uint32_t      m_connectStartMs;  // When the current connection attempt was made.
+	uint32_t      m_linkLostMs;      // When the connection was lost.
+	BLEConnectionStats m_stats;
+	EventGroupHandle_t m_reconnectEvents;   // Wakes the reconnect task when the connection is lost.
+	BLEReconnectTask*  m_pReconnectTask;
 
 	BLEClientCallbacks* m_pClientCallbacks;
-	FreeRTOS::Semaphore m_semaphoreRegEvt        = FreeRTOS::Semaphore("RegEvt");
+	BLEGattCache*       m_pGattCache;      // Where discovered services are kept, or nullptr.
+	BLENotifyRing*      m_pNotifyRing;     // Where notifications are queued for delivery, or nullptr.
+	BLEConnectionProfile m_connectionProfile;   // Asked for on every connection.
+	BLEConnectionParams  m_connectionParams;    // As last reported by the BLE stack.
+	bool                 m_dataLengthPending;   // A data length change has been asked for.
 	FreeRTOS::Semaphore m_semaphoreOpenEvt       = FreeRTOS::Semaphore("OpenEvt");
 	FreeRTOS::Semaphore m_semaphoreSearchCmplEvt = FreeRTOS::Semaphore("SearchCmplEvt");
 	FreeRTOS::Semaphore m_semaphoreRssiCmplEvt   = FreeRTOS::Semaphore("RssiCmplEvt");
-	std::map<std::string, BLERemoteService*> m_servicesMap;
+	std::map<BLEUUID, BLERemoteService*> m_servicesMap;
+	std::map<uint16_t, BLERemoteCharacteristic*> m_characteristicsByHandle;   // Where events about a characteristic are routed.
+	std::map<uint16_t, BLERemoteDescriptor*>     m_descriptorsByHandle;       // Where events about a descriptor are routed.
+	SemaphoreHandle_t   m_attributeLock;   // Guards the two maps above and is held while an event is passed on.
+	BLEWriteWindow      m_writeWindow{BLE_CLIENT_DEFAULT_WRITE_WINDOW};   // Credit for writes without response.
+	BLEOperationQueue   m_operations{&m_writeWindow};   // Reads, writes with response and notification registrations waiting their turn.
+	BLEFuture*          m_pConnectFuture;  // Completed when the connection being opened by connectAsync() opens or fails.
 	void clearServices();   // Clear any existing services.
 
 }; // class BLEDevice
@@ -90,8 +178,29 @@ private:
 class BLEClientCallbacks {
 public:
 	virtual ~BLEClientCallbacks() {};
+
+	/**
+	 * @brief Handle a connection being opened, including each one made when reconnecting after a lost link.
+	 *
+	 * Called from the %BLE stack's task once the client is ready for use, so it must not wait for GATT
+	 * operations on the connection.  A server forgets a client's subscriptions when the link goes, so this
+	 * is where an application arranges for its 0x2902 descriptors to be written again.
+	 *
+	 * @param [in] pClient The client now connected.
+	 */
 	virtual void onConnect(BLEClient *pClient) = 0;
 	virtual void onDisconnect(BLEClient *pClient) = 0;
+
+	/**
+	 * @brief Handle a change to the parameters of the connection.
+	 *
+	 * Called when the connection interval, slave latency, supervision timeout or data length changes,
+	 * whether we or the server asked for it.
+	 *
+	 * @param [in] pClient The client whose connection changed.
+	 * @param [in] params The parameters the connection now runs with.
+	 */
+	virtual void onConnParamsUpdate(BLEClient *pClient, BLEConnectionParams params) {};
 };
 
 #endif // CONFIG_BT_ENABLED
@@ -44,11 +44,15 @@ public:
 
 	std::string toString();                                 // Convert the descriptor to a string representation.
 
+protected:
+	uint16_t getCCCD(uint16_t connId);                      // Get the configuration a client wrote to this 0x2902 descriptor.
+
 private:
 	friend class BLEDescriptorMap;
 	friend class BLECharacteristic;
 	BLEUUID                 m_bleUUID;
 	uint16_t                m_handle;
+	bool                    m_isCCCD;     // True for a 0x2902 descriptor, whose value each client holds separately.
 	BLEDescriptorCallbacks* m_pCallback;
 	BLECharacteristic*      m_pCharacteristic;
 	esp_gatt_perm_t				  m_permissions = ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE;
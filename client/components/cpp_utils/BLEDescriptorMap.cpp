@@ -31,13 +31,8 @@ BLEDescriptor* BLEDescriptorMap::getByUUID(const char* uuid) {
  * @return The descriptor.  If not present, then nullptr is returned.
  */
 BLEDescriptor* BLEDescriptorMap::getByUUID(BLEUUID uuid) {
-	for (auto &myPair : m_uuidMap) {
-		if (myPair.second->getUUID().equals(uuid)) {
-			return myPair.second;
-		}
-	}
-	//return m_uuidMap.at(uuid.toString());
-	return nullptr;
+	auto it = m_uuidMap.find(uuid);
+	return it == m_uuidMap.end() ? nullptr : it->second;
 } // getByUUID
 
 
@@ -58,7 +53,7 @@ BLEDescriptor* BLEDescriptorMap::getByHandle(uint16_t handle) {
  * @return N/A.
  */
 void BLEDescriptorMap::setByUUID(const char* uuid, BLEDescriptor *pDescriptor){
-	m_uuidMap.insert(std::pair<std::string, BLEDescriptor *>(uuid, pDescriptor));
+	m_uuidMap.insert(std::pair<BLEUUID, BLEDescriptor *>(BLEUUID(uuid), pDescriptor));
 } // setByUUID
 
 
@@ -70,7 +65,7 @@ void BLEDescriptorMap::setByUUID(const char* uuid, BLEDescriptor *pDescriptor){
  * @return N/A.
  */
 void BLEDescriptorMap::setByUUID(BLEUUID uuid, BLEDescriptor *pDescriptor) {
-	m_uuidMap.insert(std::pair<std::string, BLEDescriptor *>(uuid.toString(), pDescriptor));
+	m_uuidMap.insert(std::pair<BLEUUID, BLEDescriptor *>(uuid, pDescriptor));
 } // setByUUID
 
 
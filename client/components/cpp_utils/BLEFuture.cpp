@@ -0,0 +1,140 @@
+/*
+ * BLEFuture.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include "BLEFuture.h"
+
+/*
+ * Design
+ * ------
+ * m_state is the only field shared between the task completing the operation and the task waiting for
+ * it.  It is STATE_PENDING, the handle of the one task waiting or, once the operation has finished,
+ * STATE_DONE.  A task handle is a pointer to a task control block and so is never 0 or 1.
+ *
+ * complete() fills in the result, calls the callback and then swaps in STATE_DONE.  If it swapped out a
+ * task handle it notifies that task.  It does not touch the future after the swap, because a waiter may
+ * destroy the future as soon as it sees STATE_DONE.
+ */
+static const uintptr_t STATE_PENDING = 0;
+static const uintptr_t STATE_DONE    = 1;
+
+
+BLEFuture::BLEFuture() {
+	m_state    = STATE_DONE;
+	m_status   = ESP_GATT_OK;
+	m_callback = nullptr;
+	m_pArg     = nullptr;
+} // BLEFuture
+
+
+/**
+ * @brief Finish the operation.
+ *
+ * Called once for each operation, from whichever task learns the outcome.
+ *
+ * @param [in] status The outcome of the operation.
+ * @param [in] pData The value read, if any.
+ * @param [in] length The length of the value read.
+ */
+void BLEFuture::complete(esp_gatt_status_t status, const uint8_t* pData, size_t length) {
+	m_status = status;
+	if (pData != nullptr && status == ESP_GATT_OK) {
+		m_value.assign((const char*)pData, length);
+	}
+	if (m_callback != nullptr) {
+		m_callback(this, m_pArg);
+	}
+	uintptr_t waiter = m_state.exchange(STATE_DONE, std::memory_order_acq_rel);
+	if (waiter != STATE_PENDING && waiter != STATE_DONE) {
+		::xTaskNotifyGive((TaskHandle_t)waiter);
+	}
+} // complete
+
+
+/**
+ * @brief Get the outcome of the operation.
+ * @return ESP_GATT_OK if the operation succeeded.  Only meaningful once isDone() is true.
+ */
+esp_gatt_status_t BLEFuture::getStatus() {
+	return m_status;
+} // getStatus
+
+
+/**
+ * @brief Get the value read by the operation.
+ * @return The value read.  Only meaningful once isDone() is true.
+ */
+std::string BLEFuture::getValue() {
+	return m_value;
+} // getValue
+
+
+/**
+ * @brief Has the operation finished?
+ * @return True if the operation has finished.
+ */
+bool BLEFuture::isDone() {
+	return m_state.load(std::memory_order_acquire) == STATE_DONE;
+} // isDone
+
+
+/**
+ * @brief Set a function to be called when the operation finishes.
+ *
+ * The callback is kept for later operations using the same future.
+ *
+ * @param [in] callback The function to call on the %BLE stack's task, or nullptr for none.
+ * @param [in] pArg A value passed to the callback.
+ */
+void BLEFuture::setCallback(Callback callback, void* pArg) {
+	m_callback = callback;
+	m_pArg     = pArg;
+} // setCallback
+
+
+/**
+ * @brief Prepare the future for a new operation.
+ */
+void BLEFuture::start() {
+	m_status = ESP_GATT_OK;
+	m_value.clear();
+	m_state.store(STATE_PENDING, std::memory_order_release);
+} // start
+
+
+/**
+ * @brief Block until the operation finishes.
+ *
+ * Only one task may wait on a future at a time.  The wait uses the calling task's notification, and
+ * tolerates notifications meant for something else.
+ *
+ * @param [in] timeoutMs How long to wait.
+ * @return True if the operation finished.  A future that timed out is still in use by its operation.
+ */
+bool BLEFuture::wait(uint32_t timeoutMs) {
+	uintptr_t expected = STATE_PENDING;
+	uintptr_t self     = (uintptr_t)::xTaskGetCurrentTaskHandle();
+	if (!m_state.compare_exchange_strong(expected, self, std::memory_order_acq_rel)) {
+		return expected == STATE_DONE;
+	}
+
+	TickType_t start   = ::xTaskGetTickCount();
+	TickType_t timeout = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+	while (m_state.load(std::memory_order_acquire) != STATE_DONE) {
+		TickType_t remaining = portMAX_DELAY;
+		if (timeout != portMAX_DELAY) {
+			TickType_t waited = ::xTaskGetTickCount() - start;
+			if (waited >= timeout) {
+				// Stop being the waiter.  If the operation has just finished we are done after all.
+				expected = self;
+				return !m_state.compare_exchange_strong(expected, STATE_PENDING, std::memory_order_acq_rel);
+			}
+			remaining = timeout - waited;
+		}
+		::ulTaskNotifyTake(pdTRUE, remaining);
+	}
+	return true;
+} // wait
+
+#endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,330 @@
+/*
+ * BLEGattCache.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "BLEGattCache.h"
+#include "BLEClient.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "CPPNVS.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEGattCache";
+
+/*
+ * Design
+ * ------
+ * A record is a flat sequence of bytes:
+ *
+ * [version][hash length][hash]
+ * [service count]
+ *   for each service:        [uuid][start handle][end handle][characteristic count]
+ *     for each characteristic: [uuid][handle][properties][descriptor count]
+ *       for each descriptor:     [uuid][handle]
+ *
+ * A uuid is written as its length in bytes followed by its native form.  Handles are written least
+ * significant byte first.  A record with a different version is ignored.
+ */
+static const uint8_t RECORD_VERSION = 1;
+
+
+static void appendUInt16(std::string& record, uint16_t value) {
+	record += (char)(value & 0xff);
+	record += (char)(value >> 8);
+} // appendUInt16
+
+
+static void appendUUID(std::string& record, BLEUUID uuid) {
+	esp_bt_uuid_t* pNative = uuid.getNative();
+	record += (char)pNative->len;
+	switch(pNative->len) {
+		case ESP_UUID_LEN_16:
+			appendUInt16(record, pNative->uuid.uuid16);
+			break;
+
+		case ESP_UUID_LEN_32:
+			appendUInt16(record, pNative->uuid.uuid32 & 0xffff);
+			appendUInt16(record, pNative->uuid.uuid32 >> 16);
+			break;
+
+		default:
+			record.append((char*)pNative->uuid.uuid128, pNative->len);
+			break;
+	} // switch
+} // appendUUID
+
+
+/**
+ * @brief Read a byte from a record.
+ * @param [in] record The record.
+ * @param [in, out] offset The offset of the byte, advanced past it.
+ * @param [out] value The byte.
+ * @return False if the record is too short.
+ */
+static bool readUInt8(const std::string& record, size_t& offset, uint8_t& value) {
+	if (offset + 1 > record.length()) {
+		return false;
+	}
+	value = (uint8_t)record[offset++];
+	return true;
+} // readUInt8
+
+
+static bool readUInt16(const std::string& record, size_t& offset, uint16_t& value) {
+	if (offset + 2 > record.length()) {
+		return false;
+	}
+	value = (uint8_t)record[offset] | ((uint8_t)record[offset + 1] << 8);
+	offset += 2;
+	return true;
+} // readUInt16
+
+
+static bool readUUID(const std::string& record, size_t& offset, BLEUUID& uuid) {
+	uint8_t length;
+	if (!readUInt8(record, offset, length) || offset + length > record.length()) {
+		return false;
+	}
+	esp_bt_uuid_t native;
+	native.len = length;
+	switch(length) {
+		case ESP_UUID_LEN_16: {
+			uint16_t value;
+			readUInt16(record, offset, value);
+			native.uuid.uuid16 = value;
+			break;
+		}
+
+		case ESP_UUID_LEN_32: {
+			uint16_t low, high;
+			readUInt16(record, offset, low);
+			readUInt16(record, offset, high);
+			native.uuid.uuid32 = ((uint32_t)high << 16) | low;
+			break;
+		}
+
+		case ESP_UUID_LEN_128:
+			record.copy((char*)native.uuid.uuid128, length, offset);
+			offset += length;
+			break;
+
+		default:
+			return false;
+	} // switch
+	uuid = BLEUUID(native);
+	return true;
+} // readUUID
+
+
+/**
+ * @brief Construct a cache.
+ * @param [in] nvsNamespace The %NVS namespace to keep the records in.
+ */
+BLEGattCache::BLEGattCache(std::string nvsNamespace) {
+	m_namespace = nvsNamespace;
+} // BLEGattCache
+
+
+/**
+ * @brief Forget the record of a server so that it is discovered afresh on the next connection.
+ * @param [in] address The address of the server.
+ */
+void BLEGattCache::erase(BLEAddress address) {
+	ESP_LOGD(LOG_TAG, ">> erase: %s", address.toString().c_str());
+	NVS nvs(m_namespace);
+	nvs.erase(getKey(address));
+	nvs.commit();
+	ESP_LOGD(LOG_TAG, "<< erase");
+} // erase
+
+
+/**
+ * @brief Forget the records of every server.
+ */
+void BLEGattCache::eraseAll() {
+	NVS nvs(m_namespace);
+	nvs.erase();
+	nvs.commit();
+} // eraseAll
+
+
+/**
+ * @brief Get the %NVS key of the record of a server.
+ *
+ * %NVS keys are limited to 15 characters so the address is written without separators.
+ *
+ * @param [in] address The address of the server.
+ * @return The key.
+ */
+std::string BLEGattCache::getKey(BLEAddress address) {
+	uint8_t* pAddress = *address.getNative();
+	char key[ESP_BD_ADDR_LEN * 2 + 1];
+	for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+		snprintf(&key[i * 2], 3, "%02x", pAddress[i]);
+	}
+	return std::string(key);
+} // getKey
+
+
+/**
+ * @brief Rebuild the services of the connected server from its record.
+ *
+ * The services, characteristics and descriptors are added to the client as though they had been
+ * discovered.  If the record is damaged, nothing is added.
+ *
+ * @param [in] pClient The client, connected to the server.
+ * @param [out] pHash The Database Hash held in the record.  Empty if the server has none.
+ * @return True if the client's services were rebuilt.
+ */
+bool BLEGattCache::restore(BLEClient* pClient, std::string* pHash) {
+	ESP_LOGD(LOG_TAG, ">> restore: %s", pClient->getPeerAddress().toString().c_str());
+	std::string key = getKey(pClient->getPeerAddress());
+	std::string record;
+	{
+		NVS    nvs(m_namespace, NVS_READONLY);
+		size_t length = 0;
+		nvs.get(key, nullptr, length);    // Ask for the length of the record.
+		if (length == 0 || length > BLE_GATT_CACHE_MAX_RECORD) {
+			ESP_LOGD(LOG_TAG, "<< restore: no record");
+			return false;
+		}
+		record.resize(length);
+		nvs.get(key, (uint8_t*)&record[0], length);
+		record.resize(length);
+	}
+
+	size_t  offset = 0;
+	uint8_t version;
+	uint8_t hashLength;
+	uint8_t serviceCount;
+	bool    ok = readUInt8(record, offset, version) && version == RECORD_VERSION &&
+	             readUInt8(record, offset, hashLength) && offset + hashLength <= record.length();
+	if (ok) {
+		*pHash = record.substr(offset, hashLength);
+		offset += hashLength;
+		ok = readUInt8(record, offset, serviceCount);
+	}
+
+	for (uint8_t s = 0; ok && s < serviceCount; s++) {
+		BLEUUID  uuid;
+		uint16_t startHandle, endHandle;
+		uint8_t  characteristicCount;
+		if (!readUUID(record, offset, uuid) ||
+				!readUInt16(record, offset, startHandle) ||
+				!readUInt16(record, offset, endHandle) ||
+				!readUInt8(record, offset, characteristicCount)) {
+			ok = false;
+			break;
+		}
+		esp_gatt_id_t srvcId;
+		srvcId.uuid    = *uuid.getNative();
+		srvcId.inst_id = 0;
+		BLERemoteService* pRemoteService = new BLERemoteService(srvcId, pClient, startHandle, endHandle);
+		pClient->m_servicesMap.insert(std::pair<BLEUUID, BLERemoteService*>(uuid, pRemoteService));
+
+		for (uint8_t c = 0; ok && c < characteristicCount; c++) {
+			uint16_t handle;
+			uint8_t  properties;
+			uint8_t  descriptorCount;
+			if (!readUUID(record, offset, uuid) ||
+					!readUInt16(record, offset, handle) ||
+					!readUInt8(record, offset, properties) ||
+					!readUInt8(record, offset, descriptorCount)) {
+				ok = false;
+				break;
+			}
+			BLERemoteCharacteristic* pRemoteCharacteristic = new BLERemoteCharacteristic(handle, uuid, properties, pRemoteService);
+			pRemoteService->m_characteristicMap.insert(std::pair<BLEUUID, BLERemoteCharacteristic*>(uuid, pRemoteCharacteristic));
+
+			for (uint8_t d = 0; d < descriptorCount; d++) {
+				if (!readUUID(record, offset, uuid) || !readUInt16(record, offset, handle)) {
+					ok = false;
+					break;
+				}
+				pRemoteCharacteristic->m_descriptorMap.insert(std::pair<BLEUUID, BLERemoteDescriptor*>(
+					uuid, new BLERemoteDescriptor(handle, uuid, pRemoteCharacteristic)));
+			}
+		}
+		pRemoteService->m_haveCharacteristics = true;
+	}
+
+	if (!ok) {
+		ESP_LOGE(LOG_TAG, "Damaged record for %s", pClient->getPeerAddress().toString().c_str());
+		pClient->clearServices();
+		pHash->clear();
+		return false;
+	}
+	ESP_LOGD(LOG_TAG, "<< restore: %d services", serviceCount);
+	return true;
+} // restore
+
+
+/**
+ * @brief Record the services of the connected server.
+ *
+ * Any characteristics of the client's services that have not yet been retrieved are retrieved first so
+ * that the record is complete.
+ *
+ * @param [in] pClient The client, connected to the server and with its services discovered.
+ * @param [in] hash The server's Database Hash, or empty if it has none.
+ */
+void BLEGattCache::store(BLEClient* pClient, std::string hash) {
+	ESP_LOGD(LOG_TAG, ">> store: %s", pClient->getPeerAddress().toString().c_str());
+	if (pClient->m_servicesMap.size() > UINT8_MAX || hash.length() > UINT8_MAX) {
+		ESP_LOGE(LOG_TAG, "Database too large to cache");
+		return;
+	}
+	std::string record;
+	record += (char)RECORD_VERSION;
+	record += (char)hash.length();
+	record += hash;
+	record += (char)pClient->m_servicesMap.size();
+
+	for (auto &servicePair : pClient->m_servicesMap) {
+		BLERemoteService* pRemoteService = servicePair.second;
+		std::map<BLEUUID, BLERemoteCharacteristic*>* pCharacteristics = pRemoteService->getCharacteristics();
+		if (pCharacteristics->size() > UINT8_MAX) {
+			ESP_LOGE(LOG_TAG, "Database too large to cache");
+			return;
+		}
+		appendUUID(record, pRemoteService->getUUID());
+		appendUInt16(record, pRemoteService->getStartHandle());
+		appendUInt16(record, pRemoteService->getEndHandle());
+		record += (char)pCharacteristics->size();
+
+		for (auto &characteristicPair : *pCharacteristics) {
+			BLERemoteCharacteristic* pRemoteCharacteristic = characteristicPair.second;
+			if (pRemoteCharacteristic->m_descriptorMap.size() > UINT8_MAX) {
+				ESP_LOGE(LOG_TAG, "Database too large to cache");
+				return;
+			}
+			appendUUID(record, pRemoteCharacteristic->getUUID());
+			appendUInt16(record, pRemoteCharacteristic->getHandle());
+			record += (char)pRemoteCharacteristic->m_charProp;
+			record += (char)pRemoteCharacteristic->m_descriptorMap.size();
+
+			for (auto &descriptorPair : pRemoteCharacteristic->m_descriptorMap) {
+				appendUUID(record, descriptorPair.second->getUUID());
+				appendUInt16(record, descriptorPair.second->getHandle());
+			}
+		}
+	}
+
+	if (record.length() > BLE_GATT_CACHE_MAX_RECORD) {
+		ESP_LOGE(LOG_TAG, "Database too large to cache: %d bytes", record.length());
+		return;
+	}
+	NVS nvs(m_namespace);
+	nvs.set(getKey(pClient->getPeerAddress()), (uint8_t*)record.data(), record.length());
+	nvs.commit();
+	ESP_LOGD(LOG_TAG, "<< store: %d bytes", record.length());
+} // store
+
+#endif /* CONFIG_BT_ENABLED */
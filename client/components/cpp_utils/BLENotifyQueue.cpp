@@ -0,0 +1,376 @@
+/*
+ * BLENotifyQueue.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <esp_err.h>
+#include <string.h>
+#include <freertos/task.h>
+#include "BLENotifyQueue.h"
+#include "BLECharacteristic.h"
+#include "BLEDevice.h"
+#include "GeneralUtils.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLENotifyQueue";
+
+static const EventBits_t QUEUE_ROOM = (1 << 0);   // A value may be queued, or the queue has closed.
+
+
+/**
+ * @brief Construct a notification queue for a connection.
+ * @param [in] connId The connection the notifications are sent on.
+ * @param [in] depth The number of notifications that may wait to be sent.
+ * @param [in] maxInFlight The number of notifications that may be with the %BLE stack at once.
+ * @param [in] coalesce True if a newer value for a characteristic should replace one still waiting.
+ */
+BLENotifyQueue::BLENotifyQueue(uint16_t connId, uint8_t depth, uint8_t maxInFlight, bool coalesce) {
+	m_connId         = connId;
+	m_gattsIf        = ESP_GATT_IF_NONE;
+	m_open           = false;
+	m_congested      = false;
+	m_coalesce       = coalesce;
+	m_sending        = false;
+	m_mtu            = 23;
+	m_maxInFlight    = maxInFlight == 0 ? 1 : maxInFlight;
+	m_nextId         = 0;
+	m_pending.resize(depth == 0 ? 1 : depth);
+	m_pendingHead    = 0;
+	m_pendingCount   = 0;
+	m_inFlight.resize(m_maxInFlight);
+	m_inFlightHead   = 0;
+	m_inFlightCount  = 0;
+	m_lock           = ::xSemaphoreCreateMutex();
+	m_events         = ::xEventGroupCreate();
+	updateEvents();
+
+	// Reserve room for a default MTU sized value in each slot so that queuing does not normally allocate.
+	for (auto &entry : m_pending) {
+		entry.pCharacteristic = nullptr;
+		entry.kind            = ASYNC;
+		entry.value.reserve(BLEDevice::getMTU() - 3);
+	}
+} // BLENotifyQueue
+
+
+BLENotifyQueue::~BLENotifyQueue() {
+	::vSemaphoreDelete(m_lock);
+	::vEventGroupDelete(m_events);
+} // ~BLENotifyQueue
+
+
+/**
+ * @brief Close the queue because its connection has gone.
+ *
+ * Every notification that is waiting or in flight is reported as failed and any callers waiting for room
+ * are released.
+ */
+void BLENotifyQueue::close() {
+	std::vector<Completion> failed;
+
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_open      = false;
+	m_congested = false;
+	while (m_inFlightCount > 0) {
+		failed.push_back({ m_inFlight[m_inFlightHead].pCharacteristic, m_inFlight[m_inFlightHead].kind, ESP_GATT_ERROR });
+		m_inFlightHead = (m_inFlightHead + 1) % m_inFlight.size();
+		m_inFlightCount--;
+	}
+	while (m_pendingCount > 0) {
+		failed.push_back({ m_pending[m_pendingHead].pCharacteristic, m_pending[m_pendingHead].kind, ESP_GATT_ERROR });
+		m_pendingHead = (m_pendingHead + 1) % m_pending.size();
+		m_pendingCount--;
+	}
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+
+	complete(failed);
+} // close
+
+
+/**
+ * @brief Tell the senders of values that have completed.
+ *
+ * Must be called without the lock held, as the callbacks may queue more values.
+ *
+ * @param [in] completions The values that have completed and how.
+ */
+void BLENotifyQueue::complete(std::vector<Completion>& completions) {
+	for (auto &completion : completions) {
+		if (completion.kind == ASYNC) {
+			completion.pCharacteristic->notifyComplete(completion.status);
+		} else {
+			completion.pCharacteristic->m_semaphoreConfEvt.give();
+		}
+	}
+} // complete
+
+
+/**
+ * @brief Copy the value of a characteristic into a queue entry.
+ *
+ * The value is locked meanwhile so that a setValue() from another task cannot tear it.  Must be called with
+ * our lock held; the characteristic's lock is only ever taken inside ours.
+ *
+ * @param [in] pCharacteristic The characteristic being notified.
+ * @param [in] maxLength The most of the value to copy.
+ * @param [out] value The entry's value.
+ */
+void BLENotifyQueue::copyValue(BLECharacteristic* pCharacteristic, size_t maxLength, std::string& value) {
+	::xSemaphoreTake(pCharacteristic->m_valueLock, portMAX_DELAY);
+	size_t length = pCharacteristic->m_value.getLength();
+	if (length > maxLength) {
+		length = maxLength;
+		ESP_LOGI(LOG_TAG, "- Truncating to %d bytes (maximum size for conn_id %d)", length, m_connId);
+	}
+	value.assign((char*)pCharacteristic->m_value.getData(), length);
+	::xSemaphoreGive(pCharacteristic->m_valueLock);
+} // copyValue
+
+
+/**
+ * @brief Handle an ESP_GATTS_CONF_EVT for our connection.
+ *
+ * The confirmation retires the value it is for, the next waiting value is passed to the %BLE stack and the
+ * sender is told of the outcome.
+ *
+ * @param [in] param The event parameters.
+ * @return True if the confirmation was for a value we sent.
+ */
+bool BLENotifyQueue::handleConfirm(esp_ble_gatts_cb_param_t* param) {
+	std::vector<Completion> confirmed;
+
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	// Values are confirmed in the order they were sent and every value sent on the connection went through
+	// us.  Releases of ESP-IDF that do not report the handle leave it as zero, so then it is the oldest.
+	for (size_t i = 0; i < m_inFlightCount; i++) {
+		Sent& sent = m_inFlight[(m_inFlightHead + i) % m_inFlight.size()];
+		if (param->conf.handle == 0 || sent.pCharacteristic->getHandle() == param->conf.handle) {
+			confirmed.push_back({ sent.pCharacteristic, sent.kind, param->conf.status });
+			removeInFlight(i);
+			break;
+		}
+	}
+	::xSemaphoreGive(m_lock);
+
+	if (confirmed.empty()) {
+		return false;
+	}
+	sendPending();
+	complete(confirmed);
+	return true;
+} // handleConfirm
+
+
+/**
+ * @brief Open the queue for a newly connected peer.
+ * @param [in] gattsIf The GATT server interface of the connection.
+ */
+void BLENotifyQueue::open(esp_gatt_if_t gattsIf) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_gattsIf   = gattsIf;
+	m_open      = true;
+	m_congested = false;
+	m_mtu       = 23;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // open
+
+
+/**
+ * @brief Queue the current value of a characteristic to be sent.
+ *
+ * The value is copied straight into the queue, under the characteristic's value lock, once there is room for
+ * it, so the caller may change it as soon as we return.  The lock is not held while we wait.  If the queue is
+ * full we wait up to timeoutMs for room.  Every caller waiting for room is woken when some is made.
+ *
+ * @param [in] pCharacteristic The characteristic being notified.
+ * @param [in] maxLength The most of the value to send; the rest is cut off.
+ * @param [in] timeoutMs How long to wait for room in the queue.
+ * @param [in] kind How the value is sent and its completion reported.
+ * @return True if the value was queued.
+ */
+bool BLENotifyQueue::push(BLECharacteristic* pCharacteristic, size_t maxLength, uint32_t timeoutMs, Kind kind) {
+	TickType_t start   = ::xTaskGetTickCount();
+	TickType_t timeout = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+
+	while(true) {
+		bool queued = false;
+
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		if (!m_open) {
+			::xSemaphoreGive(m_lock);
+			return false;
+		}
+
+		// A blocked sender waits for its own value to complete, so only asynchronous values are coalesced.
+		if (m_coalesce && kind == ASYNC) {
+			for (size_t i = 0; i < m_pendingCount; i++) {
+				Entry& entry = m_pending[(m_pendingHead + i) % m_pending.size()];
+				if (entry.pCharacteristic == pCharacteristic && entry.kind == ASYNC) {
+					copyValue(pCharacteristic, maxLength, entry.value);
+					queued = true;
+					break;
+				}
+			}
+		}
+
+		if (!queued && m_pendingCount < m_pending.size()) {
+			Entry& entry = m_pending[(m_pendingHead + m_pendingCount) % m_pending.size()];
+			entry.pCharacteristic = pCharacteristic;
+			entry.kind            = kind;
+			copyValue(pCharacteristic, maxLength, entry.value);
+			m_pendingCount++;
+			updateEvents();
+			queued = true;
+		}
+		::xSemaphoreGive(m_lock);
+
+		if (queued) {
+			sendPending();
+			return true;
+		}
+
+		// The queue is full.  Wait for a confirmation to make room and try again.
+		TickType_t waited = ::xTaskGetTickCount() - start;
+		if (timeout != portMAX_DELAY && waited >= timeout) {
+			ESP_LOGD(LOG_TAG, "Queue full for conn_id %d", m_connId);
+			return false;
+		}
+		if ((::xEventGroupWaitBits(m_events, QUEUE_ROOM, pdFALSE, pdFALSE,
+				timeout == portMAX_DELAY ? portMAX_DELAY : timeout - waited) & QUEUE_ROOM) == 0) {
+			ESP_LOGD(LOG_TAG, "Queue full for conn_id %d", m_connId);
+			return false;
+		}
+	}
+} // push
+
+
+/**
+ * @brief Remove a value from the values in flight.
+ *
+ * Must be called with the lock held.
+ *
+ * @param [in] i The position of the value, counting from the oldest.
+ */
+void BLENotifyQueue::removeInFlight(size_t i) {
+	// Close the gap by shuffling the older entries forward one place.
+	for (size_t j = i; j > 0; j--) {
+		m_inFlight[(m_inFlightHead + j) % m_inFlight.size()] = m_inFlight[(m_inFlightHead + j - 1) % m_inFlight.size()];
+	}
+	m_inFlightHead = (m_inFlightHead + 1) % m_inFlight.size();
+	m_inFlightCount--;
+} // removeInFlight
+
+
+/**
+ * @brief Record whether the %BLE stack has reported the connection as congested.
+ *
+ * While congested we stop passing new notifications to the stack.
+ *
+ * @param [in] congested True if the connection is congested.
+ */
+void BLENotifyQueue::setCongested(bool congested) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_congested = congested;
+	::xSemaphoreGive(m_lock);
+
+	if (!congested) {
+		sendPending();
+	}
+} // setCongested
+
+
+/**
+ * @brief Record the MTU negotiated on our connection.
+ *
+ * Notifications longer than the MTU allows are truncated when they are sent.
+ *
+ * @param [in] mtu The MTU of the connection.
+ */
+void BLENotifyQueue::setMTU(uint16_t mtu) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_mtu = mtu;
+	::xSemaphoreGive(m_lock);
+} // setMTU
+
+
+/**
+ * @brief Pass waiting values to the %BLE stack while we have credit to do so.
+ *
+ * Must be called without the lock held.  Only one task sends at a time, so the stack is given the values
+ * in the order they are recorded in flight; a task that finds another already sending leaves its values
+ * to that task.  Each value is recorded in flight and copied out of its slot into the send buffer under
+ * the lock, then sent with the lock released, so neither the tasks queuing values nor the confirmations from the %BLE stack
+ * wait on the call into the stack.
+ */
+void BLENotifyQueue::sendPending() {
+	std::vector<Completion> failed;
+
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (m_sending) {
+		::xSemaphoreGive(m_lock);
+		return;
+	}
+	m_sending = true;
+	while (m_open && !m_congested && m_pendingCount > 0 && m_inFlightCount < m_inFlight.size()) {
+		Entry& entry = m_pending[m_pendingHead];
+		size_t length = entry.value.length() > (size_t)(m_mtu - 3) ? m_mtu - 3 : entry.value.length();
+		if (length > sizeof(m_sendBuffer)) {
+			length = sizeof(m_sendBuffer);
+		}
+		memcpy(m_sendBuffer, entry.value.data(), length);
+		Sent sent = { entry.pCharacteristic, entry.kind, m_nextId++ };
+		m_inFlight[(m_inFlightHead + m_inFlightCount) % m_inFlight.size()] = sent;
+		m_inFlightCount++;
+		m_pendingHead = (m_pendingHead + 1) % m_pending.size();
+		m_pendingCount--;
+		updateEvents();
+		esp_gatt_if_t gattsIf = m_gattsIf;
+		::xSemaphoreGive(m_lock);
+
+		esp_err_t errRc = ::esp_ble_gatts_send_indicate(
+				gattsIf,
+				m_connId,
+				sent.pCharacteristic->getHandle(),
+				length,
+				m_sendBuffer,
+				sent.kind == INDICATE); // The need_confirm = true makes this an indication.
+
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		if (errRc != ESP_OK) {
+			ESP_LOGE(LOG_TAG, "esp_ble_gatts_send_indicate: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			// No confirmation will come.  If the connection has closed meanwhile, close() has reported it.
+			for (size_t i = 0; i < m_inFlightCount; i++) {
+				if (m_inFlight[(m_inFlightHead + i) % m_inFlight.size()].id == sent.id) {
+					failed.push_back({ sent.pCharacteristic, sent.kind, ESP_GATT_ERROR });
+					removeInFlight(i);
+					break;
+				}
+			}
+		}
+	}
+	m_sending = false;
+	::xSemaphoreGive(m_lock);
+
+	complete(failed);
+} // sendPending
+
+
+/**
+ * @brief Set or clear the event bit that tells waiting callers there is room.
+ *
+ * Must be called with the lock held.
+ */
+void BLENotifyQueue::updateEvents() {
+	if (!m_open || m_pendingCount < m_pending.size()) {
+		::xEventGroupSetBits(m_events, QUEUE_ROOM);
+	} else {
+		::xEventGroupClearBits(m_events, QUEUE_ROOM);
+	}
+} // updateEvents
+
+#endif /* CONFIG_BT_ENABLED */
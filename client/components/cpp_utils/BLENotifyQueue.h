@@ -0,0 +1,98 @@
+/*
+ * BLENotifyQueue.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLENOTIFYQUEUE_H_
+#define COMPONENTS_CPP_UTILS_BLENOTIFYQUEUE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <string>
+#include <vector>
+#include <esp_gatts_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+
+class BLECharacteristic;
+
+/**
+ * @brief A bounded queue of notifications waiting to be sent on one connection.
+ *
+ * Every notification and indication sent on the connection passes through its queue, so that the
+ * ESP_GATTS_CONF_EVT confirmations the %BLE stack reports, in the order the values were sent, can be matched
+ * to their senders.  Up to maxInFlight values are passed to the stack at once; the rest wait in the queue and
+ * are sent as earlier ones complete.  When the queue is full, callers wait for room.
+ *
+ * An ASYNC value, queued by BLECharacteristic::notifyAsync() or notifyAll(), lets its caller carry on and
+ * has its completion reported through BLECharacteristicCallbacks::onNotifyComplete().  A NOTIFY or INDICATE
+ * value is queued by BLECharacteristic::notify() or indicate(), which block until its completion releases
+ * them.
+ *
+ * With coalescing enabled, queuing a new ASYNC value for a characteristic that already has one waiting
+ * replaces that value so that only the newest is sent.
+ */
+class BLENotifyQueue {
+public:
+	enum Kind : uint8_t {
+		ASYNC,     // A notification whose completion is reported to the characteristic's callbacks.
+		NOTIFY,    // A notification whose sender is blocked waiting for it.
+		INDICATE   // An indication whose sender is blocked waiting for it.
+	};
+
+	BLENotifyQueue(uint16_t connId, uint8_t depth, uint8_t maxInFlight, bool coalesce);
+	~BLENotifyQueue();
+
+	void close();
+	bool handleConfirm(esp_ble_gatts_cb_param_t* param);
+	void open(esp_gatt_if_t gattsIf);
+	bool push(BLECharacteristic* pCharacteristic, size_t maxLength, uint32_t timeoutMs, Kind kind = ASYNC);
+	void setCongested(bool congested);
+	void setMTU(uint16_t mtu);
+
+private:
+	struct Entry {
+		BLECharacteristic* pCharacteristic;
+		Kind               kind;
+		std::string        value;
+	};
+
+	struct Sent {
+		BLECharacteristic* pCharacteristic;
+		Kind               kind;
+		uint32_t           id;        // Tells apart sends of the same characteristic.
+	};
+
+	struct Completion {
+		BLECharacteristic* pCharacteristic;
+		Kind               kind;
+		esp_gatt_status_t  status;
+	};
+
+	uint16_t                        m_connId;
+	esp_gatt_if_t                   m_gattsIf;
+	bool                            m_open;
+	bool                            m_congested;
+	bool                            m_coalesce;
+	bool                            m_sending;      // A task is passing values to the stack.
+	uint16_t                        m_mtu;
+	uint8_t                         m_maxInFlight;
+	uint32_t                        m_nextId;
+	std::vector<Entry>              m_pending;      // Ring of values waiting to be sent.
+	size_t                          m_pendingHead;
+	size_t                          m_pendingCount;
+	std::vector<Sent>               m_inFlight;     // Ring of values sent but not yet confirmed, oldest first.
+	size_t                          m_inFlightHead;
+	size_t                          m_inFlightCount;
+	SemaphoreHandle_t               m_lock;
+	EventGroupHandle_t              m_events;       // Tells callers waiting in push() that there may be room.
+	uint8_t                         m_sendBuffer[ESP_GATT_MAX_ATTR_LEN];   // Used only by the task sending.
+
+	static void complete(std::vector<Completion>& completions);
+	void        copyValue(BLECharacteristic* pCharacteristic, size_t maxLength, std::string& value);
+	void        removeInFlight(size_t i);
+	void        sendPending();
+	void        updateEvents();
+}; // BLENotifyQueue
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLENOTIFYQUEUE_H_ */
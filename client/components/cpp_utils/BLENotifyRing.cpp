@@ -0,0 +1,197 @@
+/*
+ * BLENotifyRing.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BLENotifyRing.h"
+#include "BLERemoteCharacteristic.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLENotifyRing";
+
+/*
+ * Design
+ * ------
+ * m_head and m_tail count notifications added and delivered since the ring was made.  They only ever
+ * increase, wrapping at 2^32, and the slot of count n is n & m_mask.  The ring holds m_head - m_tail
+ * notifications.
+ *
+ * The producer fills the slot at m_head and only then advances m_head, with release ordering, so the
+ * consumer never sees a slot before its contents.  The consumer delivers every slot up to the m_head it
+ * loaded and only then advances m_tail, once for the whole batch, so the producer never overwrites a slot
+ * being delivered.
+ *
+ * The producer gives m_ready after every notification it adds.  The consumer only waits on m_ready after
+ * finding the ring empty.  Because m_ready is a binary semaphore, a notification added between the
+ * consumer's last look and its wait leaves m_ready given and the wait returns at once.
+ */
+
+
+/**
+ * @brief Construct a ring and start its task.
+ * @param [in] depth The number of notifications the ring can hold.  Rounded up to a power of two.
+ * @param [in] slotSize The longest notification value the ring can hold.
+ * @param [in] stackSize The stack size of the task that calls the callbacks.
+ * @param [in] priority The priority of the task that calls the callbacks.
+ */
+BLENotifyRing::BLENotifyRing(uint16_t depth, uint16_t slotSize, uint32_t stackSize, UBaseType_t priority) {
+	uint32_t slots = 1;
+	while (slots < depth) {
+		slots <<= 1;
+	}
+	m_mask     = slots - 1;
+	m_slotSize = slotSize;
+	m_pSlots   = (Slot*)calloc(slots, sizeof(Slot));
+	m_pValues  = (uint8_t*)malloc(slots * slotSize);
+	m_head     = 0;
+	m_tail     = 0;
+	m_dropped  = 0;
+	m_full     = 0;
+	m_wasFull  = false;
+	m_ready    = ::xSemaphoreCreateBinary();
+	m_task     = nullptr;
+	if (m_pSlots == nullptr || m_pValues == nullptr) {
+		ESP_LOGE(LOG_TAG, "Unable to allocate %d slots of %d bytes", slots, slotSize);
+		m_mask = 0;
+		free(m_pSlots);
+		free(m_pValues);
+		m_pSlots  = nullptr;
+		m_pValues = nullptr;
+		return;
+	}
+	::xTaskCreate(&runTask, "BLENotifyRing", stackSize, this, priority, &m_task);
+} // BLENotifyRing
+
+
+/**
+ * @brief Stop the ring's task and free the ring.
+ *
+ * No client may still be using the ring.
+ */
+BLENotifyRing::~BLENotifyRing() {
+	if (m_task != nullptr) {
+		::vTaskDelete(m_task);
+	}
+	::vSemaphoreDelete(m_ready);
+	free(m_pSlots);
+	free(m_pValues);
+} // ~BLENotifyRing
+
+
+/**
+ * @brief Get the number of notifications whose callbacks have been called.
+ * @return The number of notifications delivered.
+ */
+uint32_t BLENotifyRing::getDelivered() {
+	return m_tail.load(std::memory_order_relaxed);
+} // getDelivered
+
+
+/**
+ * @brief Get the number of notifications dropped because the ring was full or they were longer than a slot.
+ * @return The number of notifications dropped.
+ */
+uint32_t BLENotifyRing::getDropped() {
+	return m_dropped.load(std::memory_order_relaxed);
+} // getDropped
+
+
+/**
+ * @brief Get the number of times the ring has filled up.
+ *
+ * A run of notifications dropped while the ring stays full counts once.  A growing count means the
+ * callbacks cannot keep up with the server and the ring should be deeper or the callbacks quicker.
+ *
+ * @return The number of times the ring has been found full.
+ */
+uint32_t BLENotifyRing::getFull() {
+	return m_full.load(std::memory_order_relaxed);
+} // getFull
+
+
+/**
+ * @brief Add a notification to the ring.
+ *
+ * Called only from the %BLE stack's task.  Never blocks.
+ *
+ * @param [in] pCharacteristic The characteristic that was notified.
+ * @param [in] pData The value of the notification.
+ * @param [in] length The length of the value.
+ * @param [in] isNotify True for a notification, false for an indication.
+ * @return True if the notification was added, false if it was dropped.
+ */
+bool BLENotifyRing::push(BLERemoteCharacteristic* pCharacteristic, const uint8_t* pData, size_t length, bool isNotify) {
+	if (m_pSlots == nullptr || length > m_slotSize) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		ESP_LOGD(LOG_TAG, "Dropped notification of %d bytes", length);
+		return false;
+	}
+	uint32_t head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) > m_mask) {
+		if (!m_wasFull) {
+			m_wasFull = true;
+			m_full.fetch_add(1, std::memory_order_relaxed);
+		}
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	m_wasFull = false;
+
+	uint32_t index = head & m_mask;
+	m_pSlots[index].pCharacteristic = pCharacteristic;
+	m_pSlots[index].length          = length;
+	m_pSlots[index].isNotify        = isNotify;
+	memcpy(m_pValues + index * m_slotSize, pData, length);
+	m_head.store(head + 1, std::memory_order_release);
+	::xSemaphoreGive(m_ready);
+	return true;
+} // push
+
+
+/**
+ * @brief Deliver notifications for as long as the ring exists.
+ */
+void BLENotifyRing::run() {
+	uint32_t tail = m_tail.load(std::memory_order_relaxed);
+	while(true) {
+		uint32_t head = m_head.load(std::memory_order_acquire);
+		if (head == tail) {
+			::xSemaphoreTake(m_ready, portMAX_DELAY);
+			continue;
+		}
+		for (; tail != head; tail++) {
+			Slot& slot = m_pSlots[tail & m_mask];
+			slot.pCharacteristic->deliverNotify(m_pValues + (tail & m_mask) * m_slotSize, slot.length, slot.isNotify);
+		}
+		m_tail.store(tail, std::memory_order_release);
+	}
+} // run
+
+
+void BLENotifyRing::runTask(void* pData) {
+	((BLENotifyRing*)pData)->run();
+} // runTask
+
+
+/**
+ * @brief Wait until every notification already in the ring has been delivered.
+ *
+ * Called before a characteristic is deleted so that no notification for it is left in the ring.  Does
+ * nothing when called from the ring's own task.
+ */
+void BLENotifyRing::waitIdle() {
+	if (m_task == nullptr || ::xTaskGetCurrentTaskHandle() == m_task) {
+		return;
+	}
+	uint32_t head = m_head.load(std::memory_order_acquire);
+	while ((int32_t)(m_tail.load(std::memory_order_acquire) - head) < 0) {
+		::vTaskDelay(1);
+	}
+} // waitIdle
+
+#endif /* CONFIG_BT_ENABLED */
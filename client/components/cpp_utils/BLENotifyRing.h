@@ -0,0 +1,75 @@
+/*
+ * BLENotifyRing.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLENOTIFYRING_H_
+#define COMPONENTS_CPP_UTILS_BLENOTIFYRING_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+class BLERemoteCharacteristic;
+
+/**
+ * @brief A ring through which notifications received by clients are handed to a task of their own.
+ *
+ * Normally the callback passed to BLERemoteCharacteristic::registerForNotify() runs on the %BLE stack's
+ * task, so a slow callback holds up every other event.  A client given a ring with
+ * BLEClient::setNotifyRing() instead copies each notification into the ring and returns at once.  The
+ * ring's own task takes the notifications out in batches and calls the callbacks.
+ *
+ * The ring has one producer, the %BLE stack's task, and one consumer, the ring's task, so neither side
+ * takes a lock.  All its memory is allocated when it is constructed.  When the ring is full, or a
+ * notification is longer than a slot, the notification is dropped and counted.  One ring may serve
+ * several clients.
+ *
+ * For example:
+ *
+ * @code{.cpp}
+ * static BLENotifyRing notifyRing(32, 20);
+ * pClient->setNotifyRing(&notifyRing);
+ * @endcode
+ */
+class BLENotifyRing {
+public:
+	BLENotifyRing(uint16_t depth, uint16_t slotSize, uint32_t stackSize = 4096, UBaseType_t priority = 5);
+	~BLENotifyRing();
+
+	uint32_t getDelivered();
+	uint32_t getDropped();
+	uint32_t getFull();
+	void     waitIdle();
+
+private:
+	friend class BLERemoteCharacteristic;
+
+	struct Slot {
+		BLERemoteCharacteristic* pCharacteristic;
+		uint16_t                 length;
+		bool                     isNotify;
+	};
+
+	bool        push(BLERemoteCharacteristic* pCharacteristic, const uint8_t* pData, size_t length, bool isNotify);
+	void        run();
+	static void runTask(void* pData);
+
+	uint32_t              m_mask;        // The number of slots, a power of two, less one.
+	uint16_t              m_slotSize;
+	Slot*                 m_pSlots;
+	uint8_t*              m_pValues;     // The value of slot i is at m_pValues + i * m_slotSize.
+	std::atomic<uint32_t> m_head;        // Count of notifications added.  Only the producer writes it.
+	std::atomic<uint32_t> m_tail;        // Count of notifications delivered.  Only the consumer writes it.
+	std::atomic<uint32_t> m_dropped;
+	std::atomic<uint32_t> m_full;        // Times the producer found the ring full after it had room.
+	bool                  m_wasFull;     // Producer only.
+	SemaphoreHandle_t     m_ready;       // Given by the producer to wake the consumer.
+	TaskHandle_t          m_task;
+}; // BLENotifyRing
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLENOTIFYRING_H_ */
@@ -0,0 +1,70 @@
+/*
+ * BLEOperationQueue.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEOPERATIONQUEUE_H_
+#define COMPONENTS_CPP_UTILS_BLEOPERATIONQUEUE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <deque>
+#include <string>
+#include <esp_gattc_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "BLEFuture.h"
+#include "BLEWriteWindow.h"
+
+/**
+ * @brief A queue of the GATT operations waiting to be made on one client connection.
+ *
+ * A server answers one ATT request at a time on a connection.  Reads, writes with response and
+ * notification registrations are therefore queued and issued in order.  Each is issued from the %BLE
+ * stack's task as soon as the one before it completes, so no application task has to wake up between
+ * them.  Each operation has a BLEFuture that is completed with its outcome.  When the connection
+ * closes, every queued operation fails with ESP_GATT_ERROR.  A write with response is not issued until
+ * the connection's writes without response have been passed on, and none are issued until it completes,
+ * since the %BLE stack reports both with the same event.
+ */
+class BLEOperationQueue {
+public:
+	BLEOperationQueue(BLEWriteWindow* pWriteWindow);
+	~BLEOperationQueue();
+
+	void close();
+	bool handleEvent(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* evtParam);
+	void issueNext();
+	void open(esp_gatt_if_t gattcIf, uint16_t connId, esp_bd_addr_t address);
+	bool read(uint16_t handle, BLEFuture* pFuture);
+	bool registerForNotify(uint16_t handle, bool enable, BLEFuture* pFuture);
+	bool write(uint16_t handle, std::string value, BLEFuture* pFuture);
+
+private:
+	enum Type {
+		READ,
+		WRITE,
+		REG_FOR_NOTIFY,
+		UNREG_FOR_NOTIFY
+	};
+
+	struct Operation {
+		Type        type;
+		uint16_t    handle;
+		std::string value;
+		BLEFuture*  pFuture;
+	};
+
+	esp_gatt_if_t         m_gattcIf;
+	uint16_t              m_connId;
+	esp_bd_addr_t         m_address;
+	bool                  m_open;
+	bool                  m_issued;   // The operation at the front of the queue is with the BLE stack.
+	BLEWriteWindow*       m_pWriteWindow;   // The writes without response on the same connection.
+	std::deque<Operation> m_operations;
+	SemaphoreHandle_t     m_lock;
+
+	bool      add(Type type, uint16_t handle, std::string value, BLEFuture* pFuture);
+	esp_err_t issue(Operation& operation, esp_gatt_if_t gattcIf, uint16_t connId, esp_bd_addr_t address);
+}; // BLEOperationQueue
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEOPERATIONQUEUE_H_ */
@@ -44,8 +44,7 @@ BLERemoteCharacteristic::BLERemoteCharacteristic(
 	m_charProp       = charProp;
 	m_pRemoteService = pRemoteService;
 	m_notifyCallback = nullptr;
-
-	retrieveDescriptors(); // Get the descriptors for this characteristic
+	m_pRemoteService->getClient()->addAttribute(this);
 	ESP_LOGD(LOG_TAG, "<< BLERemoteCharacteristic");
 } // BLERemoteCharacteristic
 
@@ -54,6 +53,12 @@ BLERemoteCharacteristic::BLERemoteCharacteristic(
  *@brief Destructor.
  */
 BLERemoteCharacteristic::~BLERemoteCharacteristic() {
+	// Once we are unmapped no new notification for us can reach the ring, so the ring only need be drained of
+	// those already in it.
+	m_pRemoteService->getClient()->removeAttribute(this);
+	if (m_pRemoteService->getClient()->m_pNotifyRing != nullptr) {
+		m_pRemoteService->getClient()->m_pNotifyRing->waitIdle();   // No notification for us may be left in the ring.
+	}
 	removeDescriptors();   // Release resources for any descriptor information we may have allocated.
 } // ~BLERemoteCharacteristic
 
@@ -112,6 +117,40 @@ bool BLERemoteCharacteristic::canWriteNoResponse() {
 } // canWriteNoResponse
 
 
+/**
+ * @brief Call the notification callback.
+ *
+ * Called from the %BLE stack's task or, if the client has a notify ring, from the ring's task.
+ *
+ * @param [in] pData The value of the notification.
+ * @param [in] length The length of the value.
+ * @param [in] isNotify True for a notification, false for an indication.
+ */
+void BLERemoteCharacteristic::deliverNotify(uint8_t* pData, size_t length, bool isNotify) {
+	if (m_notifyCallback == nullptr) {
+		return;
+	}
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, "Invoking callback for notification on characteristic %s", toString().c_str());
+	}
+	m_notifyCallback(this, pData, length, isNotify);
+} // deliverNotify
+
+
+/**
+ * @brief Wait until every write without response on the connection has been passed on by the %BLE stack.
+ *
+ * Writes without response are issued without waiting.  A caller that needs what it does next to follow
+ * them, such as a read or a write with response, can use this as a barrier.
+ *
+ * @param [in] timeoutMs How long to wait.
+ * @return True if no write is outstanding.
+ */
+bool BLERemoteCharacteristic::flush(uint32_t timeoutMs) {
+	return getRemoteService()->getClient()->getWriteWindow()->drain(timeoutMs);
+} // flush
+
+
 /*
 static bool compareSrvcId(esp_gatt_srvc_id_t id1, esp_gatt_srvc_id_t id2) {
 	if (id1.id.inst_id != id2.id.inst_id) {
@@ -139,8 +178,8 @@ static bool compareGattId(esp_gatt_id_t id1, esp_gatt_id_t id2) {
 
 /**
  * @brief Handle GATT Client events.
- * When an event arrives for a GATT client we give this characteristic the opportunity to
- * take a look at it to see if there is interest in it.
+ * The client looks up the characteristic that an event concerns by its handle and passes the event
+ * to it, so we only see events that carry our handle.
  * @param [in] event The type of event.
  * @param [in] gattc_if The interface on which the event was received.
  * @param [in] evtParam Payload data for the event.
@@ -170,104 +209,22 @@ void BLERemoteCharacteristic::gattClientEventHandler(
 			if (evtParam->notify.handle != getHandle()) {
 				break;
 			}
-			if (m_notifyCallback != nullptr) {
-				ESP_LOGD(LOG_TAG, "Invoking callback for notification on characteristic %s", toString().c_str());
-				m_notifyCallback(
+			if (m_notifyCallback == nullptr) {
+				break;
+			}
+			// With a notify ring, the value is copied and the callback is called from the ring's task.
+			if (m_pRemoteService->getClient()->m_pNotifyRing != nullptr) {
+				m_pRemoteService->getClient()->m_pNotifyRing->push(
 					this,
 					evtParam->notify.value,
 					evtParam->notify.value_len,
 					evtParam->notify.is_notify
 				);
-			} // End we have a callback function ...
-			break;
-		} // ESP_GATTC_NOTIFY_EVT
-
-
-		//
-		// ESP_GATTC_READ_CHAR_EVT
-		// This event indicates that the server has responded to the read request.
-		//
-		// read:
-		// - esp_gatt_status_t  status
-		// - uint16_t           conn_id
-		// - uint16_t           handle
-		// - uint8_t*           value
-		// - uint16_t           value_len
-	  //
-		case ESP_GATTC_READ_CHAR_EVT: {
-			// If this event is not for us, then nothing further to do.
-			if (evtParam->read.handle != getHandle()) {
 				break;
 			}
-
-			// At this point, we have determined that the event is for us, so now we save the value
-			// and unlock the semaphore to ensure that the requestor of the data can continue.
-			if (evtParam->read.status == ESP_GATT_OK) {
-				m_value = std::string((char*)evtParam->read.value, evtParam->read.value_len);
-			} else {
-				m_value = "";
-			}
-
-			m_semaphoreReadCharEvt.give();
+			deliverNotify(evtParam->notify.value, evtParam->notify.value_len, evtParam->notify.is_notify);
 			break;
-		} // ESP_GATTC_READ_CHAR_EVT
-
-
-		//
-		// ESP_GATTC_REG_FOR_NOTIFY_EVT
-		//
-		// reg_for_notify:
-		// - esp_gatt_status_t status
-		// - uint16_t          handle
-		//
-		case ESP_GATTC_REG_FOR_NOTIFY_EVT: {
-			// If the request is not for this BLERemoteCharacteristic then move on to the next.
-			if (evtParam->reg_for_notify.handle != getHandle()) {
-				break;
-			}
-
-			// We have processed the notify registration and can unlock the semaphore.
-			m_semaphoreRegForNotifyEvt.give();
-			break;
-		} // ESP_GATTC_REG_FOR_NOTIFY_EVT
-
-
-		//
-		// ESP_GATTC_UNREG_FOR_NOTIFY_EVT
-		//
-		// unreg_for_notify:
-		// - esp_gatt_status_t status
-		// - uint16_t          handle
-		//
-		case ESP_GATTC_UNREG_FOR_NOTIFY_EVT: {
-			if (evtParam->unreg_for_notify.handle != getHandle()) {
-				break;
-			}
-			// We have processed the notify un-registration and can unlock the semaphore.
-			m_semaphoreRegForNotifyEvt.give();
-			break;
-		} // ESP_GATTC_UNREG_FOR_NOTIFY_EVT:
-
-
-		//
-		// ESP_GATTC_WRITE_CHAR_EVT
-		//
-		// write:
-		// - esp_gatt_status_t status
-		// - uint16_t          conn_id
-		// - uint16_t          handle
-		//
-		case ESP_GATTC_WRITE_CHAR_EVT: {
-			// Determine if this event is for us and, if not, pass onwards.
-			if (evtParam->write.handle != getHandle()) {
-				break;
-			}
-
-			// There is nothing further we need to do here.  This is merely an indication
-			// that the write has completed and we can unlock the caller.
-			m_semaphoreWriteCharEvt.give();
-			break;
-		} // ESP_GATTC_WRITE_CHAR_EVT
+		} // ESP_GATTC_NOTIFY_EVT
 
 
 		default: {
@@ -288,14 +245,14 @@ void BLERemoteCharacteristic::retrieveDescriptors() {
 	// Loop over each of the descriptors within the service associated with this characteristic.
 	// For each descriptor we find, create a BLERemoteDescriptor instance.
 	uint16_t offset = 0;
-	esp_gattc_descr_elem_t result;
+	esp_gattc_descr_elem_t result[BLE_REMOTE_DISCOVERY_BATCH];
 	while(1) {
-		uint16_t count = 1;
+		uint16_t count = BLE_REMOTE_DISCOVERY_BATCH;
 		esp_gatt_status_t status = ::esp_ble_gattc_get_all_descr(
 			getRemoteService()->getClient()->getGattcIf(),
 			getRemoteService()->getClient()->getConnId(),
 			getHandle(),
-			&result,
+			result,
 			&count,
 			offset
 		);
@@ -312,21 +269,25 @@ void BLERemoteCharacteristic::retrieveDescriptors() {
 		if (count == 0) {
 			break;
 		}
-		ESP_LOGE(LOG_TAG, "");
-		ESP_LOGD(LOG_TAG, "Found a descriptor: Handle: %d, UUID: %s", result.handle, BLEUUID(result.uuid).toString().c_str());
-
-		// We now have a new characteristic ... let us add that to our set of known characteristics
-		BLERemoteDescriptor *pNewRemoteDescriptor = new BLERemoteDescriptor(
-			result.handle,
-			BLEUUID(result.uuid),
-			this
-		);
 
-		m_descriptorMap.insert(std::pair<std::string, BLERemoteDescriptor*>(pNewRemoteDescriptor->getUUID().toString(), pNewRemoteDescriptor));
+		for (uint16_t i = 0; i < count; i++) {
+			ESP_LOGD(LOG_TAG, "Found a descriptor: Handle: %d, UUID: %s", result[i].handle, BLEUUID(result[i].uuid).toString().c_str());
 
-		offset++;
+			// We now have a new descriptor ... let us add that to our set of known descriptors
+			BLERemoteDescriptor *pNewRemoteDescriptor = new BLERemoteDescriptor(
+				result[i].handle,
+				BLEUUID(result[i].uuid),
+				this
+			);
+
+			m_descriptorMap.insert(std::pair<BLEUUID, BLERemoteDescriptor*>(pNewRemoteDescriptor->getUUID(), pNewRemoteDescriptor));
+		}
+
+		offset += count;
+		if (count < BLE_REMOTE_DISCOVERY_BATCH) {   // A short batch is the last one.
+			break;
+		}
 	} // while true
-	//m_haveCharacteristics = true; // Remember that we have received the characteristics.
 	ESP_LOGD(LOG_TAG, "<< retrieveDescriptors(): Found %d descriptors.", offset);
 } // getDescriptors
 
@@ -334,7 +295,7 @@ void BLERemoteCharacteristic::retrieveDescriptors() {
 /**
  * @brief Retrieve the map of descriptors keyed by UUID.
  */
-std::map<std::string, BLERemoteDescriptor *>* BLERemoteCharacteristic::getDescriptors() {
+std::map<BLEUUID, BLERemoteDescriptor *>* BLERemoteCharacteristic::getDescriptors() {
 	return &m_descriptorMap;
 } // getDescriptors
 
@@ -357,12 +318,10 @@ uint16_t BLERemoteCharacteristic::getHandle() {
  */
 BLERemoteDescriptor* BLERemoteCharacteristic::getDescriptor(BLEUUID uuid) {
 	ESP_LOGD(LOG_TAG, ">> getDescriptor: uuid: %s", uuid.toString().c_str());
-	std::string v = uuid.toString();
-	for (auto &myPair : m_descriptorMap) {
-		if (myPair.first == v) {
-			ESP_LOGD(LOG_TAG, "<< getDescriptor: found");
-			return myPair.second;
-		}
+	auto it = m_descriptorMap.find(uuid);
+	if (it != m_descriptorMap.end()) {
+		ESP_LOGD(LOG_TAG, "<< getDescriptor: found");
+		return it->second;
 	}
 	ESP_LOGD(LOG_TAG, "<< getDescriptor: Not found");
 	return nullptr;
@@ -439,31 +398,30 @@ std::string BLERemoteCharacteristic::readValue() {
 		throw BLEDisconnectedException();
 	}
 
-	m_semaphoreReadCharEvt.take("readValue");
-
-	// Ask the BLE subsystem to retrieve the value for the remote hosted characteristic.
-	// This is an asynchronous request which means that we must block waiting for the response
-	// to become available.
-	esp_err_t errRc = ::esp_ble_gattc_read_char(
-		m_pRemoteService->getClient()->getGattcIf(),
-		m_pRemoteService->getClient()->getConnId(),    // The connection ID to the BLE server
-		getHandle(),                                   // The handle of this characteristic
-		ESP_GATT_AUTH_REQ_NONE);                       // Security
-
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "esp_ble_gattc_read_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		return "";
-	}
-
-	// Block waiting for the event that indicates that the read has completed.  When it has, the std::string found
-	// in m_value will contain our data.
-	m_semaphoreReadCharEvt.wait("readValue");
+	// Wait for our turn on the connection and then for the server's reply.
+	BLEFuture future;
+	readValueAsync(&future);
+	future.wait();
+	m_value = future.getValue();   // Empty if the read failed.
 
 	ESP_LOGD(LOG_TAG, "<< readValue(): length: %d", m_value.length());
 	return m_value;
 } // readValue
 
 
+/**
+ * @brief Read the value of the remote characteristic without waiting for it.
+ *
+ * The read is queued behind any other operations on the connection.
+ *
+ * @param [in] pFuture Completed with the value once the server replies.
+ * @return False if we are not connected, in which case the future has already failed.
+ */
+bool BLERemoteCharacteristic::readValueAsync(BLEFuture* pFuture) {
+	return getRemoteService()->getClient()->getOperationQueue()->read(getHandle(), pFuture);
+} // readValueAsync
+
+
 /**
  * @brief Register for notifications.
  * @param [in] notifyCallback A callback to be invoked for a notification.  If NULL is provided then we are
@@ -478,39 +436,33 @@ void BLERemoteCharacteristic::registerForNotify(
 			bool                     isNotify)) {
 	ESP_LOGD(LOG_TAG, ">> registerForNotify(): %s", toString().c_str());
 
-	m_notifyCallback = notifyCallback;   // Save the notification callback.
-
-	m_semaphoreRegForNotifyEvt.take("registerForNotify");
-
-	if (notifyCallback != nullptr) {   // If we have a callback function, then this is a registration.
-		esp_err_t errRc = ::esp_ble_gattc_register_for_notify(
-			m_pRemoteService->getClient()->getGattcIf(),
-			*m_pRemoteService->getClient()->getPeerAddress().getNative(),
-			getHandle()
-		);
-
-		if (errRc != ESP_OK) {
-			ESP_LOGE(LOG_TAG, "esp_ble_gattc_register_for_notify: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		}
-	} // End Register
-	else {   // If we weren't passed a callback function, then this is an unregistration.
-		esp_err_t errRc = ::esp_ble_gattc_unregister_for_notify(
-			m_pRemoteService->getClient()->getGattcIf(),
-			*m_pRemoteService->getClient()->getPeerAddress().getNative(),
-			getHandle()
-		);
-
-		if (errRc != ESP_OK) {
-			ESP_LOGE(LOG_TAG, "esp_ble_gattc_unregister_for_notify: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		}
-	} // End Unregister
-
-	m_semaphoreRegForNotifyEvt.wait("registerForNotify");
+	BLEFuture future;
+	registerForNotifyAsync(notifyCallback, &future);
+	future.wait();
 
 	ESP_LOGD(LOG_TAG, "<< registerForNotify()");
 } // registerForNotify
 
 
+/**
+ * @brief Register for notifications without waiting for the registration to be made.
+ * @param [in] notifyCallback A callback to be invoked for a notification.  If NULL is provided then we are
+ * unregistering a notification.
+ * @param [in] pFuture Completed once the %BLE stack has made the change.
+ * @return False if we are not connected, in which case the future has already failed.
+ */
+bool BLERemoteCharacteristic::registerForNotifyAsync(
+		void (*notifyCallback)(
+			BLERemoteCharacteristic* pBLERemoteCharacteristic,
+			uint8_t*                 pData,
+			size_t                   length,
+			bool                     isNotify),
+		BLEFuture* pFuture) {
+	m_notifyCallback = notifyCallback;   // Save the notification callback.
+	return getRemoteService()->getClient()->getOperationQueue()->registerForNotify(getHandle(), notifyCallback != nullptr, pFuture);
+} // registerForNotifyAsync
+
+
 /**
  * @brief Delete the descriptors in the descriptor map.
  * We maintain a map called m_descriptorMap that contains pointers to BLERemoteDescriptors
@@ -521,7 +473,6 @@ void BLERemoteCharacteristic::registerForNotify(
 void BLERemoteCharacteristic::removeDescriptors() {
 	// Iterate through all the descriptors releasing their storage and erasing them from the map.
 	for (auto &myPair : m_descriptorMap) {
-	   m_descriptorMap.erase(myPair.first);
 	   delete myPair.second;
 	}
 	m_descriptorMap.clear();   // Technically not neeeded, but just to be sure.
@@ -543,6 +494,11 @@ std::string BLERemoteCharacteristic::toString() {
 
 /**
  * @brief Write the new value for the characteristic.
+ *
+ * A write with response waits for the server's reply.  A write without response waits only until the
+ * %BLE stack has passed it on; use writeNoResponse() to carry on without waiting at all.  A write with
+ * response is issued once writes without response still outstanding have been passed on.
+ *
  * @param [in] newValue The new value to write.
  * @param [in] response Do we expect a response?
  * @return N/A.
@@ -556,25 +512,17 @@ void BLERemoteCharacteristic::writeValue(std::string newValue, bool response) {
 		throw BLEDisconnectedException();
 	}
 
-	m_semaphoreWriteCharEvt.take("writeValue");
-
-	// Invoke the ESP-IDF API to perform the write.
-	esp_err_t errRc = ::esp_ble_gattc_write_char(
-		m_pRemoteService->getClient()->getGattcIf(),
-		m_pRemoteService->getClient()->getConnId(),
-		getHandle(),
-		newValue.length(),
-		(uint8_t*)newValue.data(),
-		response?ESP_GATT_WRITE_TYPE_RSP:ESP_GATT_WRITE_TYPE_NO_RSP,
-		ESP_GATT_AUTH_REQ_NONE
-	);
-
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "esp_ble_gattc_write_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+	if (!response) {
+		if (writeNoResponse(newValue)) {
+			flush();
+		}
+		ESP_LOGD(LOG_TAG, "<< writeValue");
 		return;
 	}
 
-	m_semaphoreWriteCharEvt.wait("writeValue");
+	BLEFuture future;
+	writeValueAsync(newValue, &future);
+	future.wait();
 
 	ESP_LOGD(LOG_TAG, "<< writeValue");
 } // writeValue
@@ -603,4 +551,77 @@ void BLERemoteCharacteristic::writeValue(uint8_t* data, size_t length, bool resp
 	writeValue(std::string((char *)data, length), response);
 } // writeValue
 
+
+/**
+ * @brief Write the new value for the characteristic, with response, without waiting for the reply.
+ *
+ * The write is queued behind any other operations on the connection and is issued once writes without
+ * response made before it have been passed on by the %BLE stack.  Writes without response made while it
+ * is with the stack wait, within their timeout, for it to complete.
+ *
+ * @param [in] newValue The new value to write.
+ * @param [in] pFuture Completed once the server replies.
+ * @return False if we are not connected, in which case the future has already failed.
+ */
+bool BLERemoteCharacteristic::writeValueAsync(std::string newValue, BLEFuture* pFuture) {
+	return getRemoteService()->getClient()->getOperationQueue()->write(getHandle(), newValue, pFuture);
+} // writeValueAsync
+
+
+/**
+ * @brief Write several values without response, one after another.
+ *
+ * Each value is written in turn as credit allows so that the stack can hold several at once.
+ *
+ * @param [in] values The values to write, in order.
+ * @param [in] timeoutMs How long to wait for credit for each write.
+ * @return The number of values, from the start of the list, that were handed to the %BLE stack.
+ */
+size_t BLERemoteCharacteristic::writeBatch(std::vector<std::string>& values, uint32_t timeoutMs) {
+	size_t count = 0;
+	for (auto &value : values) {
+		if (!writeNoResponse(value, timeoutMs)) {
+			break;
+		}
+		count++;
+	}
+	return count;
+} // writeBatch
+
+
+/**
+ * @brief Write a value without response and without waiting for it to be sent.
+ *
+ * The value is copied by the %BLE stack so the caller may reuse its buffer as soon as we return.  Up to the
+ * client's write window of writes may be outstanding at once; beyond that we wait up to timeoutMs for one to
+ * be sent, or for a write with response that is with the %BLE stack to complete.  Call flush() when a
+ * following read must come after the writes.
+ *
+ * @param [in] data The value to write.
+ * @param [in] length The length of the value.  It must fit in a single packet at the connection's MTU.
+ * @param [in] timeoutMs How long to wait for the window to have room.
+ * @return True if the write was handed to the %BLE stack.
+ */
+bool BLERemoteCharacteristic::writeNoResponse(uint8_t* data, size_t length, uint32_t timeoutMs) {
+	BLEClient* pClient = getRemoteService()->getClient();
+	uint16_t   mtu     = pClient->getMTU();
+	if (length > (size_t)(mtu - 3)) {
+		ESP_LOGE(LOG_TAG, "writeNoResponse: length %d exceeds %d, the maximum write without response for an MTU of %d",
+			length, mtu - 3, mtu);
+		return false;
+	}
+	return pClient->getWriteWindow()->write(getHandle(), data, length, timeoutMs);
+} // writeNoResponse
+
+
+/**
+ * @brief Write a value without response and without waiting for it to be sent.
+ * @param [in] newValue The value to write.
+ * @param [in] timeoutMs How long to wait for the window to have room.
+ * @return True if the write was handed to the %BLE stack.
+ */
+bool BLERemoteCharacteristic::writeNoResponse(std::string newValue, uint32_t timeoutMs) {
+	return writeNoResponse((uint8_t*)newValue.data(), newValue.length(), timeoutMs);
+} // writeNoResponse
+
 #endif /* CONFIG_BT_ENABLED */
@@ -25,9 +25,56 @@ BLERemoteDescriptor::BLERemoteDescriptor(
 	m_handle                = handle;
 	m_uuid                  = uuid;
 	m_pRemoteCharacteristic = pRemoteCharacteristic;
+	m_pRemoteCharacteristic->getRemoteService()->getClient()->addAttribute(this);
 }
 
 
+BLERemoteDescriptor::~BLERemoteDescriptor() {
+	m_pRemoteCharacteristic->getRemoteService()->getClient()->removeAttribute(this);
+} // ~BLERemoteDescriptor
+
+
+/**
+ * @brief Handle GATT Client events about this descriptor.
+ *
+ * The client passes us only the events that carry our handle.
+ */
+void BLERemoteDescriptor::gattClientEventHandler(
+	esp_gattc_cb_event_t      event,
+	esp_gatt_if_t             gattc_if,
+	esp_ble_gattc_cb_param_t* evtParam) {
+	switch(event) {
+		//
+		// ESP_GATTC_READ_DESCR_EVT
+		// This event indicates that the server has responded to the read request.
+		//
+		// read:
+		// - esp_gatt_status_t  status
+		// - uint16_t           conn_id
+		// - uint16_t           handle
+		// - uint8_t*           value
+		// - uint16_t           value_len
+		//
+		case ESP_GATTC_READ_DESCR_EVT: {
+			if (evtParam->read.handle != getHandle()) {
+				break;
+			}
+			if (evtParam->read.status == ESP_GATT_OK) {
+				m_value = std::string((char*)evtParam->read.value, evtParam->read.value_len);
+			} else {
+				m_value = "";
+			}
+			m_semaphoreReadDescrEvt.give();
+			break;
+		} // ESP_GATTC_READ_DESCR_EVT
+
+		default: {
+			break;
+		}
+	} // switch
+} // gattClientEventHandler
+
+
 /**
  * @brief Retrieve the handle associated with this remote descriptor.
  * @return The handle associated with this remote descriptor.
@@ -75,6 +122,7 @@ std::string BLERemoteDescriptor::readValue(void) {
 
 	if (errRc != ESP_OK) {
 		ESP_LOGE(LOG_TAG, "esp_ble_gattc_read_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+		m_semaphoreReadDescrEvt.give();
 		return "";
 	}
 
@@ -166,7 +214,7 @@ void BLERemoteDescriptor::writeValue(
 void BLERemoteDescriptor::writeValue(
 		std::string newValue,
 		bool        response) {
-	writeValue(newValue.data(), newValue.length());
+	writeValue((uint8_t*)newValue.data(), newValue.length(), response);
 } // writeValue
 
 
@@ -23,6 +23,8 @@ class BLERemoteCharacteristic;
  */
 class BLERemoteDescriptor {
 public:
+	~BLERemoteDescriptor();
+
 	uint16_t    getHandle();
 	BLERemoteCharacteristic* getRemoteCharacteristic();
 	BLEUUID     getUUID();
@@ -37,12 +39,18 @@ public:
 
 
 private:
+	friend class BLEClient;
+	friend class BLEGattCache;
 	friend class BLERemoteCharacteristic;
 	BLERemoteDescriptor(
 		uint16_t                 handle,
 		BLEUUID                  uuid,
 		BLERemoteCharacteristic* pRemoteCharacteristic
 	);
+	void                     gattClientEventHandler(
+		esp_gattc_cb_event_t      event,
+		esp_gatt_if_t             gattc_if,
+		esp_ble_gattc_cb_param_t* evtParam);
 	uint16_t                 m_handle;                  // Server handle of this descriptor.
 	BLEUUID                  m_uuid;                    // UUID of this descriptor.
 	std::string              m_value;                   // Last received value of the descriptor.
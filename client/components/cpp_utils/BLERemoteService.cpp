@@ -42,83 +42,6 @@ BLERemoteService::~BLERemoteService() {
 	removeCharacteristics();
 }
 
-/*
-static bool compareSrvcId(esp_gatt_srvc_id_t id1, esp_gatt_srvc_id_t id2) {
-	if (id1.id.inst_id != id2.id.inst_id) {
-		return false;
-	}
-	if (!BLEUUID(id1.id.uuid).equals(BLEUUID(id2.id.uuid))) {
-		return false;
-	}
-	return true;
-} // compareSrvcId
-*/
-
-/**
- * @brief Handle GATT Client events
- */
-void BLERemoteService::gattClientEventHandler(
-	esp_gattc_cb_event_t      event,
-	esp_gatt_if_t             gattc_if,
-	esp_ble_gattc_cb_param_t *evtParam) {
-	switch(event) {
-		//
-		// ESP_GATTC_GET_CHAR_EVT
-		//
-		// get_char:
-		// - esp_gatt_status_t    status
-		// - uin1t6_t             conn_id
-		// - esp_gatt_srvc_id_t   srvc_id
-		// - esp_gatt_id_t        char_id
-		// - esp_gatt_char_prop_t char_prop
-		//
-	/*
-		case ESP_GATTC_GET_CHAR_EVT: {
-			// Is this event for this service?  If yes, then the local srvc_id and the event srvc_id will be
-			// the same.
-			if (compareSrvcId(m_srvcId, evtParam->get_char.srvc_id) == false) {
-				break;
-			}
-
-			// If the status is NOT OK then we have a problem and continue.
-			if (evtParam->get_char.status != ESP_GATT_OK) {
-				m_semaphoreGetCharEvt.give();
-				break;
-			}
-
-			// This is an indication that we now have the characteristic details for a characteristic owned
-			// by this service so remember it.
-			m_characteristicMap.insert(std::pair<std::string, BLERemoteCharacteristic*>(
-					BLEUUID(evtParam->get_char.char_id.uuid).toString(),
-					new BLERemoteCharacteristic(evtParam->get_char.char_id, evtParam->get_char.char_prop, this)	));
-
-
-			// Now that we have received a characteristic, lets ask for the next one.
-			esp_err_t errRc = ::esp_ble_gattc_get_characteristic(
-					m_pClient->getGattcIf(),
-					m_pClient->getConnId(),
-					&m_srvcId,
-					&evtParam->get_char.char_id);
-			if (errRc != ESP_OK) {
-				ESP_LOGE(LOG_TAG, "esp_ble_gattc_get_characteristic: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-				break;
-			}
-
-			//m_semaphoreGetCharEvt.give();
-			break;
-		} // ESP_GATTC_GET_CHAR_EVT
-*/
-		default: {
-			break;
-		}
-	} // switch
-
-	// Send the event to each of the characteristics owned by this service.
-	for (auto &myPair : m_characteristicMap) {
-	   myPair.second->gattClientEventHandler(event, gattc_if, evtParam);
-	}
-} // gattClientEventHandler
-
 
 /**
  * @brief Get the remote characteristic object for the characteristic UUID.
@@ -147,11 +70,9 @@ BLERemoteCharacteristic* BLERemoteService::getCharacteristic(BLEUUID uuid) {
 	if (!m_haveCharacteristics) {
 		retrieveCharacteristics();
 	}
-	std::string v = uuid.toString();
-	for (auto &myPair : m_characteristicMap) {
-		if (myPair.first == v) {
-			return myPair.second;
-		}
+	auto it = m_characteristicMap.find(uuid);
+	if (it != m_characteristicMap.end()) {
+		return it->second;
 	}
 	throw new BLEUuidNotFoundException();
 } // getCharacteristic
@@ -160,6 +81,9 @@ BLERemoteCharacteristic* BLERemoteService::getCharacteristic(BLEUUID uuid) {
 /**
  * @brief Retrieve all the characteristics for this service.
  * This function will not return until we have all the characteristics.
+ *
+ * The characteristics are fetched from the %BLE stack in batches of BLE_REMOTE_DISCOVERY_BATCH rather than
+ * one per call.
  * @return N/A
  */
 void BLERemoteService::retrieveCharacteristics() {
@@ -169,15 +93,15 @@ void BLERemoteService::retrieveCharacteristics() {
 	removeCharacteristics(); // Forget any previous characteristics.
 
 	uint16_t offset = 0;
-	esp_gattc_char_elem_t result;
+	esp_gattc_char_elem_t result[BLE_REMOTE_DISCOVERY_BATCH];
 	while(1) {
-		uint16_t count = 1;
+		uint16_t count = BLE_REMOTE_DISCOVERY_BATCH;
 		esp_gatt_status_t status = ::esp_ble_gattc_get_all_char(
 			getClient()->getGattcIf(),
 			getClient()->getConnId(),
 			m_startHandle,
 			m_endHandle,
-			&result,
+			result,
 			&count,
 			offset
 		);
@@ -195,19 +119,25 @@ void BLERemoteService::retrieveCharacteristics() {
 			break;
 		}
 
-		ESP_LOGD(LOG_TAG, "Found a characteristic: Handle: %d, UUID: %s", result.char_handle, BLEUUID(result.uuid).toString().c_str());
+		for (uint16_t i = 0; i < count; i++) {
+			ESP_LOGD(LOG_TAG, "Found a characteristic: Handle: %d, UUID: %s", result[i].char_handle, BLEUUID(result[i].uuid).toString().c_str());
 
-		// We now have a new characteristic ... let us add that to our set of known characteristics
-		BLERemoteCharacteristic *pNewRemoteCharacteristic = new BLERemoteCharacteristic(
-			result.char_handle,
-			BLEUUID(result.uuid),
-			result.properties,
-			this
-		);
+			// We now have a new characteristic ... let us add that to our set of known characteristics
+			BLERemoteCharacteristic *pNewRemoteCharacteristic = new BLERemoteCharacteristic(
+				result[i].char_handle,
+				BLEUUID(result[i].uuid),
+				result[i].properties,
+				this
+			);
+			pNewRemoteCharacteristic->retrieveDescriptors();
 
-		m_characteristicMap.insert(std::pair<std::string, BLERemoteCharacteristic*>(pNewRemoteCharacteristic->getUUID().toString(), pNewRemoteCharacteristic));
+			m_characteristicMap.insert(std::pair<BLEUUID, BLERemoteCharacteristic*>(pNewRemoteCharacteristic->getUUID(), pNewRemoteCharacteristic));
+		}
 
-		offset++;   // Increment our count of number of descriptors found.
+		if (count < BLE_REMOTE_DISCOVERY_BATCH) {   // A short batch is the last one.
+			break;
+		}
+		offset += count;   // Increment our count of number of characteristics found.
 	} // Loop forever (until we break inside the loop).
 
 	m_haveCharacteristics = true; // Remember that we have received the characteristics.
@@ -219,7 +149,7 @@ void BLERemoteService::retrieveCharacteristics() {
  * @brief Retrieve a map of all the characteristics of this service.
  * @return A map of all the characteristics of this service.
  */
-std::map<std::string, BLERemoteCharacteristic *> * BLERemoteService::getCharacteristics() {
+std::map<BLEUUID, BLERemoteCharacteristic *> * BLERemoteService::getCharacteristics() {
 	ESP_LOGD(LOG_TAG, ">> getCharacteristics() for service: %s", getUUID().toString().c_str());
 	// If is possible that we have not read the characteristics associated with the service so do that
 	// now.  The request to retrieve the characteristics by calling "retrieveCharacteristics" is a blocking
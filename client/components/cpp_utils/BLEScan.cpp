@@ -11,9 +11,12 @@
 #include <esp_log.h>
 #include <esp_err.h>
 
+#include <algorithm>
 #include <map>
+#include <string.h>
 
 #include "BLEAdvertisedDevice.h"
+#include "BLEDevice.h"
 #include "BLEScan.h"
 #include "BLEUtils.h"
 #include "GeneralUtils.h"
@@ -34,6 +37,9 @@ BLEScan::BLEScan() {
 	m_pAdvertisedDeviceCallbacks     = nullptr;
 	m_stopped                        = true;
 	m_wantDuplicates                 = false;
+	m_pScanFilter                    = nullptr;
+	m_filterLock                     = ::xSemaphoreCreateMutex();
+	m_scanResults.setMaxResults(BLE_SCAN_DEFAULT_MAX_RESULTS);
 	setInterval(100);
 	setWindow(100);
 } // BLEScan
@@ -87,21 +93,38 @@ void BLEScan::handleGAPEvent(
 						break;
 					}
 
-// Examine our list of previously scanned addresses and, if we found this one already,
+					// Check the advertisement against our filter before we spend any effort on it.
+					size_t advLength = param->scan_rst.adv_data_len + param->scan_rst.scan_rsp_len;
+					BLEAdvertisementView view(param->scan_rst.ble_adv, advLength);
+					::xSemaphoreTake(m_filterLock, portMAX_DELAY);
+					BLEScanFilter* pFilter = m_pScanFilter != nullptr ? m_pScanFilter : &m_filter;
+					bool matches = pFilter->matches(param->scan_rst.bda, param->scan_rst.rssi, view);
+					::xSemaphoreGive(m_filterLock);
+					if (!matches) {
+						break;
+					}
+
+// Look up this address among those we have already seen and, if we found this one already,
 // ignore it.
-					BLEAddress advertisedAddress(param->scan_rst.bda);
-					bool found = false;
+					uint32_t hash     = BLEScanResults::hashAddress(param->scan_rst.bda);
+					int16_t  position = m_scanResults.find(param->scan_rst.bda, hash);
+					bool     found    = position >= 0;
 
-					for (int i=0; i<m_scanResults.getCount(); i++) {
-						if (m_scanResults.getDevice(i).getAddress().equals(advertisedAddress)) {
-							found = true;
-							break;
-						}
+					if (found) {
+						m_scanResults.touch(position);   // Heard from again so it is the last to be evicted.
 					}
 					if (found && !m_wantDuplicates) {  // If we found a previous entry AND we don't want duplicates, then we are done.
-						ESP_LOGD(LOG_TAG, "Ignoring %s, already seen it.", advertisedAddress.toString().c_str());
+						if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+							ESP_LOGD(LOG_TAG, "Ignoring %s, already seen it.", BLEAddress(param->scan_rst.bda).toString().c_str());
+						}
+						break;
+					}
+
+					// Let the application turn the advertisement away before we spend any effort parsing it.
+					if (m_pAdvertisedDeviceCallbacks && !m_pAdvertisedDeviceCallbacks->onFilter(view)) {
 						break;
 					}
+					BLEAddress advertisedAddress(param->scan_rst.bda);
 
 					// We now construct a model of the advertised device that we have just found for the first
 					// time.
@@ -109,7 +132,7 @@ void BLEScan::handleGAPEvent(
 					advertisedDevice.setAddress(advertisedAddress);
 					advertisedDevice.setRSSI(param->scan_rst.rssi);
 					advertisedDevice.setAdFlag(param->scan_rst.flag);
-					advertisedDevice.parseAdvertisement((uint8_t*)param->scan_rst.ble_adv);
+					advertisedDevice.parseAdvertisement((uint8_t*)param->scan_rst.ble_adv, advLength);
 					advertisedDevice.setScan(this);
 
 					if (m_pAdvertisedDeviceCallbacks) {
@@ -117,7 +140,7 @@ void BLEScan::handleGAPEvent(
 					}
 
 					if (!found) {   // If we have previously seen this device, don't record it again.
-						m_scanResults.m_vectorAdvertisedDevices.push_back(advertisedDevice);
+						m_scanResults.add(advertisedDevice, hash);
 					}
 
 					break;
@@ -139,6 +162,27 @@ void BLEScan::handleGAPEvent(
 } // gapEventHandler
 
 
+/**
+ * @brief Get the filter applied to advertisements.
+ * @return A copy of the filter set with setFilter().
+ */
+BLEScanFilter BLEScan::getFilter() {
+	::xSemaphoreTake(m_filterLock, portMAX_DELAY);
+	BLEScanFilter filter = m_filter;
+	::xSemaphoreGive(m_filterLock);
+	return filter;
+} // getFilter
+
+
+/**
+ * @brief Get the results of the current or most recent scan.
+ * @return The scan results.
+ */
+BLEScanResults& BLEScan::getResults() {
+	return m_scanResults;
+} // getResults
+
+
 /**
  * @brief Should we perform an active or passive scan?
  * The default is a passive scan.  An active scan means that we will wish a scan response.
@@ -165,6 +209,27 @@ void BLEScan::setAdvertisedDeviceCallbacks(BLEAdvertisedDeviceCallbacks* pAdvert
 } // setAdvertisedDeviceCallbacks
 
 
+/**
+ * @brief Set the filter that advertisements must pass to be reported.
+ *
+ * Advertisements that fail the filter are dropped before a BLEAdvertisedDevice is built for them.  If the
+ * filter has an address allow list that is short enough, the addresses are also placed in the controller's
+ * white list so that other devices are dropped before they reach us at all.  Allow listed devices must then
+ * use a public or static address.  Advertisements are checked against the new filter at once, but the
+ * white list takes effect from the next call to start().
+ *
+ * @param [in] filter The filter.  An empty filter reports everything.
+ */
+void BLEScan::setFilter(BLEScanFilter filter) {
+	::xSemaphoreTake(m_filterLock, portMAX_DELAY);
+	m_filter = filter;
+	if (m_pScanFilter == nullptr) {   // Otherwise the white list is that of the scan's own filter until it ends.
+		updateWhiteList();
+	}
+	::xSemaphoreGive(m_filterLock);
+} // setFilter
+
+
 /**
  * @brief Set the interval to scan.
  * @param [in] The interval in msecs.
@@ -174,6 +239,19 @@ void BLEScan::setInterval(uint16_t intervalMSecs) {
 } // setInterval
 
 
+/**
+ * @brief Set the maximum number of devices recorded by a scan.
+ *
+ * When more devices than this are found, the one least recently heard from is dropped to make room.  Any
+ * results held are discarded.  The default is BLE_SCAN_DEFAULT_MAX_RESULTS.
+ *
+ * @param [in] maxResults The maximum number of devices.
+ */
+void BLEScan::setMaxResults(size_t maxResults) {
+	m_scanResults.setMaxResults(maxResults);
+} // setMaxResults
+
+
 /**
  * @brief Set the window to actively scan.
  * @param [in] windowMSecs How long to actively scan.
@@ -186,38 +264,77 @@ void BLEScan::setWindow(uint16_t windowMSecs) {
 /**
  * @brief Start scanning.
  * @param [in] duration The duration in seconds for which to scan.
- * @return N/A.
+ * @return The scan results.  They remain valid until the next scan starts.
+ */
+BLEScanResults& BLEScan::start(uint32_t duration) {
+	return startScan(duration, nullptr);
+} // start
+
+
+/**
+ * @brief Start scanning with a filter of its own.
+ *
+ * The filter is used for this scan only, in place of the one set with setFilter(), which is left as it
+ * is and applies again once the scan ends.
+ *
+ * @param [in] duration The duration in seconds for which to scan.
+ * @param [in] filter The filter for this scan.
+ * @return The scan results.  They remain valid until the next scan starts.
+ */
+BLEScanResults& BLEScan::start(uint32_t duration, BLEScanFilter filter) {
+	return startScan(duration, &filter);
+} // start
+
+
+/**
+ * @brief Scan and wait for the scan to end.
+ * @param [in] duration The duration in seconds for which to scan.
+ * @param [in] pFilter The filter for this scan, or nullptr to use the one set with setFilter().
+ * @return The scan results.
  */
-BLEScanResults BLEScan::start(uint32_t duration) {
+BLEScanResults& BLEScan::startScan(uint32_t duration, BLEScanFilter* pFilter) {
 	ESP_LOGD(LOG_TAG, ">> start(duration=%d)", duration);
 
-	m_semaphoreScanEnd.take(std::string("start"));
+	m_semaphoreScanEnd.take("start");
+
+	// Only now that no other scan is running may the filter be swapped, along with the white list.
+	if (pFilter != nullptr) {
+		::xSemaphoreTake(m_filterLock, portMAX_DELAY);
+		m_pScanFilter = pFilter;
+		updateWhiteList();
+		::xSemaphoreGive(m_filterLock);
+	}
 
-	m_scanResults.m_vectorAdvertisedDevices.clear();
+	m_scanResults.clear();
 
 	esp_err_t errRc = ::esp_ble_gap_set_scan_params(&m_scan_params);
 
 	if (errRc != ESP_OK) {
 		ESP_LOGE(LOG_TAG, "esp_ble_gap_set_scan_params: err: %d, text: %s", errRc, GeneralUtils::errorToString(errRc));
-		m_semaphoreScanEnd.give();
-		return m_scanResults;
+	} else {
+		errRc = ::esp_ble_gap_start_scanning(duration);
+		if (errRc != ESP_OK) {
+			ESP_LOGE(LOG_TAG, "esp_ble_gap_start_scanning: err: %d, text: %s", errRc, GeneralUtils::errorToString(errRc));
+		}
 	}
 
-	errRc = ::esp_ble_gap_start_scanning(duration);
-
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "esp_ble_gap_start_scanning: err: %d, text: %s", errRc, GeneralUtils::errorToString(errRc));
+	if (errRc == ESP_OK) {
+		m_stopped = false;
+		m_semaphoreScanEnd.wait("start");   // Wait for the semaphore to release.
+	} else {
 		m_semaphoreScanEnd.give();
-		return m_scanResults;
 	}
 
-	m_stopped = false;
-
-	m_semaphoreScanEnd.wait("start");   // Wait for the semaphore to release.
+	if (pFilter != nullptr) {
+		::xSemaphoreTake(m_filterLock, portMAX_DELAY);
+		m_pScanFilter = nullptr;
+		updateWhiteList();
+		::xSemaphoreGive(m_filterLock);
+	}
 
 	ESP_LOGD(LOG_TAG, "<< start()");
 	return m_scanResults;
-} // start
+} // startScan
 
 
 /**
@@ -242,6 +359,31 @@ void BLEScan::stop() {
 } // stop
 
 
+/**
+ * @brief Bring the controller's white list into line with the address allow list of the filter in use.
+ *
+ * The scan is told to accept only white listed devices if, and only if, the whole allow list fits.  Must
+ * be called with the filter's lock held.
+ */
+void BLEScan::updateWhiteList() {
+	for (auto &address : m_whiteList) {
+		BLEDevice::whiteListRemove(address);
+	}
+	m_whiteList.clear();
+
+	std::vector<BLEAddress> addresses = (m_pScanFilter != nullptr ? m_pScanFilter : &m_filter)->getAddresses();
+	if (addresses.empty() || addresses.size() > BLE_SCAN_FILTER_MAX_WHITELIST) {
+		m_scan_params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ALL;
+		return;
+	}
+	for (auto &address : addresses) {
+		BLEDevice::whiteListAdd(address);
+		m_whiteList.push_back(address);
+	}
+	m_scan_params.scan_filter_policy = BLE_SCAN_FILTER_ALLOW_ONLY_WLST;
+} // updateWhiteList
+
+
 /**
  * @brief Dump the scan results to the log.
  */
@@ -268,9 +410,197 @@ int BLEScanResults::getCount() {
  * @param [in] i The index of the device.
  * @return The device at the specified index.
  */
-BLEAdvertisedDevice BLEScanResults::getDevice(uint32_t i) {
+BLEAdvertisedDevice& BLEScanResults::getDevice(uint32_t i) {
 	return m_vectorAdvertisedDevices.at(i);
-}
+} // getDevice
+
+
+/**
+ * @brief Record a newly found device.
+ *
+ * If we are full, the device least recently heard from is replaced.
+ *
+ * @param [in] advertisedDevice The device.  Its contents are moved into the results.
+ * @param [in] hash The hash of the address of the device.
+ * @return The position of the device.
+ */
+int16_t BLEScanResults::add(BLEAdvertisedDevice& advertisedDevice, uint32_t hash) {
+	int16_t position;
+	if (m_vectorAdvertisedDevices.size() < m_maxResults) {
+		position = m_vectorAdvertisedDevices.size();
+		m_vectorAdvertisedDevices.push_back(std::move(advertisedDevice));
+		m_hashes.push_back(hash);
+		m_prev.push_back(-1);
+		m_next.push_back(-1);
+	} else {
+		position = m_oldest;
+		if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+			ESP_LOGD(LOG_TAG, "Evicting %s", m_vectorAdvertisedDevices[position].getAddress().toString().c_str());
+		}
+		unindex(position);
+		unlink(position);
+		m_vectorAdvertisedDevices[position] = std::move(advertisedDevice);
+		m_hashes[position] = hash;
+	}
+
+	size_t mask = m_index.size() - 1;
+	size_t i = hash & mask;
+	while (m_index[i] >= 0) {
+		i = (i + 1) & mask;
+	}
+	m_index[i] = position;
+
+	m_prev[position] = m_newest;   // Newly seen so it goes to the end of the recency list.
+	m_next[position] = -1;
+	if (m_newest >= 0) {
+		m_next[m_newest] = position;
+	} else {
+		m_oldest = position;
+	}
+	m_newest = position;
+	return position;
+} // add
+
+
+/**
+ * @brief Discard all the devices.
+ */
+void BLEScanResults::clear() {
+	m_vectorAdvertisedDevices.clear();
+	m_hashes.clear();
+	m_prev.clear();
+	m_next.clear();
+	m_oldest = -1;
+	m_newest = -1;
+	std::fill(m_index.begin(), m_index.end(), -1);
+} // clear
+
+
+/**
+ * @brief Find a device by address.
+ * @param [in] address The address of the device.
+ * @param [in] hash The hash of the address.
+ * @return The position of the device or -1 if we have not seen it.
+ */
+int16_t BLEScanResults::find(esp_bd_addr_t address, uint32_t hash) {
+	size_t mask = m_index.size() - 1;
+	for (size_t i = hash & mask; m_index[i] >= 0; i = (i + 1) & mask) {
+		int16_t position = m_index[i];
+		if (m_hashes[position] == hash &&
+				memcmp(m_vectorAdvertisedDevices[position].m_address.getNative(), address, ESP_BD_ADDR_LEN) == 0) {
+			return position;
+		}
+	}
+	return -1;
+} // find
+
+
+/**
+ * @brief Hash a device address.
+ * @param [in] address The address.
+ * @return The hash of the address.
+ */
+uint32_t BLEScanResults::hashAddress(esp_bd_addr_t address) {
+	uint32_t hash = 2166136261u;   // FNV-1a
+	for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+		hash = (hash ^ address[i]) * 16777619u;
+	}
+	return hash;
+} // hashAddress
+
+
+/**
+ * @brief Set the maximum number of devices we hold.
+ *
+ * Any devices held are discarded.
+ *
+ * @param [in] maxResults The maximum number of devices.
+ */
+void BLEScanResults::setMaxResults(size_t maxResults) {
+	if (maxResults < 1) {
+		maxResults = 1;
+	}
+	if (maxResults > INT16_MAX / 2) {
+		maxResults = INT16_MAX / 2;
+	}
+	m_maxResults = maxResults;
+
+	// Keep the table no more than half full so that probe sequences stay short.
+	size_t indexSize = 1;
+	while (indexSize < maxResults * 2) {
+		indexSize <<= 1;
+	}
+	m_index.assign(indexSize, -1);
+	clear();
+	m_vectorAdvertisedDevices.reserve(maxResults);
+	m_hashes.reserve(maxResults);
+	m_prev.reserve(maxResults);
+	m_next.reserve(maxResults);
+} // setMaxResults
+
+
+/**
+ * @brief Move a device to the most recently seen end of the recency list.
+ * @param [in] position The position of the device.
+ */
+void BLEScanResults::touch(int16_t position) {
+	if (position == m_newest) {
+		return;
+	}
+	unlink(position);
+	m_prev[position] = m_newest;
+	m_next[position] = -1;
+	m_next[m_newest] = position;
+	m_newest = position;
+} // touch
+
+
+/**
+ * @brief Remove a device from the hash table.
+ *
+ * Entries after it in the same probe run are shifted back so that lookups do not stop early at the gap.
+ *
+ * @param [in] position The position of the device.
+ */
+void BLEScanResults::unindex(int16_t position) {
+	size_t mask = m_index.size() - 1;
+	size_t i = m_hashes[position] & mask;
+	while (m_index[i] != position) {
+		i = (i + 1) & mask;
+	}
+	size_t j = i;
+	while (true) {
+		j = (j + 1) & mask;
+		if (m_index[j] < 0) {
+			break;
+		}
+		size_t home = m_hashes[m_index[j]] & mask;
+		// The entry at j may fill the gap at i if its home slot is not cyclically within (i, j].
+		if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			m_index[i] = m_index[j];
+			i = j;
+		}
+	}
+	m_index[i] = -1;
+} // unindex
+
+
+/**
+ * @brief Remove a device from the recency list.
+ * @param [in] position The position of the device.
+ */
+void BLEScanResults::unlink(int16_t position) {
+	if (m_prev[position] >= 0) {
+		m_next[m_prev[position]] = m_next[position];
+	} else {
+		m_oldest = m_next[position];
+	}
+	if (m_next[position] >= 0) {
+		m_prev[m_next[position]] = m_prev[position];
+	} else {
+		m_newest = m_prev[position];
+	}
+} // unlink
 
 
 #endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,205 @@
+/*
+ * BLEScanFilter.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <string.h>
+#include <algorithm>
+#include "BLEScanFilter.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEScanFilter";
+
+
+BLEScanFilter::BLEScanFilter() {
+	m_minRSSI = -9999;
+} // BLEScanFilter
+
+
+/**
+ * @brief Append an instruction to the program.
+ *
+ * The instruction is placed after any others with the same operation so the program stays ordered.
+ *
+ * @param [in] op The operation.
+ * @param [in] pOperand The operand of the operation.
+ * @param [in] length The length of the operand.
+ */
+void BLEScanFilter::add(uint8_t op, const uint8_t* pOperand, size_t length) {
+	if (length > UINT8_MAX || m_operands.size() + length > UINT16_MAX) {
+		ESP_LOGE(LOG_TAG, "Filter condition too large: op=%d, length=%d", op, length);
+		return;
+	}
+	Instruction instruction;
+	instruction.op      = op;
+	instruction.length  = length;
+	instruction.operand = m_operands.size();
+	m_operands.insert(m_operands.end(), pOperand, pOperand + length);
+
+	auto position = std::upper_bound(m_program.begin(), m_program.end(), instruction,
+			[](const Instruction& a, const Instruction& b) { return a.op < b.op; });
+	m_program.insert(position, instruction);
+} // add
+
+
+/**
+ * @brief Allow a device with the given address.
+ *
+ * Once any address is added, devices whose address has not been added are rejected.
+ *
+ * @param [in] address The address to allow.
+ * @return The filter.
+ */
+BLEScanFilter& BLEScanFilter::addAddress(BLEAddress address) {
+	add(OP_ADDRESS, *address.getNative(), ESP_BD_ADDR_LEN);
+	return *this;
+} // addAddress
+
+
+/**
+ * @brief Allow a device that sends manufacturer data from the given company.
+ * @param [in] manufacturerId The Bluetooth SIG company identifier.
+ * @return The filter.
+ */
+BLEScanFilter& BLEScanFilter::addManufacturerId(uint16_t manufacturerId) {
+	uint8_t operand[2] = { (uint8_t)(manufacturerId & 0xff), (uint8_t)(manufacturerId >> 8) }; // As sent, least significant first.
+	add(OP_MANUFACTURER, operand, sizeof(operand));
+	return *this;
+} // addManufacturerId
+
+
+/**
+ * @brief Allow a device whose complete or shortened name starts with the given text.
+ * @param [in] prefix The text the name must start with.
+ * @return The filter.
+ */
+BLEScanFilter& BLEScanFilter::addNamePrefix(std::string prefix) {
+	if (prefix.empty()) {
+		ESP_LOGE(LOG_TAG, "addNamePrefix: prefix is empty");
+		return *this;
+	}
+	add(OP_NAME, (const uint8_t*)prefix.data(), prefix.length());
+	return *this;
+} // addNamePrefix
+
+
+/**
+ * @brief Allow a device that advertises the given service.
+ * @param [in] uuid The service.
+ * @return The filter.
+ */
+BLEScanFilter& BLEScanFilter::addServiceUUID(BLEUUID uuid) {
+	if (uuid.bitSize() == 0) {
+		ESP_LOGE(LOG_TAG, "addServiceUUID: UUID has no value");
+		return *this;
+	}
+	uuid.to128();
+	add(OP_SERVICE, uuid.getNative()->uuid.uuid128, ESP_UUID_LEN_128);
+	return *this;
+} // addServiceUUID
+
+
+/**
+ * @brief Remove every condition so that the filter matches everything.
+ */
+void BLEScanFilter::clear() {
+	m_minRSSI = -9999;
+	m_program.clear();
+	m_operands.clear();
+} // clear
+
+
+/**
+ * @brief Run a single instruction.
+ * @param [in] instruction The instruction.
+ * @param [in] address The address of the advertising device.
+ * @param [in] advertisement The advertisement.
+ * @return True if the condition holds.
+ */
+bool BLEScanFilter::execute(const Instruction& instruction, esp_bd_addr_t address, BLEAdvertisementView& advertisement) {
+	const uint8_t* pOperand = m_operands.data() + instruction.operand;
+	switch(instruction.op) {
+		case OP_ADDRESS:
+			return ::memcmp(address, pOperand, ESP_BD_ADDR_LEN) == 0;
+
+		case OP_MANUFACTURER:
+			return advertisement.haveManufacturerData(pOperand, instruction.length);
+
+		case OP_NAME:
+			return advertisement.haveName((const char*)pOperand, instruction.length);
+
+		case OP_SERVICE:
+			return advertisement.isAdvertisingService(pOperand);
+
+		default:
+			return false;
+	} // switch
+} // execute
+
+
+/**
+ * @brief Get the addresses in the allow list.
+ * @return The addresses that have been added with addAddress().
+ */
+std::vector<BLEAddress> BLEScanFilter::getAddresses() {
+	std::vector<BLEAddress> addresses;
+	for (auto &instruction : m_program) {
+		if (instruction.op == OP_ADDRESS) {
+			addresses.push_back(BLEAddress((uint8_t*)&m_operands[instruction.operand]));
+		}
+	}
+	return addresses;
+} // getAddresses
+
+
+/**
+ * @brief Does the filter have no conditions?
+ * @return True if the filter matches everything.
+ */
+bool BLEScanFilter::isEmpty() {
+	return m_program.empty() && m_minRSSI == -9999;
+} // isEmpty
+
+
+/**
+ * @brief Does an advertisement pass the filter?
+ * @param [in] address The address of the advertising device.
+ * @param [in] rssi The signal strength of the advertisement.
+ * @param [in] advertisement The advertisement.
+ * @return True if every kind of condition has at least one alternative that holds.
+ */
+bool BLEScanFilter::matches(esp_bd_addr_t address, int rssi, BLEAdvertisementView& advertisement) {
+	if (rssi < m_minRSSI) {
+		return false;
+	}
+	size_t pc = 0;
+	while (pc < m_program.size()) {
+		uint8_t op      = m_program[pc].op;
+		bool    matched = false;
+		for (; pc < m_program.size() && m_program[pc].op == op; pc++) {
+			if (!matched && execute(m_program[pc], address, advertisement)) {
+				matched = true;
+			}
+		}
+		if (!matched) {
+			return false;
+		}
+	}
+	return true;
+} // matches
+
+
+/**
+ * @brief Reject advertisements weaker than the given signal strength.
+ * @param [in] rssi The weakest acceptable signal strength in dBm.
+ * @return The filter.
+ */
+BLEScanFilter& BLEScanFilter::setMinRSSI(int rssi) {
+	m_minRSSI = rssi;
+	return *this;
+} // setMinRSSI
+
+#endif /* CONFIG_BT_ENABLED */
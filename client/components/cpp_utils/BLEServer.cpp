@@ -16,6 +16,7 @@
 #include "BLEServer.h"
 #include "BLEService.h"
 #include "BLEUtils.h"
+#include "GeneralUtils.h"
 #include <string.h>
 #include <string>
 #include <gatt_api.h>
@@ -39,6 +40,10 @@ BLEServer::BLEServer() {
 	m_connectedCount   = 0;
 	m_connId           = -1;
 	m_pServerCallbacks = nullptr;
+	m_notifyQueueDepth  = 8;
+	m_notifyMaxInFlight = 4;
+	m_notifyCoalesce    = false;
+	m_connectionLock    = ::xSemaphoreCreateMutex();
 
 	//createApp(0);
 } // BLEServer
@@ -104,9 +109,53 @@ BLEAdvertising* BLEServer::getAdvertising() {
 	return &m_bleAdvertising;
 }
 
+/**
+ * @brief Get the Client Characteristic Configuration a client has written to a 0x2902 descriptor.
+ * @param [in] connId The connection of the client.
+ * @param [in] handle The handle of the 0x2902 descriptor.
+ * @return The configuration value.  Zero if the client is not connected or has not written it.
+ */
+uint16_t BLEServer::getCCCD(uint16_t connId, uint16_t handle) {
+	uint16_t value = 0;
+	::xSemaphoreTake(m_connectionLock, portMAX_DELAY);
+	if (connId < BLE_SERVER_MAX_CONNECTIONS && m_connections[connId].connected) {
+		auto it = m_connections[connId].cccd.find(handle);
+		if (it != m_connections[connId].cccd.end()) {
+			value = it->second;
+		}
+	}
+	::xSemaphoreGive(m_connectionLock);
+	return value;
+} // getCCCD
+
+
+/**
+ * @brief Get the state we hold for a connection.
+ *
+ * The entry is only changed on the %BLE event task so it may be used there without further locking.
+ *
+ * @param [in] connId The connection id.
+ * @return The connection state or nullptr if the connection id is out of range.
+ */
+BLEServerConnection* BLEServer::getConnection(uint16_t connId) {
+	if (connId >= BLE_SERVER_MAX_CONNECTIONS) {
+		ESP_LOGE(LOG_TAG, "conn_id %d is beyond the %d connections we track", connId, BLE_SERVER_MAX_CONNECTIONS);
+		return nullptr;
+	}
+	return &m_connections[connId];
+} // getConnection
+
+
+/**
+ * @brief Get the id of the most recent connection.
+ *
+ * Within BLEServerCallbacks::onConnect() this is the connection that has just been made.
+ *
+ * @return The id of the most recent connection.
+ */
 uint16_t BLEServer::getConnId() {
 	return m_connId;
-}
+} // getConnId
 
 
 /**
@@ -118,10 +167,107 @@ uint32_t BLEServer::getConnectedCount() {
 } // getConnectedCount
 
 
+/**
+ * @brief Get the parameters a connection is running with.
+ * @param [in] connId The connection of the client.
+ * @return The parameters last reported for the connection.  Zero where none have been reported.
+ */
+BLEConnectionParams BLEServer::getConnectionParams(uint16_t connId) {
+	if (connId >= BLE_SERVER_MAX_CONNECTIONS) {
+		return BLEConnectionParams();
+	}
+	return m_connections[connId].params;
+} // getConnectionParams
+
+
 uint16_t BLEServer::getGattsIf() {
 	return m_gatts_if;
 }
 
+
+/**
+ * @brief Get the notification queue of a connection.
+ * @param [in] connId The connection id.
+ * @return The notification queue or nullptr if the connection has never been seen.
+ */
+BLENotifyQueue* BLEServer::getNotifyQueue(uint16_t connId) {
+	if (connId >= BLE_SERVER_MAX_CONNECTIONS) {
+		return nullptr;
+	}
+	return m_connections[connId].pNotifyQueue;
+} // getNotifyQueue
+
+
+/**
+ * @brief Get the MTU negotiated with a client.
+ * @param [in] connId The connection of the client.
+ * @return The MTU of the connection.  The default of 23 if none has been negotiated.
+ */
+uint16_t BLEServer::getPeerMTU(uint16_t connId) {
+	if (connId >= BLE_SERVER_MAX_CONNECTIONS) {
+		return 23;
+	}
+	return m_connections[connId].mtu;
+} // getPeerMTU
+
+
+/**
+ * @brief Get the connections that should receive a notification or indication.
+ * @param [in] p2902 The 0x2902 descriptor of the characteristic or nullptr if it has none.  Without one,
+ * every connected client is a subscriber.
+ * @param [in] flag The configuration bit to test.  1 for notifications and 2 for indications.
+ * @return The ids of the subscribed connections.
+ */
+std::vector<uint16_t> BLEServer::getSubscribers(BLEDescriptor* p2902, uint16_t flag) {
+	std::vector<uint16_t> connIds;
+	::xSemaphoreTake(m_connectionLock, portMAX_DELAY);
+	for (uint16_t connId = 0; connId < BLE_SERVER_MAX_CONNECTIONS; connId++) {
+		BLEServerConnection& connection = m_connections[connId];
+		if (!connection.connected) {
+			continue;
+		}
+		if (p2902 != nullptr) {
+			auto it = connection.cccd.find(p2902->getHandle());
+			if (it == connection.cccd.end() || (it->second & flag) == 0) {
+				continue;
+			}
+		}
+		connIds.push_back(connId);
+	}
+	::xSemaphoreGive(m_connectionLock);
+	return connIds;
+} // getSubscribers
+
+
+/**
+ * @brief Handle an execute write request.
+ *
+ * Execute write does not name a handle.  It commits or cancels every prepared write the client has made
+ * since its last execute, which we hold per connection, and the client then waits for a single response.
+ *
+ * @param [in] gatts_if
+ * @param [in] param
+ */
+void BLEServer::handleExecWrite(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param) {
+	BLEServerConnection* pConnection = getConnection(param->exec_write.conn_id);
+	if (pConnection != nullptr && pConnection->preparedHandle != 0) {
+		BLECharacteristic* pCharacteristic = m_attributeMap.getCharacteristic(pConnection->preparedHandle);
+		if (pCharacteristic != nullptr) {
+			pCharacteristic->handleGATTServerEvent(ESP_GATTS_EXEC_WRITE_EVT, gatts_if, param);
+		}
+		pConnection->preparedHandle = 0;
+		pConnection->preparedValue.cancel();
+	}
+
+	esp_err_t errRc = ::esp_ble_gatts_send_response(
+			gatts_if,
+			param->exec_write.conn_id,
+			param->exec_write.trans_id, ESP_GATT_OK, nullptr);
+	if (errRc != ESP_OK) {
+		ESP_LOGE(LOG_TAG, "esp_ble_gatts_send_response: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+	}
+} // handleExecWrite
+
 /**
  * @brief Handle a received GAP event.
  *
@@ -152,6 +298,70 @@ void BLEServer::handleGAPEvent(
 			break;
 		}
 
+		//
+		// ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT
+		//
+		// pkt_data_lenth_cmpl
+		// - esp_bt_status_t                  status
+		// - esp_ble_pkt_data_length_params_t params
+		//
+		// The event does not say which connection it is for.  The stack completes requests in the order they
+		// were made, so it is credited to the lowest connection with a request outstanding.
+		//
+		case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT: {
+			for (uint16_t connId = 0; connId < BLE_SERVER_MAX_CONNECTIONS; connId++) {
+				BLEServerConnection& connection = m_connections[connId];
+				if (!connection.connected || !connection.dataLengthPending) {
+					continue;
+				}
+				connection.dataLengthPending = false;
+				if (param->pkt_data_lenth_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+					ESP_LOGE(LOG_TAG, "Data length change failed on conn_id %d: status=%d", connId, param->pkt_data_lenth_cmpl.status);
+					break;
+				}
+				connection.params.txOctets = param->pkt_data_lenth_cmpl.params.tx_len;
+				connection.params.rxOctets = param->pkt_data_lenth_cmpl.params.rx_len;
+				if (m_pServerCallbacks != nullptr) {
+					m_pServerCallbacks->onConnParamsUpdate(this, connId, connection.params);
+				}
+				break;
+			}
+			break;
+		} // ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT
+
+		//
+		// ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+		//
+		// update_conn_params
+		// - esp_bt_status_t status
+		// - esp_bd_addr_t   bda
+		// - uint16_t        min_int
+		// - uint16_t        max_int
+		// - uint16_t        latency
+		// - uint16_t        conn_int
+		// - uint16_t        timeout
+		//
+		case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+			for (uint16_t connId = 0; connId < BLE_SERVER_MAX_CONNECTIONS; connId++) {
+				BLEServerConnection& connection = m_connections[connId];
+				if (!connection.connected || memcmp(connection.address, param->update_conn_params.bda, sizeof(esp_bd_addr_t)) != 0) {
+					continue;
+				}
+				if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+					ESP_LOGE(LOG_TAG, "Connection parameter update failed on conn_id %d: status=%d", connId, param->update_conn_params.status);
+					break;
+				}
+				connection.params.interval = param->update_conn_params.conn_int;
+				connection.params.latency  = param->update_conn_params.latency;
+				connection.params.timeout  = param->update_conn_params.timeout;
+				if (m_pServerCallbacks != nullptr) {
+					m_pServerCallbacks->onConnParamsUpdate(this, connId, connection.params);
+				}
+				break;
+			}
+			break;
+		} // ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+
 		default:
 			break;
 	}
@@ -172,10 +382,33 @@ void BLEServer::handleGATTServerEvent(
 		esp_gatt_if_t             gatts_if,
 		esp_ble_gatts_cb_param_t* param) {
 
-	ESP_LOGD(LOG_TAG, ">> handleGATTServerEvent: %s",
-		BLEUtils::gattServerEventTypeToString(event).c_str());
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, ">> handleGATTServerEvent: %s",
+			BLEUtils::gattServerEventTypeToString(event).c_str());
+	}
+
+	// Every notification and indication is sent through the queue of its connection, which passes each confirmation
+	// on to its sender.
+	if (event == ESP_GATTS_CONF_EVT) {
+		BLENotifyQueue* pQueue = getNotifyQueue(param->conf.conn_id);
+		if (pQueue != nullptr && pQueue->handleConfirm(param)) {
+			ESP_LOGD(LOG_TAG, "<< handleGATTServerEvent");
+			return;
+		}
+	}
 
-	// Invoke the handler for every Service we have.
+	if (event == ESP_GATTS_EXEC_WRITE_EVT) {
+		handleExecWrite(gatts_if, param);
+		ESP_LOGD(LOG_TAG, "<< handleGATTServerEvent");
+		return;
+	}
+
+	// Events aimed at a single attribute are routed by handle straight to their owner.  Everything else, such as
+	// connection and creation events, is offered to every Service we have.
+	if (m_attributeMap.handleGATTServerEvent(event, gatts_if, param)) {
+		ESP_LOGD(LOG_TAG, "<< handleGATTServerEvent");
+		return;
+	}
 	m_serviceMap.handleGATTServerEvent(event, gatts_if, param);
 
 	switch(event) {
@@ -199,6 +432,28 @@ void BLEServer::handleGATTServerEvent(
 		//
 		case ESP_GATTS_CONNECT_EVT: {
 			m_connId = param->connect.conn_id; // Save the connection id.
+			BLEServerConnection* pConnection = getConnection(m_connId);
+			if (pConnection != nullptr) {
+				::xSemaphoreTake(m_connectionLock, portMAX_DELAY);
+				pConnection->connected = true;
+				pConnection->mtu       = 23;
+				pConnection->cccd.clear();
+				::xSemaphoreGive(m_connectionLock);
+				pConnection->preparedHandle = 0;
+				pConnection->preparedValue.cancel();
+				pConnection->readHandle = 0;
+				pConnection->readOffset = 0;
+				memcpy(pConnection->address, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+				pConnection->params            = BLEConnectionParams();
+				pConnection->dataLengthPending = false;
+				setConnectionProfile(m_connId, m_connectionProfile);
+
+				// Queues are kept for the life of the server and reused when a connection id is reused.
+				if (pConnection->pNotifyQueue == nullptr) {
+					pConnection->pNotifyQueue = new BLENotifyQueue(m_connId, m_notifyQueueDepth, m_notifyMaxInFlight, m_notifyCoalesce);
+				}
+				pConnection->pNotifyQueue->open(gatts_if);
+			}
 			if (m_pServerCallbacks != nullptr) {
 				m_pServerCallbacks->onConnect(this);
 			}
@@ -207,6 +462,21 @@ void BLEServer::handleGATTServerEvent(
 		} // ESP_GATTS_CONNECT_EVT
 
 
+		// ESP_GATTS_CONGEST_EVT
+		//
+		// congest:
+		// - uint16_t conn_id
+		// - bool     congested
+		//
+		// Hold back queued notifications while the stack reports the link as congested.
+		case ESP_GATTS_CONGEST_EVT: {
+			if (getNotifyQueue(param->congest.conn_id) != nullptr) {
+				getNotifyQueue(param->congest.conn_id)->setCongested(param->congest.congested);
+			}
+			break;
+		} // ESP_GATTS_CONGEST_EVT
+
+
 		// ESP_GATTS_CREATE_EVT
 		// Called when a new service is registered as having been created.
 		//
@@ -234,6 +504,20 @@ void BLEServer::handleGATTServerEvent(
 		// we also want to start advertising again.
 		case ESP_GATTS_DISCONNECT_EVT: {
 			m_connectedCount--;                          // Decrement the number of connected devices count.
+			BLEServerConnection* pConnection = getConnection(param->disconnect.conn_id);
+			if (pConnection != nullptr) {
+				::xSemaphoreTake(m_connectionLock, portMAX_DELAY);
+				pConnection->connected = false;
+				pConnection->cccd.clear();
+				::xSemaphoreGive(m_connectionLock);
+				pConnection->preparedHandle = 0;
+				pConnection->preparedValue.cancel();
+				pConnection->readHandle = 0;
+				pConnection->readOffset = 0;
+				if (pConnection->pNotifyQueue != nullptr) {
+					pConnection->pNotifyQueue->close();
+				}
+			}
 			if (m_pServerCallbacks != nullptr) {         // If we have callbacks, call now.
 				m_pServerCallbacks->onDisconnect(this);
 			}
@@ -242,6 +526,24 @@ void BLEServer::handleGATTServerEvent(
 		} // ESP_GATTS_DISCONNECT_EVT
 
 
+		// ESP_GATTS_MTU_EVT
+		//
+		// mtu:
+		// - uint16_t conn_id
+		// - uint16_t mtu
+		//
+		// Each client negotiates its own MTU.
+		case ESP_GATTS_MTU_EVT: {
+			if (getConnection(param->mtu.conn_id) != nullptr) {
+				getConnection(param->mtu.conn_id)->mtu = param->mtu.mtu;
+			}
+			if (getNotifyQueue(param->mtu.conn_id) != nullptr) {
+				getNotifyQueue(param->mtu.conn_id)->setMTU(param->mtu.mtu);
+			}
+			break;
+		} // ESP_GATTS_MTU_EVT
+
+
 		// ESP_GATTS_READ_EVT - A request to read the value of a characteristic has arrived.
 		//
 		// read:
@@ -309,6 +611,22 @@ void BLEServer::registerApp() {
 } // registerApp
 
 
+/**
+ * @brief Record the Client Characteristic Configuration a client has written to a 0x2902 descriptor.
+ * @param [in] connId The connection of the client.
+ * @param [in] handle The handle of the 0x2902 descriptor.
+ * @param [in] value The configuration value.
+ */
+void BLEServer::setCCCD(uint16_t connId, uint16_t handle, uint16_t value) {
+	if (connId >= BLE_SERVER_MAX_CONNECTIONS) {
+		return;
+	}
+	::xSemaphoreTake(m_connectionLock, portMAX_DELAY);
+	m_connections[connId].cccd[handle] = value;
+	::xSemaphoreGive(m_connectionLock);
+} // setCCCD
+
+
 /**
  * @brief Set the server callbacks.
  *
@@ -323,6 +641,62 @@ void BLEServer::setCallbacks(BLEServerCallbacks* pCallbacks) {
 } // setCallbacks
 
 
+/**
+ * @brief Set the connection profile asked for on every connection.
+ *
+ * The profile is asked for on each client already connected and on each that connects from now on.  It may
+ * be changed at any time, for example to a low latency profile while the user waits on the device.
+ *
+ * @param [in] profile The profile to ask for.
+ */
+void BLEServer::setConnectionProfile(const BLEConnectionProfile& profile) {
+	m_connectionProfile = profile;
+	for (uint16_t connId = 0; connId < BLE_SERVER_MAX_CONNECTIONS; connId++) {
+		if (m_connections[connId].connected) {
+			setConnectionProfile(connId, profile);
+		}
+	}
+} // setConnectionProfile
+
+
+/**
+ * @brief Ask for a connection profile on one connection.
+ *
+ * As a peripheral we may only ask.  The client decides and the outcome is reported to
+ * BLEServerCallbacks::onConnParamsUpdate().
+ *
+ * @param [in] connId The connection of the client.
+ * @param [in] profile The profile to ask for.
+ */
+void BLEServer::setConnectionProfile(uint16_t connId, const BLEConnectionProfile& profile) {
+	BLEServerConnection* pConnection = getConnection(connId);
+	if (pConnection == nullptr || !pConnection->connected) {
+		return;
+	}
+	pConnection->dataLengthPending = profile.txOctets != 0;   // Before the request, as the reply may beat us back.
+	if (profile.apply(pConnection->address) != ESP_OK) {
+		pConnection->dataLengthPending = false;
+	}
+} // setConnectionProfile
+
+
+/**
+ * @brief Set the shape of the notification queues used by BLECharacteristic::notifyAsync().
+ *
+ * Each connection has its own queue, created when the connection is first seen.  Changes apply to queues
+ * created after this call so it should be made before clients connect.
+ *
+ * @param [in] depth The number of notifications that may wait to be sent.
+ * @param [in] maxInFlight The number of notifications that may be with the %BLE stack at once.
+ * @param [in] coalesce True if a newer value for a characteristic should replace one still waiting.
+ */
+void BLEServer::setNotifyQueue(uint8_t depth, uint8_t maxInFlight, bool coalesce) {
+	m_notifyQueueDepth  = depth;
+	m_notifyMaxInFlight = maxInFlight;
+	m_notifyCoalesce    = coalesce;
+} // setNotifyQueue
+
+
 /**
  * @brief Start advertising.
  *
@@ -349,4 +723,12 @@ void BLEServerCallbacks::onDisconnect(BLEServer* pServer) {
 	ESP_LOGD("BLEServerCallbacks", "<< onDisconnect()");
 } // onDisconnect
 
+
+void BLEServerCallbacks::onConnParamsUpdate(BLEServer* pServer, uint16_t connId, BLEConnectionParams params) {
+	ESP_LOGD("BLEServerCallbacks", ">> onConnParamsUpdate(): Default");
+	ESP_LOGD("BLEServerCallbacks", "conn_id: %d, interval: %d, latency: %d, timeout: %d, txOctets: %d",
+		connId, params.interval, params.latency, params.timeout, params.txOctets);
+	ESP_LOGD("BLEServerCallbacks", "<< onConnParamsUpdate()");
+} // onConnParamsUpdate
+
 #endif // CONFIG_BT_ENABLED
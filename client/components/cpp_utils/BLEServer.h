@@ -13,17 +13,88 @@
 
 #include <string>
 #include <string.h>
+#include <map>
+#include <vector>
 
 #include "BLEUUID.h"
 #include "BLEAdvertising.h"
 #include "BLECharacteristic.h"
 #include "BLEService.h"
 #include "BLESecurity.h"
+#include "BLEConnectionProfile.h"
+#include "BLENotifyQueue.h"
+#include "BLEValue.h"
 #include "FreeRTOS.h"
 
+#if defined(CONFIG_BT_ACL_CONNECTIONS)
+#define BLE_SERVER_MAX_CONNECTIONS CONFIG_BT_ACL_CONNECTIONS
+#else
+#define BLE_SERVER_MAX_CONNECTIONS 4
+#endif
+
 class BLEServerCallbacks;
 
 
+/**
+ * @brief The state a %BLE server keeps for each connected client.
+ *
+ * Clients negotiate their own MTU, subscribe to notifications and indications through their own view of
+ * each 0x2902 descriptor and may have their own long reads and prepared writes in progress.  None of this
+ * may leak from one client to another.  A client prepares the value of one characteristic at a time, in a
+ * buffer allocated once with the connection.
+ */
+struct BLEServerConnection {
+	bool                            connected    = false;
+	esp_bd_addr_t                   address      = {0};
+	uint16_t                        mtu          = 23;
+	BLEConnectionParams             params;         // As last reported by the BLE stack.
+	bool                            dataLengthPending = false;   // A data length change has been asked for.
+	BLENotifyQueue*                 pNotifyQueue = nullptr;
+	std::map<uint16_t, uint16_t>    cccd;           // Client Characteristic Configuration by 0x2902 descriptor handle.
+	uint16_t                        preparedHandle = 0;   // The characteristic whose value is being prepared, if any.
+	BLEValue                        preparedValue;  // The prepared write, built up in place part by part.
+	uint16_t                        readHandle   = 0;   // The characteristic last read, whose long read may be in progress.
+	uint16_t                        readOffset   = 0;   // How far the long read of readHandle has got.
+};
+
+
+/**
+ * @brief A dense table mapping attribute handles to the characteristics and descriptors of a %BLE server.
+ *
+ * Attribute level GATT server events name the handle they are aimed at.  Looking that handle up here lets us
+ * deliver the event straight to its owner instead of passing it through every service and characteristic.
+ */
+class BLEAttributeMap {
+public:
+	BLEAttributeMap();
+	BLECharacteristic* getCharacteristic(uint16_t handle);
+	BLEDescriptor*     getDescriptor(uint16_t handle);
+	bool               handleGATTServerEvent(
+		esp_gatts_cb_event_t      event,
+		esp_gatt_if_t             gatts_if,
+		esp_ble_gatts_cb_param_t* param);
+	void               setByHandle(uint16_t handle, BLECharacteristic* pCharacteristic);
+	void               setByHandle(uint16_t handle, BLEDescriptor* pDescriptor);
+	std::string        toString();
+
+private:
+	struct Entry {
+		BLECharacteristic* pCharacteristic = nullptr;
+		BLEDescriptor*     pDescriptor     = nullptr;
+	};
+	std::vector<Entry> m_table;      // Indexed by handle - m_baseHandle.
+	uint16_t           m_baseHandle;
+
+	bool   dispatch(
+		uint16_t                  handle,
+		esp_gatts_cb_event_t      event,
+		esp_gatt_if_t             gatts_if,
+		esp_ble_gatts_cb_param_t* param);
+	Entry* getEntry(uint16_t handle);
+	Entry* makeEntry(uint16_t handle);
+};
+
+
 /**
  * @brief A data structure that manages the %BLE servers owned by a BLE server.
  */
@@ -42,7 +113,7 @@ public:
 	std::string toString();
 
 private:
-	std::map<std::string, BLEService*> m_uuidMap;
+	std::map<BLEUUID, BLEService*>     m_uuidMap;
 	std::map<uint16_t, BLEService*>    m_handleMap;
 };
 
@@ -53,10 +124,16 @@ private:
 class BLEServer {
 public:
 	uint32_t        getConnectedCount();
+	uint16_t        getConnId();
+	BLEConnectionParams getConnectionParams(uint16_t connId);
 	BLEService*     createService(const char* uuid);	
 	BLEService*     createService(BLEUUID uuid, uint32_t numHandles=15);
 	BLEAdvertising* getAdvertising();
+	uint16_t        getPeerMTU(uint16_t connId);
 	void            setCallbacks(BLEServerCallbacks* pCallbacks);
+	void            setConnectionProfile(const BLEConnectionProfile& profile);
+	void            setConnectionProfile(uint16_t connId, const BLEConnectionProfile& profile);
+	void            setNotifyQueue(uint8_t depth, uint8_t maxInFlight, bool coalesce = false);
 	void            startAdvertising();
 
 
@@ -64,6 +141,7 @@ private:
 	BLEServer();
 	friend class BLEService;
 	friend class BLECharacteristic;
+	friend class BLEDescriptor;
 	friend class BLEDevice;
 	esp_ble_adv_data_t  m_adv_data;
 	uint16_t            m_appId;
@@ -74,14 +152,26 @@ private:
 	FreeRTOS::Semaphore m_semaphoreRegisterAppEvt = FreeRTOS::Semaphore("RegisterAppEvt");
 	FreeRTOS::Semaphore m_semaphoreCreateEvt = FreeRTOS::Semaphore("CreateEvt");
 	BLEServiceMap       m_serviceMap;
+	BLEAttributeMap     m_attributeMap;
 	BLEServerCallbacks* m_pServerCallbacks;
-
-	void            createApp(uint16_t appId);
-	uint16_t        getConnId();
-	uint16_t        getGattsIf();
-	void            handleGAPEvent(esp_gap_ble_cb_event_t event,	esp_ble_gap_cb_param_t *param);
-	void            handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
-	void            registerApp();
+	BLEServerConnection m_connections[BLE_SERVER_MAX_CONNECTIONS]; // Indexed by conn_id.
+	SemaphoreHandle_t   m_connectionLock;
+	uint8_t             m_notifyQueueDepth;
+	uint8_t             m_notifyMaxInFlight;
+	bool                m_notifyCoalesce;
+	BLEConnectionProfile m_connectionProfile;   // Asked for on every new connection.
+
+	void                  createApp(uint16_t appId);
+	uint16_t              getCCCD(uint16_t connId, uint16_t handle);
+	BLEServerConnection*  getConnection(uint16_t connId);
+	uint16_t              getGattsIf();
+	BLENotifyQueue*       getNotifyQueue(uint16_t connId);
+	std::vector<uint16_t> getSubscribers(BLEDescriptor* p2902, uint16_t flag);
+	void                  handleExecWrite(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t* param);
+	void                  handleGAPEvent(esp_gap_ble_cb_event_t event,	esp_ble_gap_cb_param_t *param);
+	void                  handleGATTServerEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+	void                  registerApp();
+	void                  setCCCD(uint16_t connId, uint16_t handle, uint16_t value);
 }; // BLEServer
 
 
@@ -108,6 +198,18 @@ public:
 	 * @param [in] pServer A reference to the %BLE server that received the existing client disconnection.
 	 */
 	virtual void onDisconnect(BLEServer* pServer);
+
+	/**
+	 * @brief Handle a change to the parameters of a connection.
+	 *
+	 * Called when the connection interval, slave latency, supervision timeout or data length of a
+	 * connection changes, whether we or the client asked for it.
+	 *
+	 * @param [in] pServer A reference to the %BLE server.
+	 * @param [in] connId The connection whose parameters changed.
+	 * @param [in] params The parameters the connection now runs with.
+	 */
+	virtual void onConnParamsUpdate(BLEServer* pServer, uint16_t connId, BLEConnectionParams params);
 }; // BLEServerCallbacks
 
 
@@ -40,9 +40,9 @@ public:
 
 
 private:
-	std::map<BLECharacteristic*, std::string> m_uuidMap;
+	std::map<BLECharacteristic*, BLEUUID> m_uuidMap;
 	std::map<uint16_t, BLECharacteristic*> m_handleMap;
-	std::map<BLECharacteristic*, std::string>::iterator m_iterator;
+	std::map<BLECharacteristic*, BLEUUID>::iterator m_iterator;
 };
 
 
@@ -10,13 +10,30 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_ENABLED)
 #include <esp_gatt_defs.h>
+#include <functional>
 #include <string>
 
 /**
  * @brief A model of a %BLE UUID.
+ *
+ * Whatever form a UUID is given in, it is held in its canonical 128 bit form so that UUIDs compare, order
+ * and hash by value without conversion.  The form it was given in is remembered and is what getNative()
+ * and bitSize() report, as the %BLE stack expects the short forms of well known UUIDs.
+ *
+ * A UUID written as a string literal of the form "6d124ed1-50f5-4ebf-b490-c3db81cbaa8c" is parsed by the
+ * compiler, so a static BLEUUID built from one costs nothing at run time.
+ *
+ * A UUID made from anything malformed, such as a string with a character that is not a hex digit or with
+ * its dashes out of place, is the null UUID, which has no value and a bitSize() of 0.
  */
 class BLEUUID {
 public:
+	/**
+	 * @brief Create a UUID from a string literal of the form "0000180d-0000-1000-8000-00805f9b34fb".
+	 * @param [in] uuid The string literal.
+	 */
+	constexpr BLEUUID(const char (&uuid)[37]) : BLEUUID(uuid, isUUIDString(uuid)) {
+	}
 	BLEUUID(std::string uuid);
 	BLEUUID(uint16_t uuid);
 	BLEUUID(uint32_t uuid);
@@ -27,13 +44,59 @@ public:
 	int            bitSize();   // Get the number of bits in this uuid.
 	bool           equals(BLEUUID uuid);
 	esp_bt_uuid_t* getNative();
+	size_t         hash() const;
 	BLEUUID        to128();
 	std::string    toString();
 	static BLEUUID fromString(std::string uuid);  // Create a BLEUUID from a string
 
+	bool operator==(const BLEUUID& uuid) const;
+	bool operator!=(const BLEUUID& uuid) const;
+	bool operator<(const BLEUUID& uuid) const;
+
 private:
-	esp_bt_uuid_t m_uuid;       // The underlying UUID structure that this class wraps.
-	bool          m_valueSet;   // Is there a value set for this instance.
+	constexpr BLEUUID(const char* uuid, bool valid) :
+		m_uuid128{
+			hexByte(uuid, 34, valid), hexByte(uuid, 32, valid), hexByte(uuid, 30, valid), hexByte(uuid, 28, valid),
+			hexByte(uuid, 26, valid), hexByte(uuid, 24, valid), hexByte(uuid, 21, valid), hexByte(uuid, 19, valid),
+			hexByte(uuid, 16, valid), hexByte(uuid, 14, valid), hexByte(uuid, 11, valid), hexByte(uuid, 9, valid),
+			hexByte(uuid, 6, valid),  hexByte(uuid, 4, valid),  hexByte(uuid, 2, valid),  hexByte(uuid, 0, valid) },
+		m_len(valid ? ESP_UUID_LEN_128 : 0),
+		m_native() {
+	}
+	static constexpr bool isHex(char c) {
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+	}
+	static constexpr uint8_t hexNibble(char c) {
+		return (c >= '0' && c <= '9') ? c - '0' :
+			(c >= 'a' && c <= 'f') ? c - 'a' + 10 : c - 'A' + 10;
+	}
+	static constexpr uint8_t hexByte(const char* pText, size_t offset, bool valid = true) {
+		return valid ? (hexNibble(pText[offset]) << 4) | hexNibble(pText[offset + 1]) : 0;
+	}
+	// Check that the 36 characters from offset on are hex digits with dashes at 8, 13, 18 and 23, and end there.
+	static constexpr bool isUUIDString(const char* pText, size_t offset = 0) {
+		return offset == 36 ? pText[36] == '\0' :
+			((offset == 8 || offset == 13 || offset == 18 || offset == 23) ? pText[offset] == '-' : isHex(pText[offset])) &&
+			isUUIDString(pText, offset + 1);
+	}
+	void setShort(uint32_t value, uint8_t len);
+
+	uint8_t       m_uuid128[16];  // The canonical 128 bit form, least significant byte first.
+	uint8_t       m_len;          // The length of the form we were given in, 0 if there is no value.
+	esp_bt_uuid_t m_native;       // The native form handed out by getNative().
 }; // BLEUUID
+
+
+namespace std {
+/**
+ * @brief Hash a UUID by value so that it may key an unordered container.
+ */
+template<> struct hash<BLEUUID> {
+	size_t operator()(const BLEUUID& uuid) const {
+		return uuid.hash();
+	}
+};
+} // namespace std
+
 #endif /* CONFIG_BT_ENABLED */
 #endif /* COMPONENTS_CPP_UTILS_BLEUUID_H_ */
@@ -1088,6 +1088,9 @@ const char* BLEUtils::devTypeToString(esp_bt_dev_type_t type) {
 void BLEUtils::dumpGapEvent(
 	esp_gap_ble_cb_event_t  event,
 	esp_ble_gap_cb_param_t* param) {
+	if (!LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		return;
+	}
 	ESP_LOGD(LOG_TAG, "Received a GAP event: %s", gapEventToString(event));
 	switch(event) {
 		//
@@ -1374,6 +1377,9 @@ void BLEUtils::dumpGattClientEvent(
 	esp_ble_gattc_cb_param_t* evtParam) {
 
 	//esp_ble_gattc_cb_param_t *evtParam = (esp_ble_gattc_cb_param_t *)param;
+	if (!LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		return;
+	}
 	ESP_LOGD(LOG_TAG, "GATT Event: %s", BLEUtils::gattClientEventTypeToString(event).c_str());
 	switch(event) {
 		//
@@ -1644,6 +1650,9 @@ void BLEUtils::dumpGattServerEvent(
 		esp_gatts_cb_event_t      event,
 		esp_gatt_if_t             gatts_if,
 		esp_ble_gatts_cb_param_t* evtParam) {
+	if (!LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		return;
+	}
 	ESP_LOGD(LOG_TAG, "GATT ServerEvent: %s", BLEUtils::gattServerEventTypeToString(event).c_str());
 	switch(event) {
 
@@ -8,6 +8,8 @@
 #if defined(CONFIG_BT_ENABLED)
 
 #include <esp_log.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "BLEValue.h"
 #ifdef ARDUINO_ARCH_ESP32
@@ -17,61 +19,77 @@
 static const char* LOG_TAG="BLEValue";
 
 BLEValue::BLEValue() {
-	m_accumulation = "";
-	m_value        = "";
-	m_readOffset   = 0;
+	m_pData              = (uint8_t*)malloc(ESP_GATT_MAX_ATTR_LEN);   // Allocate storage for the value.
+	m_length             = 0;
+	m_capacity           = m_pData == nullptr ? 0 : ESP_GATT_MAX_ATTR_LEN;
+	m_ownsData           = true;
+	m_readOffset         = 0;
 } // BLEValue
 
 
 /**
- * @brief Add a message part to the accumulation.
- * The accumulation is a growing set of data that is added to until a commit or cancel.
- * @param [in] part A message part being added.
+ * @brief Construct a value held in storage owned by the caller.
+ * @param [in] pStorage The storage for the value.  It must outlive the value.
+ * @param [in] capacity The size of the storage in bytes.
  */
-void BLEValue::addPart(std::string part) {
-	ESP_LOGD(LOG_TAG, ">> addPart: length=%d", part.length());
-	m_accumulation += part;
-} // addPart
+BLEValue::BLEValue(uint8_t* pStorage, size_t capacity) {
+	m_pData              = pStorage;
+	m_length             = 0;
+	m_capacity           = capacity;
+	m_ownsData           = false;
+	m_readOffset         = 0;
+} // BLEValue
+
+
+BLEValue::~BLEValue() {
+	if (m_ownsData) {
+		free(m_pData);
+	}
+} // ~BLEValue
 
 
 /**
- * @brief Add a message part to the accumulation.
- * The accumulation is a growing set of data that is added to until a commit or cancel.
- * @param [in] pData A message part being added.
- * @param [in] length The number of bytes being added.
+ * @brief Write a part of a value that arrives in parts, such as a prepared write.
+ *
+ * The part is copied straight to its offset in the buffer and the value grows to take in its end.  Any
+ * gap left before the offset keeps whatever the buffer held.
+ *
+ * @param [in] offset Where in the value the part belongs.
+ * @param [in] pData The part.
+ * @param [in] length The length of the part.
+ * @return True if the part was written, false if it does not fit.
  */
-void BLEValue::addPart(uint8_t* pData, size_t length) {
-	ESP_LOGD(LOG_TAG, ">> addPart: length=%d", length);
-	m_accumulation += std::string((char *)pData, length);
+bool BLEValue::addPart(uint16_t offset, uint8_t* pData, size_t length) {
+	ESP_LOGD(LOG_TAG, ">> addPart: offset=%d, length=%d", offset, length);
+	if (offset + length > m_capacity) {
+		ESP_LOGE(LOG_TAG, "Part ending at %d exceeds capacity %d", offset + length, m_capacity);
+		return false;
+	}
+	memcpy(m_pData + offset, pData, length);
+	if (offset + length > m_length) {
+		m_length = offset + length;
+	}
+	return true;
 } // addPart
 
 
 /**
- * @brief Cancel the current accumulation.
+ * @brief Discard the value, for example a prepared write that has been cancelled.
  */
 void BLEValue::cancel() {
 	ESP_LOGD(LOG_TAG, ">> cancel");
-	m_accumulation = "";
-	m_readOffset   = 0;
+	m_length     = 0;
+	m_readOffset = 0;
 } // cancel
 
 
 /**
- * @brief Commit the current accumulation.
- * When writing a value, we may find that we write it in "parts" meaning that the writes come in in pieces
- * of the overall message.  After the last part has been received, we may perform a commit which means that
- * we now have the complete message and commit the change as a unit.
+ * @brief Get the size of the buffer holding the value.
+ * @return The largest value, in bytes, that may be held.
  */
-void BLEValue::commit() {
-	ESP_LOGD(LOG_TAG, ">> commit");
-	// If there is nothing to commit, do nothing.
-	if (m_accumulation.length() == 0) {
-		return;
-	}
-	setValue(m_accumulation);
-	m_accumulation = "";
-	m_readOffset   = 0;
-} // commit
+size_t BLEValue::getCapacity() {
+	return m_capacity;
+} // getCapacity
 
 
 /**
@@ -79,7 +97,7 @@ void BLEValue::commit() {
  * @return A pointer to the data.
  */
 uint8_t* BLEValue::getData() {
-	return (uint8_t*)m_value.data();
+	return m_pData;
 }
 
 
@@ -88,7 +106,7 @@ uint8_t* BLEValue::getData() {
  * @return The length of the data in bytes.
  */
 size_t BLEValue::getLength() {
-	return m_value.length();
+	return m_length;
 } // getLength
 
 
@@ -102,10 +120,10 @@ uint16_t BLEValue::getReadOffset() {
 
 
 /**
- * @brief Get the current value.
+ * @brief Get a copy of the current value.
  */
 std::string BLEValue::getValue() {
-	return m_value;
+	return std::string((char*)m_pData, m_length);
 } // getValue
 
 
@@ -118,11 +136,38 @@ void BLEValue::setReadOffset(uint16_t readOffset) {
 } // setReadOffset
 
 
+/**
+ * @brief Hold the value in storage owned by the caller.
+ *
+ * The current value is copied into the new storage.  A buffer we allocated ourselves is released.
+ *
+ * @param [in] pStorage The storage for the value.  It must outlive the value.
+ * @param [in] capacity The size of the storage in bytes.
+ * @return True if the storage was adopted, false if it is too small for the current value.
+ */
+bool BLEValue::setStorage(uint8_t* pStorage, size_t capacity) {
+	if (m_length > capacity) {
+		ESP_LOGE(LOG_TAG, "Storage of %d bytes is too small for the current value of %d bytes", capacity, m_length);
+		return false;
+	}
+	if (m_length > 0) {
+		memmove(pStorage, m_pData, m_length);
+	}
+	if (m_ownsData) {
+		free(m_pData);
+	}
+	m_pData              = pStorage;
+	m_capacity           = capacity;
+	m_ownsData           = false;
+	return true;
+} // setStorage
+
+
 /**
  * @brief Set the current value.
  */
 void BLEValue::setValue(std::string value) {
-	m_value = value;
+	setValue((uint8_t*)value.data(), value.length());
 } // setValue
 
 
@@ -132,11 +177,15 @@ void BLEValue::setValue(std::string value) {
  * @param [in] The length of the new current value.
  */
 void BLEValue::setValue(uint8_t* pData, size_t length) {
-	m_value = std::string((char*)pData, length);
+	if (length > m_capacity) {
+		ESP_LOGE(LOG_TAG, "Size %d too large, must be no bigger than %d", length, m_capacity);
+		return;
+	}
+	if (pData != m_pData) {
+		memmove(m_pData, pData, length);
+	}
+	m_length = length;
 } // setValue
 
 
-
-
-
 #endif // CONFIG_BT_ENABLED
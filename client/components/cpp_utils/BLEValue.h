@@ -10,29 +10,42 @@
 #include "sdkconfig.h"
 #if defined(CONFIG_BT_ENABLED)
 #include <string>
+#include <esp_gatt_defs.h>
 
 /**
  * @brief The model of a %BLE value.
+ *
+ * The value is held in a buffer of fixed capacity, ESP_GATT_MAX_ATTR_LEN bytes by default, that is allocated
+ * once when the value is constructed.  Alternatively the application may supply the storage.  Setting the
+ * value copies it into the buffer and getData() / getLength() give access to it without copying.  A value
+ * arriving in parts, such as a prepared write, is built up in the buffer in place with addPart().
  */
 class BLEValue {
 public:
 	BLEValue();
-	void        addPart(std::string part);
-	void        addPart(uint8_t* pData, size_t length);
+	BLEValue(uint8_t* pStorage, size_t capacity);
+	~BLEValue();
+	bool        addPart(uint16_t offset, uint8_t* pData, size_t length);
 	void        cancel();
-	void        commit();
+	size_t      getCapacity();
 	uint8_t*    getData();
 	size_t      getLength();
 	uint16_t    getReadOffset();
 	std::string getValue();
 	void        setReadOffset(uint16_t readOffset);
+	bool        setStorage(uint8_t* pStorage, size_t capacity);
 	void        setValue(std::string value);
 	void        setValue(uint8_t* pData, size_t length);
 
 private:
-	std::string m_accumulation;
+	BLEValue(const BLEValue&);            // A value owns its buffer and is not copied.
+	BLEValue& operator=(const BLEValue&);
+
+	uint8_t*    m_pData;         // The buffer holding the value.
+	size_t      m_length;        // The length of the value.
+	size_t      m_capacity;      // The size of the buffer.
+	bool        m_ownsData;      // True if we allocated the buffer and must free it.
 	uint16_t    m_readOffset;
-	std::string m_value;
 };
 #endif // CONFIG_BT_ENABLED
 #endif /* COMPONENTS_CPP_UTILS_BLEVALUE_H_ */
@@ -0,0 +1,294 @@
+/*
+ * BLEWriteWindow.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <esp_err.h>
+#include <freertos/task.h>
+#include "BLEWriteWindow.h"
+#include "GeneralUtils.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEWriteWindow";
+
+static const EventBits_t WINDOW_CREDIT  = (1 << 0);   // A write may be issued, or the window has closed.
+static const EventBits_t WINDOW_DRAINED = (1 << 1);   // No write is outstanding.
+
+
+/**
+ * @brief Construct a write window.
+ * @param [in] size The number of writes that may be outstanding at once.
+ */
+BLEWriteWindow::BLEWriteWindow(uint8_t size) {
+	m_gattcIf   = ESP_GATT_IF_NONE;
+	m_connId    = 0;
+	m_open      = false;
+	m_congested = false;
+	m_suspended = false;
+	m_held      = false;
+	m_size      = size == 0 ? 1 : size;
+	m_inFlight  = 0;
+	m_lock      = ::xSemaphoreCreateMutex();
+	m_events    = ::xEventGroupCreate();
+	updateEvents();
+} // BLEWriteWindow
+
+
+BLEWriteWindow::~BLEWriteWindow() {
+	::vSemaphoreDelete(m_lock);
+	::vEventGroupDelete(m_events);
+} // ~BLEWriteWindow
+
+
+/**
+ * @brief Close the window because the connection has gone.
+ *
+ * Outstanding writes are forgotten and any callers waiting for credit are released.
+ */
+void BLEWriteWindow::close() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_open      = false;
+	m_congested = false;
+	m_suspended = false;
+	m_held      = false;
+	m_inFlight  = 0;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // close
+
+
+/**
+ * @brief Wait until every write issued through the window has been passed on by the %BLE stack.
+ *
+ * A caller that needs a following operation to be ordered after its writes without response calls this
+ * first.
+ *
+ * @param [in] timeoutMs How long to wait.
+ * @return True if no write is outstanding.
+ */
+bool BLEWriteWindow::drain(uint32_t timeoutMs) {
+	TickType_t start   = ::xTaskGetTickCount();
+	TickType_t timeout = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+
+	while(true) {
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		bool drained = m_inFlight == 0;
+		::xSemaphoreGive(m_lock);
+		if (drained) {
+			return true;
+		}
+		if (!wait(WINDOW_DRAINED, start, timeout)) {
+			ESP_LOGD(LOG_TAG, "Timed out draining writes for conn_id %d", m_connId);
+			return false;
+		}
+	}
+} // drain
+
+
+/**
+ * @brief Stop issuing writes so that a write with response can be issued once those outstanding are done.
+ *
+ * The %BLE stack reports a write with response and a write without response to the same characteristic
+ * with the same event, so the two must never be with the stack at once.  Writers wait until resume().
+ *
+ * @return True if no write is outstanding, so the write with response may be issued now.
+ */
+bool BLEWriteWindow::hold() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_held = true;
+	updateEvents();
+	bool drained = m_inFlight == 0;
+	::xSemaphoreGive(m_lock);
+	return drained;
+} // hold
+
+
+/**
+ * @brief Open the window for a newly connected server.
+ * @param [in] gattcIf The GATT client interface of the connection.
+ * @param [in] connId The connection the writes are sent on.
+ */
+void BLEWriteWindow::open(esp_gatt_if_t gattcIf, uint16_t connId) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_gattcIf   = gattcIf;
+	m_connId    = connId;
+	m_open      = true;
+	m_congested = false;
+	m_suspended = false;
+	m_held      = false;
+	m_inFlight  = 0;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // open
+
+
+/**
+ * @brief Return the credit of a write that the %BLE stack has finished with.
+ * @param [in] status The outcome reported by the stack.
+ */
+void BLEWriteWindow::release(esp_gatt_status_t status) {
+	if (status != ESP_GATT_OK) {
+		ESP_LOGE(LOG_TAG, "Write without response failed: status=%d", status);
+	}
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (m_inFlight > 0) {
+		m_inFlight--;
+	}
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // release
+
+
+/**
+ * @brief Let writers issue writes again once the write with response that held the window has completed.
+ */
+void BLEWriteWindow::resume() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_held = false;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // resume
+
+
+/**
+ * @brief Record whether the %BLE stack has reported the connection as congested.
+ * @param [in] congested True if the connection is congested.
+ */
+void BLEWriteWindow::setCongested(bool congested) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_congested = congested;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // setCongested
+
+
+/**
+ * @brief Set the number of writes that may be outstanding at once.
+ * @param [in] size The size of the window.
+ */
+void BLEWriteWindow::setSize(uint8_t size) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_size = size == 0 ? 1 : size;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // setSize
+
+
+/**
+ * @brief Hold writers until the window is opened again because the connection has gone but is expected back.
+ *
+ * Outstanding writes are forgotten.  Callers that write while the window is suspended wait, within their
+ * timeout, for the connection to return and are then sent in the order they arrive.
+ */
+void BLEWriteWindow::suspend() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_open      = false;
+	m_congested = false;
+	m_suspended = true;
+	m_held      = false;
+	m_inFlight  = 0;
+	updateEvents();
+	::xSemaphoreGive(m_lock);
+} // suspend
+
+
+/**
+ * @brief Bring the event bits into line with our state.
+ *
+ * Must be called with the lock held.  Every task waiting on a bit that becomes set is woken.
+ */
+void BLEWriteWindow::updateEvents() {
+	EventBits_t set = 0;
+	if ((!m_open && !m_suspended) || (m_open && !m_congested && !m_held && m_inFlight < m_size)) {
+		set |= WINDOW_CREDIT;
+	}
+	if (m_inFlight == 0) {
+		set |= WINDOW_DRAINED;
+	}
+	::xEventGroupClearBits(m_events, (WINDOW_CREDIT | WINDOW_DRAINED) & ~set);
+	if (set != 0) {
+		::xEventGroupSetBits(m_events, set);
+	}
+} // updateEvents
+
+
+/**
+ * @brief Wait for an event bit, counting time already spent against the timeout.
+ * @param [in] bits The bit to wait for.
+ * @param [in] start The tick count at which the caller started.
+ * @param [in] timeout The caller's timeout in ticks.
+ * @return True if the bit was set before the timeout expired.
+ */
+bool BLEWriteWindow::wait(EventBits_t bits, TickType_t start, TickType_t timeout) {
+	TickType_t remaining = portMAX_DELAY;
+	if (timeout != portMAX_DELAY) {
+		TickType_t waited = ::xTaskGetTickCount() - start;
+		if (waited >= timeout) {
+			return false;
+		}
+		remaining = timeout - waited;
+	}
+	return (::xEventGroupWaitBits(m_events, bits, pdFALSE, pdFALSE, remaining) & bits) != 0;
+} // wait
+
+
+/**
+ * @brief Issue a write without response once there is credit for it.
+ *
+ * The %BLE stack copies the value before the call returns so the caller may reuse its buffer at once.
+ *
+ * @param [in] handle The handle of the characteristic to write.
+ * @param [in] pData The value to write.
+ * @param [in] length The length of the value.
+ * @param [in] timeoutMs How long to wait for credit.
+ * @return True if the write was handed to the %BLE stack.
+ */
+bool BLEWriteWindow::write(uint16_t handle, uint8_t* pData, size_t length, uint32_t timeoutMs) {
+	TickType_t start   = ::xTaskGetTickCount();
+	TickType_t timeout = timeoutMs == portMAX_DELAY ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+
+	while(true) {
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		if (!m_open && !m_suspended) {
+			::xSemaphoreGive(m_lock);
+			return false;
+		}
+		bool haveCredit = m_open && !m_congested && !m_held && m_inFlight < m_size;
+		if (haveCredit) {
+			m_inFlight++;      // Claim the credit before we let go of the lock.
+			updateEvents();
+		}
+		esp_gatt_if_t gattcIf = m_gattcIf;
+		uint16_t      connId  = m_connId;
+		::xSemaphoreGive(m_lock);
+
+		if (haveCredit) {
+			// The stack's task may need our lock to report an earlier write so we must not hold it here.
+			esp_err_t errRc = ::esp_ble_gattc_write_char(
+				gattcIf,
+				connId,
+				handle,
+				length,
+				pData,
+				ESP_GATT_WRITE_TYPE_NO_RSP,
+				ESP_GATT_AUTH_REQ_NONE
+			);
+			if (errRc != ESP_OK) {
+				ESP_LOGE(LOG_TAG, "esp_ble_gattc_write_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+				release(ESP_GATT_OK);
+				return false;
+			}
+			return true;
+		}
+
+		if (!wait(WINDOW_CREDIT, start, timeout)) {
+			ESP_LOGD(LOG_TAG, "No write credit for conn_id %d", connId);
+			return false;
+		}
+	}
+} // write
+
+#endif /* CONFIG_BT_ENABLED */
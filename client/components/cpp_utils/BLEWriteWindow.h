@@ -0,0 +1,64 @@
+/*
+ * BLEWriteWindow.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEWRITEWINDOW_H_
+#define COMPONENTS_CPP_UTILS_BLEWRITEWINDOW_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_gattc_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+
+/**
+ * The number of writes without response that may be with the %BLE stack at once on a connection.
+ */
+#define BLE_CLIENT_DEFAULT_WRITE_WINDOW 4
+
+/**
+ * @brief A credit window for writes without response on one client connection.
+ *
+ * A write without response has no reply from the server so there is nothing to wait for once the %BLE stack
+ * has accepted it.  Rather than wait for the stack to report each write sent before issuing the next, the
+ * window lets up to a fixed number of writes be outstanding.  A credit is returned as the stack reports each
+ * write passed on for transmission.  While the stack reports the connection as congested, because the
+ * controller has run out of transmit buffers, no new writes are issued.  Writers that find no credit wait
+ * for one.  While the connection is down but expected back, writers wait for it to return.  While the
+ * client's operation queue holds the window for a write with response, writers wait for that to complete,
+ * as the %BLE stack reports both kinds of write with the same event.
+ */
+class BLEWriteWindow {
+public:
+	BLEWriteWindow(uint8_t size);
+	~BLEWriteWindow();
+
+	void close();
+	bool drain(uint32_t timeoutMs);
+	bool hold();
+	void open(esp_gatt_if_t gattcIf, uint16_t connId);
+	void release(esp_gatt_status_t status);
+	void resume();
+	void setCongested(bool congested);
+	void setSize(uint8_t size);
+	void suspend();
+	bool write(uint16_t handle, uint8_t* pData, size_t length, uint32_t timeoutMs);
+
+private:
+	esp_gatt_if_t      m_gattcIf;
+	uint16_t           m_connId;
+	bool               m_open;
+	bool               m_congested;
+	bool               m_suspended;   // The connection is down but expected back, so writers wait for it.
+	bool               m_held;        // A write with response is waiting for, or is with, the stack.
+	uint8_t            m_size;
+	uint8_t            m_inFlight;
+	SemaphoreHandle_t  m_lock;
+	EventGroupHandle_t m_events;   // Bits telling waiters that there is credit or that nothing is outstanding.
+
+	void updateEvents();
+	bool wait(EventBits_t bits, TickType_t start, TickType_t timeout);
+}; // BLEWriteWindow
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEWRITEWINDOW_H_ */
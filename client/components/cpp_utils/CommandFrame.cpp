@@ -0,0 +1,135 @@
+/*
+ * CommandFrame.cpp
+ */
+#include <esp_log.h>
+#include <sstream>
+#include "CommandFrame.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "CommandFrame";
+
+static const size_t HEADER_LENGTH = 7;
+
+
+CommandFrame::CommandFrame() : CommandFrame(0, 0) {
+} // CommandFrame
+
+
+/**
+ * @brief Construct a command with normal speed and amplitude and no timestamp.
+ * @param [in] opcode The command.
+ * @param [in] sequence The sender's number for the command.
+ */
+CommandFrame::CommandFrame(uint8_t opcode, uint16_t sequence) {
+	this->opcode       = opcode;
+	this->sequence     = sequence;
+	this->speed        = 0;
+	this->amplitude    = 0;
+	this->status       = OK;
+	this->hasTimestamp = false;
+	this->timestamp    = 0;
+} // CommandFrame
+
+
+/**
+ * @brief Make the acknowledgement of this command.
+ *
+ * The acknowledgement carries the command's sequence number and timestamp back to its sender.
+ *
+ * @param [in] status What became of the command.
+ * @return The acknowledgement.
+ */
+CommandFrame CommandFrame::ack(Status status) const {
+	CommandFrame frame(ACK, sequence);
+	frame.status       = status;
+	frame.hasTimestamp = hasTimestamp;
+	frame.timestamp    = timestamp;
+	return frame;
+} // ack
+
+
+/**
+ * @brief Decode a frame received from the air.
+ * @param [in] pData The received value.
+ * @param [in] length The length of the received value.
+ * @return True if the value is a frame of our version.
+ */
+bool CommandFrame::decode(const uint8_t* pData, size_t length) {
+	if (length < HEADER_LENGTH || pData[0] != VERSION) {
+		ESP_LOGD(LOG_TAG, "Not a version %d frame: length=%d", VERSION, length);
+		return false;
+	}
+	opcode       = pData[1];
+	sequence     = pData[2] | (pData[3] << 8);
+	hasTimestamp = (pData[4] & FLAG_TIMESTAMP) != 0;
+	speed        = opcode == ACK ? 0 : pData[5];
+	status       = opcode == ACK ? pData[5] : OK;
+	amplitude    = pData[6];
+	timestamp    = 0;
+	if (hasTimestamp) {
+		if (length < HEADER_LENGTH + 4) {
+			ESP_LOGD(LOG_TAG, "Frame too short for its timestamp: length=%d", length);
+			return false;
+		}
+		timestamp = pData[7] | (pData[8] << 8) | (pData[9] << 16) | ((uint32_t)pData[10] << 24);
+	}
+	return true;
+} // decode
+
+
+/**
+ * @brief Encode the frame for the air.
+ * @param [out] pData Where to encode the frame.  Must have room for MAX_LENGTH bytes.
+ * @return The length of the encoded frame.
+ */
+size_t CommandFrame::encode(uint8_t* pData) const {
+	pData[0] = VERSION;
+	pData[1] = opcode;
+	pData[2] = sequence & 0xff;
+	pData[3] = sequence >> 8;
+	pData[4] = hasTimestamp ? FLAG_TIMESTAMP : 0;
+	pData[5] = opcode == ACK ? status : speed;
+	pData[6] = amplitude;
+	if (!hasTimestamp) {
+		return HEADER_LENGTH;
+	}
+	pData[7]  = timestamp & 0xff;
+	pData[8]  = (timestamp >> 8) & 0xff;
+	pData[9]  = (timestamp >> 16) & 0xff;
+	pData[10] = timestamp >> 24;
+	return HEADER_LENGTH + 4;
+} // encode
+
+
+/**
+ * @brief Is this frame's sequence number newer than another?
+ *
+ * Sequence numbers wrap, so a number is newer if it is less than half the number space ahead.
+ *
+ * @param [in] sequence The sequence number to compare with.
+ * @return True if this frame is newer.
+ */
+bool CommandFrame::isNewerThan(uint16_t sequence) const {
+	return (int16_t)(this->sequence - sequence) > 0;
+} // isNewerThan
+
+
+/**
+ * @brief Return a string representation of the frame.
+ * @return A string representation of the frame.
+ */
+std::string CommandFrame::toString() const {
+	std::stringstream ss;
+	ss << "opcode: " << (int)opcode << ", sequence: " << sequence;
+	if (opcode == ACK) {
+		ss << ", status: " << (int)status;
+	} else {
+		ss << ", speed: " << (int)speed << ", amplitude: " << (int)amplitude;
+	}
+	if (hasTimestamp) {
+		ss << ", timestamp: " << timestamp;
+	}
+	return ss.str();
+} // toString
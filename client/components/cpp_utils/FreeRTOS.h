@@ -9,13 +9,22 @@
 #define MAIN_FREERTOS_H_
 #include <stdint.h>
 #include <string>
-#include <pthread.h>
+#include "sdkconfig.h"
 
 #include <freertos/FreeRTOS.h>   // Include the base FreeRTOS definitions.
 #include <freertos/task.h>       // Include the task definitions.
 #include <freertos/semphr.h>     // Include the semaphore definitions.
 #include <freertos/ringbuf.h>    // Include the ringbuffer definitions.
 
+/**
+ * Semaphores only remember their names and owners, for logging, when debug logging is compiled in.
+ */
+#if defined(CONFIG_LOG_DEFAULT_LEVEL) && CONFIG_LOG_DEFAULT_LEVEL >= 4
+#define FREERTOS_SEMAPHORE_NAMES 1
+#else
+#define FREERTOS_SEMAPHORE_NAMES 0
+#endif
+
 
 /**
  * @brief Interface to %FreeRTOS functions.
@@ -28,26 +37,34 @@ public:
 
 	static uint32_t getTimeSinceStart();
 
+	/**
+	 * @brief A binary semaphore that carries a value from the task that gives it to the task waiting on it.
+	 *
+	 * The usual pattern is for a task to take() the semaphore, start an operation and wait() for it.  The
+	 * task that learns the outcome gives the semaphore with a value, which wait() returns.  Names and
+	 * owners are string literals and are only kept when FREERTOS_SEMAPHORE_NAMES is set, so neither
+	 * construction nor take and give allocate memory.
+	 */
 	class Semaphore {
 	public:
-		Semaphore(std::string owner = "<Unknown>");
+		Semaphore(const char* name = "<Unknown>");
 		~Semaphore();
 		void        give();
 		void        give(uint32_t value);
 		void        giveFromISR();
-		void        setName(std::string name);
-		bool        take(std::string owner="<Unknown>");
-		bool        take(uint32_t timeoutMs, std::string owner="<Unknown>");
+		void        setName(const char* name);
+		bool        take(const char* owner = "<Unknown>");
+		bool        take(uint32_t timeoutMs, const char* owner = "<Unknown>");
 		std::string toString();
-		uint32_t    wait(std::string owner="<Unknown>");
+		uint32_t    wait(const char* owner = "<Unknown>");
 
 	private:
 		SemaphoreHandle_t m_semaphore;
-		pthread_mutex_t   m_pthread_mutex;
-		std::string       m_name;
-		std::string       m_owner;
 		uint32_t          m_value;
-		bool              m_usePthreads;
+#if FREERTOS_SEMAPHORE_NAMES
+		const char*       m_name;
+		const char*       m_owner;
+#endif
 	};
 };
 
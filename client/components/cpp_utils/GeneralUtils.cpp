@@ -22,6 +22,8 @@
 
 static const char* LOG_TAG = "GeneralUtils";
 
+esp_log_level_t GeneralUtils::m_logLevel = (esp_log_level_t) CONFIG_LOG_DEFAULT_LEVEL;
+
 static const char kBase64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
     "abcdefghijklmnopqrstuvwxyz"
     "0123456789+/";
@@ -291,6 +293,9 @@ void GeneralUtils::hexDump(uint8_t* pData, uint32_t length) {
  * @return N/A.
  */
 void GeneralUtils::hexDump(const uint8_t* pData, uint32_t length) {
+	if (!LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		return;
+	}
 	char ascii[80];
 	char hex[80];
 	char tempBuf[80];
@@ -327,6 +332,52 @@ void GeneralUtils::hexDump(const uint8_t* pData, uint32_t length) {
 } // hexDump
 
 
+/**
+ * @brief Set the log level of every tag.
+ *
+ * This is esp_log_level_set("*", level) but it also remembers the level so that LOG_LEVEL_ENABLED() can skip
+ * building log arguments that would be thrown away.  Call this rather than esp_log_level_set(), whose levels
+ * LOG_LEVEL_ENABLED() does not see.
+ *
+ * @param [in] level The new log level.
+ * @return N/A.
+ */
+void GeneralUtils::setLogLevel(esp_log_level_t level) {
+	m_logLevel = level;
+	::esp_log_level_set("*", level);
+} // setLogLevel
+
+
+/**
+ * @brief Format binary data as hex into a caller supplied buffer.
+ *
+ * No storage is allocated so this is safe to use from event handlers with a small stack buffer.  If the
+ * buffer is too small, only as many bytes as fit are formatted.  The result is always NUL terminated.
+ *
+ * @param [in] pBuffer The buffer to receive the hex string.
+ * @param [in] bufferSize The size of the buffer in bytes.
+ * @param [in] pData The data to format.
+ * @param [in] length The length of the data in bytes.
+ * @return The buffer, for use directly as a log argument.
+ */
+char* GeneralUtils::toHex(char* pBuffer, size_t bufferSize, const uint8_t* pData, size_t length) {
+	static const char hexDigits[] = "0123456789abcdef";
+	if (bufferSize == 0) {
+		return pBuffer;
+	}
+	if (length > (bufferSize - 1) / 2) {
+		length = (bufferSize - 1) / 2;
+	}
+	char* pOut = pBuffer;
+	for (size_t i = 0; i < length; i++) {
+		*pOut++ = hexDigits[pData[i] >> 4];
+		*pOut++ = hexDigits[pData[i] & 0x0f];
+	}
+	*pOut = '\0';
+	return pBuffer;
+} // toHex
+
+
 /**
  * @brief Convert an IP address to string.
  * @param ip The 4 byte IP address.
@@ -68,7 +68,8 @@ size_t               Memory::m_lastHeapSize = 0;
 	if (m_pRecords == nullptr) {
 		return;
 	}
-	esp_log_level_set("*", ESP_LOG_NONE);
+	esp_log_level_t logLevel = GeneralUtils::getLogLevel();
+	GeneralUtils::setLogLevel(ESP_LOG_NONE);
 	size_t count = heap_trace_get_count();
 	heap_trace_record_t record;
 	printf(">>> dumpRanges\n");
@@ -88,7 +89,7 @@ size_t               Memory::m_lastHeapSize = 0;
 		printf("\n");
 	}
 	printf("<<< dumpRanges\n");
-	esp_log_level_set("*", ESP_LOG_VERBOSE);
+	GeneralUtils::setLogLevel(logLevel);
 } // dumpRanges
 
 
@@ -0,0 +1,75 @@
+/*
+ * TelemetryFrame.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_TELEMETRYFRAME_H_
+#define COMPONENTS_CPP_UTILS_TELEMETRYFRAME_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * @brief One sample of the tie's state, taken on the tie's fixed telemetry cadence.
+ */
+struct TelemetrySample {
+	static const uint8_t CHANNELS  = 2;
+	static const uint8_t FLAG_BUSY = 1 << 0;   // A trajectory was playing.
+
+	uint16_t pulseUs[CHANNELS];   // The pulse width last sent to each servo, zero if none has been.
+	uint8_t  trajectory;          // The tie's number for the trajectory last played, zero if none has been.
+	uint8_t  flags;
+	uint8_t  queueDepth;          // Commands waiting for the motion engine.
+	uint16_t latencyMs;           // From the last command arriving to its trajectory being played.
+	uint32_t freeHeap;            // Bytes.
+};
+
+
+/**
+ * @brief A batch of consecutive telemetry samples sent in one notification.
+ *
+ * On the air a frame is:
+ *
+ * | Offset | Size | Field                                                        |
+ * |--------|------|--------------------------------------------------------------|
+ * | 0      | 1    | Version, VERSION                                             |
+ * | 1      | 1    | Number of samples                                            |
+ * | 2      | 2    | Sequence number of the first sample, little endian           |
+ * | 4      | 2    | Time between samples in milliseconds, little endian          |
+ * | 6      | 13   | Each sample in turn                                          |
+ *
+ * and a sample is:
+ *
+ * | Offset | Size | Field                                                        |
+ * |--------|------|--------------------------------------------------------------|
+ * | 0      | 4    | Pulse width of each channel in microseconds, little endian   |
+ * | 4      | 1    | Trajectory                                                   |
+ * | 5      | 1    | Flags                                                        |
+ * | 6      | 1    | Queue depth                                                  |
+ * | 7      | 2    | Latency in milliseconds, little endian                       |
+ * | 9      | 4    | Free heap in bytes, little endian                            |
+ *
+ * Samples are numbered one after another and taken periodMs apart, so a receiver can place each in time
+ * and count any that never reached it from the gaps in the numbering.
+ */
+class TelemetryFrame {
+public:
+	static const uint8_t VERSION       = 1;
+	static const size_t  HEADER_LENGTH = 6;
+	static const size_t  SAMPLE_LENGTH = 13;
+	static const uint8_t MAX_SAMPLES   = 16;
+	static const size_t  MAX_LENGTH    = HEADER_LENGTH + MAX_SAMPLES * SAMPLE_LENGTH;
+
+	TelemetryFrame();
+
+	static uint8_t capacity(uint16_t mtu);
+	bool           decode(const uint8_t* pData, size_t length);
+	size_t         encode(uint8_t* pData) const;
+	std::string    toString() const;
+
+	uint16_t        sequence;    // Of the first sample.
+	uint16_t        periodMs;
+	uint8_t         count;
+	TelemetrySample samples[MAX_SAMPLES];
+}; // TelemetryFrame
+
+#endif /* COMPONENTS_CPP_UTILS_TELEMETRYFRAME_H_ */
@@ -0,0 +1,16 @@
+/*
+ * esp_log.h
+ *
+ * Host stand-in for the ESP-IDF logging macros.  Logging is compiled out.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_LOG_H_
+#define HOST_TEST_STUBS_ESP_LOG_H_
+
+#define ESP_LOGE(tag, format, ...) do { (void)(tag); } while(0)
+#define ESP_LOGW(tag, format, ...) do { (void)(tag); } while(0)
+#define ESP_LOGI(tag, format, ...) do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, format, ...) do { (void)(tag); } while(0)
+#define ESP_LOGV(tag, format, ...) do { (void)(tag); } while(0)
+
+#endif /* HOST_TEST_STUBS_ESP_LOG_H_ */
@@ -0,0 +1,211 @@
+/*
+ * test_gesture_engine.cpp
+ *
+ * Replays traces of button edges through a ButtonEdgeRing into a GestureEngine, the way gesture_task does,
+ * and checks which gestures come out and when.  Each press is traced as both contacts would see it,
+ * bounce included.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "GestureEngine.h"
+
+#define PIN_NO 1   // Normally open, closes when pressed.
+#define PIN_NC 2   // Normally closed, closes when released.
+
+#define MS 1000
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+/**
+ * @brief A trace of edges and the gestures that replaying it reports.
+ */
+class Replay {
+public:
+	struct Report {
+		GestureEngine::Gesture gesture;
+		int64_t                timeUs;
+	};
+
+	// Trace a press that goes down at downUs and comes up again holdUs later.
+	void press(int64_t downUs, int64_t holdUs) {
+		add(downUs,               PIN_NC, 1);
+		add(downUs,               PIN_NO, 0);
+		add(downUs + MS,          PIN_NO, 1);   // Bounce.
+		add(downUs + MS,          PIN_NO, 0);
+		add(downUs + holdUs,      PIN_NO, 1);
+		add(downUs + holdUs,      PIN_NC, 0);
+		add(downUs + holdUs + MS, PIN_NC, 1);   // Bounce.
+		add(downUs + holdUs + MS, PIN_NC, 0);
+	}
+
+	// Feed the trace to the engine, waking at each deadline as the task would, until nothing is pending.
+	void run() {
+		GestureEngine engine(PIN_NO, PIN_NC, callback, this);
+		ButtonEdgeRing ring;
+		for (size_t i = 0; i < m_edges.size(); i++) {
+			while (engine.getDeadline() <= m_edges[i].timeUs) {
+				engine.advance(engine.getDeadline());
+			}
+			CHECK(ring.push(m_edges[i]));
+			ButtonEdge edge;
+			while (ring.pop(&edge)) {
+				engine.edge(edge);
+			}
+		}
+		while (engine.getDeadline() != GestureEngine::NO_DEADLINE) {
+			engine.advance(engine.getDeadline());
+		}
+	}
+
+	std::vector<Report> m_reports;
+
+private:
+	void add(int64_t timeUs, uint8_t pin, uint8_t level) {
+		ButtonEdge edge = { timeUs, pin, level };
+		m_edges.push_back(edge);
+	}
+
+	static void callback(GestureEngine::Gesture gesture, int64_t timeUs, void* pArg) {
+		Report report = { gesture, timeUs };
+		((Replay*)pArg)->m_reports.push_back(report);
+	}
+
+	std::vector<ButtonEdge> m_edges;
+};
+
+
+// A press shorter than the noise threshold reports nothing, alone or in the gap after a press.
+static void test_noise_rejected() {
+	Replay alone;
+	alone.press(0, 5 * MS);
+	alone.run();
+	CHECK(alone.m_reports.empty());
+
+	Replay between;
+	between.press(0, 100 * MS);
+	between.press(200 * MS, 5 * MS);
+	between.run();
+	CHECK(between.m_reports.size() == 1);
+	if (between.m_reports.size() == 1) {
+		CHECK(between.m_reports[0].gesture == GestureEngine::SINGLE_PRESS);
+		CHECK(between.m_reports[0].timeUs == 100 * MS + 350 * MS);   // The glitch does not restart the gap.
+	}
+}
+
+
+// A single press is certain once the gap after its release has passed.
+static void test_single_press() {
+	Replay replay;
+	replay.press(0, 100 * MS);
+	replay.run();
+	CHECK(replay.m_reports.size() == 1);
+	if (replay.m_reports.size() == 1) {
+		CHECK(replay.m_reports[0].gesture == GestureEngine::SINGLE_PRESS);
+		CHECK(replay.m_reports[0].timeUs == 450 * MS);
+	}
+}
+
+
+// Two presses within the gap are one double press, and two further apart are two single presses.
+static void test_double_press() {
+	Replay replay;
+	replay.press(0, 100 * MS);
+	replay.press(300 * MS, 100 * MS);
+	replay.run();
+	CHECK(replay.m_reports.size() == 1);
+	if (replay.m_reports.size() == 1) {
+		CHECK(replay.m_reports[0].gesture == GestureEngine::DOUBLE_PRESS);
+		CHECK(replay.m_reports[0].timeUs == 400 * MS + 350 * MS);
+	}
+
+	Replay apart;
+	apart.press(0, 100 * MS);
+	apart.press(500 * MS, 100 * MS);
+	apart.run();
+	CHECK(apart.m_reports.size() == 2);
+	if (apart.m_reports.size() == 2) {
+		CHECK(apart.m_reports[0].gesture == GestureEngine::SINGLE_PRESS);
+		CHECK(apart.m_reports[1].gesture == GestureEngine::SINGLE_PRESS);
+	}
+}
+
+
+// A triple press cannot be extended and so is reported at its third release without waiting.
+static void test_triple_press() {
+	Replay replay;
+	replay.press(0, 80 * MS);
+	replay.press(200 * MS, 80 * MS);
+	replay.press(400 * MS, 80 * MS);
+	replay.run();
+	CHECK(replay.m_reports.size() == 1);
+	if (replay.m_reports.size() == 1) {
+		CHECK(replay.m_reports[0].gesture == GestureEngine::TRIPLE_PRESS);
+		CHECK(replay.m_reports[0].timeUs == 480 * MS);
+	}
+}
+
+
+// A hold is reported once, as soon as it has lasted long enough and not when it ends.
+static void test_long_hold() {
+	Replay replay;
+	replay.press(0, 2000 * MS);
+	replay.run();
+	CHECK(replay.m_reports.size() == 1);
+	if (replay.m_reports.size() == 1) {
+		CHECK(replay.m_reports[0].gesture == GestureEngine::LONG_HOLD);
+		CHECK(replay.m_reports[0].timeUs == 500 * MS);
+	}
+}
+
+
+// Presses followed within the gap by a hold make one long hold.  The presses before it are not reported.
+static void test_presses_then_hold() {
+	Replay replay;
+	replay.press(0, 100 * MS);
+	replay.press(200 * MS, 100 * MS);
+	replay.press(400 * MS, 1000 * MS);
+	replay.run();
+	CHECK(replay.m_reports.size() == 1);
+	if (replay.m_reports.size() == 1) {
+		CHECK(replay.m_reports[0].gesture == GestureEngine::LONG_HOLD);
+		CHECK(replay.m_reports[0].timeUs == 900 * MS);
+	}
+}
+
+
+// A full ring drops the newest edge and counts it, and hands back the rest in order.
+static void test_ring_full() {
+	ButtonEdgeRing ring;
+	for (uint32_t i = 0; i <= ButtonEdgeRing::DEPTH; i++) {
+		ButtonEdge edge = { (int64_t)i, PIN_NO, 0 };
+		CHECK(ring.push(edge) == (i < ButtonEdgeRing::DEPTH));
+	}
+	CHECK(ring.getDropped() == 1);
+	ButtonEdge edge;
+	for (uint32_t i = 0; i < ButtonEdgeRing::DEPTH; i++) {
+		CHECK(ring.pop(&edge) && edge.timeUs == (int64_t)i);
+	}
+	CHECK(!ring.pop(&edge));
+}
+
+
+int main() {
+	test_noise_rejected();
+	test_single_press();
+	test_double_press();
+	test_triple_press();
+	test_long_hold();
+	test_presses_then_hold();
+	test_ring_full();
+	printf("test_gesture_engine: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
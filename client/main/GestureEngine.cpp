@@ -0,0 +1,226 @@
+/*
+ * GestureEngine.cpp
+ */
+#include <esp_log.h>
+#include "GestureEngine.h"
+
+static const char* LOG_TAG = "GestureEngine";
+
+/**
+ * Presses under 10ms are noise, a hold of 500ms is long and presses more than 350ms apart are separate
+ * gestures.
+ */
+const GestureEngine::Timing GestureEngine::DEFAULT_TIMING = { 10000, 500000, 350000 };
+
+
+ButtonEdgeRing::ButtonEdgeRing() {
+	m_head    = 0;
+	m_tail    = 0;
+	m_dropped = 0;
+} // ButtonEdgeRing
+
+
+/**
+ * @brief Get the number of edges dropped because the ring was full.
+ * @return The number of edges dropped.
+ */
+uint32_t ButtonEdgeRing::getDropped() {
+	return m_dropped.load(std::memory_order_relaxed);
+} // getDropped
+
+
+/**
+ * @brief Take the oldest edge out of the ring.
+ *
+ * Called only from the consuming task.
+ *
+ * @param [out] pEdge The edge.
+ * @return True if there was an edge.
+ */
+bool ButtonEdgeRing::pop(ButtonEdge* pEdge) {
+	uint32_t tail = m_tail.load(std::memory_order_relaxed);
+	if (tail == m_head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	*pEdge = m_edges[tail & (DEPTH - 1)];
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+} // pop
+
+
+/**
+ * @brief Add an edge to the ring.
+ *
+ * Called only from the interrupt handler.  Never blocks.
+ *
+ * @param [in] edge The edge.
+ * @return True if the edge was added, false if the ring was full.
+ */
+bool ButtonEdgeRing::push(const ButtonEdge& edge) {
+	uint32_t head = m_head.load(std::memory_order_relaxed);
+	if (head - m_tail.load(std::memory_order_acquire) >= DEPTH) {
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	m_edges[head & (DEPTH - 1)] = edge;
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+} // push
+
+
+/**
+ * @brief Construct a gesture engine.
+ * @param [in] pressPin The pin of the normally open contact, which closes when the button is pressed.
+ * @param [in] releasePin The pin of the normally closed contact, which closes when the button is released.
+ * @param [in] gestureCallback Called with each gesture and the time at which it became certain.
+ * @param [in] pArg Passed to the callback.
+ * @param [in] timing The thresholds that tell gestures apart.
+ */
+GestureEngine::GestureEngine(uint8_t pressPin, uint8_t releasePin, void (*gestureCallback)(Gesture gesture, int64_t timeUs, void* pArg), void* pArg, const Timing& timing) {
+	m_pressPin        = pressPin;
+	m_releasePin      = releasePin;
+	m_gestureCallback = gestureCallback;
+	m_pArg            = pArg;
+	m_timing          = timing;
+	m_state           = IDLE;
+	m_count           = 0;
+	m_pressedUs       = 0;
+	m_releasedUs      = 0;
+	m_deadline        = NO_DEADLINE;
+} // GestureEngine
+
+
+/**
+ * @brief Let time pass, reporting any gesture that has become certain by now.
+ * @param [in] nowUs The current time.
+ */
+void GestureEngine::advance(int64_t nowUs) {
+	if (nowUs < m_deadline) {
+		return;
+	}
+	switch(m_state) {
+		case PRESSED: {
+			m_state    = HELD;
+			m_deadline = NO_DEADLINE;
+			commit(LONG_HOLD, m_pressedUs + m_timing.longHoldUs);
+			break;
+		}
+		case RELEASED: {
+			m_state    = IDLE;
+			m_deadline = NO_DEADLINE;
+			commit((Gesture)m_count, m_releasedUs + m_timing.pressGapUs);
+			break;
+		}
+		default: {
+			m_deadline = NO_DEADLINE;
+			break;
+		}
+	} // switch
+} // advance
+
+
+/**
+ * @brief Report a gesture to the callback.
+ * @param [in] gesture The gesture.
+ * @param [in] timeUs The time at which the gesture became certain.
+ */
+void GestureEngine::commit(Gesture gesture, int64_t timeUs) {
+	ESP_LOGD(LOG_TAG, "Gesture %d", gesture);
+	if (m_gestureCallback != nullptr) {
+		m_gestureCallback(gesture, timeUs, m_pArg);
+	}
+} // commit
+
+
+/**
+ * @brief Feed the engine the next edge.
+ *
+ * Edges must be fed in the order they happened.  Any gesture that became certain before the edge is
+ * reported first.
+ *
+ * @param [in] edge The edge.
+ */
+void GestureEngine::edge(const ButtonEdge& edge) {
+	advance(edge.timeUs);
+	if (edge.level != 0) {
+		return;   // A contact opening tells us nothing; the other one closing does.
+	}
+	if (edge.pin == m_pressPin) {
+		press(edge.timeUs);
+	} else if (edge.pin == m_releasePin) {
+		release(edge.timeUs);
+	}
+} // edge
+
+
+/**
+ * @brief Get the time at which the engine next needs advance() to be called.
+ * @return The time or NO_DEADLINE if it is waiting only for edges.
+ */
+int64_t GestureEngine::getDeadline() {
+	return m_deadline;
+} // getDeadline
+
+
+/**
+ * @brief Handle the button going down.
+ * @param [in] timeUs When it went down.
+ */
+void GestureEngine::press(int64_t timeUs) {
+	switch(m_state) {
+		case IDLE: {
+			m_count = 0;
+			// Fall through.
+		}
+		case RELEASED: {
+			m_state     = PRESSED;
+			m_pressedUs = timeUs;
+			m_deadline  = timeUs + m_timing.longHoldUs;
+			break;
+		}
+		default: {
+			break;    // Already down.
+		}
+	} // switch
+} // press
+
+
+/**
+ * @brief Handle the button coming up.
+ * @param [in] timeUs When it came up.
+ */
+void GestureEngine::release(int64_t timeUs) {
+	switch(m_state) {
+		case PRESSED: {
+			if (timeUs - m_pressedUs < m_timing.noiseUs) {
+				// Too short to be a press so carry on as if it never happened.
+				if (m_count == 0) {
+					m_state    = IDLE;
+					m_deadline = NO_DEADLINE;
+				} else {
+					m_state    = RELEASED;
+					m_deadline = m_releasedUs + m_timing.pressGapUs;
+				}
+				break;
+			}
+			m_count++;
+			m_releasedUs = timeUs;
+			if (m_count == TRIPLE_PRESS) {   // Nothing longer than a triple press so it is already certain.
+				m_state    = IDLE;
+				m_deadline = NO_DEADLINE;
+				commit(TRIPLE_PRESS, timeUs);
+				break;
+			}
+			m_state    = RELEASED;
+			m_deadline = timeUs + m_timing.pressGapUs;
+			break;
+		}
+		case HELD: {
+			m_state = IDLE;
+			break;
+		}
+		default: {
+			break;    // Already up.
+		}
+	} // switch
+} // release
@@ -0,0 +1,109 @@
+/*
+ * GestureEngine.h
+ */
+
+#ifndef MAIN_GESTUREENGINE_H_
+#define MAIN_GESTUREENGINE_H_
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief A change of level on a button contact, as seen by the interrupt handler.
+ */
+struct ButtonEdge {
+	int64_t timeUs;
+	uint8_t pin;
+	uint8_t level;
+};
+
+
+/**
+ * @brief A ring through which an interrupt handler passes button edges to a task.
+ *
+ * The interrupt handler is the only producer and one task the only consumer, so neither takes a lock.
+ * When the ring is full the newest edge is dropped and counted.
+ */
+class ButtonEdgeRing {
+public:
+	static const uint32_t DEPTH = 32;   // A power of two.
+
+	ButtonEdgeRing();
+
+	uint32_t getDropped();
+	bool     pop(ButtonEdge* pEdge);
+	bool     push(const ButtonEdge& edge);
+
+private:
+	ButtonEdge            m_edges[DEPTH];
+	std::atomic<uint32_t> m_head;      // Count of edges pushed.  Only the interrupt handler writes it.
+	std::atomic<uint32_t> m_tail;      // Count of edges popped.  Only the task writes it.
+	std::atomic<uint32_t> m_dropped;
+}; // ButtonEdgeRing
+
+
+/**
+ * @brief Recognises button gestures from the edges of a changeover switch.
+ *
+ * The button has a normally open and a normally closed contact, each pulled up and so low while closed.
+ * The button is pressed when its normally open contact closes and released when its normally closed contact
+ * closes.  Bounce re-closes the contact that has just closed and so changes nothing.
+ *
+ * The engine is a state machine fed one edge at a time.  A gesture is reported as soon as it can no longer
+ * be extended: a triple press at its third release, a long hold as soon as the button has been held for
+ * longHoldUs, and a single or double press once no further press has begun within pressGapUs of the last
+ * release.  Presses shorter than noiseUs are ignored.  A hold that begins within pressGapUs of earlier presses
+ * ends the gesture as a long hold and the presses before it are not reported, so each gesture the user makes
+ * yields exactly one report.
+ *
+ * Nothing in the engine reads a clock.  Each edge carries its own time, and the owner calls advance() with
+ * the current time when getDeadline() is reached, so a recorded trace of edges can be replayed on a host.
+ */
+class GestureEngine {
+public:
+	enum Gesture : uint8_t {
+		SINGLE_PRESS = 1,
+		DOUBLE_PRESS = 2,
+		TRIPLE_PRESS = 3,
+		LONG_HOLD    = 4
+	};
+
+	struct Timing {
+		int64_t noiseUs;
+		int64_t longHoldUs;
+		int64_t pressGapUs;
+	};
+
+	static const Timing DEFAULT_TIMING;
+	static const int64_t NO_DEADLINE = INT64_MAX;
+
+	GestureEngine(uint8_t pressPin, uint8_t releasePin, void (*gestureCallback)(Gesture gesture, int64_t timeUs, void* pArg), void* pArg, const Timing& timing = DEFAULT_TIMING);
+
+	void    advance(int64_t nowUs);
+	void    edge(const ButtonEdge& edge);
+	int64_t getDeadline();
+
+private:
+	enum State : uint8_t {
+		IDLE,       // Nothing is going on.
+		PRESSED,    // The button is down and m_count presses have already been completed.
+		RELEASED,   // The button is up after m_count presses which another may yet join.
+		HELD        // A long hold has been reported and the button is still down.
+	};
+
+	void commit(Gesture gesture, int64_t timeUs);
+	void press(int64_t timeUs);
+	void release(int64_t timeUs);
+
+	uint8_t m_pressPin;
+	uint8_t m_releasePin;
+	void  (*m_gestureCallback)(Gesture gesture, int64_t timeUs, void* pArg);
+	void*   m_pArg;
+	Timing  m_timing;
+	State   m_state;
+	uint8_t m_count;       // Short presses completed in the gesture under way.
+	int64_t m_pressedUs;   // When the button went down.
+	int64_t m_releasedUs;  // When the button last came up after a short press.
+	int64_t m_deadline;    // When the state times out, or NO_DEADLINE.
+}; // GestureEngine
+
+#endif /* MAIN_GESTUREENGINE_H_ */
@@ -0,0 +1,99 @@
+/*
+ * TelemetrySummary.cpp
+ */
+#include <esp_log.h>
+#include <sstream>
+#include "TelemetrySummary.h"
+
+static const char* LOG_TAG = "TelemetrySummary";
+
+
+TelemetrySummary::TelemetrySummary() {
+	m_started = false;
+	m_next    = 0;
+	reset();
+} // TelemetrySummary
+
+
+/**
+ * @brief Fold a received frame into the summary.
+ * @param [in] frame The frame.
+ */
+void TelemetrySummary::add(const TelemetryFrame& frame) {
+	int first = 0;
+	if (m_started) {
+		int16_t gap = frame.sequence - m_next;
+		if (gap > 0) {
+			ESP_LOGD(LOG_TAG, "Lost %d samples before %d", gap, frame.sequence);
+			m_lost += gap;
+		} else {
+			first = -gap;    // Skip samples already received.
+		}
+	}
+	if (first >= frame.count) {
+		return;
+	}
+	for (int i = first; i < frame.count; i++) {
+		const TelemetrySample& sample = frame.samples[i];
+		if (sample.flags & TelemetrySample::FLAG_BUSY) {
+			m_busy++;
+		}
+		if (sample.latencyMs > m_maxLatencyMs) {
+			m_maxLatencyMs = sample.latencyMs;
+		}
+		if (sample.queueDepth > m_maxQueueDepth) {
+			m_maxQueueDepth = sample.queueDepth;
+		}
+		if (sample.freeHeap < m_minFreeHeap) {
+			m_minFreeHeap = sample.freeHeap;
+		}
+		m_received++;
+	}
+	m_last    = frame.samples[frame.count - 1];
+	m_next    = frame.sequence + frame.count;
+	m_started = true;
+} // add
+
+
+/**
+ * @brief Get the number of samples received since the summary was last reset.
+ * @return The number of samples.
+ */
+uint32_t TelemetrySummary::getReceived() {
+	return m_received;
+} // getReceived
+
+
+/**
+ * @brief Start the figures afresh.
+ *
+ * The sequence number expected next is kept, so samples lost across a reset are still counted.
+ */
+void TelemetrySummary::reset() {
+	m_received      = 0;
+	m_lost          = 0;
+	m_busy          = 0;
+	m_maxLatencyMs  = 0;
+	m_maxQueueDepth = 0;
+	m_minFreeHeap   = UINT32_MAX;
+	m_last          = TelemetrySample();
+} // reset
+
+
+/**
+ * @brief Return a string representation of the summary.
+ * @return A string representation of the summary.
+ */
+std::string TelemetrySummary::toString() {
+	std::stringstream ss;
+	ss << "samples: " << m_received << ", lost: " << m_lost;
+	if (m_received > 0) {
+		ss << ", busy: " << (m_busy * 100 / m_received) << "%"
+			<< ", max latency: " << m_maxLatencyMs << "ms"
+			<< ", max queue: " << (int)m_maxQueueDepth
+			<< ", min free heap: " << m_minFreeHeap
+			<< ", pulses: " << m_last.pulseUs[0] << "/" << m_last.pulseUs[1] << "us"
+			<< ", trajectory: " << (int)m_last.trajectory;
+	}
+	return ss.str();
+} // toString
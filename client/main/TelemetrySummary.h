@@ -0,0 +1,39 @@
+/*
+ * TelemetrySummary.h
+ */
+
+#ifndef MAIN_TELEMETRYSUMMARY_H_
+#define MAIN_TELEMETRYSUMMARY_H_
+#include <stdint.h>
+#include <string>
+#include "TelemetryFrame.h"
+
+/**
+ * @brief Summarises the telemetry samples received from the tie.
+ *
+ * Each frame received is folded into running figures: how many samples arrived and how many were lost on
+ * the way, the worst command latency, queue depth and free heap seen, and how much of the time the tie was
+ * moving.  A frame that repeats or precedes samples already received is ignored.
+ */
+class TelemetrySummary {
+public:
+	TelemetrySummary();
+
+	void            add(const TelemetryFrame& frame);
+	uint32_t        getReceived();
+	void            reset();
+	std::string     toString();
+
+private:
+	bool            m_started;        // Has any sample been received?
+	uint16_t        m_next;           // The sequence number expected next.
+	uint32_t        m_received;
+	uint32_t        m_lost;
+	uint32_t        m_busy;           // Samples taken while a trajectory was playing.
+	uint16_t        m_maxLatencyMs;
+	uint8_t         m_maxQueueDepth;
+	uint32_t        m_minFreeHeap;
+	TelemetrySample m_last;
+}; // TelemetrySummary
+
+#endif /* MAIN_TELEMETRYSUMMARY_H_ */
@@ -10,6 +10,8 @@
 */
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <atomic>
 #include <string>
 #include <sstream>
 //#include <sys/time.h>
@@ -17,9 +19,15 @@
 
 #include "BLEAdvertisedDevice.h"
 #include "BLEClient.h"
+#include "BLEExceptions.h"
 #include "BLEScan.h"
 #include "BLEUtils.h"
+#include "CommandFrame.h"
+#include "GeneralUtils.h"
+#include "GestureEngine.h"
 #include "Task.h"
+#include "TelemetryFrame.h"
+#include "TelemetrySummary.h"
 
 // GPIO includes
 #include <driver/gpio.h>
@@ -35,6 +43,11 @@ static const char* LOG_TAG = "SampleClient";
 static BLEUUID serviceUUID("6d124ed1-50f5-4ebf-b490-c3db81cbaa8c");
 // The characteristic of the remote service we are interested in.
 static BLEUUID    charUUID("4c7a3456-6ac2-4e16-9951-028dc32c443c");
+// The tie's telemetry, which it notifies us of in batches of samples.
+static BLEUUID telemetryServiceUUID("0b6e3a52-9d41-4c0e-8f0a-51c2e7d4a610");
+static BLEUUID    telemetryCharUUID("0b6e3a53-9d41-4c0e-8f0a-51c2e7d4a610");
+// Remembers the server's services so that reconnecting to it skips discovery.
+static BLEGattCache gattCache;
 
 // GPIO interrupt stuff
 #define ESP_INTR_FLAG_DEFAULT 0
@@ -43,93 +56,159 @@ static BLEUUID    charUUID("4c7a3456-6ac2-4e16-9951-028dc32c443c");
 #define GPIO_NO GPIO_NUM_18
 #define GPIO_INPUT_PIN_SEL ((1<<GPIO_NO) | (1<<GPIO_NC))
 
-//queue to hear all button noise
-static xQueueHandle gpio_evt_nc_queue = NULL;
-//queue to hear all confirmed short presses
-static xQueueHandle short_evt_queue = NULL;
+//ring to hear every edge of the button's contacts, straight from the interrupt handler
+static ButtonEdgeRing button_edges;
+//task that turns the edges into gestures
+static TaskHandle_t gesture_task_handle = NULL;
 //queue to hear all outgoing messages (as button sequences are confirmed and sent out)
 static xQueueHandle outgoing_queue = NULL;
 
 
+// How long to wait for the server to acknowledge a command before sending it again, and how many times to.
+#define ACK_TIMEOUT_MS 300
+#define ACK_RETRIES    2
+
+// The sequence number of the command waiting for its acknowledgement, or -1 if none is.
+static std::atomic<int32_t> awaited_sequence(-1);
+
+// Not a gesture: wakes the client task to enable notifications again after the connection has come back.
+#define MSG_RESUBSCRIBE 0
+static std::atomic<bool> resubscribe_needed(false);
+
+// Ask for an MTU large enough for the tie to send thirteen telemetry samples in each notification.
+#define TELEMETRY_MTU 185
+// Log a summary of the tie's telemetry after this many samples, ten seconds' worth.
+#define TELEMETRY_SUMMARY_SAMPLES 100
+
+static TelemetrySummary telemetry_summary;
+
+
 extern "C" {
 	void app_main(void);
 }
 
+static uint32_t now_ms()
+{
+	return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// The server acknowledges each command by notifying us with the command's own sequence number and timestamp.
+static void ack_callback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify)
+{
+	CommandFrame ack;
+	if (!ack.decode(pData, length) || ack.opcode != CommandFrame::ACK) {
+		return;
+	}
+	int32_t expected = ack.sequence;
+	if (!awaited_sequence.compare_exchange_strong(expected, -1)) {
+		ESP_LOGD(LOG_TAG, "Late acknowledgement: %s", ack.toString().c_str());
+		return;
+	}
+	ESP_LOGI(LOG_TAG, "Command %d acknowledged with status %d after %d ms", ack.sequence, ack.status, now_ms() - ack.timestamp);
+}
+
+// The tie notifies us of its telemetry in batches.  Fold each into the summary and log it now and then.
+static void telemetry_callback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify)
+{
+	TelemetryFrame frame;
+	if (!frame.decode(pData, length)) {
+		return;
+	}
+	telemetry_summary.add(frame);
+	if (telemetry_summary.getReceived() >= TELEMETRY_SUMMARY_SAMPLES) {
+		ESP_LOGI(LOG_TAG, "Telemetry: %s", telemetry_summary.toString().c_str());
+		telemetry_summary.reset();
+	}
+}
+
+// getService() throws when the server lacks the service, so turn that into nullptr for the checks below.
+static BLERemoteService* find_service(BLEClient* pClient, BLEUUID uuid)
+{
+	try {
+		return pClient->getService(uuid);
+	} catch (BLEUuidNotFoundException* pException) {
+		delete pException;
+		return nullptr;
+	}
+}
+
+// As find_service(), for a characteristic of a service.
+static BLERemoteCharacteristic* find_characteristic(BLERemoteService* pRemoteService, BLEUUID uuid)
+{
+	try {
+		return pRemoteService->getCharacteristic(uuid);
+	} catch (BLEUuidNotFoundException* pException) {
+		delete pException;
+		return nullptr;
+	}
+}
+
+// The server only notifies a client that has enabled notifications in the characteristic's 0x2902 descriptor.
+static void subscribe(BLERemoteCharacteristic* pRemoteCharacteristic, void (*notifyCallback)(BLERemoteCharacteristic*, uint8_t*, size_t, bool))
+{
+	pRemoteCharacteristic->registerForNotify(notifyCallback);
+	BLERemoteDescriptor* p2902 = pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902));
+	if (p2902 == nullptr) {
+		ESP_LOGW(LOG_TAG, "No 0x2902 descriptor on %s", pRemoteCharacteristic->getUUID().toString().c_str());
+		return;
+	}
+	uint8_t notifications[] = { 0x01, 0x00 };
+	p2902->writeValue(notifications, sizeof(notifications));
+}
+
+// The server forgets our subscriptions when the link goes.  The stack's task calls us on reconnection and
+// must not wait for the descriptor writes, so we only ask the client task to make them.
+class ResubscribeCallbacks: public BLEClientCallbacks {
+	void onConnect(BLEClient* pClient) {
+		resubscribe_needed = true;
+		uint16_t msg_code = MSG_RESUBSCRIBE;
+		xQueueSendToFront(outgoing_queue, &msg_code, 0);   // A full queue wakes the task anyway.
+	}
+
+	void onDisconnect(BLEClient* pClient) {
+	}
+}; // ResubscribeCallbacks
+
 static void gpio_isr_handler(void* arg)
 {
-	TickType_t tick = xTaskGetTickCount();
-	xQueueSendFromISR(gpio_evt_nc_queue, &tick, NULL);
+	gpio_num_t pin = (gpio_num_t)(uint32_t)arg;
+	ButtonEdge edge = { esp_timer_get_time(), (uint8_t)pin, (uint8_t)gpio_get_level(pin) };
+	button_edges.push(edge);
+	BaseType_t woken = pdFALSE;
+	vTaskNotifyGiveFromISR(gesture_task_handle, &woken);
+	if (woken) {
+		portYIELD_FROM_ISR();
+	}
 }
 
-static void short_counter(void *arg)
+// Each gesture is sent as its press count, or 4 for a long hold.
+static void gesture_callback(GestureEngine::Gesture gesture, int64_t timeUs, void* arg)
 {
-	TickType_t event_tick;
-	uint16_t messages_waiting;
-	for (;;) {
-		if (xQueueReceive(short_evt_queue, &event_tick, portMAX_DELAY)) {
-				//after the first message is received, block this thread for N ticks and see how many messages have accumulated
-				vTaskDelay(1000);
-				messages_waiting = uxQueueMessagesWaiting(short_evt_queue);
-				int i;
-				for ( i = 0; i < messages_waiting; i = i+1 )
-				{
-					// TODO maybe check them for their actual time values...
-					xQueueReceive(short_evt_queue, &event_tick, portMAX_DELAY);
-				}
-				messages_waiting = messages_waiting + 1;
-//				printf("I think there were %d button pushes\n", messages_waiting);
-				if ( messages_waiting < 4 ) { //4+ short presses would be noise
-					xQueueSendToBack(outgoing_queue, &messages_waiting, portMAX_DELAY);
-				}
-		}
+	uint16_t msg_code = gesture;
+	if (xQueueSendToBack(outgoing_queue, &msg_code, 0) != pdTRUE) {
+		ESP_LOGW(LOG_TAG, "Dropped gesture %d", msg_code);
 	}
 }
 
-static void gpio_task_example(void* arg)
+static void gesture_task(void* arg)
 {
-	TickType_t begin_event_tick = 0;
-	TickType_t event_tick;
-
-	uint32_t level_nc = gpio_get_level(GPIO_NC);
-	uint32_t level_no = gpio_get_level(GPIO_NO);
-	bool button_state = false;
-	bool state = false;
-//	printf("NC initially registered as: %d\n", level_nc);
-    for(;;) {
-
-    	if(xQueueReceive(gpio_evt_nc_queue, &event_tick, portMAX_DELAY)) {
-//    		printf("Somebody hit @ %d\n", event_tick);
-    		level_nc = gpio_get_level(GPIO_NC);
-    		if (level_nc) {
-    			state = true;
-    		}
-    		level_no = gpio_get_level(GPIO_NO);
-    		if (level_no) {
-    			state = false;
-    		}
-    		if ( state != button_state )
-    		{
-    			//capture time and whether this is the beginning or end of a push
-    			button_state = state;
-    			if ( button_state ) {
-    				begin_event_tick = event_tick; // capture start moment
-    			} else {
-    				uint32_t elapsed = event_tick - begin_event_tick;
-    				if ( elapsed > 10 && elapsed < 500 )
-    				{
-//    					printf("short press finished\n");
-    					xQueueSendToBack(short_evt_queue, &event_tick, portMAX_DELAY);
-    				} else if ( elapsed >= 500 ){
-    					// TODO launch (D)
-//    					printf("long press finished\n");
-    					uint16_t msg_code = 4;
-    					xQueueSendToBack(outgoing_queue, &msg_code, portMAX_DELAY);
-    				}
-    				// things happening in sub-10 ticks are noise
-    			}
-    		}
-    	}
-    }
+	GestureEngine engine(GPIO_NO, GPIO_NC, gesture_callback, NULL);
+	for(;;) {
+		// Sleep until an edge arrives or the gesture under way can no longer be extended.
+		TickType_t wait = portMAX_DELAY;
+		int64_t deadline = engine.getDeadline();
+		if (deadline != GestureEngine::NO_DEADLINE) {
+			int64_t remainingUs = deadline - esp_timer_get_time();
+			wait = remainingUs <= 0 ? 0 : pdMS_TO_TICKS((remainingUs + 999) / 1000);
+		}
+		ulTaskNotifyTake(pdTRUE, wait);
+
+		ButtonEdge edge;
+		while (button_edges.pop(&edge)) {
+			engine.edge(edge);
+		}
+		engine.advance(esp_timer_get_time());
+	}
 }
 
 
@@ -142,12 +221,17 @@ class MyClient: public Task {
 	void run(void* data) {
 		BLEAddress* pAddress = (BLEAddress*)data;
 		BLEClient*  pClient  = BLEDevice::createClient();
+		pClient->setGattCache(&gattCache);
 
-		// Connect to the remove BLE Server.
-		pClient->connect(*pAddress);
+		// Connect to the remove BLE Server.  Once connected, any loss of the connection is repaired in
+		// the background so this task can carry on writing.
+		while (!pClient->connect(*pAddress)) {
+			delay(1000);
+		}
+		pClient->setAutoReconnect(true);
 
 		// Obtain a reference to the service we are after in the remote BLE server.
-		BLERemoteService* pRemoteService = pClient->getService(serviceUUID);
+		BLERemoteService* pRemoteService = find_service(pClient, serviceUUID);
 		if (pRemoteService == nullptr) {
 //			ESP_LOGW(LOG_TAG, "Failed to find our service UUID: %s", serviceUUID.toString().c_str());
 			return;
@@ -155,7 +239,7 @@ class MyClient: public Task {
 
 
 		// Obtain a reference to the characteristic in the service of the remote BLE server.
-		BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService->getCharacteristic(charUUID);
+		BLERemoteCharacteristic* pRemoteCharacteristic = find_characteristic(pRemoteService, charUUID);
 		if (pRemoteCharacteristic == nullptr) {
 //			ESP_LOGW(LOG_TAG, "Failed to find our characteristic UUID: %s", charUUID.toString().c_str());
 			return;
@@ -165,23 +249,58 @@ class MyClient: public Task {
 		std::string value = pRemoteCharacteristic->readValue();
 //		ESP_LOGW(LOG_TAG, "The characteristic value was: %s", value.c_str());
 
+		subscribe(pRemoteCharacteristic, ack_callback);
+
+		// Telemetry is optional; a tie without it is still driven.
+		BLERemoteService* pTelemetryService = find_service(pClient, telemetryServiceUUID);
+		BLERemoteCharacteristic* pTelemetryCharacteristic = pTelemetryService == nullptr ? nullptr : find_characteristic(pTelemetryService, telemetryCharUUID);
+		if (pTelemetryCharacteristic != nullptr) {
+			subscribe(pTelemetryCharacteristic, telemetry_callback);
+		}
+		pClient->setClientCallbacks(new ResubscribeCallbacks());
+
+		// Each gesture's press count is the opcode of its command.  Commands are numbered so that the server
+		// can drop one we send again because its acknowledgement did not arrive in time.
 		uint16_t msg_code;
+		uint16_t sequence = 0;
+		CommandFrame command;
+		uint8_t frame[CommandFrame::MAX_LENGTH];
+		size_t length = 0;
+		int retries = 0;
 		while(1) {
-//			// Just straight up block on this method until we get an interrupt message on the queue
-			xQueueReceive(outgoing_queue, &msg_code, portMAX_DELAY);
-			if (msg_code == 1) {
-//				printf("writing A\n");
-				pRemoteCharacteristic->writeValue("A");
-			} else if (msg_code == 2) {
-//				printf("writing B\n");
-				pRemoteCharacteristic->writeValue("B");
-			} else if (msg_code == 3) {
-//				printf("writing C\n");
-				pRemoteCharacteristic->writeValue("C");
-			} else if (msg_code == 4) {
-//				printf("writing D\n");
-				pRemoteCharacteristic->writeValue("D");
+			if (resubscribe_needed.exchange(false)) {
+				try {
+					subscribe(pRemoteCharacteristic, ack_callback);
+					if (pTelemetryCharacteristic != nullptr) {
+						subscribe(pTelemetryCharacteristic, telemetry_callback);
+					}
+				} catch (BLEDisconnectedException& exception) {
+					ESP_LOGW(LOG_TAG, "Lost the connection again before enabling notifications");
+				}
 			}
+
+			// Block until we get an interrupt message on the queue, or until it is time to send again
+			bool awaiting = awaited_sequence.load() >= 0;
+			if (!xQueueReceive(outgoing_queue, &msg_code, awaiting ? pdMS_TO_TICKS(ACK_TIMEOUT_MS) : portMAX_DELAY)) {
+				if (awaited_sequence.load() == command.sequence && retries < ACK_RETRIES) {
+					retries++;
+					pRemoteCharacteristic->writeNoResponse(frame, length);
+				} else {
+					ESP_LOGW(LOG_TAG, "Command %d was not acknowledged", command.sequence);
+					awaited_sequence = -1;
+				}
+				continue;
+			}
+			if (msg_code < CommandFrame::HOME || msg_code > CommandFrame::TREMORS) {
+				continue;
+			}
+			command = CommandFrame(msg_code, ++sequence);
+			command.hasTimestamp = true;
+			command.timestamp    = now_ms();
+			length  = command.encode(frame);
+			retries = 0;
+			awaited_sequence = command.sequence;
+			pRemoteCharacteristic->writeNoResponse(frame, length);
 		}
 
 		// UNREACHABLE... I think
@@ -209,17 +328,25 @@ class MyAdvertisedDeviceCallbacks: public BLEAdvertisedDeviceCallbacks {
 		}
 		if (advertisedDevice.haveServiceUUID() && advertisedDevice.isAdvertisingService(serviceUUID)) {
 			advertisedDevice.getScan()->stop();
+			if (m_pMyClient != nullptr) {   // The client reconnects by itself so we only ever need one.
+				return;
+			}
 
 //			ESP_LOGW(LOG_TAG, "Found our device!  address: %s", advertisedDevice.getAddress().toString().c_str());
 			MyClient* pMyClient = new MyClient();
+			m_pMyClient = pMyClient;
 			pMyClient->setStackSize(18000);
 			pMyClient->start(new BLEAddress(*advertisedDevice.getAddress().getNative()));
 		} // Found our server
 	} // onResult
+
+	MyClient* m_pMyClient = nullptr;
 }; // MyAdvertisedDeviceCallbacks
 
 void app_main(void)
 {
+	// Log levels are set here and through GeneralUtils so that the guards on debug output see them
+	GeneralUtils::setLogLevel((esp_log_level_t) CONFIG_LOG_DEFAULT_LEVEL);
 
 	// Configure GPIO pin first
 	ESP_LOGW(LOG_TAG, ">> test1_task");
@@ -233,23 +360,23 @@ void app_main(void)
 	gpio_config(&gpioConfig);
 
 	gpio_install_isr_service(0);
-	gpio_isr_handler_add(GPIO_NC, gpio_isr_handler, NULL);
-	gpio_isr_handler_add(GPIO_NO, gpio_isr_handler, NULL);
+	outgoing_queue = xQueueCreate(10, sizeof(uint16_t));   // Press counts, as uint16_t
 
-	//create a queue to handle gpio event from isr
-	gpio_evt_nc_queue = xQueueCreate(10, sizeof(uint32_t));
-	short_evt_queue = xQueueCreate(10, sizeof(uint32_t));
-	outgoing_queue = xQueueCreate(10, sizeof(uint32_t));
+	//start the gesture task before edges can arrive for it
+	xTaskCreate(gesture_task, "gesture_task", 2048, NULL, 10, &gesture_task_handle);
 
-	//start gpio task
-	xTaskCreate(gpio_task_example, "gpio_task_example", 2048, NULL, 10, NULL);
-	xTaskCreate(short_counter, "short_counter", 2048, NULL, 10, NULL);
+	gpio_isr_handler_add(GPIO_NC, gpio_isr_handler, (void*)GPIO_NC);
+	gpio_isr_handler_add(GPIO_NO, gpio_isr_handler, (void*)GPIO_NO);
 
 	// BLE scan init
 	ESP_LOGW(LOG_TAG, "Scanning sample starting");
 	BLEDevice::init("ESP32-Client");
+	BLEDevice::setMTU(TELEMETRY_MTU);
 	BLEScan *pBLEScan = BLEDevice::getScan();
 	pBLEScan->setAdvertisedDeviceCallbacks(new MyAdvertisedDeviceCallbacks());
+	BLEScanFilter filter;
+	filter.addServiceUUID(serviceUUID);   // Only servers that advertise our service are worth parsing.
+	pBLEScan->setFilter(filter);
 	pBLEScan->setActiveScan(true);
 	pBLEScan->start(30);
 }
@@ -18,6 +18,7 @@
 #include "BLEDevice.h"
 #include "BLEUtils.h"
 #include "BLE2902.h"
+#include "BLENotifyQueue.h"
 #include "GeneralUtils.h"
 #ifdef ARDUINO_ARCH_ESP32
 #include "esp32-hal-log.h"
@@ -46,6 +47,7 @@ BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties) {
 	m_handle     = NULL_HANDLE;
 	m_properties = (esp_gatt_char_prop_t)0;
 	m_pCallbacks = nullptr;
+	m_valueLock  = ::xSemaphoreCreateMutex();
 
 	setBroadcastProperty((properties & PROPERTY_BROADCAST) !=0);
 	setReadProperty((properties & PROPERTY_READ) !=0);
@@ -60,6 +62,7 @@ BLECharacteristic::BLECharacteristic(BLEUUID uuid, uint32_t properties) {
  */
 BLECharacteristic::~BLECharacteristic() {
 	//free(m_value.attr_value); // Release the storage for the value.
+	::vSemaphoreDelete(m_valueLock);
 } // ~BLECharacteristic
 
 
@@ -195,7 +198,10 @@ BLEUUID BLECharacteristic::getUUID() {
  * @return A pointer to storage containing the current characteristic value.
  */
 std::string BLECharacteristic::getValue() {
-	return m_value.getValue();
+	::xSemaphoreTake(m_valueLock, portMAX_DELAY);
+	std::string value = m_value.getValue();
+	::xSemaphoreGive(m_valueLock);
+	return value;
 } // getValue
 
 
@@ -206,7 +212,9 @@ void BLECharacteristic::handleGATTServerEvent(
 		esp_gatts_cb_event_t      event,
 		esp_gatt_if_t             gatts_if,
 		esp_ble_gatts_cb_param_t* param) {
-	ESP_LOGD(LOG_TAG, ">> handleGATTServerEvent: %s", BLEUtils::gattServerEventTypeToString(event).c_str());
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, ">> handleGATTServerEvent: %s", BLEUtils::gattServerEventTypeToString(event).c_str());
+	}
 
 	switch(event) {
 	// Events handled:
@@ -229,22 +237,18 @@ void BLECharacteristic::handleGATTServerEvent(
 		// - esp_bd_addr_t bda
 		// - uint8_t exec_write_flag - Either ESP_GATT_PREP_WRITE_EXEC or ESP_GATT_PREP_WRITE_CANCEL
 		//
+		// We are only given this event if the client made prepared writes to us.  The prepared data is held by
+		// the server for the connection, which discards it and responds to the client once every affected
+		// characteristic has seen the event.
+		//
 		case ESP_GATTS_EXEC_WRITE_EVT: {
-			if (param->exec_write.exec_write_flag == ESP_GATT_PREP_WRITE_EXEC) {
-				m_value.commit();
+			BLEServerConnection* pConnection = getService()->getServer()->getConnection(param->exec_write.conn_id);
+			if (pConnection != nullptr && pConnection->preparedHandle == m_handle &&
+					param->exec_write.exec_write_flag == ESP_GATT_PREP_WRITE_EXEC) {
+				setValue(pConnection->preparedValue.getData(), pConnection->preparedValue.getLength());
 				if (m_pCallbacks != nullptr) {
-					m_pCallbacks->onWrite(this); // Invoke the onWrite callback handler.
+					m_pCallbacks->onWrite(this, param->exec_write.conn_id); // Invoke the onWrite callback handler.
 				}
-			} else {
-				m_value.cancel();
-			}
-
-			esp_err_t errRc = ::esp_ble_gatts_send_response(
-					gatts_if,
-					param->write.conn_id,
-					param->write.trans_id, ESP_GATT_OK, nullptr);
-			if (errRc != ESP_OK) {
-				ESP_LOGE(LOG_TAG, "esp_ble_gatts_send_response: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
 			}
 			break;
 		} // ESP_GATTS_EXEC_WRITE_EVT
@@ -284,18 +288,45 @@ void BLECharacteristic::handleGATTServerEvent(
 // we save the new value.  Next we look at the need_rsp flag which indicates whether or not we need
 // to send a response.  If we do, then we formulate a response and send it.
 			if (param->write.handle == m_handle) {
+				esp_gatt_status_t status = ESP_GATT_OK;
 				if (param->write.is_prep) {
-					m_value.addPart(param->write.value, param->write.len);
+					// Prepared writes are kept per connection so that two clients writing long values at the same
+					// time cannot interleave their data.  Each part is copied straight to its offset in the
+					// connection's fixed buffer.  A part that does not fit fails and the value prepared so far is
+					// discarded, so the execute cannot commit a truncated value.  A connection prepares one value at
+					// a time, so a part for another characteristic before the execute is refused.
+					BLEServerConnection* pConnection = getService()->getServer()->getConnection(param->write.conn_id);
+					if (pConnection != nullptr) {
+						BLEValue& prepared = pConnection->preparedValue;
+						size_t    capacity = m_value.getCapacity() < prepared.getCapacity() ? m_value.getCapacity() : prepared.getCapacity();
+						size_t    end      = param->write.offset + param->write.len;
+						if (pConnection->preparedHandle != 0 && pConnection->preparedHandle != m_handle) {
+							ESP_LOGE(LOG_TAG, "Prepared write while handle 0x%.2x is still being prepared", pConnection->preparedHandle);
+							status = ESP_GATT_PREPARE_Q_FULL;
+						} else if (end > capacity) {
+							ESP_LOGE(LOG_TAG, "Prepared write to offset %d exceeds capacity %d", end, capacity);
+							status = param->write.offset > capacity ? ESP_GATT_INVALID_OFFSET : ESP_GATT_INVALID_ATTR_LEN;
+							pConnection->preparedHandle = 0;
+							prepared.cancel();
+						} else {
+							if (pConnection->preparedHandle == 0) {
+								prepared.cancel();
+							}
+							pConnection->preparedHandle = m_handle;
+							prepared.addPart(param->write.offset, param->write.value, param->write.len);
+						}
+					}
 				} else {
 					setValue(param->write.value, param->write.len);
 				}
 
-				ESP_LOGD(LOG_TAG, " - Response to write event: New value: handle: %.2x, uuid: %s",
-						getHandle(), getUUID().toString().c_str());
-
-				char* pHexData = BLEUtils::buildHexData(nullptr, param->write.value, param->write.len);
-				ESP_LOGD(LOG_TAG, " - Data: length: %d, data: %s", param->write.len, pHexData);
-				free(pHexData);
+				if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+					char hexBuf[101];
+					ESP_LOGD(LOG_TAG, " - Response to write event: New value: handle: %.2x, uuid: %s",
+							getHandle(), getUUID().toString().c_str());
+					ESP_LOGD(LOG_TAG, " - Data: length: %d, data: %s", param->write.len,
+							GeneralUtils::toHex(hexBuf, sizeof(hexBuf), param->write.value, param->write.len));
+				}
 
 				if (param->write.need_rsp) {
 					esp_gatt_rsp_t rsp;
@@ -309,14 +340,14 @@ void BLECharacteristic::handleGATTServerEvent(
 					esp_err_t errRc = ::esp_ble_gatts_send_response(
 							gatts_if,
 							param->write.conn_id,
-							param->write.trans_id, ESP_GATT_OK, &rsp);
+							param->write.trans_id, status, &rsp);
 					if (errRc != ESP_OK) {
 						ESP_LOGE(LOG_TAG, "esp_ble_gatts_send_response: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
 					}
 				} // Response needed
 
 				if (m_pCallbacks != nullptr && param->write.is_prep != true) {
-					m_pCallbacks->onWrite(this); // Invoke the onWrite callback handler.
+					m_pCallbacks->onWrite(this, param->write.conn_id); // Invoke the onWrite callback handler.
 				}
 			} // Match on handles.
 			break;
@@ -360,58 +391,82 @@ void BLECharacteristic::handleGATTServerEvent(
 // The following code has deliberately not been factored to make it fewer statements because this would cloud the
 // the logic flow comprehension.
 //
+// Each client may have its own long read in progress so the offset is kept with the connection.  A client has
+// one request outstanding at a time, so one slot per connection is enough.  Should a read of another
+// characteristic come between the chunks, the read blob request's own offset says where to carry on.
+//
+				BLEServerConnection* pConnection = getService()->getServer()->getConnection(param->read.conn_id);
+				uint16_t unusedOffset = 0;
+				uint16_t& readOffset  = pConnection != nullptr ? pConnection->readOffset : unusedOffset;
+				if (pConnection != nullptr && pConnection->readHandle != m_handle) {
+					pConnection->readHandle = m_handle;
+					readOffset              = param->read.offset;
+				}
+
+				// Chunks are sized by the MTU this client negotiated.
 				// TODO requires some more research to confirm that 512 is max PDU like in bluetooth specs
-				uint16_t maxOffset = BLEDevice::getMTU() - 1;
-				if (BLEDevice::getMTU() > 512) {
+				uint16_t mtu       = getService()->getServer()->getPeerMTU(param->read.conn_id);
+				uint16_t maxOffset = mtu - 1;
+				if (mtu > 512) {
 					maxOffset = 512;
 				}
 				if (param->read.need_rsp) {
 					ESP_LOGD(LOG_TAG, "Sending a response (esp_ble_gatts_send_response)");
 					esp_gatt_rsp_t rsp;
 
+					// If is_long is false then this is the first (or only) request to read data, so invoke the callback.
+					if (!param->read.is_long && m_pCallbacks != nullptr) {
+						m_pCallbacks->onRead(this);
+					}
+
+					// Each chunk is copied straight from the value into the response; the value itself is never copied.
+					// The value is locked meanwhile so that a setValue() from another task cannot tear the chunk.  A
+					// long read that spans a setValue() still sees the new value from its next chunk on.
+					::xSemaphoreTake(m_valueLock, portMAX_DELAY);
+					uint8_t* pValue = m_value.getData();
+					size_t   length = m_value.getLength();
+
 					if (param->read.is_long) {
-						std::string value = m_value.getValue();
+						if (readOffset > length) {   // The value has shrunk since the read began.
+							readOffset = length;
+						}
 
-						if (value.length() - m_value.getReadOffset() < maxOffset) {
+						if (length - readOffset < maxOffset) {
 							// This is the last in the chain
-							rsp.attr_value.len    = value.length() - m_value.getReadOffset();
-							rsp.attr_value.offset = m_value.getReadOffset();
-							memcpy(rsp.attr_value.value, value.data() + rsp.attr_value.offset, rsp.attr_value.len);
-							m_value.setReadOffset(0);
+							rsp.attr_value.len    = length - readOffset;
+							rsp.attr_value.offset = readOffset;
+							memcpy(rsp.attr_value.value, pValue + rsp.attr_value.offset, rsp.attr_value.len);
+							readOffset = 0;
 						} else {
 							// There will be more to come.
 							rsp.attr_value.len    = maxOffset;
-							rsp.attr_value.offset = m_value.getReadOffset();
-							memcpy(rsp.attr_value.value, value.data() + rsp.attr_value.offset, rsp.attr_value.len);
-							m_value.setReadOffset(rsp.attr_value.offset + maxOffset);
+							rsp.attr_value.offset = readOffset;
+							memcpy(rsp.attr_value.value, pValue + rsp.attr_value.offset, rsp.attr_value.len);
+							readOffset = rsp.attr_value.offset + maxOffset;
 						}
 					} else { // read.is_long == false
-
-						if (m_pCallbacks != nullptr) {  // If is.long is false then this is the first (or only) request to read data, so invoke the callback
-							m_pCallbacks->onRead(this);   // Invoke the read callback.
-						}
-
-						std::string value = m_value.getValue();
-
-						if (value.length()+1 > maxOffset) {
+						if (length+1 > maxOffset) {
 							// Too big for a single shot entry.
-							m_value.setReadOffset(maxOffset);
+							readOffset = maxOffset;
 							rsp.attr_value.len    = maxOffset;
 							rsp.attr_value.offset = 0;
-							memcpy(rsp.attr_value.value, value.data(), rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, pValue, rsp.attr_value.len);
 						} else {
 							// Will fit in a single packet with no callbacks required.
-							rsp.attr_value.len    = value.length();
+							rsp.attr_value.len    = length;
 							rsp.attr_value.offset = 0;
-							memcpy(rsp.attr_value.value, value.data(), rsp.attr_value.len);
+							memcpy(rsp.attr_value.value, pValue, rsp.attr_value.len);
 						}
 					}
+					::xSemaphoreGive(m_valueLock);
 					rsp.attr_value.handle   = param->read.handle;
 					rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
 
-					char *pHexData = BLEUtils::buildHexData(nullptr, rsp.attr_value.value, rsp.attr_value.len);
-					ESP_LOGD(LOG_TAG, " - Data: length=%d, data=%s, offset=%d", rsp.attr_value.len, pHexData, rsp.attr_value.offset);
-					free(pHexData);
+					if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+						char hexBuf[101];
+						ESP_LOGD(LOG_TAG, " - Data: length=%d, data=%s, offset=%d", rsp.attr_value.len,
+								GeneralUtils::toHex(hexBuf, sizeof(hexBuf), rsp.attr_value.value, rsp.attr_value.len), rsp.attr_value.offset);
+					}
 
 					esp_err_t errRc = ::esp_ble_gatts_send_response(
 							gatts_if, param->read.conn_id,
@@ -455,116 +510,223 @@ void BLECharacteristic::handleGATTServerEvent(
 	} // switch event
 
 	// Give each of the descriptors associated with this characteristic the opportunity to handle the
-	// event.
+	// event.  Reads, writes and confirmations are routed by handle by the server so the descriptors
+	// will be given those directly if they are the target.
+	switch(event) {
+		case ESP_GATTS_READ_EVT:
+		case ESP_GATTS_WRITE_EVT:
+		case ESP_GATTS_EXEC_WRITE_EVT:
+		case ESP_GATTS_CONF_EVT:
+			break;
 
-	m_descriptorMap.handleGATTServerEvent(event, gatts_if, param);
+		default:
+			m_descriptorMap.handleGATTServerEvent(event, gatts_if, param);
+			break;
+	}
 	ESP_LOGD(LOG_TAG, "<< handleGATTServerEvent");
 } // handleGATTServerEvent
 
 
 /**
  * @brief Send an indication.
- * An indication is a transmission of up to the first 20 bytes of the characteristic value.  An indication
- * will block waiting a positive confirmation from the client.
+ * An indication is a transmission of up to the first 20 bytes of the characteristic value.  It is sent to
+ * each client that has enabled indications in turn and we block waiting for each client's confirmation.
  * @return N/A
  */
 void BLECharacteristic::indicate() {
 
-	ESP_LOGD(LOG_TAG, ">> indicate: length: %d", m_value.getValue().length());
+	ESP_LOGD(LOG_TAG, ">> indicate: length: %d", m_value.getLength());
 
 	assert(getService() != nullptr);
 	assert(getService()->getServer() != nullptr);
 
-	GeneralUtils::hexDump((uint8_t*)m_value.getValue().data(), m_value.getValue().length());
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		::xSemaphoreTake(m_valueLock, portMAX_DELAY);
+		GeneralUtils::hexDump(m_value.getData(), m_value.getLength());
+		::xSemaphoreGive(m_valueLock);
+	}
 
-	if (getService()->getServer()->getConnectedCount() == 0) {
+	BLEServer* pServer = getService()->getServer();
+	if (pServer->getConnectedCount() == 0) {
 		ESP_LOGD(LOG_TAG, "<< indicate: No connected clients.");
 		return;
 	}
 
-	// Test to see if we have a 0x2902 descriptor.  If we do, then check to see if indications are enabled
-	// and, if not, prevent the indication.
+	// Test to see if we have a 0x2902 descriptor.  If we do, then only those clients that have enabled
+	// indications in it are sent one.
 
 	BLE2902 *p2902 = (BLE2902*)getDescriptorByUUID((uint16_t)0x2902);
-	if (p2902 != nullptr && !p2902->getIndications()) {
+	std::vector<uint16_t> connIds = pServer->getSubscribers(p2902, 1 << 1);
+	if (connIds.empty()) {
 		ESP_LOGD(LOG_TAG, "<< indications disabled; ignoring");
 		return;
 	}
 
-	if (m_value.getValue().length() > (BLEDevice::getMTU() - 3)) {
-		ESP_LOGI(LOG_TAG, "- Truncating to %d bytes (maximum indicate size)", BLEDevice::getMTU() - 3);
-	}
-
-	size_t length = m_value.getValue().length();
-
-	m_semaphoreConfEvt.take("indicate");
-
-	esp_err_t errRc = ::esp_ble_gatts_send_indicate(
-			getService()->getServer()->getGattsIf(),
-			getService()->getServer()->getConnId(),
-			getHandle(), length, (uint8_t*)m_value.getValue().data(), true); // The need_confirm = true makes this an indication.
+	for (auto connId : connIds) {
+		// The connection's queue copies the value, as much as the client's own MTU allows, sends it after any
+		// already waiting and releases us when it is confirmed.
+		m_semaphoreConfEvt.take("indicate");
+		BLENotifyQueue* pQueue = pServer->getNotifyQueue(connId);
+		if (pQueue == nullptr || !pQueue->push(this, pServer->getPeerMTU(connId) - 3, portMAX_DELAY, BLENotifyQueue::INDICATE)) {
+			ESP_LOGD(LOG_TAG, "indicate: Not sent to conn_id %d", connId);
+			m_semaphoreConfEvt.give();
+			continue;
+		}
 
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "<< esp_ble_gatts_send_indicate: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		return;
+		m_semaphoreConfEvt.wait("indicate");
 	}
-
-	m_semaphoreConfEvt.wait("indicate");
 	ESP_LOGD(LOG_TAG, "<< indicate");
 } // indicate
 
 
 /**
  * @brief Send a notify.
- * A notification is a transmission of up to the first 20 bytes of the characteristic value.  An notification
- * will not block; it is a fire and forget.
+ * A notification is a transmission of up to the first 20 bytes of the characteristic value.  It is sent to
+ * each client that has enabled notifications in turn, waiting for the %BLE stack to report each one sent.
+ * Use notifyAll() to queue the notifications without waiting.
  * @return N/A.
  */
 void BLECharacteristic::notify() {
-	ESP_LOGD(LOG_TAG, ">> notify: length: %d", m_value.getValue().length());
+	ESP_LOGD(LOG_TAG, ">> notify: length: %d", m_value.getLength());
 
 
 	assert(getService() != nullptr);
 	assert(getService()->getServer() != nullptr);
 
 
-	GeneralUtils::hexDump((uint8_t*)m_value.getValue().data(), m_value.getValue().length());
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		::xSemaphoreTake(m_valueLock, portMAX_DELAY);
+		GeneralUtils::hexDump(m_value.getData(), m_value.getLength());
+		::xSemaphoreGive(m_valueLock);
+	}
 
-	if (getService()->getServer()->getConnectedCount() == 0) {
+	BLEServer* pServer = getService()->getServer();
+	if (pServer->getConnectedCount() == 0) {
 		ESP_LOGD(LOG_TAG, "<< notify: No connected clients.");
 		return;
 	}
 
-	// Test to see if we have a 0x2902 descriptor.  If we do, then check to see if notification is enabled
-	// and, if not, prevent the notification.
+	// Test to see if we have a 0x2902 descriptor.  If we do, then only those clients that have enabled
+	// notifications in it are sent one.
 
 	BLE2902 *p2902 = (BLE2902*)getDescriptorByUUID((uint16_t)0x2902);
-	if (p2902 != nullptr && !p2902->getNotifications()) {
+	std::vector<uint16_t> connIds = pServer->getSubscribers(p2902, 1 << 0);
+	if (connIds.empty()) {
 		ESP_LOGD(LOG_TAG, "<< notifications disabled; ignoring");
 		return;
 	}
 
-	if (m_value.getValue().length() > (BLEDevice::getMTU() - 3)) {
-		ESP_LOGI(LOG_TAG, "- Truncating to %d bytes (maximum notify size)", BLEDevice::getMTU() - 3);
+	for (auto connId : connIds) {
+		// The connection's queue copies the value, as much as the client's own MTU allows, sends it after any
+		// already waiting and releases us when it is confirmed.
+		m_semaphoreConfEvt.take("notify");
+		BLENotifyQueue* pQueue = pServer->getNotifyQueue(connId);
+		if (pQueue == nullptr || !pQueue->push(this, pServer->getPeerMTU(connId) - 3, portMAX_DELAY, BLENotifyQueue::NOTIFY)) {
+			ESP_LOGD(LOG_TAG, "notify: Not sent to conn_id %d", connId);
+			m_semaphoreConfEvt.give();
+			continue;
+		}
+
+		m_semaphoreConfEvt.wait("notify");
 	}
 
-	size_t length = m_value.getValue().length();
+	ESP_LOGD(LOG_TAG, "<< notify");
+} // Notify
 
-	m_semaphoreConfEvt.take("notify");
 
-	esp_err_t errRc = ::esp_ble_gatts_send_indicate(
-			getService()->getServer()->getGattsIf(),
-			getService()->getServer()->getConnId(),
-			getHandle(), length, (uint8_t*)m_value.getValue().data(), false); // The need_confirm = false makes this a notify.
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "<< esp_ble_gatts_send_indicate: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		return;
+/**
+ * @brief Queue a notify for every subscribed client without waiting for any of them.
+ *
+ * The current value is copied into the notification queue of each client that has enabled notifications.
+ * A client whose queue is full, because it is slow or its link is congested, does not hold up the others;
+ * we wait at most timeoutMs for room in its queue and otherwise skip it.  The outcome of each notification
+ * is reported through BLECharacteristicCallbacks::onNotifyComplete().
+ *
+ * @param [in] timeoutMs How long to wait for room in each client's queue.
+ * @return The number of clients a notification was queued for.
+ */
+size_t BLECharacteristic::notifyAll(uint32_t timeoutMs) {
+	assert(getService() != nullptr);
+	assert(getService()->getServer() != nullptr);
+
+	BLEServer* pServer = getService()->getServer();
+	BLE2902 *p2902 = (BLE2902*)getDescriptorByUUID((uint16_t)0x2902);
+	size_t queued = 0;
+	for (auto connId : pServer->getSubscribers(p2902, 1 << 0)) {
+		BLENotifyQueue* pQueue = pServer->getNotifyQueue(connId);
+		if (pQueue != nullptr && pQueue->push(this, ESP_GATT_MAX_ATTR_LEN, timeoutMs)) {
+			queued++;
+		} else {
+			ESP_LOGD(LOG_TAG, "notifyAll: Not queued for conn_id %d", connId);
+		}
 	}
+	return queued;
+} // notifyAll
 
-	m_semaphoreConfEvt.wait("notify");
 
-	ESP_LOGD(LOG_TAG, "<< notify");
-} // Notify
+/**
+ * @brief Queue a notify without waiting for it to be sent.
+ *
+ * The current value is copied into the notification queue of the most recent connection and we return
+ * immediately.  The queue keeps several notifications in flight with the %BLE stack and reports the outcome
+ * of each one through BLECharacteristicCallbacks::onNotifyComplete().  If the queue is full we wait up to
+ * timeoutMs for room.
+ *
+ * @param [in] timeoutMs How long to wait for room in the queue.
+ * @return True if the notification was queued.
+ */
+bool BLECharacteristic::notifyAsync(uint32_t timeoutMs) {
+	assert(getService() != nullptr);
+	assert(getService()->getServer() != nullptr);
+
+	return notifyAsync(getService()->getServer()->getConnId(), timeoutMs);
+} // notifyAsync
+
+
+/**
+ * @brief Queue a notify for one client without waiting for it to be sent.
+ *
+ * As notifyAsync(uint32_t) but for the client on the given connection, for example the one whose write
+ * is being handled.
+ *
+ * @param [in] connId The connection of the client to notify.
+ * @param [in] timeoutMs How long to wait for room in the queue.
+ * @return True if the notification was queued.
+ */
+bool BLECharacteristic::notifyAsync(uint16_t connId, uint32_t timeoutMs) {
+	assert(getService() != nullptr);
+	assert(getService()->getServer() != nullptr);
+
+	BLEServer* pServer = getService()->getServer();
+	if (pServer->getConnectedCount() == 0) {
+		ESP_LOGD(LOG_TAG, "<< notifyAsync: No connected clients.");
+		return false;
+	}
+
+	BLE2902 *p2902 = (BLE2902*)getDescriptorByUUID((uint16_t)0x2902);
+	if (p2902 != nullptr && !p2902->getNotifications(connId)) {
+		ESP_LOGD(LOG_TAG, "<< notifyAsync: notifications disabled for conn_id %d; ignoring", connId);
+		return false;
+	}
+
+	BLENotifyQueue* pQueue = pServer->getNotifyQueue(connId);
+	if (pQueue == nullptr) {
+		ESP_LOGE(LOG_TAG, "<< notifyAsync: No notification queue for conn_id %d", connId);
+		return false;
+	}
+	return pQueue->push(this, ESP_GATT_MAX_ATTR_LEN, timeoutMs);
+} // notifyAsync
+
+
+/**
+ * @brief Report the outcome of a queued notification to the callbacks.
+ * @param [in] status The status reported by the %BLE stack.
+ */
+void BLECharacteristic::notifyComplete(esp_gatt_status_t status) {
+	if (m_pCallbacks != nullptr) {
+		m_pCallbacks->onNotifyComplete(this, status);
+	}
+} // notifyComplete
 
 
 /**
@@ -589,7 +751,7 @@ void BLECharacteristic::setBroadcastProperty(bool value) {
  * @param [in] pCallbacks An instance of a callbacks structure used to define any callbacks for the characteristic.
  */
 void BLECharacteristic::setCallbacks(BLECharacteristicCallbacks* pCallbacks) {
-	ESP_LOGD(LOG_TAG, ">> setCallbacks: 0x%x", (uint32_t)pCallbacks);
+	ESP_LOGD(LOG_TAG, ">> setCallbacks: 0x%x", (uint32_t)(uintptr_t)pCallbacks);
 	m_pCallbacks = pCallbacks;
 	ESP_LOGD(LOG_TAG, "<< setCallbacks");
 } // setCallbacks
@@ -660,18 +822,40 @@ void BLECharacteristic::setReadProperty(bool value) {
  * @param [in] length The length of the data in bytes.
  */
 void BLECharacteristic::setValue(uint8_t* data, size_t length) {
-	char *pHex = BLEUtils::buildHexData(nullptr, data, length);
-	ESP_LOGD(LOG_TAG, ">> setValue: length=%d, data=%s, characteristic UUID=%s", length, pHex, getUUID().toString().c_str());
-	free(pHex);
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		char hexBuf[101];
+		ESP_LOGD(LOG_TAG, ">> setValue: length=%d, data=%s, characteristic UUID=%s", length,
+				GeneralUtils::toHex(hexBuf, sizeof(hexBuf), data, length), getUUID().toString().c_str());
+	}
 	if (length > ESP_GATT_MAX_ATTR_LEN) {
 		ESP_LOGE(LOG_TAG, "Size %d too large, must be no bigger than %d", length, ESP_GATT_MAX_ATTR_LEN);
 		return;
 	}
+	::xSemaphoreTake(m_valueLock, portMAX_DELAY);
 	m_value.setValue(data, length);
+	::xSemaphoreGive(m_valueLock);
 	ESP_LOGD(LOG_TAG, "<< setValue");
 } // setValue
 
 
+/**
+ * @brief Hold the value of the characteristic in storage owned by the application.
+ *
+ * By default each characteristic allocates ESP_GATT_MAX_ATTR_LEN bytes for its value.  An application that
+ * knows its values are small, or that wants to place them itself, may supply the storage instead.
+ *
+ * @param [in] pStorage The storage for the value.  It must outlive the characteristic.
+ * @param [in] capacity The size of the storage in bytes.
+ * @return True if the storage is now in use.
+ */
+bool BLECharacteristic::setValueStorage(uint8_t* pStorage, size_t capacity) {
+	::xSemaphoreTake(m_valueLock, portMAX_DELAY);
+	bool done = m_value.setStorage(pStorage, capacity);
+	::xSemaphoreGive(m_valueLock);
+	return done;
+} // setValueStorage
+
+
 /**
  * @brief Set the value of the characteristic from string data.
  * We set the value of the characteristic from the bytes contained in the
@@ -753,4 +937,29 @@ void BLECharacteristicCallbacks::onWrite(BLECharacteristic *pCharacteristic) {
 	ESP_LOGD("BLECharacteristicCallbacks", "<< onWrite");
 } // onWrite
 
+
+/**
+ * @brief Callback function to support a write request, told which client wrote.
+ *
+ * By default the write is passed on to onWrite(BLECharacteristic*).  A server that must tell its clients
+ * apart, for example to reply to the writer alone, overrides this one instead.
+ *
+ * @param [in] pCharacteristic The characteristic that is the source of the event.
+ * @param [in] connId The connection of the client that wrote.
+ */
+void BLECharacteristicCallbacks::onWrite(BLECharacteristic* pCharacteristic, uint16_t connId) {
+	onWrite(pCharacteristic);
+} // onWrite
+
+
+/**
+ * @brief Callback function invoked when a notification queued by notifyAsync() has been sent or has failed.
+ * @param [in] pCharacteristic The characteristic that is the source of the event.
+ * @param [in] status The status reported by the %BLE stack.
+ */
+void BLECharacteristicCallbacks::onNotifyComplete(BLECharacteristic* pCharacteristic, esp_gatt_status_t status) {
+	ESP_LOGD("BLECharacteristicCallbacks", ">> onNotifyComplete: default");
+	ESP_LOGD("BLECharacteristicCallbacks", "<< onNotifyComplete");
+} // onNotifyComplete
+
 #endif /* CONFIG_BT_ENABLED */
@@ -41,11 +41,10 @@ BLECharacteristic* BLECharacteristicMap::getByUUID(const char* uuid) {
  */
 BLECharacteristic* BLECharacteristicMap::getByUUID(BLEUUID uuid) {
 	for (auto &myPair : m_uuidMap) {
-		if (myPair.first->getUUID().equals(uuid)) {
+		if (myPair.second == uuid) {
 			return myPair.first;
 		}
 	}
-	//return m_uuidMap.at(uuid.toString());
 	return nullptr;
 } // getByUUID
 
@@ -117,7 +116,7 @@ void BLECharacteristicMap::setByHandle(uint16_t handle,
 void BLECharacteristicMap::setByUUID(
 		BLECharacteristic *pCharacteristic,
 		BLEUUID            uuid) {
-	m_uuidMap.insert(std::pair<BLECharacteristic *, std::string>(pCharacteristic, uuid.toString()));
+	m_uuidMap.insert(std::pair<BLECharacteristic *, BLEUUID>(pCharacteristic, uuid));
 } // setByUUID
 
 
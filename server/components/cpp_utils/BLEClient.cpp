@@ -12,9 +12,12 @@
 #include <esp_gap_ble_api.h>
 #include <esp_gattc_api.h>
 #include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLEScan.h"
 #include "BLEUtils.h"
 #include "BLEService.h"
 #include "GeneralUtils.h"
+#include "Task.h"
 #include <string>
 #include <sstream>
 #include <unordered_set>
@@ -44,12 +47,41 @@
  */
 static const char* LOG_TAG = "BLEClient";
 
+static const EventBits_t RECONNECT_LINK_LOST = (1 << 0);   // The connection has been lost.
+
+
+/**
+ * @brief The task that brings a lost connection back.
+ */
+class BLEReconnectTask : public Task {
+	void run(void* data) {
+		((BLEClient*)data)->reconnect();
+	}
+}; // BLEReconnectTask
+
+
 BLEClient::BLEClient() {
-	m_pClientCallbacks = nullptr;
-	m_conn_id          = 0;
-	m_gattc_if         = 0;
-	m_haveServices     = false;
-	m_isConnected      = false;  // Initially, we are flagged as not connected.
+	m_appId               = BLEDevice::addClient(this);
+	m_pClientCallbacks    = nullptr;
+	m_pGattCache          = nullptr;
+	m_pNotifyRing         = nullptr;
+	m_dataLengthPending   = false;
+	m_pConnectFuture      = nullptr;
+	m_conn_id             = 0;
+	m_gattc_if            = ESP_GATT_IF_NONE;
+	m_haveServices        = false;
+	m_servicesUnverified  = false;
+	m_isConnected         = false;  // Initially, we are flagged as not connected.
+	m_mtu                 = 23;     // The default MTU until a larger one is negotiated.
+	m_autoReconnect       = false;
+	m_disconnectRequested = false;
+	m_linkLost            = false;
+	m_connectStartMs      = 0;
+	m_linkLostMs          = 0;
+	m_stats               = BLEConnectionStats();
+	m_reconnectEvents     = ::xEventGroupCreate();
+	m_pReconnectTask      = nullptr;
+	m_attributeLock       = ::xSemaphoreCreateRecursiveMutex();
 } // BLEClient
 
 
@@ -59,13 +91,42 @@ BLEClient::BLEClient() {
 BLEClient::~BLEClient() {
 	// We may have allocated service references associated with this client.  Before we are finished
 	// with the client, we must release resources.
+	if (m_pReconnectTask != nullptr) {
+		m_pReconnectTask->stop();
+		delete m_pReconnectTask;
+	}
+	::vEventGroupDelete(m_reconnectEvents);
 	for (auto &myPair : m_servicesMap) {
 	   delete myPair.second;
 	}
 	m_servicesMap.clear();
+	BLEDevice::removeClient(this);
+	::vSemaphoreDelete(m_attributeLock);
 } // ~BLEClient
 
 
+/**
+ * @brief Route the events about a characteristic to it.
+ * @param [in] pRemoteCharacteristic The characteristic.
+ */
+void BLEClient::addAttribute(BLERemoteCharacteristic* pRemoteCharacteristic) {
+	::xSemaphoreTakeRecursive(m_attributeLock, portMAX_DELAY);
+	m_characteristicsByHandle[pRemoteCharacteristic->getHandle()] = pRemoteCharacteristic;
+	::xSemaphoreGiveRecursive(m_attributeLock);
+} // addAttribute
+
+
+/**
+ * @brief Route the events about a descriptor to it.
+ * @param [in] pRemoteDescriptor The descriptor.
+ */
+void BLEClient::addAttribute(BLERemoteDescriptor* pRemoteDescriptor) {
+	::xSemaphoreTakeRecursive(m_attributeLock, portMAX_DELAY);
+	m_descriptorsByHandle[pRemoteDescriptor->getHandle()] = pRemoteDescriptor;
+	::xSemaphoreGiveRecursive(m_attributeLock);
+} // addAttribute
+
+
 /**
  * @brief Clear any existing services.
  *
@@ -88,39 +149,50 @@ void BLEClient::clearServices() {
  */
 bool BLEClient::connect(BLEAddress address) {
 	ESP_LOGD(LOG_TAG, ">> connect(%s)", address.toString().c_str());
+	BLEFuture future;
+	bool rc = connectAsync(address, &future) && future.wait() && future.getStatus() == ESP_GATT_OK;
+	ESP_LOGD(LOG_TAG, "<< connect(), rc=%d", rc);
+	return rc;
+} // connect
 
-// We need the connection handle that we get from registering the application.  We register the app
-// and then block on its completion.  When the event has arrived, we will have the handle.
-	m_semaphoreRegEvt.take("connect");
-
-	clearServices(); // Delete any services that may exist.
-
-	esp_err_t errRc = ::esp_ble_gattc_app_register(0);
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "esp_ble_gattc_app_register: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
-		return false;
-	}
-
-	m_semaphoreRegEvt.wait("connect");
 
-	m_peerAddress = address;
+/**
+ * @brief Start connecting to the partner (BLE Server) without waiting for the connection to open.
+ *
+ * Our application is registered with the %BLE stack first if need be.  The registration is kept until we
+ * disconnect so that a failed attempt can be retried.
+ *
+ * @param [in] address The address of the partner.
+ * @param [in] pFuture Completed with ESP_GATT_OK once the connection is open or with the reason it failed.
+ * @return False if the attempt could not be started, in which case the future has already failed.
+ */
+bool BLEClient::connectAsync(BLEAddress address, BLEFuture* pFuture) {
+	ESP_LOGD(LOG_TAG, ">> connectAsync(%s)", address.toString().c_str());
 
-	// Perform the open connection request against the target BLE Server.
-	m_semaphoreOpenEvt.take("connect");
-	errRc = ::esp_ble_gattc_open(
-		getGattcIf(),
-		*getPeerAddress().getNative(), // address
-		1                              // direct connection
-	);
-	if (errRc != ESP_OK) {
-		ESP_LOGE(LOG_TAG, "esp_ble_gattc_open: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+	clearServices(); // Delete any services that may exist.
+	m_haveServices        = false;
+	m_disconnectRequested = false;
+	m_peerAddress         = address;
+	m_pConnectFuture      = pFuture;
+	pFuture->start();
+
+	// The connection is opened once the registration event has given us our GATT client interface.
+	if (m_gattc_if == ESP_GATT_IF_NONE) {
+		esp_err_t errRc = ::esp_ble_gattc_app_register(m_appId);
+		if (errRc != ESP_OK) {
+			ESP_LOGE(LOG_TAG, "esp_ble_gattc_app_register: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			m_pConnectFuture = nullptr;
+			pFuture->complete(ESP_GATT_ERROR);
+			return false;
+		}
+	} else if (!requestOpen()) {
+		m_pConnectFuture = nullptr;
+		pFuture->complete(ESP_GATT_ERROR);
 		return false;
 	}
-
-	uint32_t rc = m_semaphoreOpenEvt.wait("connect");   // Wait for the connection to complete.
-	ESP_LOGD(LOG_TAG, "<< connect(), rc=%d", rc==ESP_GATT_OK);
-	return rc == ESP_GATT_OK;
-} // connect
+	ESP_LOGD(LOG_TAG, "<< connectAsync()");
+	return true;
+} // connectAsync
 
 
 /**
@@ -129,12 +201,16 @@ bool BLEClient::connect(BLEAddress address) {
  */
 void BLEClient::disconnect() {
 	ESP_LOGD(LOG_TAG, ">> disconnect()");
+	m_disconnectRequested = true;   // Stop any reconnection and don't start another.
 	esp_err_t errRc = ::esp_ble_gattc_close(getGattcIf(), getConnId());
 	if (errRc != ESP_OK) {
 		ESP_LOGE(LOG_TAG, "esp_ble_gattc_close: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
 		return;
 	}
 	esp_ble_gattc_app_unregister(getGattcIf());
+	m_gattc_if    = ESP_GATT_IF_NONE;
+	m_writeWindow.close();
+	m_operations.close();
 	m_peerAddress = BLEAddress("00:00:00:00:00:00");
 	ESP_LOGD(LOG_TAG, "<< disconnect()");
 } // disconnect
@@ -159,15 +235,64 @@ void BLEClient::gattClientEventHandler(
 		// - uint16_t          conn_id
 		// - esp_bd_addr_t     remote_bda
 		case ESP_GATTC_DISCONNECT_EVT: {
+				// The stack reports the loss of a link to every client so ignore those of other servers.
+				if (!BLEAddress(evtParam->disconnect.remote_bda).equals(m_lastPeerAddress)) {
+					break;
+				}
 				// If we receive a disconnect event, set the class flag that indicates that we are
 				// no longer connected.
 				if (m_pClientCallbacks != nullptr) {
 					m_pClientCallbacks->onDisconnect(this);
 				}
 				m_isConnected = false;
+				m_mtu         = 23;
+				if (m_autoReconnect && !m_disconnectRequested) {
+					// We didn't ask for this so hold writers until the reconnect task brings the link back.
+					m_stats.linkLosses++;
+					m_linkLost   = true;
+					m_linkLostMs = FreeRTOS::getTimeSinceStart();
+					m_writeWindow.suspend();
+					::xEventGroupSetBits(m_reconnectEvents, RECONNECT_LINK_LOST);
+				} else {
+					m_writeWindow.close();
+				}
+				m_operations.close();
 				break;
 		} // ESP_GATTC_DISCONNECT_EVT
 
+
+		//
+		// ESP_GATTC_CONGEST_EVT
+		//
+		// congest:
+		// - uint16_t conn_id
+		// - bool     congested
+		//
+		// The controller has run out of (or regained) buffers for packets to send on the connection.
+		//
+		case ESP_GATTC_CONGEST_EVT: {
+			if (evtParam->congest.conn_id == m_conn_id) {
+				m_writeWindow.setCongested(evtParam->congest.congested);
+			}
+			break;
+		} // ESP_GATTC_CONGEST_EVT
+
+
+		//
+		// ESP_GATTC_CFG_MTU_EVT
+		//
+		// cfg_mtu:
+		// - esp_gatt_status_t status
+		// - uint16_t          conn_id
+		// - uint16_t          mtu
+		//
+		case ESP_GATTC_CFG_MTU_EVT: {
+			if (evtParam->cfg_mtu.status == ESP_GATT_OK) {
+				m_mtu = evtParam->cfg_mtu.mtu;
+			}
+			break;
+		} // ESP_GATTC_CFG_MTU_EVT
+
 		//
 		// ESP_GATTC_OPEN_EVT
 		//
@@ -179,13 +304,38 @@ void BLEClient::gattClientEventHandler(
 		//
 		case ESP_GATTC_OPEN_EVT: {
 			m_conn_id = evtParam->open.conn_id;
-			if (m_pClientCallbacks != nullptr) {
-				m_pClientCallbacks->onConnect(this);
-			}
 			if (evtParam->open.status == ESP_GATT_OK) {
-				m_isConnected = true;   // Flag us as connected.
+				m_isConnected     = true;   // Flag us as connected.
+				m_mtu             = evtParam->open.mtu;
+				m_lastPeerAddress = m_peerAddress;
+
+				uint32_t now = FreeRTOS::getTimeSinceStart();
+				m_stats.connects++;
+				m_stats.lastConnectMs = now - m_connectStartMs;
+				if (m_stats.lastConnectMs > m_stats.maxConnectMs) {
+					m_stats.maxConnectMs = m_stats.lastConnectMs;
+				}
+				if (m_linkLost) {
+					m_linkLost = false;
+					m_stats.lastOutageMs = now - m_linkLostMs;
+					if (m_stats.lastOutageMs > m_stats.maxOutageMs) {
+						m_stats.maxOutageMs = m_stats.lastOutageMs;
+					}
+				}
+				m_writeWindow.open(gattc_if, m_conn_id);
+				m_operations.open(gattc_if, m_conn_id, evtParam->open.remote_bda);
+				m_connectionParams = BLEConnectionParams();
+				setConnectionProfile(m_connectionProfile);
+				if (m_pClientCallbacks != nullptr) {
+					m_pClientCallbacks->onConnect(this);
+				}
 			}
 			m_semaphoreOpenEvt.give(evtParam->open.status);
+			if (m_pConnectFuture != nullptr) {
+				BLEFuture* pFuture = m_pConnectFuture;
+				m_pConnectFuture = nullptr;
+				pFuture->complete(evtParam->open.status);
+			}
 			break;
 		} // ESP_GATTC_OPEN_EVT
 
@@ -199,11 +349,38 @@ void BLEClient::gattClientEventHandler(
 		//
 		case ESP_GATTC_REG_EVT: {
 			m_gattc_if = gattc_if;
-			m_semaphoreRegEvt.give();
+			// Carry on with the connection that connectAsync() started.
+			if (m_pConnectFuture != nullptr && (evtParam->reg.status != ESP_GATT_OK || !requestOpen())) {
+				ESP_LOGE(LOG_TAG, "Unable to open connection: status=%d", evtParam->reg.status);
+				BLEFuture* pFuture = m_pConnectFuture;
+				m_pConnectFuture = nullptr;
+				pFuture->complete(evtParam->reg.status != ESP_GATT_OK ? evtParam->reg.status : ESP_GATT_ERROR);
+			}
 			break;
 		} // ESP_GATTC_REG_EVT
 
 
+		//
+		// ESP_GATTC_SRVC_CHG_EVT
+		//
+		// srvc_chg:
+		// - esp_bd_addr_t remote_bda
+		//
+		// The server has told us that its services have changed so what we hold of them is stale.
+		//
+		case ESP_GATTC_SRVC_CHG_EVT: {
+			BLEAddress address = BLEAddress(evtParam->srvc_chg.remote_bda);
+			if (!address.equals(m_peerAddress)) {
+				break;
+			}
+			if (m_pGattCache != nullptr) {
+				m_pGattCache->erase(address);
+			}
+			m_haveServices = false;   // Discover them again when next asked.
+			break;
+		} // ESP_GATTC_SRVC_CHG_EVT
+
+
 		//
 		// ESP_GATTC_SEARCH_CMPL_EVT
 		//
@@ -234,7 +411,7 @@ void BLEClient::gattClientEventHandler(
 				evtParam->search_res.start_handle,
 				evtParam->search_res.end_handle
 			);
-			m_servicesMap.insert(std::pair<std::string, BLERemoteService *>(uuid.toString(), pRemoteService));
+			m_servicesMap.insert(std::pair<BLEUUID, BLERemoteService *>(uuid, pRemoteService));
 			break;
 		} // ESP_GATTC_SEARCH_RES_EVT
 
@@ -244,14 +421,83 @@ void BLEClient::gattClientEventHandler(
 		}
 	} // Switch
 
-	// Pass the request on to all services.
-	for (auto &myPair : m_servicesMap) {
-	   myPair.second->gattClientEventHandler(event, gattc_if, evtParam);
+	// The server knows no attribute at a handle taken from a record with no hash, so the record is stale.
+	// Forget it and discover the services again when next asked.
+	if (m_servicesUnverified && m_pGattCache != nullptr) {
+		esp_gatt_status_t status = ESP_GATT_OK;
+		switch(event) {
+			case ESP_GATTC_READ_CHAR_EVT:
+			case ESP_GATTC_READ_DESCR_EVT:  status = evtParam->read.status;  break;
+			case ESP_GATTC_WRITE_CHAR_EVT:
+			case ESP_GATTC_WRITE_DESCR_EVT: status = evtParam->write.status; break;
+			default:                                                          break;
+		} // switch
+		if (status == ESP_GATT_INVALID_HANDLE) {
+			ESP_LOGD(LOG_TAG, "Cached record of %s is stale", m_peerAddress.toString().c_str());
+			m_pGattCache->erase(m_peerAddress);
+			m_servicesUnverified = false;
+			m_haveServices       = false;
+		}
+	}
+
+	// Completions of queued operations go to their futures.
+	if (m_operations.handleEvent(event, evtParam)) {
+		return;
 	}
 
+	// Any other write reported is a write without response that the stack has now passed on, so its credit
+	// can be used for another, and a write with response waiting for the window to drain may now go.
+	if (event == ESP_GATTC_WRITE_CHAR_EVT) {
+		m_writeWindow.release(evtParam->write.status);
+		m_operations.issueNext();
+		return;
+	}
+
+	// Pass events about a characteristic or descriptor to it, found by its handle.
+	uint16_t handle;
+	bool     isDescriptor = false;
+	switch(event) {
+		case ESP_GATTC_NOTIFY_EVT:           handle = evtParam->notify.handle;           break;
+		case ESP_GATTC_READ_DESCR_EVT:       handle = evtParam->read.handle; isDescriptor = true; break;
+		default:
+			return;
+	} // switch
+	// The lock is held while the event is handled, so that once removeAttribute() returns no event is
+	// still being handled by the attribute removed.  It is recursive as a handler may add attributes.
+	::xSemaphoreTakeRecursive(m_attributeLock, portMAX_DELAY);
+	if (isDescriptor) {
+		auto it = m_descriptorsByHandle.find(handle);
+		if (it != m_descriptorsByHandle.end()) {
+			it->second->gattClientEventHandler(event, gattc_if, evtParam);
+		}
+	} else {
+		auto it = m_characteristicsByHandle.find(handle);
+		if (it != m_characteristicsByHandle.end()) {
+			it->second->gattClientEventHandler(event, gattc_if, evtParam);
+		}
+	}
+	::xSemaphoreGiveRecursive(m_attributeLock);
 } // gattClientEventHandler
 
 
+/**
+ * @brief Get the parameters the connection is running with.
+ * @return The parameters last reported for the connection.  Zero where none have been reported.
+ */
+BLEConnectionParams BLEClient::getConnectionParams() {
+	return m_connectionParams;
+} // getConnectionParams
+
+
+/**
+ * @brief Get counts and timings of the connections we have made.
+ * @return A snapshot of the statistics.
+ */
+BLEConnectionStats BLEClient::getConnectionStats() {
+	return m_stats;
+} // getConnectionStats
+
+
 uint16_t BLEClient::getConnId() {
 	return m_conn_id;
 } // getConnId
@@ -263,6 +509,33 @@ esp_gatt_if_t BLEClient::getGattcIf() {
 } // getGattcIf
 
 
+/**
+ * @brief Get the queue of operations waiting to be made on our connection.
+ * @return The operation queue.
+ */
+BLEOperationQueue* BLEClient::getOperationQueue() {
+	return &m_operations;
+} // getOperationQueue
+
+
+/**
+ * @brief Get the credit window for writes without response on our connection.
+ * @return The write window.
+ */
+BLEWriteWindow* BLEClient::getWriteWindow() {
+	return &m_writeWindow;
+} // getWriteWindow
+
+
+/**
+ * @brief Get the MTU negotiated with the remote server.
+ * @return The MTU of the connection.  The default of 23 if none has been negotiated.
+ */
+uint16_t BLEClient::getMTU() {
+	return m_mtu;
+} // getMTU
+
+
 /**
  * @brief Retrieve the address of the peer.
  *
@@ -325,13 +598,18 @@ BLERemoteService* BLEClient::getService(BLEUUID uuid) {
 	if (!m_haveServices) {
 		getServices();
 	}
-	std::string uuidStr = uuid.toString();
-	for (auto &myPair : m_servicesMap) {
-		if (myPair.first == uuidStr) {
-			ESP_LOGD(LOG_TAG, "<< getService: found the service with uuid: %s", uuid.toString().c_str());
-			return myPair.second;
-		}
-	} // End of each of the services.
+	auto it = m_servicesMap.find(uuid);
+	if (it == m_servicesMap.end() && m_servicesUnverified && m_pGattCache != nullptr) {
+		// A record with no hash may be stale, so look at what the server has now before giving up.
+		ESP_LOGD(LOG_TAG, "Service not in cached record; discovering");
+		m_pGattCache->erase(m_peerAddress);
+		getServices();
+		it = m_servicesMap.find(uuid);
+	}
+	if (it != m_servicesMap.end()) {
+		ESP_LOGD(LOG_TAG, "<< getService: found the service with uuid: %s", uuid.toString().c_str());
+		return it->second;
+	}
 	ESP_LOGD(LOG_TAG, "<< getService: not found");
 	throw new BLEUuidNotFoundException;
 } // getService
@@ -340,20 +618,44 @@ BLERemoteService* BLEClient::getService(BLEUUID uuid) {
 /**
  * @brief Ask the remote %BLE server for its services.
  * A %BLE Server exposes a set of services for its partners.  Here we ask the server for its set of
- * services and wait until we have received them all.
+ * services and wait until we have received them all.  If a cache has been set with setGattCache() and it
+ * holds a current record of the server, the services are taken from the record instead.
  * @return N/A
  */
-std::map<std::string, BLERemoteService*>* BLEClient::getServices() {
+std::map<BLEUUID, BLERemoteService*>* BLEClient::getServices() {
 /*
  * Design
  * ------
  * We invoke esp_ble_gattc_search_service.  This will request a list of the service exposed by the
  * peer BLE partner to be returned as events.  Each event will be an an instance of ESP_GATTC_SEARCH_RES_EVT
  * and will culminate with an ESP_GATTC_SEARCH_CMPL_EVT when all have been received.
+ *
+ * With a cache, we first rebuild the services from the record of the server.  If the record holds a
+ * Database Hash, we read the server's current hash through the rebuilt services.  A match means the
+ * record is current and we are done.  Otherwise we throw the rebuilt services away and search as above,
+ * then record what we found for next time.
+ *
+ * A record without a hash cannot be checked up front.  It is used until it is caught out, either by a
+ * service it lacks being asked for or by the server rejecting a handle taken from it, and is then erased.
  */
 	ESP_LOGD(LOG_TAG, ">> getServices");
 
 	clearServices(); // Clear any services that may exist.
+	m_servicesUnverified = false;
+
+	if (m_pGattCache != nullptr) {
+		std::string cachedHash;
+		if (m_pGattCache->restore(this, &cachedHash)) {
+			if (cachedHash.empty() || readDatabaseHash() == cachedHash) {
+				m_haveServices       = true;
+				m_servicesUnverified = cachedHash.empty();
+				ESP_LOGD(LOG_TAG, "<< getServices: from cache");
+				return &m_servicesMap;
+			}
+			ESP_LOGD(LOG_TAG, "Database hash has changed");
+			clearServices();
+		}
+	}
 
 	esp_err_t errRc = esp_ble_gattc_search_service(
 		getGattcIf(),
@@ -367,6 +669,10 @@ std::map<std::string, BLERemoteService*>* BLEClient::getServices() {
 	}
 	m_semaphoreSearchCmplEvt.wait("getServices");
 	m_haveServices = true; // Remember that we now have services.
+
+	if (m_pGattCache != nullptr) {
+		m_pGattCache->store(this, readDatabaseHash());
+	}
 	ESP_LOGD(LOG_TAG, "<< getServices");
 	return &m_servicesMap;
 } // getServices
@@ -386,6 +692,168 @@ std::string BLEClient::getValue(BLEUUID serviceUUID, BLEUUID characteristicUUID)
 } // getValue
 
 
+/**
+ * @brief Ask for a connection to a server and wait for the outcome.
+ *
+ * We must already be registered with the %BLE stack.  A direct connection attempt lasts until the server
+ * is found or the stack gives up on it.
+ *
+ * @param [in] address The address of the server.
+ * @return True if the connection is open.
+ */
+bool BLEClient::open(BLEAddress address) {
+	m_peerAddress = address;
+
+	// Perform the open connection request against the target BLE Server.
+	m_semaphoreOpenEvt.take("open");
+	if (!requestOpen()) {
+		m_semaphoreOpenEvt.give();
+		return false;
+	}
+
+	uint32_t rc = m_semaphoreOpenEvt.wait("open");   // Wait for the connection to complete.
+	return rc == ESP_GATT_OK;
+} // open
+
+
+/**
+ * @brief Read the Database Hash of the server.
+ *
+ * The hash is the value of characteristic 0x2B2A of the Generic Attribute service (0x1801).  It changes
+ * whenever the server's database does.
+ *
+ * @return The hash, or empty if the server does not expose one.
+ */
+std::string BLEClient::readDatabaseHash() {
+	auto serviceIt = m_servicesMap.find(BLEUUID((uint16_t)0x1801));
+	if (serviceIt == m_servicesMap.end()) {
+		return "";
+	}
+	std::map<BLEUUID, BLERemoteCharacteristic*>* pCharacteristics = serviceIt->second->getCharacteristics();
+	auto characteristicIt = pCharacteristics->find(BLEUUID((uint16_t)0x2b2a));
+	if (characteristicIt == pCharacteristics->end()) {
+		return "";
+	}
+	return characteristicIt->second->readValue();
+} // readDatabaseHash
+
+
+/**
+ * @brief Bring the connection back each time it is lost.
+ *
+ * This is the body of the reconnect task.  It sleeps until the connection is lost and then cycles through:
+ *
+ * * Direct - Ask for a direct connection to the server we were connected to.  The %BLE stack connects as
+ * soon as the server advertises, so a server that is merely rebooting is reconnected to at once.
+ * * Scan - Once direct attempts have failed BLE_CLIENT_RECONNECT_DIRECT_ATTEMPTS times, the server is
+ * probably away.  Rather than tie the stack up with long direct attempts, scan for the server with a
+ * filter for its address and only try again once it has been heard.
+ * * Backoff - Wait before the next attempt, doubling the wait after each failure.
+ *
+ * The services and their handles are kept across the outage so references the application holds remain
+ * valid.  Writes without response made during the outage wait in the write window and go out as soon as
+ * the connection is open.
+ */
+void BLEClient::reconnect() {
+	while(1) {
+		::xEventGroupWaitBits(m_reconnectEvents, RECONNECT_LINK_LOST, pdTRUE, pdFALSE, portMAX_DELAY);
+		ESP_LOGD(LOG_TAG, ">> reconnect: %s", m_lastPeerAddress.toString().c_str());
+
+		uint32_t backoffMs = BLE_CLIENT_RECONNECT_MIN_BACKOFF_MS;
+		uint32_t failures  = 0;
+		while (m_autoReconnect && !m_disconnectRequested && !m_isConnected) {
+			bool heard = true;
+			if (failures >= BLE_CLIENT_RECONNECT_DIRECT_ATTEMPTS) {
+				heard = scanForPeer();
+			}
+			if (heard) {
+				m_stats.attempts++;
+				if (open(m_lastPeerAddress)) {
+					break;
+				}
+				failures++;
+			}
+			FreeRTOS::sleep(backoffMs);
+			backoffMs = backoffMs * 2 > BLE_CLIENT_RECONNECT_MAX_BACKOFF_MS ? BLE_CLIENT_RECONNECT_MAX_BACKOFF_MS : backoffMs * 2;
+		}
+		ESP_LOGD(LOG_TAG, "<< reconnect: connected=%d", m_isConnected.load());
+	}
+} // reconnect
+
+
+/**
+ * @brief Stop routing the events about a characteristic to it.
+ * @param [in] pRemoteCharacteristic The characteristic.
+ */
+void BLEClient::removeAttribute(BLERemoteCharacteristic* pRemoteCharacteristic) {
+	::xSemaphoreTakeRecursive(m_attributeLock, portMAX_DELAY);
+	auto it = m_characteristicsByHandle.find(pRemoteCharacteristic->getHandle());
+	if (it != m_characteristicsByHandle.end() && it->second == pRemoteCharacteristic) {
+		m_characteristicsByHandle.erase(it);
+	}
+	::xSemaphoreGiveRecursive(m_attributeLock);
+} // removeAttribute
+
+
+/**
+ * @brief Stop routing the events about a descriptor to it.
+ * @param [in] pRemoteDescriptor The descriptor.
+ */
+void BLEClient::removeAttribute(BLERemoteDescriptor* pRemoteDescriptor) {
+	::xSemaphoreTakeRecursive(m_attributeLock, portMAX_DELAY);
+	auto it = m_descriptorsByHandle.find(pRemoteDescriptor->getHandle());
+	if (it != m_descriptorsByHandle.end() && it->second == pRemoteDescriptor) {
+		m_descriptorsByHandle.erase(it);
+	}
+	::xSemaphoreGiveRecursive(m_attributeLock);
+} // removeAttribute
+
+
+/**
+ * @brief Ask the %BLE stack for a direct connection to m_peerAddress.
+ *
+ * The outcome arrives as ESP_GATTC_OPEN_EVT.
+ *
+ * @return False if we have been asked to disconnect or the stack refused the request.
+ */
+bool BLEClient::requestOpen() {
+	// disconnect() unregisters us, so a reconnection racing it would otherwise open on no interface.
+	if (m_disconnectRequested || m_gattc_if == ESP_GATT_IF_NONE) {
+		ESP_LOGD(LOG_TAG, "requestOpen: disconnect requested");
+		return false;
+	}
+	m_connectStartMs = FreeRTOS::getTimeSinceStart();
+	esp_err_t errRc = ::esp_ble_gattc_open(
+		getGattcIf(),
+		*getPeerAddress().getNative(), // address
+		1                              // direct connection
+	);
+	if (errRc != ESP_OK) {
+		ESP_LOGE(LOG_TAG, "esp_ble_gattc_open: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+		return false;
+	}
+	return true;
+} // requestOpen
+
+
+/**
+ * @brief Scan for the server we were last connected to.
+ *
+ * The scan is given a filter of its own so that only the server is reported.  The application's filter is
+ * left alone and applies again once the scan ends.
+ *
+ * @return True if the server was heard.
+ */
+bool BLEClient::scanForPeer() {
+	m_stats.scans++;
+	BLEScanFilter filter;
+	filter.addAddress(m_lastPeerAddress);
+	int count = BLEDevice::getScan()->start(BLE_CLIENT_RECONNECT_SCAN_SECONDS, filter).getCount();
+	ESP_LOGD(LOG_TAG, "scanForPeer: heard=%d", count > 0);
+	return count > 0;
+} // scanForPeer
+
+
 /**
  * @brief Handle a received GAP event.
  *
@@ -406,10 +874,68 @@ void BLEClient::handleGAPEvent(
 		// - esp_bd_addr_t remote_addr
 		//
 		case ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT: {
+			if (!BLEAddress(param->read_rssi_cmpl.remote_addr).equals(m_peerAddress)) {
+				break;   // The reading is for another client.
+			}
 			m_semaphoreRssiCmplEvt.give((uint32_t)param->read_rssi_cmpl.rssi);
 			break;
 		} // ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT
 
+		//
+		// ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT
+		//
+		// pkt_data_lenth_cmpl
+		// - esp_bt_status_t                  status
+		// - esp_ble_pkt_data_length_params_t params
+		//
+		// The event does not say which connection it is for, so it is taken by a client with a request outstanding.
+		//
+		case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT: {
+			if (!m_dataLengthPending) {
+				break;
+			}
+			m_dataLengthPending = false;
+			if (param->pkt_data_lenth_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+				ESP_LOGE(LOG_TAG, "Data length change failed: status=%d", param->pkt_data_lenth_cmpl.status);
+				break;
+			}
+			m_connectionParams.txOctets = param->pkt_data_lenth_cmpl.params.tx_len;
+			m_connectionParams.rxOctets = param->pkt_data_lenth_cmpl.params.rx_len;
+			if (m_pClientCallbacks != nullptr) {
+				m_pClientCallbacks->onConnParamsUpdate(this, m_connectionParams);
+			}
+			break;
+		} // ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT
+
+		//
+		// ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+		//
+		// update_conn_params
+		// - esp_bt_status_t status
+		// - esp_bd_addr_t   bda
+		// - uint16_t        min_int
+		// - uint16_t        max_int
+		// - uint16_t        latency
+		// - uint16_t        conn_int
+		// - uint16_t        timeout
+		//
+		case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT: {
+			if (!m_isConnected || !BLEAddress(param->update_conn_params.bda).equals(m_peerAddress)) {
+				break;   // The update is for another connection.
+			}
+			if (param->update_conn_params.status != ESP_BT_STATUS_SUCCESS) {
+				ESP_LOGE(LOG_TAG, "Connection parameter update failed: status=%d", param->update_conn_params.status);
+				break;
+			}
+			m_connectionParams.interval = param->update_conn_params.conn_int;
+			m_connectionParams.latency  = param->update_conn_params.latency;
+			m_connectionParams.timeout  = param->update_conn_params.timeout;
+			if (m_pClientCallbacks != nullptr) {
+				m_pClientCallbacks->onConnParamsUpdate(this, m_connectionParams);
+			}
+			break;
+		} // ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT
+
 		default:
 			break;
 	}
@@ -427,6 +953,29 @@ bool BLEClient::isConnected() {
 
 
 
+/**
+ * @brief Reconnect to the server whenever the connection is lost without our asking.
+ *
+ * A task is started which, when the connection is lost, tries to bring it back as described for reconnect().
+ * While it does so, writes without response wait for the connection rather than fail.  getConnectionStats()
+ * reports how long connections and outages took.
+ *
+ * @param [in] autoReconnect True to reconnect.
+ */
+void BLEClient::setAutoReconnect(bool autoReconnect) {
+	m_autoReconnect = autoReconnect;
+	if (autoReconnect && m_pReconnectTask == nullptr) {
+		m_pReconnectTask = new BLEReconnectTask();
+		m_pReconnectTask->setName("BLEReconnect");
+		m_pReconnectTask->setStackSize(8192);
+		m_pReconnectTask->start(this);
+	}
+	if (!autoReconnect && !m_isConnected) {
+		m_writeWindow.close();   // Release any writers waiting for the connection to return.
+	}
+} // setAutoReconnect
+
+
 /**
  * @brief Set the callbacks that will be invoked.
  */
@@ -435,6 +984,52 @@ void BLEClient::setClientCallbacks(BLEClientCallbacks* pClientCallbacks) {
 } // setClientCallbacks
 
 
+/**
+ * @brief Set the connection profile to ask for.
+ *
+ * The profile is asked for now if we are connected and again each time a connection is opened.  It may be
+ * changed at any time, for example to a low latency profile while the user waits on the server.  The
+ * outcome is reported to BLEClientCallbacks::onConnParamsUpdate().
+ *
+ * @param [in] profile The profile to ask for.
+ */
+void BLEClient::setConnectionProfile(const BLEConnectionProfile& profile) {
+	m_connectionProfile = profile;
+	if (!m_isConnected) {
+		return;
+	}
+	m_dataLengthPending = profile.txOctets != 0;   // Before the request, as the reply may beat us back.
+	if (profile.apply(*m_peerAddress.getNative()) != ESP_OK) {
+		m_dataLengthPending = false;
+	}
+} // setConnectionProfile
+
+
+/**
+ * @brief Set a cache in which to keep the services of the servers we connect to.
+ *
+ * With a cache, reconnecting to a server whose services we have seen before skips discovering them.
+ *
+ * @param [in] pGattCache The cache, or nullptr to always discover.
+ */
+void BLEClient::setGattCache(BLEGattCache* pGattCache) {
+	m_pGattCache = pGattCache;
+} // setGattCache
+
+
+/**
+ * @brief Set a ring through which notifications are delivered.
+ *
+ * With a ring, notification callbacks are called from the ring's task rather than the %BLE stack's, so a
+ * slow callback no longer holds up the stack.  Notifications that arrive while the ring is full are dropped.
+ *
+ * @param [in] pNotifyRing The ring, or nullptr to call notification callbacks from the %BLE stack's task.
+ */
+void BLEClient::setNotifyRing(BLENotifyRing* pNotifyRing) {
+	m_pNotifyRing = pNotifyRing;
+} // setNotifyRing
+
+
 /**
  * @brief Set the value of a specific characteristic associated with a specific service.
  * @param [in] serviceUUID The service that owns the characteristic.
@@ -448,6 +1043,19 @@ void BLEClient::setValue(BLEUUID serviceUUID, BLEUUID characteristicUUID, std::s
 } // setValue
 
 
+/**
+ * @brief Set how many writes without response may be outstanding on the connection at once.
+ *
+ * A larger window lets more writes be queued in the %BLE stack without waiting.  The stack still holds back
+ * writes while the controller reports the connection congested.  The default is BLE_CLIENT_DEFAULT_WRITE_WINDOW.
+ *
+ * @param [in] size The number of writes.
+ */
+void BLEClient::setWriteWindow(uint8_t size) {
+	m_writeWindow.setSize(size);
+} // setWriteWindow
+
+
 /**
  * @brief Return a string representation of this client.
  * @return A string representation of this client.
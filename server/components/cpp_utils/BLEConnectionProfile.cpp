@@ -0,0 +1,99 @@
+/*
+ * BLEConnectionProfile.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <string.h>
+#include <sstream>
+#include "BLEAddress.h"
+#include "BLEConnectionProfile.h"
+#include "GeneralUtils.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEConnectionProfile";
+
+const BLEConnectionProfile BLEConnectionProfile::LowLatency(6, 12, 0, 400, 251);
+const BLEConnectionProfile BLEConnectionProfile::Balanced(24, 40, 0, 400, 251);
+const BLEConnectionProfile BLEConnectionProfile::LowPower(80, 160, 4, 600, 251);
+
+
+/**
+ * @brief Construct a profile that leaves connections as they are.
+ */
+BLEConnectionProfile::BLEConnectionProfile() {
+	minInterval = 0;
+	maxInterval = 0;
+	latency     = 0;
+	timeout     = 0;
+	txOctets    = 0;
+} // BLEConnectionProfile
+
+
+/**
+ * @brief Construct a profile.
+ * @param [in] minInterval Shortest acceptable connection interval in units of 1.25 ms, from 6 (7.5 ms).
+ * @param [in] maxInterval Longest acceptable connection interval in units of 1.25 ms, up to 3200 (4 s).
+ * @param [in] latency Connection events the peripheral may skip.
+ * @param [in] timeout Supervision timeout in units of 10 ms.  It must exceed (1 + latency) * maxInterval * 2.5.
+ * @param [in] txOctets Link layer payload to ask for, from 27 to 251, or 0 to leave the data length alone.
+ */
+BLEConnectionProfile::BLEConnectionProfile(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, uint16_t txOctets) {
+	this->minInterval = minInterval;
+	this->maxInterval = maxInterval;
+	this->latency     = latency;
+	this->timeout     = timeout;
+	this->txOctets    = txOctets;
+} // BLEConnectionProfile
+
+
+/**
+ * @brief Ask for the profile on a connection.
+ *
+ * Returns once the requests are with the %BLE stack.  The outcome arrives later as
+ * ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT and ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT.
+ *
+ * @param [in] address The address of the peer on the connection.
+ * @return ESP_OK if the requests were made.
+ */
+esp_err_t BLEConnectionProfile::apply(esp_bd_addr_t address) const {
+	ESP_LOGD(LOG_TAG, ">> apply: %s to %s", toString().c_str(), BLEAddress(address).toString().c_str());
+	if (maxInterval != 0) {
+		esp_ble_conn_update_params_t params;
+		memcpy(params.bda, address, sizeof(esp_bd_addr_t));
+		params.min_int = minInterval;
+		params.max_int = maxInterval;
+		params.latency = latency;
+		params.timeout = timeout;
+		esp_err_t errRc = ::esp_ble_gap_update_conn_params(&params);
+		if (errRc != ESP_OK) {
+			ESP_LOGE(LOG_TAG, "esp_ble_gap_update_conn_params: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			return errRc;
+		}
+	}
+	if (txOctets != 0) {
+		esp_err_t errRc = ::esp_ble_gap_set_pkt_data_len(address, txOctets);
+		if (errRc != ESP_OK) {
+			ESP_LOGE(LOG_TAG, "esp_ble_gap_set_pkt_data_len: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			return errRc;
+		}
+	}
+	ESP_LOGD(LOG_TAG, "<< apply");
+	return ESP_OK;
+} // apply
+
+
+/**
+ * @brief Return a string representation of the profile.
+ * @return A string representation of the profile.
+ */
+std::string BLEConnectionProfile::toString() const {
+	std::stringstream ss;
+	ss << "interval: " << minInterval << "-" << maxInterval << ", latency: " << latency <<
+		", timeout: " << timeout << ", txOctets: " << txOctets;
+	return ss.str();
+} // toString
+
+#endif /* CONFIG_BT_ENABLED */
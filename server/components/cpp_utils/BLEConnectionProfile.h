@@ -0,0 +1,62 @@
+/*
+ * BLEConnectionProfile.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLECONNECTIONPROFILE_H_
+#define COMPONENTS_CPP_UTILS_BLECONNECTIONPROFILE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_err.h>
+#include <esp_gap_ble_api.h>
+#include <string>
+
+/**
+ * @brief The parameters a connection is actually running with.
+ *
+ * Fields are zero until the %BLE stack has reported them.
+ */
+struct BLEConnectionParams {
+	uint16_t interval = 0;   // Connection interval in units of 1.25 ms.
+	uint16_t latency  = 0;   // Connection events the peripheral may skip.
+	uint16_t timeout  = 0;   // Supervision timeout in units of 10 ms.
+	uint16_t txOctets = 0;   // Longest link layer payload we send.  27 without data length extension.
+	uint16_t rxOctets = 0;   // Longest link layer payload we receive.
+};
+
+
+/**
+ * @brief The connection parameters and data length asked for on a connection.
+ *
+ * Every connection otherwise runs at whatever interval the central picked when it connected.  The
+ * interval bounds the time from an event on one device to its arrival at the other, while a longer
+ * interval and slave latency let both radios sleep for longer.  Three profiles are provided:
+ *
+ * * LowLatency - A 7.5 to 15 ms interval with no slave latency, for when a user is waiting on the link.
+ * * Balanced - A 30 to 50 ms interval with no slave latency.
+ * * LowPower - A 100 to 200 ms interval over which the peripheral may skip 4 connection events.
+ *
+ * All three ask for data length extension so that a full 251 byte payload fits in one packet.  A field
+ * of zero leaves that part of the connection as it is.  The peer may refuse or adjust what is asked for,
+ * so the values granted are reported through the client and server callbacks.
+ */
+class BLEConnectionProfile {
+public:
+	BLEConnectionProfile();
+	BLEConnectionProfile(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout, uint16_t txOctets);
+
+	esp_err_t   apply(esp_bd_addr_t address) const;
+	std::string toString() const;
+
+	uint16_t minInterval;   // Shortest acceptable connection interval in units of 1.25 ms.
+	uint16_t maxInterval;   // Longest acceptable connection interval in units of 1.25 ms.
+	uint16_t latency;       // Connection events the peripheral may skip.
+	uint16_t timeout;       // Supervision timeout in units of 10 ms.
+	uint16_t txOctets;      // Link layer payload to ask for, from 27 to 251.
+
+	static const BLEConnectionProfile LowLatency;
+	static const BLEConnectionProfile Balanced;
+	static const BLEConnectionProfile LowPower;
+}; // BLEConnectionProfile
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLECONNECTIONPROFILE_H_ */
@@ -14,6 +14,7 @@
 #include <esp_log.h>
 #include <esp_err.h>
 #include "BLEService.h"
+#include "BLEServer.h"
 #include "BLEDescriptor.h"
 #include "GeneralUtils.h"
 #ifdef ARDUINO_ARCH_ESP32
@@ -41,6 +42,7 @@ BLEDescriptor::BLEDescriptor(BLEUUID uuid) {
 	m_value.attr_len     = 0;                                         // Initial length is 0.
 	m_value.attr_max_len = ESP_GATT_MAX_ATTR_LEN;                     // Maximum length of the data.
 	m_handle             = NULL_HANDLE;                               // Handle is initially unknown.
+	m_isCCCD             = uuid.equals(BLEUUID((uint16_t) 0x2902));   // Is this a Client Characteristic Configuration?
 	m_pCharacteristic    = nullptr;                                   // No initial characteristic.
 	m_pCallback          = nullptr;                                   // No initial callback.
 
@@ -88,6 +90,19 @@ void BLEDescriptor::executeCreate(BLECharacteristic* pCharacteristic) {
 } // executeCreate
 
 
+/**
+ * @brief Get the Client Characteristic Configuration a client has written to this 0x2902 descriptor.
+ * @param [in] connId The connection of the client.
+ * @return The configuration value or zero if the client has not written one.
+ */
+uint16_t BLEDescriptor::getCCCD(uint16_t connId) {
+	if (m_pCharacteristic == nullptr) {
+		return 0;
+	}
+	return m_pCharacteristic->getService()->getServer()->getCCCD(connId, m_handle);
+} // getCCCD
+
+
 /**
  * @brief Get the BLE handle for this descriptor.
  * @return The handle for this descriptor.
@@ -159,6 +174,7 @@ void BLEDescriptor::handleGATTServerEvent(
 					m_pCharacteristic->getService()->getHandle() == param->add_char_descr.service_handle &&
 					m_pCharacteristic == m_pCharacteristic->getService()->getLastCreatedCharacteristic()) {
 				setHandle(param->add_char_descr.attr_handle);
+				m_pCharacteristic->getService()->getServer()->m_attributeMap.setByHandle(param->add_char_descr.attr_handle, this);
 				m_semaphoreCreateEvt.give();
 			}
 			break;
@@ -180,6 +196,13 @@ void BLEDescriptor::handleGATTServerEvent(
 			if (param->write.handle == m_handle) {
 				setValue(param->write.value, param->write.len);   // Set the value of the descriptor.
 
+				// Each client has its own Client Characteristic Configuration.  Our own value only records the
+				// most recent write from any of them.
+				if (m_isCCCD && param->write.len >= 1) {
+					uint16_t cccd = param->write.value[0] | (param->write.len >= 2 ? param->write.value[1] << 8 : 0);
+					m_pCharacteristic->getService()->getServer()->setCCCD(param->write.conn_id, m_handle, cccd);
+				}
+
 				esp_gatt_rsp_t rsp;   // Build a response.
 				rsp.attr_value.len    = getLength();
 				rsp.attr_value.handle = m_handle;
@@ -232,6 +255,13 @@ void BLEDescriptor::handleGATTServerEvent(
 					rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
 					memcpy(rsp.attr_value.value, getValue(), rsp.attr_value.len);
 
+					if (m_isCCCD) {   // A client reads back its own configuration.
+						uint16_t cccd = getCCCD(param->read.conn_id);
+						rsp.attr_value.len      = 2;
+						rsp.attr_value.value[0] = cccd & 0xff;
+						rsp.attr_value.value[1] = cccd >> 8;
+					}
+
 					esp_err_t errRc = ::esp_ble_gatts_send_response(
 							gatts_if,
 							param->read.conn_id,
@@ -259,7 +289,7 @@ void BLEDescriptor::handleGATTServerEvent(
  * @param [in] pCallbacks An instance of a callback structure used to define any callbacks for the descriptor.
  */
 void BLEDescriptor::setCallbacks(BLEDescriptorCallbacks* pCallback) {
-	ESP_LOGD(LOG_TAG, ">> setCallbacks: 0x%x", (uint32_t)pCallback);
+	ESP_LOGD(LOG_TAG, ">> setCallbacks: 0x%x", (uint32_t)(uintptr_t)pCallback);
 	m_pCallback = pCallback;
 	ESP_LOGD(LOG_TAG, "<< setCallbacks");
 } // setCallbacks
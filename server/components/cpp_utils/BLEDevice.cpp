@@ -39,14 +39,80 @@ static const char* LOG_TAG = "BLEDevice";
  */
 BLEServer* BLEDevice::m_pServer = nullptr;
 BLEScan*   BLEDevice::m_pScan   = nullptr;
-BLEClient* BLEDevice::m_pClient = nullptr;
+std::map<uint16_t, BLEClient*>      BLEDevice::m_clientsByAppId;
+std::map<esp_gatt_if_t, BLEClient*> BLEDevice::m_clientsByGattcIf;
+SemaphoreHandle_t                   BLEDevice::m_clientsLock = ::xSemaphoreCreateRecursiveMutex();
+uint16_t   BLEDevice::m_nextAppId = 0;
 bool       initialized          = false;   // Have we been initialized?
 esp_ble_sec_act_t 	BLEDevice::m_securityLevel = (esp_ble_sec_act_t)0;
 BLESecurityCallbacks* BLEDevice::m_securityCallbacks = nullptr;
 uint16_t   BLEDevice::m_localMTU = 23;
+std::atomic<BLEEventTrace*> BLEDevice::m_pEventTrace(nullptr);
+SemaphoreHandle_t           BLEDevice::m_eventTraceLock = ::xSemaphoreCreateMutex();
+
+/**
+ * @brief Add a client to those that GATT client events are routed to.
+ *
+ * Each client registers with the %BLE stack under its own app id and so is given its own GATT client
+ * interface, to which the stack addresses the events of the client's connection.
+ *
+ * @param [in] pClient The client.
+ * @return The app id the client is to register with.
+ */
+/* STATIC */ uint16_t BLEDevice::addClient(BLEClient* pClient) {
+	::xSemaphoreTakeRecursive(m_clientsLock, portMAX_DELAY);
+	uint16_t appId = m_nextAppId++;
+	m_clientsByAppId.insert(std::pair<uint16_t, BLEClient*>(appId, pClient));
+	::xSemaphoreGiveRecursive(m_clientsLock);
+	return appId;
+} // addClient
+
+
+/**
+ * @brief Stop routing events to a client that is being destroyed.
+ *
+ * The %BLE stack delivers events on its own task, which holds the lock on the clients while it passes an
+ * event to them, so once we return no event is being or will be passed to this client.
+ *
+ * @param [in] pClient The client.
+ */
+/* STATIC */ void BLEDevice::removeClient(BLEClient* pClient) {
+	::xSemaphoreTakeRecursive(m_clientsLock, portMAX_DELAY);
+	m_clientsByAppId.erase(pClient->m_appId);
+	for (auto it = m_clientsByGattcIf.begin(); it != m_clientsByGattcIf.end(); ) {
+		if (it->second == pClient) {
+			it = m_clientsByGattcIf.erase(it);
+		} else {
+			++it;
+		}
+	}
+	::xSemaphoreGiveRecursive(m_clientsLock);
+} // removeClient
+
+
+/**
+ * @brief Record an event into the trace, if one is set.
+ *
+ * The lock is only taken while tracing, so that the usual case costs one load.
+ */
+/* STATIC */ void BLEDevice::recordEvent(uint8_t source, uint8_t event, uint8_t iface, const void* param, size_t paramSize) {
+	if (m_pEventTrace.load(std::memory_order_relaxed) == nullptr) {
+		return;
+	}
+	::xSemaphoreTake(m_eventTraceLock, portMAX_DELAY);
+	BLEEventTrace* pEventTrace = m_pEventTrace;
+	if (pEventTrace != nullptr) {
+		pEventTrace->record(source, event, iface, param, paramSize);
+	}
+	::xSemaphoreGive(m_eventTraceLock);
+} // recordEvent
+
 
 /**
  * @brief Create a new instance of a client.
+ *
+ * Any number of clients may be created, each with its own connection to a server.
+ *
  * @return A new instance of the client.
  */
 /* STATIC */ BLEClient* BLEDevice::createClient() {
@@ -55,9 +121,9 @@ uint16_t   BLEDevice::m_localMTU = 23;
 	ESP_LOGE(LOG_TAG, "BLE GATTC is not enabled - CONFIG_GATTC_ENABLE not defined");
 	abort();
 #endif  // CONFIG_GATTC_ENABLE
-	m_pClient = new BLEClient();
+	BLEClient* pClient = new BLEClient();
 	ESP_LOGD(LOG_TAG, "<< createClient");
-	return m_pClient;
+	return pClient;
 } // createClient
 
 
@@ -90,25 +156,28 @@ uint16_t   BLEDevice::m_localMTU = 23;
    esp_gatt_if_t             gatts_if,
    esp_ble_gatts_cb_param_t* param
 ) {
-	ESP_LOGD(LOG_TAG, "gattServerEventHandler [esp_gatt_if: %d] ... %s",
-		gatts_if,
-		BLEUtils::gattServerEventTypeToString(event).c_str());
+	recordEvent(BLEEventTrace::SOURCE_GATT_SERVER, event, gatts_if, param, sizeof(*param));
+
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, "gattServerEventHandler [esp_gatt_if: %d] ... %s",
+			gatts_if,
+			BLEUtils::gattServerEventTypeToString(event).c_str());
+	}
 
 	BLEUtils::dumpGattServerEvent(event, gatts_if, param);
 
 	switch(event) {
 		case ESP_GATTS_CONNECT_EVT: {
-			BLEDevice::m_localMTU = 23;
 			if(BLEDevice::m_securityLevel){
 				esp_ble_set_encryption(param->connect.remote_bda, BLEDevice::m_securityLevel);
 			}
 			break;
 		} // ESP_GATTS_CONNECT_EVT
 
+		// The negotiated MTU belongs to the connection and is recorded by the server.
 		case ESP_GATTS_MTU_EVT: {
-			BLEDevice::m_localMTU = param->mtu.mtu;
-	        ESP_LOGI(LOG_TAG, "ESP_GATTS_MTU_EVT, MTU %d", BLEDevice::m_localMTU);
-	        break;
+			ESP_LOGI(LOG_TAG, "ESP_GATTS_MTU_EVT, conn_id %d, MTU %d", param->mtu.conn_id, param->mtu.mtu);
+			break;
 		}
 		default: {
 			break;
@@ -136,8 +205,12 @@ uint16_t   BLEDevice::m_localMTU = 23;
 	esp_gatt_if_t             gattc_if,
 	esp_ble_gattc_cb_param_t* param) {
 
-	ESP_LOGD(LOG_TAG, "gattClientEventHandler [esp_gatt_if: %d] ... %s",
-		gattc_if, BLEUtils::gattClientEventTypeToString(event).c_str());
+	recordEvent(BLEEventTrace::SOURCE_GATT_CLIENT, event, gattc_if, param, sizeof(*param));
+
+	if (LOG_LEVEL_ENABLED(ESP_LOG_DEBUG)) {
+		ESP_LOGD(LOG_TAG, "gattClientEventHandler [esp_gatt_if: %d] ... %s",
+			gattc_if, BLEUtils::gattClientEventTypeToString(event).c_str());
+	}
 	BLEUtils::dumpGattClientEvent(event, gattc_if, param);
 
 	switch(event) {
@@ -154,16 +227,44 @@ uint16_t   BLEDevice::m_localMTU = 23;
 			break;
 		} // ESP_GATTC_CONNECT_EVT
 
+		//
+		// ESP_GATTC_REG_EVT
+		//
+		// A client has registered.  From now on the stack addresses its events to the interface it has been
+		// given so remember whose interface it is.
+		//
+		case ESP_GATTC_REG_EVT: {
+			::xSemaphoreTakeRecursive(m_clientsLock, portMAX_DELAY);
+			auto it = m_clientsByAppId.find(param->reg.app_id);
+			if (it != m_clientsByAppId.end()) {
+				m_clientsByGattcIf[gattc_if] = it->second;
+			}
+			::xSemaphoreGiveRecursive(m_clientsLock);
+			break;
+		} // ESP_GATTC_REG_EVT
+
 		default: {
 			break;
 		}
 	} // switch
 
 
-	// If we have a client registered, call it.
-	if (BLEDevice::m_pClient != nullptr) {
-		BLEDevice::m_pClient->gattClientEventHandler(event, gattc_if, param);
+	// Pass the event to the client it is addressed to or, if it is addressed to no interface in particular,
+	// to every client.  The lock is recursive so that a handler may itself create or remove a client; we
+	// step past each client before handing it the event in case it removes itself.
+	::xSemaphoreTakeRecursive(m_clientsLock, portMAX_DELAY);
+	if (gattc_if == ESP_GATT_IF_NONE) {
+		for (auto it = m_clientsByGattcIf.begin(); it != m_clientsByGattcIf.end(); ) {
+			BLEClient* pClient = (it++)->second;
+			pClient->gattClientEventHandler(event, gattc_if, param);
+		}
+	} else {
+		auto it = m_clientsByGattcIf.find(gattc_if);
+		if (it != m_clientsByGattcIf.end()) {
+			it->second->gattClientEventHandler(event, gattc_if, param);
+		}
 	}
+	::xSemaphoreGiveRecursive(m_clientsLock);
 
 } // gattClientEventHandler
 
@@ -175,6 +276,8 @@ uint16_t   BLEDevice::m_localMTU = 23;
 	esp_gap_ble_cb_event_t event,
 	esp_ble_gap_cb_param_t *param) {
 
+	recordEvent(BLEEventTrace::SOURCE_GAP, event, 0, param, sizeof(*param));
+
 	BLEUtils::dumpGapEvent(event, param);
 
 	switch(event) {
@@ -244,9 +347,12 @@ uint16_t   BLEDevice::m_localMTU = 23;
 		BLEDevice::m_pServer->handleGAPEvent(event, param);
 	}
 
-	if (BLEDevice::m_pClient != nullptr) {
-		BLEDevice::m_pClient->handleGAPEvent(event, param);
+	::xSemaphoreTakeRecursive(m_clientsLock, portMAX_DELAY);
+	for (auto it = m_clientsByAppId.begin(); it != m_clientsByAppId.end(); ) {
+		BLEClient* pClient = (it++)->second;
+		pClient->handleGAPEvent(event, param);
 	}
+	::xSemaphoreGiveRecursive(m_clientsLock);
 
 	if (BLEDevice::m_pScan != nullptr) {
 		BLEDevice::getScan()->handleGAPEvent(event, param);
@@ -477,6 +583,20 @@ void BLEDevice::setEncryptionLevel(esp_ble_sec_act_t level) {
 	BLEDevice::m_securityLevel = level;
 }
 
+/**
+ * @brief Record every event the %BLE stack delivers.
+ *
+ * Events are recorded as they arrive, before they are handled.  Once this returns no event is being
+ * recorded into the trace it replaces, which may then be deleted.
+ *
+ * @param [in] pEventTrace The trace to record into or nullptr to stop recording.
+ */
+/* STATIC */ void BLEDevice::setEventTrace(BLEEventTrace* pEventTrace) {
+	::xSemaphoreTake(m_eventTraceLock, portMAX_DELAY);
+	m_pEventTrace = pEventTrace;
+	::xSemaphoreGive(m_eventTraceLock);
+} // setEventTrace
+
 /*
  * @brief Set callbacks that will be used to handle encryption negotiation events and authentication events
  * @param [in] cllbacks Pointer to BLESecurityCallbacks class callback
@@ -502,7 +622,10 @@ esp_err_t BLEDevice::setMTU(uint16_t mtu) {
 }
 
 /*
- * @brief Get local MTU value set during mtu request or default value
+ * @brief Get the local MTU value set by setMTU() or the default value.
+ *
+ * This is the largest MTU we will accept.  The MTU actually used on a connection is negotiated with the peer;
+ * see BLEServer::getPeerMTU() and BLEClient::getMTU().
  */
 uint16_t BLEDevice::getMTU() {
 	return m_localMTU;
@@ -11,15 +11,19 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <esp_gap_ble_api.h> // ESP32 BLE
 #include <esp_gattc_api.h>   // ESP32 BLE
+#include <atomic>
 #include <map>               // Part of C++ STL
 #include <string>
 #include <esp_bt.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include "BLEServer.h"
 #include "BLEClient.h"
 #include "BLEUtils.h"
 #include "BLEScan.h"
 #include "BLEAddress.h"
+#include "BLEEventTrace.h"
 
 /**
  * @brief %BLE functions.
@@ -39,19 +43,30 @@ public:
 	static void        whiteListAdd(BLEAddress address);    // Add an entry to the BLE white list.
 	static void        whiteListRemove(BLEAddress address); // Remove an entry from the BLE white list.
 	static void		   setEncryptionLevel(esp_ble_sec_act_t level);
+	static void        setEventTrace(BLEEventTrace* pEventTrace);  // Record every event the BLE stack delivers.
 	static void		   setSecurityCallbacks(BLESecurityCallbacks* pCallbacks);
 	static esp_err_t   setMTU(uint16_t mtu);
 	static uint16_t	   getMTU();
 
 private:
+	friend class BLEClient;
+	friend class BLEEventTrace;
+
 	static BLEServer *m_pServer;
 	static BLEScan   *m_pScan;
-	static BLEClient *m_pClient;
+	static std::map<uint16_t, BLEClient*>      m_clientsByAppId;      // Every client, keyed by the app id it registers with.
+	static std::map<esp_gatt_if_t, BLEClient*> m_clientsByGattcIf;    // Registered clients, keyed by their GATT client interface.
+	static SemaphoreHandle_t                   m_clientsLock;         // Guards both client maps.
+	static uint16_t                            m_nextAppId;
 	static esp_ble_sec_act_t 	m_securityLevel;
 	static BLESecurityCallbacks* m_securityCallbacks;
 	static uint16_t		m_localMTU;
+	static std::atomic<BLEEventTrace*> m_pEventTrace;
+	static SemaphoreHandle_t           m_eventTraceLock;   // Held while an event is recorded and while the trace is changed.
 
-	static esp_gatt_if_t getGattcIF();
+	static uint16_t addClient(BLEClient* pClient);
+	static void     recordEvent(uint8_t source, uint8_t event, uint8_t iface, const void* param, size_t paramSize);
+	static void     removeClient(BLEClient* pClient);
 
 	static void gattClientEventHandler(
 		esp_gattc_cb_event_t      event,
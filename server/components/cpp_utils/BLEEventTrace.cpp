@@ -0,0 +1,414 @@
+/*
+ * BLEEventTrace.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_bt_main.h>
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BLEEventTrace.h"
+#include "BLEDevice.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEEventTrace";
+
+/*
+ * Design
+ * ------
+ * A dumped trace is the five bytes "BLET" and TRACE_VERSION followed by the records, oldest first.  Each
+ * record, in the byte order of the ESP32, is:
+ *
+ *   uint16_t length        The length of the whole record.
+ *   uint8_t  source        GAP, GATT client or GATT server.
+ *   uint8_t  event         The event id.
+ *   uint8_t  iface         The GATT interface the event was addressed to.  Zero for GAP.
+ *   uint32_t timeUs        esp_timer_get_time() when the event arrived, wrapping every 71 minutes.
+ *   uint16_t paramLength   The length of the parameters which follow.
+ *   uint8_t  param[paramLength]
+ *   uint8_t  payload[length - RECORD_HEADER_SIZE - paramLength]
+ *
+ * The parameters are the bytes of the event's parameter union with trailing zeros trimmed.  Most events
+ * use only the first few bytes of the union so this is where a record saves most of its space.  The value
+ * an event points at is copied into the payload and the pointer in the recorded parameters is zeroed, so
+ * the recording holds no addresses.  On replay the parameters are zero filled back to the size of the
+ * union and the pointer is set to the payload.
+ *
+ * The ring holds only whole records.  Before a record is written the oldest records are dropped until it
+ * fits.
+ */
+
+static const char     TRACE_MAGIC[]      = "BLET";
+static const uint8_t  TRACE_VERSION      = 1;
+static const size_t   TRACE_HEADER_SIZE  = 5;
+static const size_t   RECORD_HEADER_SIZE = 11;
+
+
+/**
+ * @brief Construct a trace.
+ * @param [in] size The number of bytes of records the trace can hold.
+ */
+BLEEventTrace::BLEEventTrace(size_t size) {
+	m_pBuffer  = (uint8_t*)malloc(size);
+	m_size     = m_pBuffer == nullptr ? 0 : size;
+	m_head     = 0;
+	m_used     = 0;
+	m_recorded = 0;
+	m_lost     = 0;
+	m_lock     = ::xSemaphoreCreateMutex();
+	if (m_pBuffer == nullptr) {
+		ESP_LOGE(LOG_TAG, "Unable to allocate %d bytes", size);
+	}
+} // BLEEventTrace
+
+
+/**
+ * @brief Free the trace.
+ *
+ * The trace must first be removed from BLEDevice.
+ */
+BLEEventTrace::~BLEEventTrace() {
+	::vSemaphoreDelete(m_lock);
+	free(m_pBuffer);
+} // ~BLEEventTrace
+
+
+/**
+ * @brief Forget every record.
+ */
+void BLEEventTrace::clear() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_head     = 0;
+	m_used     = 0;
+	m_recorded = 0;
+	m_lost     = 0;
+	::xSemaphoreGive(m_lock);
+} // clear
+
+
+/**
+ * @brief Get the records held, oldest first, in the form replay() takes.
+ *
+ * Recording carries on while the trace is dumped.  Room for a full ring is allocated before the lock is
+ * taken, so the %BLE stack's task is only held up for the copy.
+ *
+ * @return The binary trace.
+ */
+std::string BLEEventTrace::dump() {
+	std::string trace(TRACE_MAGIC, 4);
+	trace += (char)TRACE_VERSION;
+	trace.resize(TRACE_HEADER_SIZE + m_size);
+
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	uint32_t used = m_used;
+	read((m_head + m_size - m_used) % (m_size == 0 ? 1 : m_size), &trace[TRACE_HEADER_SIZE], m_used);
+	::xSemaphoreGive(m_lock);
+
+	trace.resize(TRACE_HEADER_SIZE + used);
+	return trace;
+} // dump
+
+
+/**
+ * @brief Get the number of records lost, either overwritten to make room or too long for the trace.
+ * @return The number of records lost.
+ */
+uint32_t BLEEventTrace::getLost() {
+	return m_lost;
+} // getLost
+
+
+/**
+ * @brief Get the number of records written since the trace was made or cleared.
+ * @return The number of records written.
+ */
+uint32_t BLEEventTrace::getRecorded() {
+	return m_recorded;
+} // getRecorded
+
+
+/**
+ * @brief Find the value an event's parameters point at.
+ * @param [in] source The source of the event.
+ * @param [in] event The event id.
+ * @param [in] pParam The event's parameters.
+ * @param [out] ppLength Set to the field holding the length of the value.
+ * @return The field pointing at the value or nullptr if the event carries no value.
+ */
+/* STATIC */ uint8_t** BLEEventTrace::payloadOf(uint8_t source, uint8_t event, Param* pParam, uint16_t** ppLength) {
+	switch(source) {
+		case SOURCE_GATT_CLIENT: {
+			switch(event) {
+				case ESP_GATTC_NOTIFY_EVT: {
+					*ppLength = &pParam->gattc.notify.value_len;
+					return &pParam->gattc.notify.value;
+				}
+				case ESP_GATTC_READ_CHAR_EVT:
+				case ESP_GATTC_READ_DESCR_EVT: {
+					*ppLength = &pParam->gattc.read.value_len;
+					return &pParam->gattc.read.value;
+				}
+				default: {
+					break;
+				}
+			} // switch
+			break;
+		} // SOURCE_GATT_CLIENT
+
+		case SOURCE_GATT_SERVER: {
+			switch(event) {
+				case ESP_GATTS_WRITE_EVT: {
+					*ppLength = &pParam->gatts.write.len;
+					return &pParam->gatts.write.value;
+				}
+				case ESP_GATTS_CONF_EVT: {
+					*ppLength = &pParam->gatts.conf.len;
+					return &pParam->gatts.conf.value;
+				}
+				default: {
+					break;
+				}
+			} // switch
+			break;
+		} // SOURCE_GATT_SERVER
+
+		default: {
+			break;
+		}
+	} // switch
+	return nullptr;
+} // payloadOf
+
+
+/**
+ * @brief Copy bytes out of the ring.
+ *
+ * Must be called with the lock held.
+ *
+ * @param [in] offset The offset in the ring of the first byte.
+ * @param [out] pData Where to copy the bytes.
+ * @param [in] length The number of bytes.
+ */
+void BLEEventTrace::read(uint32_t offset, void* pData, size_t length) {
+	size_t first = m_size - offset < length ? m_size - offset : length;
+	memcpy(pData, m_pBuffer + offset, first);
+	memcpy((uint8_t*)pData + first, m_pBuffer, length - first);
+} // read
+
+
+/**
+ * @brief Record an event, dropping the oldest records to make room.
+ *
+ * Called from the %BLE stack's task by BLEDevice as each event arrives.
+ *
+ * @param [in] source The source of the event.
+ * @param [in] event The event id.
+ * @param [in] iface The GATT interface the event was addressed to.
+ * @param [in] pParam The event's parameters.
+ * @param [in] paramSize The size of the event's parameter union.
+ */
+void BLEEventTrace::record(uint8_t source, uint8_t event, uint8_t iface, const void* pParam, size_t paramSize) {
+	uint32_t timeUs = (uint32_t)::esp_timer_get_time();
+
+	Param param;
+	memset(&param, 0, sizeof(param));
+	memcpy(&param, pParam, paramSize);
+
+	uint16_t* pLength   = nullptr;
+	uint8_t** ppValue   = payloadOf(source, event, &param, &pLength);
+	uint8_t*  pPayload  = nullptr;
+	uint16_t  payloadLength = 0;
+	if (ppValue != nullptr && *ppValue != nullptr) {
+		pPayload      = *ppValue;
+		payloadLength = *pLength;
+		*ppValue      = nullptr;
+	}
+
+	uint16_t paramLength = paramSize;
+	while (paramLength > 0 && ((uint8_t*)&param)[paramLength - 1] == 0) {
+		paramLength--;
+	}
+
+	size_t length = RECORD_HEADER_SIZE + paramLength + payloadLength;
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (length > m_size || length > UINT16_MAX) {
+		m_lost++;
+		::xSemaphoreGive(m_lock);
+		ESP_LOGD(LOG_TAG, "Record of %d bytes does not fit", length);
+		return;
+	}
+	while (m_size - m_used < length) {
+		uint16_t oldest;
+		read((m_head + m_size - m_used) % m_size, &oldest, sizeof(oldest));
+		m_used -= oldest;
+		m_lost++;
+	}
+
+	uint8_t header[RECORD_HEADER_SIZE];
+	uint16_t recordLength = length;
+	memcpy(header, &recordLength, 2);
+	header[2] = source;
+	header[3] = event;
+	header[4] = iface;
+	memcpy(header + 5, &timeUs, 4);
+	memcpy(header + 9, &paramLength, 2);
+
+	write(m_head, header, RECORD_HEADER_SIZE);
+	write((m_head + RECORD_HEADER_SIZE) % m_size, &param, paramLength);
+	write((m_head + RECORD_HEADER_SIZE + paramLength) % m_size, pPayload, payloadLength);
+	m_head = (m_head + length) % m_size;
+	m_used += length;
+	m_recorded++;
+	::xSemaphoreGive(m_lock);
+} // record
+
+
+/**
+ * @brief Feed a dumped trace back through BLEDevice.
+ *
+ * Each event is passed to the same handler as when it was recorded, and from there to the servers,
+ * clients and scan, as though the %BLE stack had just delivered it.  Any trace set on BLEDevice is put
+ * aside while the trace is replayed so the replay is not itself recorded.
+ *
+ * A live stack would deliver its own events among those replayed, on another task, and would act on the
+ * calls the handlers make in response to the replayed ones.  So a trace is only replayed once the stack
+ * has been stopped with esp_bluedroid_disable(), or against stand-ins for the stack on a host.
+ *
+ * @param [in] trace A trace returned by dump().
+ * @param [in] speed How many times faster than recorded to replay.  Zero replays without pausing.
+ * @return True if the whole trace was replayed, false if it is malformed or the stack is enabled.
+ */
+/* STATIC */ bool BLEEventTrace::replay(const std::string& trace, float speed) {
+	if (::esp_bluedroid_get_status() == ESP_BLUEDROID_STATUS_ENABLED) {
+		ESP_LOGE(LOG_TAG, "Not replaying while the BLE stack is enabled");
+		return false;
+	}
+	if (trace.size() < TRACE_HEADER_SIZE || trace.compare(0, 4, TRACE_MAGIC) != 0 || (uint8_t)trace[4] != TRACE_VERSION) {
+		ESP_LOGE(LOG_TAG, "Not a trace of version %d", TRACE_VERSION);
+		return false;
+	}
+
+	BLEEventTrace* pSaved = BLEDevice::m_pEventTrace;
+	BLEDevice::setEventTrace(nullptr);
+
+	const uint8_t* pTrace   = (const uint8_t*)trace.data();
+	size_t         offset   = TRACE_HEADER_SIZE;
+	int64_t        startUs  = ::esp_timer_get_time();
+	uint32_t       firstUs  = 0;
+	uint32_t       replayed = 0;
+	bool           ok       = true;
+
+	while (offset < trace.size()) {
+		uint16_t length;
+		uint32_t timeUs;
+		uint16_t paramLength;
+		if (trace.size() - offset < RECORD_HEADER_SIZE) {
+			ok = false;
+			break;
+		}
+		memcpy(&length, pTrace + offset, 2);
+		memcpy(&timeUs, pTrace + offset + 5, 4);
+		memcpy(&paramLength, pTrace + offset + 9, 2);
+		if (length < RECORD_HEADER_SIZE + paramLength || trace.size() - offset < length) {
+			ok = false;
+			break;
+		}
+		uint8_t source = pTrace[offset + 2];
+		uint8_t event  = pTrace[offset + 3];
+		uint8_t iface  = pTrace[offset + 4];
+
+		if (speed > 0) {
+			if (replayed == 0) {
+				firstUs = timeUs;
+			}
+			int64_t dueUs  = startUs + (int64_t)((uint32_t)(timeUs - firstUs) / speed);
+			int64_t waitUs = dueUs - ::esp_timer_get_time();
+			if (waitUs > 0 && pdMS_TO_TICKS(waitUs / 1000) > 0) {
+				::vTaskDelay(pdMS_TO_TICKS(waitUs / 1000));
+			}
+		}
+
+		Param param;
+		memset(&param, 0, sizeof(param));
+		memcpy(&param, pTrace + offset + RECORD_HEADER_SIZE, paramLength < sizeof(param) ? paramLength : sizeof(param));
+		std::string payload((const char*)pTrace + offset + RECORD_HEADER_SIZE + paramLength, length - RECORD_HEADER_SIZE - paramLength);
+		uint16_t* pLength = nullptr;
+		uint8_t** ppValue = payloadOf(source, event, &param, &pLength);
+		if (ppValue != nullptr && !payload.empty()) {
+			*ppValue = (uint8_t*)&payload[0];
+		}
+
+		switch(source) {
+			case SOURCE_GAP: {
+				BLEDevice::gapEventHandler((esp_gap_ble_cb_event_t)event, &param.gap);
+				break;
+			}
+			case SOURCE_GATT_CLIENT: {
+				BLEDevice::gattClientEventHandler((esp_gattc_cb_event_t)event, (esp_gatt_if_t)iface, &param.gattc);
+				break;
+			}
+			case SOURCE_GATT_SERVER: {
+				BLEDevice::gattServerEventHandler((esp_gatts_cb_event_t)event, (esp_gatt_if_t)iface, &param.gatts);
+				break;
+			}
+			default: {
+				ESP_LOGE(LOG_TAG, "Unknown source %d at offset %d", source, offset);
+				break;
+			}
+		} // switch
+		offset += length;
+		replayed++;
+	}
+
+	BLEDevice::setEventTrace(pSaved);
+	if (!ok) {
+		ESP_LOGE(LOG_TAG, "Trace is malformed at offset %d", offset);
+	}
+	ESP_LOGD(LOG_TAG, "Replayed %d events", replayed);
+	return ok;
+} // replay
+
+
+/**
+ * @brief Write the records held to a file, for example for the TFTP server to send.
+ * @param [in] path The path of the file.
+ * @return True if the file was written.
+ */
+bool BLEEventTrace::save(std::string path) {
+	std::string trace = dump();
+	FILE* pFile = fopen(path.c_str(), "wb");
+	if (pFile == nullptr) {
+		ESP_LOGE(LOG_TAG, "Unable to open %s", path.c_str());
+		return false;
+	}
+	size_t written = fwrite(trace.data(), 1, trace.size(), pFile);
+	fclose(pFile);
+	if (written != trace.size()) {
+		ESP_LOGE(LOG_TAG, "Wrote %d of %d bytes to %s", written, trace.size(), path.c_str());
+		return false;
+	}
+	return true;
+} // save
+
+
+/**
+ * @brief Copy bytes into the ring.
+ *
+ * Must be called with the lock held.
+ *
+ * @param [in] offset The offset in the ring of the first byte.
+ * @param [in] pData The bytes.
+ * @param [in] length The number of bytes.
+ */
+void BLEEventTrace::write(uint32_t offset, const void* pData, size_t length) {
+	size_t first = m_size - offset < length ? m_size - offset : length;
+	memcpy(m_pBuffer + offset, pData, first);
+	memcpy(m_pBuffer, (const uint8_t*)pData + first, length - first);
+} // write
+
+#endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,86 @@
+/*
+ * BLEEventTrace.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEEVENTTRACE_H_
+#define COMPONENTS_CPP_UTILS_BLEEVENTTRACE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <esp_gap_ble_api.h>
+#include <esp_gattc_api.h>
+#include <esp_gatts_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * @brief A recording of the events the %BLE stack passes to BLEDevice.
+ *
+ * A trace given to BLEDevice::setEventTrace() records every GAP, GATT client and GATT server event, with
+ * its parameters and the time it arrived, in a ring of fixed size allocated when the trace is constructed.
+ * When the ring is full the oldest events are overwritten.  The values carried by notifications, reads,
+ * writes and confirmations are recorded with their events.
+ *
+ * dump() returns the recording in a compact binary form which can be served by an HttpServer or written
+ * with save() to a file for the TFTP server.  replay() feeds a dumped recording back through BLEDevice to
+ * the servers, clients and scan, at the speed it was recorded or faster, once the %BLE stack is disabled.
+ *
+ * For example:
+ *
+ * @code{.cpp}
+ * static BLEEventTrace eventTrace(16 * 1024);
+ * BLEDevice::setEventTrace(&eventTrace);
+ *
+ * static void handleTrace(HttpRequest* pRequest, HttpResponse* pResponse) {
+ *    pResponse->addHeader("Content-Type", "application/octet-stream");
+ *    pResponse->sendData(eventTrace.dump());
+ *    pResponse->close();
+ * }
+ * httpServer.addPathHandler("GET", "/trace", handleTrace);
+ * @endcode
+ */
+class BLEEventTrace {
+public:
+	BLEEventTrace(size_t size);
+	~BLEEventTrace();
+
+	void        clear();
+	std::string dump();
+	uint32_t    getLost();
+	uint32_t    getRecorded();
+	bool        save(std::string path);
+	static bool replay(const std::string& trace, float speed = 1.0);
+
+private:
+	friend class BLEDevice;
+
+	enum Source : uint8_t {
+		SOURCE_GAP          = 0,
+		SOURCE_GATT_CLIENT  = 1,
+		SOURCE_GATT_SERVER  = 2
+	};
+
+	union Param {
+		esp_ble_gap_cb_param_t   gap;
+		esp_ble_gattc_cb_param_t gattc;
+		esp_ble_gatts_cb_param_t gatts;
+	};
+
+	static uint8_t** payloadOf(uint8_t source, uint8_t event, Param* pParam, uint16_t** ppLength);
+	void             read(uint32_t offset, void* pData, size_t length);
+	void             record(uint8_t source, uint8_t event, uint8_t iface, const void* pParam, size_t paramSize);
+	void             write(uint32_t offset, const void* pData, size_t length);
+
+	uint8_t*          m_pBuffer;
+	uint32_t          m_size;
+	uint32_t          m_head;       // The offset at which the next record is written.
+	uint32_t          m_used;       // The bytes of whole records held, ending at m_head.
+	uint32_t          m_recorded;
+	uint32_t          m_lost;       // Records overwritten to make room, or too long to record.
+	SemaphoreHandle_t m_lock;
+}; // BLEEventTrace
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEEVENTTRACE_H_ */
@@ -0,0 +1,66 @@
+/*
+ * BLEFuture.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEFUTURE_H_
+#define COMPONENTS_CPP_UTILS_BLEFUTURE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <atomic>
+#include <string>
+#include <stdint.h>
+#include <esp_gatt_defs.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+/**
+ * @brief The outcome of a %BLE client operation that has been started but may not have finished.
+ *
+ * The asynchronous client calls, such as BLERemoteCharacteristic::readValueAsync(), return as soon as
+ * the operation is queued.  The caller finds out how it went through a future it passes in.  The
+ * caller may poll isDone(), block in wait() or set a callback that is called when the operation
+ * finishes.  The callback is called on the %BLE stack's task so it must not block.
+ *
+ * A future holds no FreeRTOS objects.  A task waiting on it is woken with a task notification.  A
+ * future may be reused once its operation has finished, but must not be destroyed before then.
+ *
+ * For example:
+ *
+ * @code{.cpp}
+ * static void onRead(BLEFuture* pFuture, void* pArg) {
+ *   ESP_LOGD(LOG_TAG, "Read %d bytes", pFuture->getValue().length());
+ * }
+ *
+ * static BLEFuture readFuture;
+ * readFuture.setCallback(onRead, nullptr);
+ * pRemoteCharacteristic->readValueAsync(&readFuture);
+ * @endcode
+ */
+class BLEFuture {
+public:
+	typedef void (*Callback)(BLEFuture* pFuture, void* pArg);
+
+	BLEFuture();
+
+	esp_gatt_status_t getStatus();
+	std::string       getValue();
+	bool              isDone();
+	void              setCallback(Callback callback, void* pArg);
+	bool              wait(uint32_t timeoutMs = portMAX_DELAY);
+
+private:
+	friend class BLEClient;
+	friend class BLEOperationQueue;
+
+	void complete(esp_gatt_status_t status, const uint8_t* pData = nullptr, size_t length = 0);
+	void start();
+
+	std::atomic<uintptr_t> m_state;   // STATE_PENDING, STATE_DONE or the handle of the task waiting.
+	esp_gatt_status_t      m_status;
+	std::string            m_value;
+	Callback               m_callback;
+	void*                  m_pArg;
+}; // BLEFuture
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEFUTURE_H_ */
@@ -0,0 +1,61 @@
+/*
+ * BLEGattCache.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLEGATTCACHE_H_
+#define COMPONENTS_CPP_UTILS_BLEGATTCACHE_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <string>
+
+#include "BLEAddress.h"
+
+class BLEClient;
+
+/**
+ * The largest record kept for a server.  This is the largest blob that %NVS can hold in a single page.
+ */
+#define BLE_GATT_CACHE_MAX_RECORD 1984
+
+/**
+ * @brief A persistent cache of the attribute databases of the servers a client has connected to.
+ *
+ * Discovering the services, characteristics and descriptors of a server takes many round trips over the
+ * air.  Once a server has been discovered, its database is written to %NVS as a record keyed by the address
+ * of the server.  When the client connects to the server again, its services are rebuilt from the record
+ * and discovery is skipped.
+ *
+ * Alongside the database, the record holds the server's Database Hash (characteristic 0x2B2A of the
+ * Generic Attribute service) if the server exposes one.  A record with a hash is only used if the server
+ * still reports the same hash, so a server whose database has changed is discovered afresh.  A record
+ * without a hash is used until the server signals that its services have changed, a service missing from
+ * it is asked for, or the server rejects a handle taken from it.  It is then erased and the server is
+ * discovered again.
+ *
+ * For example:
+ *
+ * @code{.cpp}
+ * static BLEGattCache gattCache;
+ * pClient->setGattCache(&gattCache);
+ * @endcode
+ */
+class BLEGattCache {
+public:
+	BLEGattCache(std::string nvsNamespace = "blegattc");
+
+	void erase(BLEAddress address);
+	void eraseAll();
+
+private:
+	friend class BLEClient;
+
+	bool        restore(BLEClient* pClient, std::string* pHash);
+	void        store(BLEClient* pClient, std::string hash);
+
+	static std::string getKey(BLEAddress address);
+
+	std::string m_namespace;   // The NVS namespace the records are kept in.
+}; // BLEGattCache
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLEGATTCACHE_H_ */
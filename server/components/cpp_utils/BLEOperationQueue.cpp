@@ -0,0 +1,307 @@
+/*
+ * BLEOperationQueue.cpp
+ */
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_log.h>
+#include <esp_err.h>
+#include <string.h>
+#include "BLEOperationQueue.h"
+#include "GeneralUtils.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "BLEOperationQueue";
+
+
+/**
+ * @brief Construct an operation queue.
+ * @param [in] pWriteWindow The write window of the same connection.
+ */
+BLEOperationQueue::BLEOperationQueue(BLEWriteWindow* pWriteWindow) {
+	m_pWriteWindow = pWriteWindow;
+	m_gattcIf = ESP_GATT_IF_NONE;
+	m_connId  = 0;
+	memset(m_address, 0, sizeof(esp_bd_addr_t));
+	m_open    = false;
+	m_issued  = false;
+	m_lock    = ::xSemaphoreCreateMutex();
+} // BLEOperationQueue
+
+
+BLEOperationQueue::~BLEOperationQueue() {
+	close();
+	::vSemaphoreDelete(m_lock);
+} // ~BLEOperationQueue
+
+
+/**
+ * @brief Queue an operation and issue it if nothing is ahead of it.
+ * @param [in] type The type of the operation.
+ * @param [in] handle The handle of the attribute.
+ * @param [in] value The value to write, if any.
+ * @param [in] pFuture The future to complete, or nullptr.
+ * @return False if the connection is not open.
+ */
+bool BLEOperationQueue::add(Type type, uint16_t handle, std::string value, BLEFuture* pFuture) {
+	if (pFuture != nullptr) {
+		pFuture->start();
+	}
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (!m_open) {
+		::xSemaphoreGive(m_lock);
+		if (pFuture != nullptr) {
+			pFuture->complete(ESP_GATT_ERROR);
+		}
+		return false;
+	}
+	Operation operation;
+	operation.type    = type;
+	operation.handle  = handle;
+	operation.value   = value;
+	operation.pFuture = pFuture;
+	m_operations.push_back(operation);
+	::xSemaphoreGive(m_lock);
+	issueNext();
+	return true;
+} // add
+
+
+/**
+ * @brief Close the queue because the connection has gone.
+ *
+ * Every queued operation fails with ESP_GATT_ERROR.
+ */
+void BLEOperationQueue::close() {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	std::deque<Operation> failed;
+	failed.swap(m_operations);
+	m_open   = false;
+	m_issued = false;
+	::xSemaphoreGive(m_lock);
+	for (auto &operation : failed) {
+		if (operation.pFuture != nullptr) {
+			operation.pFuture->complete(ESP_GATT_ERROR);
+		}
+	}
+} // close
+
+
+/**
+ * @brief Complete the operation at the front of the queue if an event reports it.
+ * @param [in] event The GATT client event.
+ * @param [in] evtParam The parameters of the event.
+ * @return True if the event belonged to a queued operation.
+ */
+bool BLEOperationQueue::handleEvent(esp_gattc_cb_event_t event, esp_ble_gattc_cb_param_t* evtParam) {
+	Type              type;
+	uint16_t          handle;
+	esp_gatt_status_t status;
+	const uint8_t*    pData  = nullptr;
+	size_t            length = 0;
+	switch(event) {
+		case ESP_GATTC_READ_CHAR_EVT:
+			type   = READ;
+			handle = evtParam->read.handle;
+			status = evtParam->read.status;
+			pData  = evtParam->read.value;
+			length = evtParam->read.value_len;
+			break;
+
+		case ESP_GATTC_WRITE_CHAR_EVT:
+			type   = WRITE;
+			handle = evtParam->write.handle;
+			status = evtParam->write.status;
+			break;
+
+		case ESP_GATTC_REG_FOR_NOTIFY_EVT:
+			type   = REG_FOR_NOTIFY;
+			handle = evtParam->reg_for_notify.handle;
+			status = evtParam->reg_for_notify.status;
+			break;
+
+		case ESP_GATTC_UNREG_FOR_NOTIFY_EVT:
+			type   = UNREG_FOR_NOTIFY;
+			handle = evtParam->unreg_for_notify.handle;
+			status = evtParam->unreg_for_notify.status;
+			break;
+
+		default:
+			return false;
+	} // switch
+
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	if (!m_issued || m_operations.empty() || m_operations.front().type != type || m_operations.front().handle != handle) {
+		::xSemaphoreGive(m_lock);
+		return false;   // Not ours, such as a write without response being passed on.
+	}
+	BLEFuture* pFuture = m_operations.front().pFuture;
+	m_operations.pop_front();
+	m_issued = false;
+	::xSemaphoreGive(m_lock);
+	if (type == WRITE) {
+		m_pWriteWindow->resume();
+	}
+
+	if (status != ESP_GATT_OK) {
+		ESP_LOGE(LOG_TAG, "Operation on handle 0x%.2x failed: status=%d", handle, status);
+	}
+	if (pFuture != nullptr) {
+		pFuture->complete(status, pData, length);
+	}
+	issueNext();
+	return true;
+} // handleEvent
+
+
+/**
+ * @brief Hand an operation to the %BLE stack.
+ * @param [in] operation The operation.
+ * @param [in] gattcIf The GATT client interface of the connection.
+ * @param [in] connId The connection.
+ * @param [in] address The address of the server.
+ * @return ESP_OK if the stack accepted the operation.
+ */
+esp_err_t BLEOperationQueue::issue(Operation& operation, esp_gatt_if_t gattcIf, uint16_t connId, esp_bd_addr_t address) {
+	esp_err_t errRc;
+	switch(operation.type) {
+		case READ:
+			errRc = ::esp_ble_gattc_read_char(gattcIf, connId, operation.handle, ESP_GATT_AUTH_REQ_NONE);
+			if (errRc != ESP_OK) {
+				ESP_LOGE(LOG_TAG, "esp_ble_gattc_read_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			}
+			break;
+
+		case WRITE:
+			errRc = ::esp_ble_gattc_write_char(
+				gattcIf,
+				connId,
+				operation.handle,
+				operation.value.length(),
+				(uint8_t*)operation.value.data(),
+				ESP_GATT_WRITE_TYPE_RSP,
+				ESP_GATT_AUTH_REQ_NONE
+			);
+			if (errRc != ESP_OK) {
+				ESP_LOGE(LOG_TAG, "esp_ble_gattc_write_char: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			}
+			break;
+
+		case REG_FOR_NOTIFY:
+			errRc = ::esp_ble_gattc_register_for_notify(gattcIf, address, operation.handle);
+			if (errRc != ESP_OK) {
+				ESP_LOGE(LOG_TAG, "esp_ble_gattc_register_for_notify: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			}
+			break;
+
+		default:
+			errRc = ::esp_ble_gattc_unregister_for_notify(gattcIf, address, operation.handle);
+			if (errRc != ESP_OK) {
+				ESP_LOGE(LOG_TAG, "esp_ble_gattc_unregister_for_notify: rc=%d %s", errRc, GeneralUtils::errorToString(errRc));
+			}
+			break;
+	} // switch
+	return errRc;
+} // issue
+
+
+/**
+ * @brief Issue the operation at the front of the queue unless one is already with the %BLE stack.
+ *
+ * Operations the stack refuses fail at once and the next is tried.  A write with response holds the write
+ * window and waits while writes without response are outstanding; the client calls us again as each of
+ * those is passed on.
+ */
+void BLEOperationQueue::issueNext() {
+	while(true) {
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		if (!m_open || m_issued || m_operations.empty()) {
+			::xSemaphoreGive(m_lock);
+			return;
+		}
+		Operation     operation = m_operations.front();
+		if (operation.type == WRITE && !m_pWriteWindow->hold()) {
+			::xSemaphoreGive(m_lock);
+			return;
+		}
+		esp_gatt_if_t gattcIf   = m_gattcIf;
+		uint16_t      connId    = m_connId;
+		esp_bd_addr_t address;
+		memcpy(address, m_address, sizeof(esp_bd_addr_t));
+		m_issued = true;   // Claim the front before we let go of the lock.
+		::xSemaphoreGive(m_lock);
+
+		// The stack's task may need our lock to report an earlier operation so we must not hold it here.
+		if (issue(operation, gattcIf, connId, address) == ESP_OK) {
+			return;
+		}
+
+		::xSemaphoreTake(m_lock, portMAX_DELAY);
+		if (m_issued && !m_operations.empty() && m_operations.front().pFuture == operation.pFuture) {
+			m_operations.pop_front();
+			m_issued = false;
+		}
+		::xSemaphoreGive(m_lock);
+		if (operation.type == WRITE) {
+			m_pWriteWindow->resume();
+		}
+		if (operation.pFuture != nullptr) {
+			operation.pFuture->complete(ESP_GATT_ERROR);
+		}
+	}
+} // issueNext
+
+
+/**
+ * @brief Open the queue for a newly connected server.
+ * @param [in] gattcIf The GATT client interface of the connection.
+ * @param [in] connId The connection the operations are made on.
+ * @param [in] address The address of the server.
+ */
+void BLEOperationQueue::open(esp_gatt_if_t gattcIf, uint16_t connId, esp_bd_addr_t address) {
+	::xSemaphoreTake(m_lock, portMAX_DELAY);
+	m_gattcIf = gattcIf;
+	m_connId  = connId;
+	memcpy(m_address, address, sizeof(esp_bd_addr_t));
+	m_open    = true;
+	m_issued  = false;
+	::xSemaphoreGive(m_lock);
+} // open
+
+
+/**
+ * @brief Queue a read of a characteristic.
+ * @param [in] handle The handle of the characteristic.
+ * @param [in] pFuture Completed with the value read.
+ * @return False if the connection is not open.
+ */
+bool BLEOperationQueue::read(uint16_t handle, BLEFuture* pFuture) {
+	return add(READ, handle, "", pFuture);
+} // read
+
+
+/**
+ * @brief Queue a registration, or unregistration, for notifications and indications from a characteristic.
+ * @param [in] handle The handle of the characteristic.
+ * @param [in] enable True to register and false to unregister.
+ * @param [in] pFuture Completed when the %BLE stack has made the change.
+ * @return False if the connection is not open.
+ */
+bool BLEOperationQueue::registerForNotify(uint16_t handle, bool enable, BLEFuture* pFuture) {
+	return add(enable ? REG_FOR_NOTIFY : UNREG_FOR_NOTIFY, handle, "", pFuture);
+} // registerForNotify
+
+
+/**
+ * @brief Queue a write with response to a characteristic.
+ * @param [in] handle The handle of the characteristic.
+ * @param [in] value The value to write.
+ * @param [in] pFuture Completed when the server has replied.
+ * @return False if the connection is not open.
+ */
+bool BLEOperationQueue::write(uint16_t handle, std::string value, BLEFuture* pFuture) {
+	return add(WRITE, handle, value, pFuture);
+} // write
+
+#endif /* CONFIG_BT_ENABLED */
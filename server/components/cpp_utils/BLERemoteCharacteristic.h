@@ -11,9 +11,11 @@
 #if defined(CONFIG_BT_ENABLED)
 
 #include <string>
+#include <vector>
 
 #include <esp_gattc_api.h>
 
+#include "BLEFuture.h"
 #include "BLERemoteService.h"
 #include "BLERemoteDescriptor.h"
 #include "BLEUUID.h"
@@ -36,27 +38,37 @@ public:
 	bool        canRead();
 	bool        canWrite();
 	bool        canWriteNoResponse();
+	bool        flush(uint32_t timeoutMs = portMAX_DELAY);
 	BLERemoteDescriptor* getDescriptor(BLEUUID uuid);
-	std::map<std::string, BLERemoteDescriptor *>* getDescriptors();
+	std::map<BLEUUID, BLERemoteDescriptor *>* getDescriptors();
 	uint16_t    getHandle();
 	BLEUUID     getUUID();
 	std::string readValue(void);
+	bool        readValueAsync(BLEFuture* pFuture);
 	uint8_t     readUInt8(void);
 	uint16_t    readUInt16(void);
 	uint32_t    readUInt32(void);
 	void        registerForNotify(void (*notifyCallback)(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify));
+	bool        registerForNotifyAsync(void (*notifyCallback)(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify), BLEFuture* pFuture);
 	void        writeValue(uint8_t* data, size_t length, bool response = false);
 	void        writeValue(std::string newValue, bool response = false);
 	void        writeValue(uint8_t newValue, bool response = false);
+	bool        writeValueAsync(std::string newValue, BLEFuture* pFuture);
+	size_t      writeBatch(std::vector<std::string>& values, uint32_t timeoutMs = portMAX_DELAY);
+	bool        writeNoResponse(uint8_t* data, size_t length, uint32_t timeoutMs = portMAX_DELAY);
+	bool        writeNoResponse(std::string newValue, uint32_t timeoutMs = portMAX_DELAY);
 	std::string toString(void);
 
 private:
 	BLERemoteCharacteristic(uint16_t handle, BLEUUID uuid, esp_gatt_char_prop_t charProp, BLERemoteService* pRemoteService);
 	friend class BLEClient;
+	friend class BLEGattCache;
+	friend class BLENotifyRing;
 	friend class BLERemoteService;
 	friend class BLERemoteDescriptor;
 
 	// Private member functions
+	void deliverNotify(uint8_t* pData, size_t length, bool isNotify);
 	void gattClientEventHandler(
 		esp_gattc_cb_event_t      event,
 		esp_gatt_if_t             gattc_if,
@@ -72,14 +84,11 @@ private:
 	esp_gatt_char_prop_t m_charProp;
 	uint16_t             m_handle;
 	BLERemoteService*    m_pRemoteService;
-	FreeRTOS::Semaphore  m_semaphoreReadCharEvt      = FreeRTOS::Semaphore("ReadCharEvt");
-	FreeRTOS::Semaphore  m_semaphoreRegForNotifyEvt  = FreeRTOS::Semaphore("RegForNotifyEvt");
-	FreeRTOS::Semaphore  m_semaphoreWriteCharEvt     = FreeRTOS::Semaphore("WriteCharEvt");
 	std::string          m_value;
   void (*m_notifyCallback)(BLERemoteCharacteristic* pBLERemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify);
 
 	// We maintain a map of descriptors owned by this characteristic keyed by a string representation of the UUID.
-	std::map<std::string, BLERemoteDescriptor*> m_descriptorMap;
+	std::map<BLEUUID, BLERemoteDescriptor*> m_descriptorMap;
 }; // BLERemoteCharacteristic
 #endif /* CONFIG_BT_ENABLED */
 #endif /* COMPONENTS_CPP_UTILS_BLEREMOTECHARACTERISTIC_H_ */
@@ -20,6 +20,11 @@
 class BLEClient;
 class BLERemoteCharacteristic;
 
+/**
+ * The number of characteristics or descriptors fetched from the %BLE stack in a single call during discovery.
+ */
+#define BLE_REMOTE_DISCOVERY_BATCH 10
+
 
 /**
  * @brief A model of a remote %BLE service.
@@ -33,7 +38,7 @@ public:
 	BLERemoteCharacteristic* getCharacteristic(const char* uuid);	  // Get the specified characteristic reference.
 	BLERemoteCharacteristic* getCharacteristic(BLEUUID uuid);       // Get the specified characteristic reference.
 	BLERemoteCharacteristic* getCharacteristic(uint16_t uuid);      // Get the specified characteristic reference.
-	std::map<std::string, BLERemoteCharacteristic*>* getCharacteristics();
+	std::map<BLEUUID, BLERemoteCharacteristic*>* getCharacteristics();
 	void getCharacteristics(std::map<uint16_t, BLERemoteCharacteristic*>* pCharacteristicMap);  // Get the characteristics map.
 
 	BLEClient*               getClient(void);                                           // Get a reference to the client associated with this service.
@@ -49,6 +54,7 @@ private:
 
 	// Friends
 	friend class BLEClient;
+	friend class BLEGattCache;
 	friend class BLERemoteCharacteristic;
 
 	// Private methods
@@ -57,17 +63,12 @@ private:
 	uint16_t            getStartHandle();                // Get the start handle for this service.
 	uint16_t            getEndHandle();                  // Get the end handle for this service.
 
-	void                gattClientEventHandler(
-		esp_gattc_cb_event_t      event,
-		esp_gatt_if_t             gattc_if,
-		esp_ble_gattc_cb_param_t* evtParam);
-
 	void                removeCharacteristics();
 
 	// Properties
 
 	// We maintain a map of characteristics owned by this service keyed by a string representation of the UUID.
-	std::map<std::string, BLERemoteCharacteristic *> m_characteristicMap;
+	std::map<BLEUUID, BLERemoteCharacteristic *> m_characteristicMap;
 
 	// We maintain a map of characteristics owned by this service keyed by a handle.
 	std::map<uint16_t, BLERemoteCharacteristic *> m_characteristicMapByHandle;
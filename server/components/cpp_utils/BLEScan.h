@@ -14,6 +14,7 @@
 #include <vector>
 #include "BLEAdvertisedDevice.h"
 #include "BLEClient.h"
+#include "BLEScanFilter.h"
 #include "FreeRTOS.h"
 
 class BLEAdvertisedDevice;
@@ -22,22 +23,46 @@ class BLEClient;
 class BLEScan;
 
 
+#define BLE_SCAN_DEFAULT_MAX_RESULTS 64
+
+
 /**
  * @brief The result of having performed a scan.
  * When a scan completes, we have a set of found devices.  Each device is described
  * by a BLEAdvertisedDevice object.  The number of items in the set is given by
  * getCount().  We can retrieve a device by calling getDevice() passing in the
  * index (starting at 0) of the desired device.
+ *
+ * The results hold at most a fixed number of devices.  Devices are found by address through an open
+ * addressing hash table so that recognising a device we have already seen does not depend on how many we
+ * have seen.  When the results are full, the device that was least recently heard from makes way for the
+ * new one.
  */
 class BLEScanResults {
 public:
-	void                dump();
-	int                 getCount();
-	BLEAdvertisedDevice getDevice(uint32_t i);
+	void                 dump();
+	int                  getCount();
+	BLEAdvertisedDevice& getDevice(uint32_t i);
 
 private:
 	friend BLEScan;
-	std::vector<BLEAdvertisedDevice> m_vectorAdvertisedDevices;
+	std::vector<BLEAdvertisedDevice> m_vectorAdvertisedDevices; // The devices, in the order first seen until one is evicted.
+	std::vector<uint32_t>            m_hashes;      // The address hash of each device.
+	std::vector<int16_t>             m_prev;        // Recency list, from least to most recently seen.
+	std::vector<int16_t>             m_next;
+	int16_t                          m_oldest  = -1;
+	int16_t                          m_newest  = -1;
+	std::vector<int16_t>             m_index;       // Open addressing table of device positions; -1 when empty.
+	size_t                           m_maxResults = 0;
+
+	int16_t add(BLEAdvertisedDevice& advertisedDevice, uint32_t hash);
+	void    clear();
+	int16_t find(esp_bd_addr_t address, uint32_t hash);
+	static uint32_t hashAddress(esp_bd_addr_t address);
+	void    setMaxResults(size_t maxResults);
+	void    touch(int16_t position);
+	void    unindex(int16_t position);
+	void    unlink(int16_t position);
 };
 
 /**
@@ -47,14 +72,19 @@ private:
  */
 class BLEScan {
 public:
-	void           setActiveScan(bool active);
-	void           setAdvertisedDeviceCallbacks(
+	BLEScanFilter   getFilter();
+	BLEScanResults& getResults();
+	void            setActiveScan(bool active);
+	void            setAdvertisedDeviceCallbacks(
 			              BLEAdvertisedDeviceCallbacks* pAdvertisedDeviceCallbacks,
 										bool wantDuplicates = false);
-	void           setInterval(uint16_t intervalMSecs);
-	void           setWindow(uint16_t windowMSecs);
-	BLEScanResults start(uint32_t duration);
-	void           stop();
+	void            setFilter(BLEScanFilter filter);
+	void            setInterval(uint16_t intervalMSecs);
+	void            setMaxResults(size_t maxResults);
+	void            setWindow(uint16_t windowMSecs);
+	BLEScanResults& start(uint32_t duration);
+	BLEScanResults& start(uint32_t duration, BLEScanFilter filter);
+	void            stop();
 
 private:
 	BLEScan();   // One doesn't create a new instance instead one asks the BLEDevice for the singleton.
@@ -63,6 +93,8 @@ private:
 		esp_gap_ble_cb_event_t  event,
 		esp_ble_gap_cb_param_t* param);
 	void parseAdvertisement(BLEClient* pRemoteDevice, uint8_t *payload);
+	BLEScanResults& startScan(uint32_t duration, BLEScanFilter* pFilter);
+	void updateWhiteList();
 
 
 	esp_ble_scan_params_t         m_scan_params;
@@ -71,6 +103,10 @@ private:
 	FreeRTOS::Semaphore           m_semaphoreScanEnd = FreeRTOS::Semaphore("ScanEnd");
 	BLEScanResults                m_scanResults;
 	bool                          m_wantDuplicates;
+	BLEScanFilter                 m_filter;
+	BLEScanFilter*                m_pScanFilter;  // The filter given to the scan in progress, used in place of m_filter.
+	SemaphoreHandle_t             m_filterLock; // Guards m_filter and m_pScanFilter, which the BLE stack's task reads.
+	std::vector<BLEAddress>       m_whiteList;  // Addresses we have placed in the controller's white list.
 }; // BLEScan
 
 #endif /* CONFIG_BT_ENABLED */
@@ -0,0 +1,88 @@
+/*
+ * BLEScanFilter.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_BLESCANFILTER_H_
+#define COMPONENTS_CPP_UTILS_BLESCANFILTER_H_
+#include "sdkconfig.h"
+#if defined(CONFIG_BT_ENABLED)
+#include <esp_bt_defs.h>
+
+#include <string>
+#include <vector>
+
+#include "BLEAddress.h"
+#include "BLEAdvertisementView.h"
+#include "BLEUUID.h"
+
+/**
+ * The largest address allow list that is handed to the controller's white list.  Longer lists are checked
+ * in software only.
+ */
+#define BLE_SCAN_FILTER_MAX_WHITELIST 12
+
+
+/**
+ * @brief A description of the advertisements a scan is interested in.
+ *
+ * A filter is built up from conditions:
+ *
+ * * The device's address is one of an allow list.
+ * * The signal is at least a given strength.
+ * * The device sends manufacturer data with a given company identifier.
+ * * The device's name starts with given text.
+ * * The device advertises a given service.
+ *
+ * Conditions of different kinds must all hold; conditions of the same kind are alternatives, so adding
+ * two services matches a device that advertises either.  A filter with no conditions matches everything.
+ *
+ * The conditions are held as a small program that is kept ordered with the cheapest tests first and is run
+ * directly over the raw advertisement, so a rejected advertisement costs neither a parse nor an allocation.
+ *
+ * For example:
+ *
+ * @code{.cpp}
+ * BLEScanFilter filter;
+ * filter.addServiceUUID(BLEUUID("6d124ed1-50f5-4ebf-b490-c3db81cbaa8c")).setMinRSSI(-80);
+ * pBLEScan->setFilter(filter);
+ * @endcode
+ */
+class BLEScanFilter {
+public:
+	BLEScanFilter();
+
+	BLEScanFilter&          addAddress(BLEAddress address);
+	BLEScanFilter&          addManufacturerId(uint16_t manufacturerId);
+	BLEScanFilter&          addNamePrefix(std::string prefix);
+	BLEScanFilter&          addServiceUUID(BLEUUID uuid);
+	void                    clear();
+	std::vector<BLEAddress> getAddresses();
+	bool                    isEmpty();
+	bool                    matches(esp_bd_addr_t address, int rssi, BLEAdvertisementView& advertisement);
+	BLEScanFilter&          setMinRSSI(int rssi);
+
+private:
+	// The operations, in the order in which they are run.
+	enum : uint8_t {
+		OP_ADDRESS,
+		OP_MANUFACTURER,
+		OP_NAME,
+		OP_SERVICE
+	};
+
+	struct Instruction {
+		uint8_t  op;
+		uint8_t  length;    // The length of the operand.
+		uint16_t operand;   // The offset of the operand in m_operands.
+	};
+
+	void add(uint8_t op, const uint8_t* pOperand, size_t length);
+	bool execute(const Instruction& instruction, esp_bd_addr_t address, BLEAdvertisementView& advertisement);
+
+	int                      m_minRSSI;
+	std::vector<Instruction> m_program;    // Kept sorted by op so that alternatives sit together.
+	std::vector<uint8_t>     m_operands;
+}; // BLEScanFilter
+
+#endif /* CONFIG_BT_ENABLED */
+#endif /* COMPONENTS_CPP_UTILS_BLESCANFILTER_H_ */
@@ -26,13 +26,8 @@ BLEService* BLEServiceMap::getByUUID(const char* uuid) {
  * @return The characteristic.
  */
 BLEService* BLEServiceMap::getByUUID(BLEUUID uuid) {
-	for (auto &myPair : m_uuidMap) {
-		if (myPair.second->getUUID().equals(uuid)) {
-			return myPair.second;
-		}
-	}
-	//return m_uuidMap.at(uuid.toString());
-	return nullptr;
+	auto it = m_uuidMap.find(uuid);
+	return it == m_uuidMap.end() ? nullptr : it->second;
 } // getByUUID
 
 
@@ -54,7 +49,7 @@ BLEService* BLEServiceMap::getByHandle(uint16_t handle) {
  */
 void BLEServiceMap::setByUUID(BLEUUID uuid,
 		BLEService *service) {
-	m_uuidMap.insert(std::pair<std::string, BLEService *>(uuid.toString(), service));
+	m_uuidMap.insert(std::pair<BLEUUID, BLEService *>(uuid, service));
 } // setByUUID
 
 
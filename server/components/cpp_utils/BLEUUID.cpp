@@ -8,14 +8,19 @@
 #if defined(CONFIG_BT_ENABLED)
 #include <esp_log.h>
 #include <string.h>
-#include <sstream>
-#include <iomanip>
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
 #include "BLEUUID.h"
 static const char* LOG_TAG = "BLEUUID";
 
+/**
+ * @brief The first 12 bytes (least significant first) of the Bluetooth base UUID.
+ *
+ * A 16 or 32 bit UUID is shorthand for the base UUID with the short value in the remaining 4 bytes.
+ */
+static const uint8_t baseUUID[12] = { 0xfb, 0x34, 0x9b, 0x5f, 0x80, 0x00, 0x00, 0x80, 0x00, 0x10, 0x00, 0x00 };
+
 #ifdef ARDUINO_ARCH_ESP32
 #include "esp32-hal-log.h"
 #endif
@@ -64,56 +69,35 @@ static void memrcpy(uint8_t* target, uint8_t* source, uint32_t size) {
  *  12345678-90ab-cdef-1234-567890abcdef
  * ```
  *
- * This has a length of 36 characters.  We need to parse this into 16 bytes.
+ * This has a length of 36 characters.  We need to parse this into 16 bytes.  Any other length, or 36
+ * characters that are not hex digits and dashes in that pattern, gives the null UUID.
  *
  * @param [in] value The string to build a UUID from.
  */
-BLEUUID::BLEUUID(std::string value) {
-	m_valueSet = true;
+BLEUUID::BLEUUID(std::string value) : m_native() {
 	if (value.length() == 2) {
-		m_uuid.len         = ESP_UUID_LEN_16;
-		m_uuid.uuid.uuid16 = value[0] | (value[1] << 8);
+		setShort((uint8_t)value[0] | ((uint8_t)value[1] << 8), ESP_UUID_LEN_16);
 	}
 	else if (value.length() == 4) {
-		m_uuid.len         = ESP_UUID_LEN_32;
-		m_uuid.uuid.uuid32 = value[0] | (value[1] << 8) | (value[2] << 16) | (value[3] << 24);
+		setShort((uint8_t)value[0] | ((uint8_t)value[1] << 8) | ((uint8_t)value[2] << 16) | ((uint32_t)(uint8_t)value[3] << 24), ESP_UUID_LEN_32);
 	}
 	else if (value.length() == 16) {
-		m_uuid.len = ESP_UUID_LEN_128;
-		memrcpy(m_uuid.uuid.uuid128, (uint8_t*)value.data(), 16);
+		m_len = ESP_UUID_LEN_128;
+		memrcpy(m_uuid128, (uint8_t*)value.data(), 16);
 	}
-	else if (value.length() == 36) {
+	else if (value.length() == 36 && isUUIDString(value.c_str())) {
 // If the length of the string is 36 bytes then we will assume it is a long hex string in
-// UUID format.
-		m_uuid.len = ESP_UUID_LEN_128;
-		int vals[16];
-		sscanf(value.c_str(), "%2x%2x%2x%2x-%2x%2x-%2x%2x-%2x%2x-%2x%2x%2x%2x%2x%2x",
-			&vals[15],
-			&vals[14],
-			&vals[13],
-			&vals[12],
-			&vals[11],
-			&vals[10],
-			&vals[9],
-			&vals[8],
-			&vals[7],
-			&vals[6],
-			&vals[5],
-			&vals[4],
-			&vals[3],
-			&vals[2],
-			&vals[1],
-			&vals[0]
-		);
-
-		int i;
-		for (i=0; i<16; i++) {
-			m_uuid.uuid.uuid128[i] = vals[i];
+// UUID format.  The pairs of hex digits, most significant first, start at these offsets.
+		static const uint8_t offsets[16] = { 0, 2, 4, 6, 9, 11, 14, 16, 19, 21, 24, 26, 28, 30, 32, 34 };
+		m_len = ESP_UUID_LEN_128;
+		for (int i=0; i<16; i++) {
+			m_uuid128[15 - i] = hexByte(value.c_str(), offsets[i]);
 		}
 	}
 	else {
-		ESP_LOGE(LOG_TAG, "ERROR: UUID value not 2, 4, 16 or 36 bytes");
-		m_valueSet = false;
+		ESP_LOGE(LOG_TAG, "ERROR: UUID value not 2, 4, 16 or 36 bytes, or not a UUID string");
+		m_len = 0;
+		memset(m_uuid128, 0, sizeof(m_uuid128));
 	}
 } //BLEUUID(std::string)
 
@@ -125,18 +109,19 @@ BLEUUID::BLEUUID(std::string value) {
  * @param [in] size The size of the data.
  * @param [in] msbFirst Is the MSB first in pData memory?
  */
-BLEUUID::BLEUUID(uint8_t* pData, size_t size, bool msbFirst) {
+BLEUUID::BLEUUID(uint8_t* pData, size_t size, bool msbFirst) : m_native() {
 	if (size != 16) {
 		ESP_LOGE(LOG_TAG, "ERROR: UUID length not 16 bytes");
+		m_len = 0;
+		memset(m_uuid128, 0, sizeof(m_uuid128));
 		return;
 	}
-	m_uuid.len = ESP_UUID_LEN_128;
+	m_len = ESP_UUID_LEN_128;
 	if (msbFirst) {
-		memrcpy(m_uuid.uuid.uuid128, pData, 16);
+		memrcpy(m_uuid128, pData, 16);
 	} else {
-		memcpy(m_uuid.uuid.uuid128, pData, 16);
+		memcpy(m_uuid128, pData, 16);
 	}
-	m_valueSet         = true;
 } // BLEUUID
 
 
@@ -145,11 +130,8 @@ BLEUUID::BLEUUID(uint8_t* pData, size_t size, bool msbFirst) {
  *
  * @param [in] uuid The 16bit short form UUID.
  */
-BLEUUID::BLEUUID(uint16_t uuid) {
-	m_uuid.len         = ESP_UUID_LEN_16;
-	m_uuid.uuid.uuid16 = uuid;
-	m_valueSet         = true;
-
+BLEUUID::BLEUUID(uint16_t uuid) : m_native() {
+	setShort(uuid, ESP_UUID_LEN_16);
 } // BLEUUID
 
 
@@ -158,10 +140,8 @@ BLEUUID::BLEUUID(uint16_t uuid) {
  *
  * @param [in] uuid The 32bit short form UUID.
  */
-BLEUUID::BLEUUID(uint32_t uuid) {
-	m_uuid.len         = ESP_UUID_LEN_32;
-	m_uuid.uuid.uuid32 = uuid;
-	m_valueSet         = true;
+BLEUUID::BLEUUID(uint32_t uuid) : m_native() {
+	setShort(uuid, ESP_UUID_LEN_32);
 } // BLEUUID
 
 
@@ -170,9 +150,28 @@ BLEUUID::BLEUUID(uint32_t uuid) {
  *
  * @param [in] uuid The native UUID.
  */
-BLEUUID::BLEUUID(esp_bt_uuid_t uuid) {
-	m_uuid     = uuid;
-	m_valueSet = true;
+BLEUUID::BLEUUID(esp_bt_uuid_t uuid) : m_native() {
+	switch(uuid.len) {
+		case ESP_UUID_LEN_16: {
+			setShort(uuid.uuid.uuid16, ESP_UUID_LEN_16);
+			break;
+		}
+		case ESP_UUID_LEN_32: {
+			setShort(uuid.uuid.uuid32, ESP_UUID_LEN_32);
+			break;
+		}
+		case ESP_UUID_LEN_128: {
+			m_len = ESP_UUID_LEN_128;
+			memcpy(m_uuid128, uuid.uuid.uuid128, 16);
+			break;
+		}
+		default: {
+			ESP_LOGE(LOG_TAG, "Unknown UUID length: %d", uuid.len);
+			m_len = 0;
+			memset(m_uuid128, 0, sizeof(m_uuid128));
+			break;
+		}
+	} // End of switch
 } // BLEUUID
 
 
@@ -185,8 +184,9 @@ BLEUUID::BLEUUID(esp_gatt_id_t gattId) : BLEUUID(gattId.uuid) {
 } // BLEUUID
 
 
-BLEUUID::BLEUUID() {
-	m_valueSet = false;
+BLEUUID::BLEUUID() : m_native() {
+	m_len = 0;
+	memset(m_uuid128, 0, sizeof(m_uuid128));
 } // BLEUUID
 
 
@@ -195,10 +195,10 @@ BLEUUID::BLEUUID() {
  * @return The number of bits in the UUID.  One of 16, 32 or 128.
  */
 int BLEUUID::bitSize() {
-	if (m_valueSet == false) {
-		return 0;
-	}
-	switch(m_uuid.len) {
+	switch(m_len) {
+		case 0: {
+			return 0;
+		}
 		case ESP_UUID_LEN_16: {
 			return 16;
 		}
@@ -209,7 +209,7 @@ int BLEUUID::bitSize() {
 			return 128;
 		}
 		default: {
-			ESP_LOGE(LOG_TAG, "Unknown UUID length: %d", m_uuid.len);
+			ESP_LOGE(LOG_TAG, "Unknown UUID length: %d", m_len);
 			return 0;
 		}
 	} // End of switch
@@ -219,28 +219,13 @@ int BLEUUID::bitSize() {
 /**
  * @brief Compare a UUID against this UUID.
  *
+ * This is the same test as operator==, so two null UUIDs are equal.
+ *
  * @param [in] uuid The UUID to compare against.
  * @return True if the UUIDs are equal and false otherwise.
  */
 bool BLEUUID::equals(BLEUUID uuid) {
-	//ESP_LOGD(TAG, "Comparing: %s to %s", toString().c_str(), uuid.toString().c_str());
-	if (m_valueSet == false || uuid.m_valueSet == false) {
-		return false;
-	}
-
-	if (uuid.m_uuid.len != m_uuid.len) {
-		return uuid.toString() == toString();
-	}
-
-	if (uuid.m_uuid.len == ESP_UUID_LEN_16) {
-		return uuid.m_uuid.uuid.uuid16 == m_uuid.uuid.uuid16;
-	}
-
-	if (uuid.m_uuid.len == ESP_UUID_LEN_32) {
-		return uuid.m_uuid.uuid.uuid32 == m_uuid.uuid.uuid32;
-	}
-
-	return memcmp(uuid.m_uuid.uuid.uuid128, m_uuid.uuid.uuid128, 16) == 0;
+	return *this == uuid;
 } // equals
 
 
@@ -252,22 +237,26 @@ bool BLEUUID::equals(BLEUUID uuid) {
  * NNNN
  * NNNNNNNN
  * <UUID>
+ *
+ * Anything else, including a short form with a character that is not a hex digit, gives the null UUID.
  */
 BLEUUID BLEUUID::fromString(std::string _uuid){
-	uint8_t start = 0;
-	if (strstr(_uuid.c_str(), "0x") != nullptr) { // If the string starts with 0x, skip those characters.
+	size_t start = 0;
+	if (_uuid.compare(0, 2, "0x") == 0) { // If the string starts with 0x, skip those characters.
 		start = 2;
 	}
-	uint8_t len = _uuid.length() - start; // Calculate the length of the string we are going to use.
-
-	if( len == 4) {
-		uint16_t x = strtoul(_uuid.substr(start, len).c_str(), NULL, 16);
-		return BLEUUID(x);
-	} else if (len == 8) {
-		uint32_t x = strtoul(_uuid.substr(start, len).c_str(), NULL, 16);
-		return BLEUUID(x);
+	size_t len = _uuid.length() - start; // Calculate the length of the string we are going to use.
+
+	if (len == 4 || len == 8) {
+		for (size_t i = start; i < _uuid.length(); i++) {
+			if (!isHex(_uuid[i])) {
+				return BLEUUID();
+			}
+		}
+		uint32_t x = strtoul(_uuid.c_str() + start, NULL, 16);
+		return len == 4 ? BLEUUID((uint16_t)x) : BLEUUID(x);
 	} else if (len == 36) {
-		return BLEUUID(_uuid);
+		return BLEUUID(_uuid.substr(start));
 	}
 	return BLEUUID();
 } // fromString
@@ -280,65 +269,84 @@ BLEUUID BLEUUID::fromString(std::string _uuid){
  */
 esp_bt_uuid_t* BLEUUID::getNative() {
 	//ESP_LOGD(TAG, ">> getNative()")
-	if (m_valueSet == false) {
+	if (m_len == 0) {
 		ESP_LOGD(LOG_TAG, "<< Return of un-initialized UUID!");
 		return nullptr;
 	}
+	m_native.len = m_len;
+	if (m_len == ESP_UUID_LEN_16) {
+		m_native.uuid.uuid16 = m_uuid128[12] | (m_uuid128[13] << 8);
+	} else if (m_len == ESP_UUID_LEN_32) {
+		m_native.uuid.uuid32 = m_uuid128[12] | (m_uuid128[13] << 8) | (m_uuid128[14] << 16) | ((uint32_t)m_uuid128[15] << 24);
+	} else {
+		memcpy(m_native.uuid.uuid128, m_uuid128, 16);
+	}
 	//ESP_LOGD(TAG, "<< getNative()");
-	return &m_uuid;
+	return &m_native;
 } // getNative
 
 
 /**
- * @brief Convert a UUID to its 128 bit representation.
+ * @brief Get a hash of the UUID's value.
  *
- * A UUID can be internally represented as 16bit, 32bit or the full 128bit.  This method
- * will convert 16 or 32 bit representations to the full 128bit.
+ * UUIDs that are equal hash the same whatever form they were created in.
+ *
+ * @return The hash.
  */
-BLEUUID BLEUUID::to128() {
-	//ESP_LOGD(LOG_TAG, ">> toFull() - %s", toString().c_str());
-
-	// If we either don't have a value or are already a 128 bit UUID, nothing further to do.
-	if (m_valueSet == false || m_uuid.len == ESP_UUID_LEN_128) {
-		return *this;
+size_t BLEUUID::hash() const {
+	// FNV-1a over the canonical form.  Short UUIDs differ only in bytes 12 to 15 which are mixed last.
+	uint32_t hash = 2166136261u;
+	for (int i=0; i<16; i++) {
+		hash = (hash ^ m_uuid128[i]) * 16777619u;
 	}
+	return hash;
+} // hash
 
-	// If we are 16 bit or 32 bit, then set the 4 bytes of the variable part of the UUID.
-	if (m_uuid.len == ESP_UUID_LEN_16) {
-		uint16_t temp = m_uuid.uuid.uuid16;
-		m_uuid.uuid.uuid128[15] = 0;
-		m_uuid.uuid.uuid128[14] = 0;
-		m_uuid.uuid.uuid128[13] = (temp >> 8) & 0xff;
-		m_uuid.uuid.uuid128[12] = temp & 0xff;
 
-	}
-	else if (m_uuid.len == ESP_UUID_LEN_32) {
-		uint32_t temp = m_uuid.uuid.uuid32;
-		m_uuid.uuid.uuid128[15] = (temp >> 24) & 0xff;
-		m_uuid.uuid.uuid128[14] = (temp >> 16) & 0xff;
-		m_uuid.uuid.uuid128[13] = (temp >> 8) & 0xff;
-		m_uuid.uuid.uuid128[12] = temp & 0xff;
-	}
+bool BLEUUID::operator==(const BLEUUID& uuid) const {
+	return memcmp(m_uuid128, uuid.m_uuid128, 16) == 0;
+} // operator==
+
 
-	// Set the fixed parts of the UUID.
-	m_uuid.uuid.uuid128[11] = 0x00;
-	m_uuid.uuid.uuid128[10] = 0x00;
+bool BLEUUID::operator!=(const BLEUUID& uuid) const {
+	return !(*this == uuid);
+} // operator!=
+
+
+/**
+ * @brief Order UUIDs by value so that they may key an ordered container.
+ */
+bool BLEUUID::operator<(const BLEUUID& uuid) const {
+	return memcmp(m_uuid128, uuid.m_uuid128, 16) < 0;
+} // operator<
 
-	m_uuid.uuid.uuid128[9]  = 0x10;
-	m_uuid.uuid.uuid128[8]  = 0x00;
 
-	m_uuid.uuid.uuid128[7]  = 0x80;
-	m_uuid.uuid.uuid128[6]  = 0x00;
+/**
+ * @brief Set the value from a 16 or 32 bit short form UUID.
+ * @param [in] value The short form value.
+ * @param [in] len The length of the short form, ESP_UUID_LEN_16 or ESP_UUID_LEN_32.
+ */
+void BLEUUID::setShort(uint32_t value, uint8_t len) {
+	memcpy(m_uuid128, baseUUID, sizeof(baseUUID));
+	m_uuid128[12] = value & 0xff;
+	m_uuid128[13] = (value >> 8) & 0xff;
+	m_uuid128[14] = (value >> 16) & 0xff;
+	m_uuid128[15] = (value >> 24) & 0xff;
+	m_len = len;
+} // setShort
 
-	m_uuid.uuid.uuid128[5]  = 0x00;
-	m_uuid.uuid.uuid128[4]  = 0x80;
-	m_uuid.uuid.uuid128[3]  = 0x5f;
-	m_uuid.uuid.uuid128[2]  = 0x9b;
-	m_uuid.uuid.uuid128[1]  = 0x34;
-	m_uuid.uuid.uuid128[0]  = 0xfb;
 
-	m_uuid.len = ESP_UUID_LEN_128;
-	//ESP_LOGD(TAG, "<< toFull <-  %s", toString().c_str());
+/**
+ * @brief Convert a UUID to its 128 bit representation.
+ *
+ * A UUID can be internally represented as 16bit, 32bit or the full 128bit.  This method
+ * will convert 16 or 32 bit representations to the full 128bit.
+ */
+BLEUUID BLEUUID::to128() {
+	// The canonical form is always held, so all that changes is the form we present.
+	if (m_len != 0) {
+		m_len = ESP_UUID_LEN_128;
+	}
 	return *this;
 } // to128
 
@@ -356,55 +364,24 @@ BLEUUID BLEUUID::to128() {
  * @return A string representation of the UUID.
  */
 std::string BLEUUID::toString() {
-	if (m_valueSet == false) {   // If we have no value, nothing to format.
+	if (m_len == 0) {   // If we have no value, nothing to format.
 		return "<NULL>";
 	}
 
-	// If the UUIDs are 16 or 32 bit, pad correctly.
-	std::stringstream ss;
-
-	if (m_uuid.len == ESP_UUID_LEN_16) {  // If the UUID is 16bit, pad correctly.
-		ss << "0000" <<
-			std::hex <<
-			std::setfill('0') <<
-			std::setw(4) <<
-			m_uuid.uuid.uuid16 <<
-			"-0000-1000-8000-00805f9b34fb";
-		return ss.str();                    // Return the string
-	} // End 16bit UUID
-
-	if (m_uuid.len == ESP_UUID_LEN_32) {  // If the UUID is 32bit, pad correctly.
-		ss << std::hex <<
-			std::setfill('0') <<
-			std::setw(8) <<
-			m_uuid.uuid.uuid32 <<
-			"-0000-1000-8000-00805f9b34fb";
-		return ss.str();                    // return the string
-	} // End 32bit UUID
-
-	// The UUID is not 16bit or 32bit which means that it is 128bit.
-	//
 	// UUID string format:
 	// AABBCCDD-EEFF-GGHH-IIJJ-KKLLMMNNOOPP
 	//
-	ss << std::hex << std::setfill('0') <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[15] <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[14] <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[13] <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[12] << "-" <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[11] <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[10] << "-" <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[9]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[8]  << "-" <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[7]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[6]  << "-" <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[5]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[4]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[3]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[2]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[1]  <<
-		std::setw(2) << (int)m_uuid.uuid.uuid128[0];
-	return ss.str();
+	static const char hexDigits[] = "0123456789abcdef";
+	char text[37];
+	char* p = text;
+	for (int i=15; i>=0; i--) {
+		*p++ = hexDigits[m_uuid128[i] >> 4];
+		*p++ = hexDigits[m_uuid128[i] & 0x0f];
+		if (i == 12 || i == 10 || i == 8 || i == 6) {
+			*p++ = '-';
+		}
+	}
+	return std::string(text, 36);
 } // toString
 
 #endif /* CONFIG_BT_ENABLED */
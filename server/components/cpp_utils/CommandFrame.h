@@ -0,0 +1,71 @@
+/*
+ * CommandFrame.h
+ */
+
+#ifndef COMPONENTS_CPP_UTILS_COMMANDFRAME_H_
+#define COMPONENTS_CPP_UTILS_COMMANDFRAME_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * @brief A command sent by a controller to the tie, or the tie's acknowledgement of one.
+ *
+ * On the air a frame is:
+ *
+ * | Offset | Size | Field                                                        |
+ * |--------|------|--------------------------------------------------------------|
+ * | 0      | 1    | Version, COMMAND_FRAME_VERSION                               |
+ * | 1      | 1    | Opcode                                                       |
+ * | 2      | 2    | Sequence number, little endian                               |
+ * | 4      | 1    | Flags                                                        |
+ * | 5      | 1    | Speed in percent of normal, or the status of an ACK          |
+ * | 6      | 1    | Amplitude in percent of normal                               |
+ * | 7      | 4    | Timestamp in milliseconds, little endian, if FLAG_TIMESTAMP  |
+ *
+ * A speed or amplitude of zero means normal.  The sender numbers its commands one after another.  The
+ * receiver acknowledges each with an ACK carrying the same sequence number and timestamp, so the sender can
+ * measure the round trip against its own clock, and ignores any command whose number is not newer than the
+ * last it accepted from that sender.
+ */
+class CommandFrame {
+public:
+	static const uint8_t VERSION    = 1;
+	static const size_t  MAX_LENGTH = 11;
+
+	enum Opcode : uint8_t {
+		HOME       = 1,     // Send the tie back to its natural vertical state.
+		RAISE      = 2,     // Raise the tie slowly or, if it is already up, flip the tip up.
+		RAISE_FAST = 3,     // Raise the tie quickly.
+		TREMORS    = 4,     // Wiggle back and forth for a while.
+		ACK        = 0x80   // Acknowledge a command.
+	};
+
+	enum Status : uint8_t {
+		OK        = 0,      // The command was accepted.
+		DUPLICATE = 1,      // The command had already been accepted and was not repeated.
+		STALE     = 2,      // A newer command had already been accepted so this one was dropped.
+		REJECTED  = 3       // The opcode is not one the receiver knows.
+	};
+
+	static const uint8_t FLAG_TIMESTAMP = 1 << 0;
+
+	CommandFrame();
+	CommandFrame(uint8_t opcode, uint16_t sequence);
+
+	CommandFrame ack(Status status) const;
+	bool         decode(const uint8_t* pData, size_t length);
+	size_t       encode(uint8_t* pData) const;
+	bool         isNewerThan(uint16_t sequence) const;
+	std::string  toString() const;
+
+	uint8_t  opcode;
+	uint16_t sequence;
+	uint8_t  speed;          // Percent of normal, zero for normal.
+	uint8_t  amplitude;      // Percent of normal, zero for normal.
+	uint8_t  status;         // Of an ACK.
+	bool     hasTimestamp;
+	uint32_t timestamp;      // Milliseconds on the sender's clock.
+}; // CommandFrame
+
+#endif /* COMPONENTS_CPP_UTILS_COMMANDFRAME_H_ */
@@ -75,51 +75,42 @@ uint32_t FreeRTOS::getTimeSinceStart() {
  * @param [in] owner A debug tag.
  * @return The value associated with the semaphore.
  */
-uint32_t FreeRTOS::Semaphore::wait(std::string owner) {
-	ESP_LOGV(LOG_TAG, ">> wait: Semaphore waiting: %s for %s", toString().c_str(), owner.c_str());
-
-
-	if (m_usePthreads) {
-		pthread_mutex_lock(&m_pthread_mutex);
-	} else {
-		xSemaphoreTake(m_semaphore, portMAX_DELAY);
-	}
+uint32_t FreeRTOS::Semaphore::wait(const char* owner) {
+	ESP_LOGV(LOG_TAG, ">> wait: Semaphore waiting: %s for %s", toString().c_str(), owner);
 
+	::xSemaphoreTake(m_semaphore, portMAX_DELAY);
+#if FREERTOS_SEMAPHORE_NAMES
 	m_owner = owner;
-
-	if (m_usePthreads) {
-		pthread_mutex_unlock(&m_pthread_mutex);
-	} else {
-		xSemaphoreGive(m_semaphore);
-	}
+#endif
+	::xSemaphoreGive(m_semaphore);
 
 	ESP_LOGV(LOG_TAG, "<< wait: Semaphore released: %s", toString().c_str());
-	m_owner = std::string("<N/A>");
+#if FREERTOS_SEMAPHORE_NAMES
+	m_owner = "<N/A>";
+#endif
 	return m_value;
 } // wait
 
 
-FreeRTOS::Semaphore::Semaphore(std::string name) {
-	m_usePthreads = false;   	// Are we using pThreads or FreeRTOS?
-	if (m_usePthreads) {
-		pthread_mutex_init(&m_pthread_mutex, nullptr);
-	} else {
-		m_semaphore = xSemaphoreCreateMutex();
-	}
-
-	m_name      = name;
-	m_owner     = std::string("<N/A>");
+/**
+ * @brief Construct a semaphore, initially free.
+ * @param [in] name A debug name.  Must be a string that lives as long as the semaphore, such as a literal.
+ */
+FreeRTOS::Semaphore::Semaphore(const char* name) {
+	// A binary semaphore rather than a mutex as it is usually given by a task other than the one that took it.
+	m_semaphore = ::xSemaphoreCreateBinary();
+	::xSemaphoreGive(m_semaphore);
 	m_value     = 0;
-}
+#if FREERTOS_SEMAPHORE_NAMES
+	m_name      = name;
+	m_owner     = "<N/A>";
+#endif
+} // Semaphore
 
 
 FreeRTOS::Semaphore::~Semaphore() {
-	if (m_usePthreads) {
-		pthread_mutex_destroy(&m_pthread_mutex);
-	} else {
-		vSemaphoreDelete(m_semaphore);
-	}
-}
+	::vSemaphoreDelete(m_semaphore);
+} // ~Semaphore
 
 
 /**
@@ -128,16 +119,10 @@ FreeRTOS::Semaphore::~Semaphore() {
  */
 void FreeRTOS::Semaphore::give() {
 	ESP_LOGV(LOG_TAG, "Semaphore giving: %s", toString().c_str());
-	if (m_usePthreads) {
-		pthread_mutex_unlock(&m_pthread_mutex);
-	} else {
-		xSemaphoreGive(m_semaphore);
-	}
-// #ifdef ARDUINO_ARCH_ESP32
-// 	FreeRTOS::sleep(10); 
-// #endif
-
-	m_owner = std::string("<N/A>");
+	::xSemaphoreGive(m_semaphore);
+#if FREERTOS_SEMAPHORE_NAMES
+	m_owner = "<N/A>";
+#endif
 } // Semaphore::give
 
 
@@ -157,11 +142,7 @@ void FreeRTOS::Semaphore::give(uint32_t value) {
  */
 void FreeRTOS::Semaphore::giveFromISR() {
 	BaseType_t higherPriorityTaskWoken;
-	if (m_usePthreads) {
-		assert(false);
-	} else {
-		xSemaphoreGiveFromISR(m_semaphore, &higherPriorityTaskWoken);
-	}
+	::xSemaphoreGiveFromISR(m_semaphore, &higherPriorityTaskWoken);
 } // giveFromISR
 
 
@@ -171,16 +152,13 @@ void FreeRTOS::Semaphore::giveFromISR() {
  * @param [in] owner The new owner (for debugging)
  * @return True if we took the semaphore.
  */
-bool FreeRTOS::Semaphore::take(std::string owner)
+bool FreeRTOS::Semaphore::take(const char* owner)
 {
-	ESP_LOGD(LOG_TAG, "Semaphore taking: %s for %s", toString().c_str(), owner.c_str());
-	bool rc = false;
-	if (m_usePthreads) {
-		pthread_mutex_lock(&m_pthread_mutex);
-	} else {
-		rc = ::xSemaphoreTake(m_semaphore, portMAX_DELAY);
-	}
+	ESP_LOGD(LOG_TAG, "Semaphore taking: %s for %s", toString().c_str(), owner);
+	bool rc = ::xSemaphoreTake(m_semaphore, portMAX_DELAY);
+#if FREERTOS_SEMAPHORE_NAMES
 	m_owner = owner;
+#endif
 	if (rc) {
 		ESP_LOGD(LOG_TAG, "Semaphore taken:  %s", toString().c_str());
 	} else {
@@ -197,16 +175,12 @@ bool FreeRTOS::Semaphore::take(std::string owner)
  * @param [in] owner The new owner (for debugging)
  * @return True if we took the semaphore.
  */
-bool FreeRTOS::Semaphore::take(uint32_t timeoutMs, std::string owner) {
-
-	ESP_LOGV(LOG_TAG, "Semaphore taking: %s for %s", toString().c_str(), owner.c_str());
-	bool rc = false;
-	if (m_usePthreads) {
-		assert(false);  // We apparently don't have a timed wait for pthreads.
-	} else {
-		rc = ::xSemaphoreTake(m_semaphore, timeoutMs/portTICK_PERIOD_MS);
-	}
+bool FreeRTOS::Semaphore::take(uint32_t timeoutMs, const char* owner) {
+	ESP_LOGV(LOG_TAG, "Semaphore taking: %s for %s", toString().c_str(), owner);
+	bool rc = ::xSemaphoreTake(m_semaphore, timeoutMs/portTICK_PERIOD_MS);
+#if FREERTOS_SEMAPHORE_NAMES
 	m_owner = owner;
+#endif
 	if (rc) {
 		ESP_LOGV(LOG_TAG, "Semaphore taken:  %s", toString().c_str());
 	} else {
@@ -223,17 +197,23 @@ bool FreeRTOS::Semaphore::take(uint32_t timeoutMs, std::string owner) {
  */
 std::string FreeRTOS::Semaphore::toString() {
 	std::stringstream stringStream;
-	stringStream << "name: "<< m_name << " (0x" << std::hex << std::setfill('0') << (uint32_t)m_semaphore << "), owner: " << m_owner;
+#if FREERTOS_SEMAPHORE_NAMES
+	stringStream << "name: "<< m_name << " (0x" << std::hex << std::setfill('0') << (uint32_t)(uintptr_t)m_semaphore << "), owner: " << m_owner;
+#else
+	stringStream << "(0x" << std::hex << std::setfill('0') << (uint32_t)(uintptr_t)m_semaphore << ")";
+#endif
 	return stringStream.str();
 } // toString
 
 
 /**
  * @brief Set the name of the semaphore.
- * @param [in] name The name of the semaphore.
+ * @param [in] name The name of the semaphore.  Must be a string that lives as long as the semaphore.
  */
-void FreeRTOS::Semaphore::setName(std::string name) {
+void FreeRTOS::Semaphore::setName(const char* name) {
+#if FREERTOS_SEMAPHORE_NAMES
 	m_name = name;
+#endif
 } // setName
 
 
@@ -10,9 +10,21 @@
 #include <stdint.h>
 #include <string>
 #include <esp_err.h>
+#include <esp_log.h>
 #include <algorithm>
 #include <vector>
 
+/**
+ * @brief Test whether logging at the given level is active for the current source file.
+ *
+ * Use this to guard the construction of expensive log arguments such as hex dumps or toString() results.
+ * The LOG_LOCAL_LEVEL test is a constant and removes the guarded code entirely when the level is compiled out.
+ * Otherwise it costs one comparison against the level set through GeneralUtils::setLogLevel().  That level is
+ * the only one it sees: esp_log_level_set() for a tag does not reach it, so raising a tag's level that way
+ * leaves the guarded messages out.  Set the level with GeneralUtils::setLogLevel() instead.
+ */
+#define LOG_LEVEL_ENABLED(level) (LOG_LOCAL_LEVEL >= (level) && GeneralUtils::getLogLevel() >= (level))
+
 /**
  * @brief General utilities.
  */
@@ -23,12 +35,17 @@ public:
 	static void        dumpInfo();
 	static bool        endsWith(std::string str, char c);
 	static const char* errorToString(esp_err_t errCode);
+	static esp_log_level_t getLogLevel() { return m_logLevel; }
 	static void        hexDump(const uint8_t* pData, uint32_t length);
 	static std::string ipToString(uint8_t* ip);
+	static void        setLogLevel(esp_log_level_t level);
 	static std::vector<std::string> split(std::string source, char delimiter);
+	static char*       toHex(char* pBuffer, size_t bufferSize, const uint8_t* pData, size_t length);
 	static std::string toLower(std::string& value);
 	static std::string trim(const std::string& str);
 
+private:
+	static esp_log_level_t m_logLevel;
 };
 
 #endif /* COMPONENTS_CPP_UTILS_GENERALUTILS_H_ */
@@ -0,0 +1,109 @@
+/*
+ * TelemetryFrame.cpp
+ */
+#include <esp_log.h>
+#include <sstream>
+#include "TelemetryFrame.h"
+#ifdef ARDUINO_ARCH_ESP32
+#include "esp32-hal-log.h"
+#endif
+
+static const char* LOG_TAG = "TelemetryFrame";
+
+
+TelemetryFrame::TelemetryFrame() {
+	sequence = 0;
+	periodMs = 0;
+	count    = 0;
+} // TelemetryFrame
+
+
+/**
+ * @brief Get the number of samples that fit in one notification.
+ *
+ * A notification carries at most the MTU less three bytes of attribute protocol header.
+ *
+ * @param [in] mtu The MTU of the connection.
+ * @return The number of samples, at most MAX_SAMPLES.  Always at least one.
+ */
+uint8_t TelemetryFrame::capacity(uint16_t mtu) {
+	size_t samples = mtu < 3 + HEADER_LENGTH + SAMPLE_LENGTH ? 1 : (mtu - 3 - HEADER_LENGTH) / SAMPLE_LENGTH;
+	return samples > MAX_SAMPLES ? MAX_SAMPLES : samples;
+} // capacity
+
+
+/**
+ * @brief Decode a frame received from the air.
+ * @param [in] pData The received value.
+ * @param [in] length The length of the received value.
+ * @return True if the value is a whole frame of our version.
+ */
+bool TelemetryFrame::decode(const uint8_t* pData, size_t length) {
+	if (length < HEADER_LENGTH || pData[0] != VERSION) {
+		ESP_LOGD(LOG_TAG, "Not a version %d frame: length=%d", VERSION, length);
+		return false;
+	}
+	if (pData[1] > MAX_SAMPLES || length < HEADER_LENGTH + pData[1] * SAMPLE_LENGTH) {
+		ESP_LOGD(LOG_TAG, "Frame too short for its %d samples: length=%d", pData[1], length);
+		return false;
+	}
+	count    = pData[1];
+	sequence = pData[2] | (pData[3] << 8);
+	periodMs = pData[4] | (pData[5] << 8);
+	const uint8_t* p = pData + HEADER_LENGTH;
+	for (int i = 0; i < count; i++, p += SAMPLE_LENGTH) {
+		TelemetrySample& sample = samples[i];
+		sample.pulseUs[0] = p[0] | (p[1] << 8);
+		sample.pulseUs[1] = p[2] | (p[3] << 8);
+		sample.trajectory = p[4];
+		sample.flags      = p[5];
+		sample.queueDepth = p[6];
+		sample.latencyMs  = p[7] | (p[8] << 8);
+		sample.freeHeap   = p[9] | (p[10] << 8) | (p[11] << 16) | ((uint32_t)p[12] << 24);
+	}
+	return true;
+} // decode
+
+
+/**
+ * @brief Encode the frame for the air.
+ * @param [out] pData Where to encode the frame.  Must have room for MAX_LENGTH bytes.
+ * @return The length of the encoded frame.
+ */
+size_t TelemetryFrame::encode(uint8_t* pData) const {
+	pData[0] = VERSION;
+	pData[1] = count;
+	pData[2] = sequence & 0xff;
+	pData[3] = sequence >> 8;
+	pData[4] = periodMs & 0xff;
+	pData[5] = periodMs >> 8;
+	uint8_t* p = pData + HEADER_LENGTH;
+	for (int i = 0; i < count; i++, p += SAMPLE_LENGTH) {
+		const TelemetrySample& sample = samples[i];
+		p[0]  = sample.pulseUs[0] & 0xff;
+		p[1]  = sample.pulseUs[0] >> 8;
+		p[2]  = sample.pulseUs[1] & 0xff;
+		p[3]  = sample.pulseUs[1] >> 8;
+		p[4]  = sample.trajectory;
+		p[5]  = sample.flags;
+		p[6]  = sample.queueDepth;
+		p[7]  = sample.latencyMs & 0xff;
+		p[8]  = sample.latencyMs >> 8;
+		p[9]  = sample.freeHeap & 0xff;
+		p[10] = (sample.freeHeap >> 8) & 0xff;
+		p[11] = (sample.freeHeap >> 16) & 0xff;
+		p[12] = sample.freeHeap >> 24;
+	}
+	return HEADER_LENGTH + count * SAMPLE_LENGTH;
+} // encode
+
+
+/**
+ * @brief Return a string representation of the frame.
+ * @return A string representation of the frame.
+ */
+std::string TelemetryFrame::toString() const {
+	std::stringstream ss;
+	ss << "sequence: " << sequence << ", periodMs: " << periodMs << ", count: " << (int)count;
+	return ss.str();
+} // toString
@@ -0,0 +1,104 @@
+/*
+ * bench_gatts_dispatch.cpp
+ *
+ * Replays synthetic write events to a server with 1, 10 and 100 characteristics and reports the time each
+ * takes to dispatch.  Events are looked up by handle, so the cost should not grow with the characteristics.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "BLEDevice.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+#define EVENTS 100000
+
+
+static uint64_t nowNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// Add a service with count writable characteristics and return the first of them.
+static BLECharacteristic* addService(BLEServer* pServer, uint16_t serviceId, uint16_t firstId, int count) {
+	BLEService* pService = pServer->createService(BLEUUID(serviceId), 1 + 2 * count);
+	BLECharacteristic* pFirst = nullptr;
+	for (int i = 0; i < count; i++) {
+		BLECharacteristic* pCharacteristic = pService->createCharacteristic(BLEUUID((uint16_t)(firstId + i)),
+			BLECharacteristic::PROPERTY_WRITE_NR);
+		if (pFirst == nullptr) {
+			pFirst = pCharacteristic;
+		}
+	}
+	pService->start();
+	return pFirst;
+}
+
+
+// Time a write without response to the characteristic, as the stack would deliver it.
+static double timeWrites(BLECharacteristic* pCharacteristic) {
+	uint8_t value[4];
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.write.conn_id = 0;
+	param.write.handle  = pCharacteristic->getHandle();
+	param.write.len     = sizeof(value);
+	param.write.value   = value;
+
+	for (int i = 0; i < EVENTS / 10; i++) {   // Warm up.
+		FakeBluedroid::deliverServerEvent(ESP_GATTS_WRITE_EVT, &param);
+	}
+	uint64_t startNs = nowNs();
+	for (int i = 0; i < EVENTS; i++) {
+		memcpy(value, &i, sizeof(value));
+		param.write.trans_id = i;
+		FakeBluedroid::deliverServerEvent(ESP_GATTS_WRITE_EVT, &param);
+	}
+	double perEvent = (double)(nowNs() - startNs) / EVENTS;
+
+	int last = EVENTS - 1;
+	CHECK(pCharacteristic->getValue() == std::string((const char*)&last, sizeof(last)));
+	return perEvent;
+}
+
+
+// The characteristics are added a service at a time and the first one written throughout, so a dispatch that
+// visited every attribute would slow down with each service.
+static void bench_dispatch() {
+	BLEDevice::init("host");
+	BLEServer* pServer = BLEDevice::createServer();
+	const int sizes[] = { 1, 10, 100 };
+	double    costs[3];
+	int       count  = 0;
+	BLECharacteristic* pTarget = nullptr;
+	for (int i = 0; i < 3; i++) {
+		BLECharacteristic* pFirst = addService(pServer, 0x1000 + i, 0x2000 + count, sizes[i] - count);
+		if (pTarget == nullptr) {
+			pTarget = pFirst;
+		}
+		count = sizes[i];
+		FakeBluedroid::waitIdle();
+		costs[i] = timeWrites(pTarget);
+		printf("%3d characteristics: %6.0f ns per write event\n", count, costs[i]);
+	}
+	CHECK(costs[2] < 10 * costs[0]);   // Generous, for a loaded host; a fan-out would take about 100 times as long.
+}
+
+
+int main() {
+	bench_dispatch();
+	printf("bench_gatts_dispatch: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * bench_notify.cpp
+ *
+ * Sends notifications from a server to a subscribed client through the fake Bluetooth stack, first with the
+ * blocking BLECharacteristic::notify() and then with notifyAsync(), and reports the notifications sent per
+ * second and the 99th percentile of the time each call keeps its caller.  As on the ESP32 a notification is
+ * confirmed once the stack has taken it, so a blocking send waits for a trip through the BTC task and not for
+ * one over the air.  An async send waits only when the queue is full.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "BLE2902.h"
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+#define NOTIFICATIONS 5000
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLECharacteristic*    pCharacteristic = nullptr;
+static std::atomic<uint32_t> received(0);
+static std::atomic<uint32_t> lastReceived(0);
+static std::atomic<uint32_t> completed(0);
+
+
+class CompletionCounter: public BLECharacteristicCallbacks {
+	void onNotifyComplete(BLECharacteristic* pCharacteristic, esp_gatt_status_t status) {
+		completed++;
+	}
+};
+
+
+static void notifyCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	uint32_t value = 0;
+	memcpy(&value, pData, length < sizeof(value) ? length : sizeof(value));
+	lastReceived = value;
+	received++;
+}
+
+
+static uint64_t nowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+// Serve a notifying characteristic and subscribe a client to it.
+static bool connect() {
+	BLEDevice::init("host");
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID), BLECharacteristic::PROPERTY_NOTIFY);
+	pCharacteristic->setCallbacks(new CompletionCounter());
+	pCharacteristic->addDescriptor(new BLE2902());
+	pService->start();
+
+	BLEClient* pClient = BLEDevice::createClient();
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService == nullptr ? nullptr :
+		pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	if (pRemoteCharacteristic == nullptr) {
+		return false;
+	}
+	pRemoteCharacteristic->registerForNotify(notifyCallback);
+	uint8_t enable[] = { 0x01, 0x00 };
+	pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902))->writeValue(enable, sizeof(enable), true);
+	FakeBluedroid::waitIdle();
+	return true;
+}
+
+
+// Send NOTIFICATIONS numbered values, timing each call, and report once the client has them all.
+static void run(const char* name, bool async) {
+	std::vector<uint32_t> latencies;
+	latencies.reserve(NOTIFICATIONS);
+	received  = 0;
+	completed = 0;
+
+	uint64_t startUs = nowUs();
+	for (uint32_t i = 1; i <= NOTIFICATIONS; i++) {
+		pCharacteristic->setValue((uint8_t*)&i, sizeof(i));
+		uint64_t callUs = nowUs();
+		if (async) {
+			CHECK(pCharacteristic->notifyAsync());
+		} else {
+			pCharacteristic->notify();
+		}
+		latencies.push_back(nowUs() - callUs);
+	}
+	FakeBluedroid::waitIdle();
+	uint64_t elapsedUs = nowUs() - startUs;
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%-8s %8.0f notifications/s, enqueue p50 %4u us, p99 %5u us\n", name,
+		NOTIFICATIONS * 1e6 / elapsedUs, latencies[NOTIFICATIONS / 2], latencies[NOTIFICATIONS * 99 / 100]);
+	CHECK(received == NOTIFICATIONS);
+	CHECK(lastReceived == NOTIFICATIONS);
+	CHECK(!async || completed == NOTIFICATIONS);
+}
+
+
+int main() {
+	if (connect()) {
+		run("blocking", false);
+		run("async", true);
+	}
+	printf("bench_notify: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,108 @@
+/*
+ * bench_scan.cpp
+ *
+ * Feeds 10000 scan results from 1000 advertisers to a running BLEScan through the fake Bluetooth stack and
+ * reports the time per result and how far the heap grew.  It runs once with the default cap on the results
+ * kept and once with room for every advertiser.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "BLEDevice.h"
+#include "BLEScan.h"
+#include "FakeBluedroid.h"
+
+#define ADVERTISERS 1000
+#define RESULTS     10000
+#define BATCH       100     // Results between heap samples.
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static SemaphoreHandle_t scanDone;
+
+
+static uint64_t nowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+static size_t heapInUse() {
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+
+static void scanTask(void* pArg) {
+	BLEDevice::getScan()->start(60);
+	::xSemaphoreGive(scanDone);
+	::vTaskDelete(nullptr);
+}
+
+
+// Hand the stack the advertisement of one of the advertisers, with its flags and a name.
+static bool inject(int advertiser) {
+	esp_bd_addr_t address = { 0x30, 0xae, 0xa4, 0x00, (uint8_t)(advertiser >> 8), (uint8_t)advertiser };
+	uint8_t data[16] = { 0x02, 0x01, 0x06 };
+	int nameLength = snprintf((char*)data + 5, sizeof(data) - 5, "dev%d", advertiser);
+	data[3] = nameLength + 1;
+	data[4] = 0x09;   // Complete local name.
+	return FakeBluedroid::injectScanResult(address, data, 5 + nameLength, -40 - advertiser % 50);
+}
+
+
+static void run(size_t maxResults) {
+	BLEScan* pScan = BLEDevice::getScan();
+	pScan->setMaxResults(1);   // Start from the smallest table, so that growing it to maxResults counts.
+	size_t baseline = heapInUse();
+	size_t peak     = baseline;
+	pScan->setMaxResults(maxResults);
+
+	::xTaskCreate(scanTask, "scan", 8192, nullptr, 5, nullptr);
+	while (!inject(0)) {
+		::vTaskDelay(1);
+	}
+	uint64_t startUs = nowUs();
+	for (int i = 1; i < RESULTS; i++) {
+		inject(i % ADVERTISERS);
+		if (i % BATCH == 0) {
+			FakeBluedroid::waitIdle();
+			size_t inUse = heapInUse();
+			if (inUse > peak) {
+				peak = inUse;
+			}
+		}
+	}
+	FakeBluedroid::waitIdle();
+	uint64_t elapsedUs = nowUs() - startUs;
+
+	size_t expected = maxResults < ADVERTISERS ? maxResults : ADVERTISERS;
+	printf("max results %4u: %5.2f us per result, heap grew by at most %6u bytes, %4d devices kept\n",
+		(unsigned)maxResults, (double)elapsedUs / RESULTS, (unsigned)(peak - baseline), pScan->getResults().getCount());
+	CHECK((size_t)pScan->getResults().getCount() == expected);
+
+	pScan->stop();
+	::xSemaphoreTake(scanDone, portMAX_DELAY);
+	FakeBluedroid::waitIdle();
+}
+
+
+int main() {
+	BLEDevice::init("host");
+	scanDone = ::xSemaphoreCreateBinary();
+	run(BLE_SCAN_DEFAULT_MAX_RESULTS);
+	run(ADVERTISERS);
+	printf("bench_scan: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+/*
+ * bench_write_window.cpp
+ *
+ * Sends writes without response from a client to a server through the fake Bluetooth stack, with write
+ * windows of several sizes, and reports the writes per second and a histogram of how long each call to
+ * writeNoResponse() took.  Writes with response are timed too, for comparison.  The fake stack reports a
+ * write without response sent as soon as it has taken it, so credit comes back after a trip through the BTC
+ * task and not over the air.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+#define WRITES            5000
+#define WRITES_RESPONSE   200      // Each takes a round trip, so fewer are needed.
+#define BUCKETS           6        // Latencies under 1, 10, 100 us, 1, 10 ms and the rest.
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static std::atomic<uint32_t> received(0);
+
+
+class WriteCounter: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic* pCharacteristic) {
+		received++;
+	}
+};
+
+
+static uint64_t nowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+// Serve a writable characteristic and connect a client to it.
+static BLERemoteCharacteristic* connect(BLEClient** ppClient) {
+	BLEDevice::init("host");
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	BLECharacteristic* pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID),
+		BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR);
+	pCharacteristic->setCallbacks(new WriteCounter());
+	pService->start();
+
+	*ppClient = BLEDevice::createClient();
+	CHECK((*ppClient)->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	BLERemoteService* pRemoteService = (*ppClient)->getService(BLEUUID(SERVICE_UUID));
+	BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService == nullptr ? nullptr :
+		pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	return pRemoteCharacteristic;
+}
+
+
+// Make count writes of 20 bytes, timing each call, and report once the server has them all.
+static void run(const char* name, BLERemoteCharacteristic* pRemoteCharacteristic, bool response, int count) {
+	uint32_t histogram[BUCKETS] = { 0 };
+	uint8_t  value[20];
+	memset(value, 0x5a, sizeof(value));
+	received = 0;
+
+	uint64_t startUs = nowUs();
+	for (int i = 0; i < count; i++) {
+		memcpy(value, &i, sizeof(i));
+		uint64_t callUs = nowUs();
+		if (response) {
+			pRemoteCharacteristic->writeValue(value, sizeof(value), true);
+		} else {
+			CHECK(pRemoteCharacteristic->writeNoResponse(value, sizeof(value)));
+		}
+		uint64_t latencyUs = nowUs() - callUs;
+		int bucket = 0;
+		for (uint64_t limit = 1; bucket < BUCKETS - 1 && latencyUs >= limit; limit *= 10) {
+			bucket++;
+		}
+		histogram[bucket]++;
+	}
+	FakeBluedroid::waitIdle();
+	uint64_t elapsedUs = nowUs() - startUs;
+
+	printf("%-16s %8.0f writes/s  <1us %5u  <10us %5u  <100us %5u  <1ms %5u  <10ms %5u  more %5u\n", name,
+		count * 1e6 / elapsedUs, histogram[0], histogram[1], histogram[2], histogram[3], histogram[4], histogram[5]);
+	CHECK(received == (uint32_t)count);
+}
+
+
+int main() {
+	BLEClient* pClient = nullptr;
+	BLERemoteCharacteristic* pRemoteCharacteristic = connect(&pClient);
+	if (pRemoteCharacteristic != nullptr) {
+		run("with response", pRemoteCharacteristic, true, WRITES_RESPONSE);
+		const uint8_t sizes[] = { 1, 4, 16 };
+		for (int i = 0; i < 3; i++) {
+			char name[32];
+			snprintf(name, sizeof(name), "window of %u", sizes[i]);
+			pClient->setWriteWindow(sizes[i]);
+			run(name, pRemoteCharacteristic, false, WRITES);
+		}
+	}
+	printf("bench_write_window: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
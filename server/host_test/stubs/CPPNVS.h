@@ -0,0 +1,26 @@
+/*
+ * CPPNVS.h
+ *
+ * Host stand-in for the NVS wrapper.  Nothing is stored: a get leaves its result untouched.
+ */
+
+#ifndef HOST_TEST_STUBS_CPPNVS_H_
+#define HOST_TEST_STUBS_CPPNVS_H_
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+typedef enum {
+	NVS_READONLY,
+	NVS_READWRITE
+} nvs_open_mode;
+
+class NVS {
+public:
+	NVS(std::string name, nvs_open_mode openMode = NVS_READWRITE) {}
+	void commit() {}
+	void get(std::string key, uint8_t* result, size_t& length) { length = 0; }
+	void set(std::string key, uint8_t* data, size_t length) {}
+};
+
+#endif /* HOST_TEST_STUBS_CPPNVS_H_ */
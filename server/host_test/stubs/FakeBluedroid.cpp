@@ -0,0 +1,1616 @@
+/*
+ * FakeBluedroid.cpp
+ *
+ * The fake Bluetooth host stack described in FakeBluedroid.h, together with an in-memory NVS.
+ *
+ * All of the stack's state is behind one lock.  A call works out what the stack would do and queues the
+ * resulting callbacks, each with the time it is due; the BTC task makes them in that order with the lock
+ * released, so a callback may call back into the stack as it would on the ESP32.
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <esp_bt.h>
+#include <esp_bt_device.h>
+#include <esp_bt_main.h>
+#include <esp_gap_ble_api.h>
+#include <esp_gatt_common_api.h>
+#include <esp_gattc_api.h>
+#include <esp_gatts_api.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <nvs.h>
+#include <nvs_flash.h>
+
+#include "FakeBluedroid.h"
+
+#define FIRST_APP_HANDLE 0x28   // Bluedroid keeps the handles below for its own GAP and GATT services.
+#define MAX_CONNECTIONS  4
+#define MAX_READ_LENGTH  512
+
+namespace {
+
+enum AttributeKind {
+	ATTR_SERVICE,
+	ATTR_DECLARATION,
+	ATTR_VALUE,
+	ATTR_DESCRIPTOR
+};
+
+struct Attribute {
+	AttributeKind        kind;
+	esp_bt_uuid_t        uuid;
+	esp_gatt_char_prop_t properties;
+	bool                 autoResponse;   // Bluedroid answers for the attribute itself.
+	std::string          value;
+};
+
+struct Service {
+	esp_gatt_srvc_id_t id;
+	uint16_t           start;
+	uint16_t           end;
+	uint16_t           next;      // The next free handle.
+	bool               started;
+};
+
+// A read or write request from a client, which is served once those before it on the connection are done.
+struct Request {
+	bool        isWrite;
+	bool        isDescriptor;
+	uint16_t    handle;
+	std::string value;     // Written so far or, for a read, read so far.
+	size_t      offset;    // The part of a long write that has been prepared.
+	bool        executing; // A long write whose parts have all been prepared.
+	uint32_t    transId;
+};
+
+struct Connection {
+	esp_gatt_if_t       gattcIf;
+	esp_bd_addr_t       clientAddress;
+	uint16_t            mtu;
+	std::deque<Request> requests;
+};
+
+struct Advertisement {
+	esp_bd_addr_t address;
+	std::string   data;
+	int           rssi;
+};
+
+struct Event {
+	uint64_t              dueUs;
+	uint64_t              seq;
+	std::function<void()> deliver;
+	bool                  timer;     // The end of a scan, which waitIdle() does not wait for.
+};
+
+struct Later {
+	bool operator()(const Event& a, const Event& b) const {
+		return a.dueUs > b.dueUs || (a.dueUs == b.dueUs && a.seq > b.seq);
+	}
+};
+
+struct NvsEntry {
+	char        type;     // 'b'lob, 's'tring or 'u'32.
+	std::string data;
+};
+
+/**
+ * @brief The whole of the fake stack.  It is never destroyed, as callbacks may still be running at exit.
+ */
+struct Stack {
+	pthread_mutex_t lock;
+	pthread_cond_t  changed;
+	std::priority_queue<Event, std::vector<Event>, Later> events;
+	uint64_t        seq;
+	uint32_t        pending;    // Events queued that are not timers.
+	bool            busy;
+	bool            initialized;
+	bool            enabled;    // While false the stack delivers no events, as the real one makes no calls back.
+	bool            btcStarted;
+
+	esp_gap_ble_cb_t gapCallback;
+	esp_gatts_cb_t   gattsCallback;
+	esp_gattc_cb_t   gattcCallback;
+
+	uint32_t latencyUs;
+	uint32_t connectTimeoutUs;
+	uint16_t peerMtu;
+	uint16_t localMtu;
+	uint32_t lossPerMille;
+	uint32_t random;
+	bool     peerPresent;
+
+	esp_bd_addr_t                      localAddress;
+	esp_gatt_if_t                      nextIf;
+	esp_gatt_if_t                      gattsIf;
+	std::map<esp_gatt_if_t, uint16_t>  clientApps;
+	std::map<uint16_t, Attribute>      attributes;
+	std::map<uint16_t, Service>        services;
+	uint16_t                           nextHandle;
+	std::map<uint16_t, Connection>     connections;
+	std::set<std::pair<esp_gatt_if_t, uint16_t>> registrations;
+	uint32_t                           nextTransId;
+
+	bool                       scanning;
+	uint32_t                   scanGeneration;
+	std::vector<Advertisement> advertisements;
+
+	std::map<std::string, std::map<std::string, NvsEntry>> nvs;
+	std::map<nvs_handle, std::string>                      nvsHandles;
+	nvs_handle                                             nextNvsHandle;
+
+	FakeBluedroid::Stats stats;
+};
+
+Stack* g_pStack = nullptr;
+
+
+uint64_t nowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+} // nowUs
+
+
+esp_bt_uuid_t uuid16(uint16_t value) {
+	esp_bt_uuid_t uuid;
+	memset(&uuid, 0, sizeof(uuid));
+	uuid.len         = ESP_UUID_LEN_16;
+	uuid.uuid.uuid16 = value;
+	return uuid;
+} // uuid16
+
+
+Stack& getStack();
+
+
+// Set on the BTC task while the server's callback runs, and cleared again while it calls back into the stack.
+__thread bool t_inServerCallback = false;
+
+
+/**
+ * @brief Lock the stack, creating it if need be, for the life of the scope.
+ */
+class Locked {
+public:
+	Locked(): m_inServerCallback(t_inServerCallback) {
+		t_inServerCallback = false;
+		pthread_mutex_lock(&getStack().lock);
+	}
+	~Locked() {
+		pthread_mutex_unlock(&g_pStack->lock);
+		t_inServerCallback = m_inServerCallback;
+	}
+
+private:
+	bool m_inServerCallback;
+};
+
+
+// Everything below that takes a Stack& expects the stack to be locked.
+
+void post(Stack& stack, uint32_t delayUs, std::function<void()> deliver, bool timer = false) {
+	if (!stack.enabled) {
+		return;
+	}
+	Event event;
+	event.dueUs   = nowUs() + delayUs;
+	event.seq     = stack.seq++;
+	event.deliver = deliver;
+	event.timer   = timer;
+	stack.events.push(event);
+	if (!timer) {
+		stack.pending++;
+	}
+	pthread_cond_broadcast(&stack.changed);
+} // post
+
+
+// Events carry their value with them; the pointer in the parameters is pointed at it when they are delivered.
+void postGap(Stack& stack, uint32_t delayUs, esp_gap_ble_cb_event_t event, const esp_ble_gap_cb_param_t& param) {
+	esp_gap_ble_cb_t callback = stack.gapCallback;
+	if (callback == nullptr) {
+		return;
+	}
+	post(stack, delayUs, [=]() {
+		esp_ble_gap_cb_param_t copy = param;
+		callback(event, &copy);
+	});
+} // postGap
+
+
+void postGatts(Stack& stack, uint32_t delayUs, esp_gatts_cb_event_t event, const esp_ble_gatts_cb_param_t& param, const std::string& value = "") {
+	esp_gatts_cb_t callback = stack.gattsCallback;
+	esp_gatt_if_t  gattsIf  = stack.gattsIf;
+	if (callback == nullptr || gattsIf == ESP_GATT_IF_NONE) {
+		return;
+	}
+	post(stack, delayUs, [=]() {
+		esp_ble_gatts_cb_param_t copy = param;
+		std::string buffer = value;
+		if (event == ESP_GATTS_WRITE_EVT) {
+			copy.write.value = (uint8_t*)&buffer[0];
+		} else if (event == ESP_GATTS_CONF_EVT) {
+			copy.conf.value = (uint8_t*)&buffer[0];
+		}
+		t_inServerCallback = true;
+		callback(event, gattsIf, &copy);
+		t_inServerCallback = false;
+	});
+} // postGatts
+
+
+void postGattc(Stack& stack, uint32_t delayUs, esp_gattc_cb_event_t event, esp_gatt_if_t gattcIf, const esp_ble_gattc_cb_param_t& param, const std::string& value = "") {
+	esp_gattc_cb_t callback = stack.gattcCallback;
+	if (callback == nullptr) {
+		return;
+	}
+	post(stack, delayUs, [=]() {
+		esp_ble_gattc_cb_param_t copy = param;
+		std::string buffer = value;
+		if (event == ESP_GATTC_READ_CHAR_EVT || event == ESP_GATTC_READ_DESCR_EVT) {
+			copy.read.value = (uint8_t*)&buffer[0];
+		} else if (event == ESP_GATTC_NOTIFY_EVT) {
+			copy.notify.value = (uint8_t*)&buffer[0];
+		}
+		callback(event, gattcIf, &copy);
+	});
+} // postGattc
+
+
+Connection* findConnection(Stack& stack, esp_gatt_if_t gattcIf, uint16_t connId) {
+	auto it = stack.connections.find(connId);
+	if (it == stack.connections.end() || (gattcIf != ESP_GATT_IF_NONE && it->second.gattcIf != gattcIf)) {
+		return nullptr;
+	}
+	return &it->second;
+} // findConnection
+
+
+uint16_t addAttribute(Stack& stack, Service& service, AttributeKind kind, esp_bt_uuid_t uuid, esp_gatt_char_prop_t properties, bool autoResponse, const std::string& value) {
+	Attribute attribute;
+	attribute.kind         = kind;
+	attribute.uuid         = uuid;
+	attribute.properties   = properties;
+	attribute.autoResponse = autoResponse;
+	attribute.value        = value;
+	uint16_t handle = service.next++;
+	stack.attributes[handle] = attribute;
+	return handle;
+} // addAttribute
+
+
+Service& addService(Stack& stack, esp_gatt_srvc_id_t id, uint16_t numHandle) {
+	Service service;
+	service.id      = id;
+	service.start   = stack.nextHandle;
+	service.end     = stack.nextHandle + numHandle - 1;
+	service.next    = stack.nextHandle;
+	service.started = false;
+	stack.nextHandle += numHandle;
+	Service& added = stack.services[service.start] = service;
+	addAttribute(stack, added, ATTR_SERVICE, id.id.uuid, 0, true, "");
+	return added;
+} // addService
+
+
+// The GAP and GATT services Bluedroid serves itself.  The GATT service has no Database Hash, as in ESP-IDF 3.
+void addBuiltInServices(Stack& stack) {
+	esp_gatt_srvc_id_t id;
+	memset(&id, 0, sizeof(id));
+	id.is_primary = true;
+
+	id.id.uuid = uuid16(0x1800);
+	Service& gap = addService(stack, id, 5);
+	addAttribute(stack, gap, ATTR_DECLARATION, uuid16(0x2803), 0, true, "");
+	addAttribute(stack, gap, ATTR_VALUE, uuid16(0x2a00), ESP_GATT_CHAR_PROP_BIT_READ, true, "host");
+	addAttribute(stack, gap, ATTR_DECLARATION, uuid16(0x2803), 0, true, "");
+	addAttribute(stack, gap, ATTR_VALUE, uuid16(0x2a01), ESP_GATT_CHAR_PROP_BIT_READ, true, std::string(2, '\0'));
+	gap.started = true;
+
+	id.id.uuid = uuid16(0x1801);
+	Service& gatt = addService(stack, id, 4);
+	addAttribute(stack, gatt, ATTR_DECLARATION, uuid16(0x2803), 0, true, "");
+	addAttribute(stack, gatt, ATTR_VALUE, uuid16(0x2a05), ESP_GATT_CHAR_PROP_BIT_INDICATE, true, "");
+	addAttribute(stack, gatt, ATTR_DESCRIPTOR, uuid16(0x2902), 0, true, std::string(2, '\0'));
+	gatt.started = true;
+} // addBuiltInServices
+
+
+bool lose(Stack& stack) {
+	stack.random = stack.random * 1103515245 + 12345;
+	return (stack.random >> 16) % 1000 < stack.lossPerMille;
+} // lose
+
+
+void startRequest(Stack& stack, uint16_t connId);
+
+
+// The client's request has been answered: tell it, then serve the next.
+void completeRequest(Stack& stack, uint16_t connId, esp_gatt_status_t status) {
+	Connection& connection = stack.connections[connId];
+	Request request = connection.requests.front();
+	connection.requests.pop_front();
+
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	if (request.isWrite) {
+		param.write.status  = status;
+		param.write.conn_id = connId;
+		param.write.handle  = request.handle;
+		postGattc(stack, stack.latencyUs, request.isDescriptor ? ESP_GATTC_WRITE_DESCR_EVT : ESP_GATTC_WRITE_CHAR_EVT, connection.gattcIf, param);
+	} else {
+		param.read.status    = status;
+		param.read.conn_id   = connId;
+		param.read.handle    = request.handle;
+		param.read.value_len = status == ESP_GATT_OK ? request.value.size() : 0;
+		postGattc(stack, stack.latencyUs, request.isDescriptor ? ESP_GATTC_READ_DESCR_EVT : ESP_GATTC_READ_CHAR_EVT, connection.gattcIf, param,
+			status == ESP_GATT_OK ? request.value : "");
+	}
+	if (!connection.requests.empty()) {
+		startRequest(stack, connId);
+	}
+} // completeRequest
+
+
+// A response to the request at the head of the connection, whether from the server or from the stack itself.
+void handleResponse(Stack& stack, uint16_t connId, esp_gatt_status_t status, const uint8_t* pValue, uint16_t length) {
+	Connection& connection = stack.connections[connId];
+	Request&    request    = connection.requests.front();
+	if (status != ESP_GATT_OK) {
+		if (request.isWrite && request.offset > 0 && !request.executing) {   // Throw away what was prepared.
+			esp_ble_gatts_cb_param_t param;
+			memset(&param, 0, sizeof(param));
+			param.exec_write.conn_id         = connId;
+			param.exec_write.trans_id        = stack.nextTransId++;
+			param.exec_write.exec_write_flag = ESP_GATT_PREP_WRITE_CANCEL;
+			memcpy(param.exec_write.bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+			postGatts(stack, stack.latencyUs, ESP_GATTS_EXEC_WRITE_EVT, param);
+		}
+		completeRequest(stack, connId, status);
+		return;
+	}
+	if (!request.isWrite) {
+		if (length > connection.mtu - 1) {
+			length = connection.mtu - 1;   // As much as fits in the response packet.
+		}
+		request.value.append((const char*)pValue, length);
+		if (length == connection.mtu - 1 && request.value.size() < MAX_READ_LENGTH) {
+			startRequest(stack, connId);   // A full response: read on from where it ends.
+			return;
+		}
+	} else if (request.offset > 0 && !request.executing) {
+		if (request.offset < request.value.size()) {
+			startRequest(stack, connId);   // The next part.
+			return;
+		}
+		request.executing = true;
+		startRequest(stack, connId);
+		return;
+	}
+	completeRequest(stack, connId, ESP_GATT_OK);
+} // handleResponse
+
+
+// Send the request at the head of the connection, or its next part, to the server.
+void startRequest(Stack& stack, uint16_t connId) {
+	Connection& connection = stack.connections[connId];
+	Request&    request    = connection.requests.front();
+
+	auto it = stack.attributes.find(request.handle);
+	bool valid = it != stack.attributes.end() &&
+		(request.isDescriptor ? it->second.kind == ATTR_DESCRIPTOR : it->second.kind == ATTR_VALUE);
+	if (!valid) {
+		completeRequest(stack, connId, ESP_GATT_INVALID_HANDLE);
+		return;
+	}
+	Attribute& attribute = it->second;
+
+	if (attribute.autoResponse) {
+		if (request.isWrite) {
+			attribute.value = request.value;
+			completeRequest(stack, connId, ESP_GATT_OK);
+		} else {
+			std::string chunk = attribute.value.substr(request.value.size(), connection.mtu - 1);
+			handleResponse(stack, connId, ESP_GATT_OK, (const uint8_t*)chunk.data(), chunk.size());
+		}
+		return;
+	}
+
+	request.transId = stack.nextTransId++;
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	if (!request.isWrite) {
+		param.read.conn_id  = connId;
+		param.read.trans_id = request.transId;
+		param.read.handle   = request.handle;
+		param.read.offset   = request.value.size();
+		param.read.is_long  = !request.value.empty();
+		param.read.need_rsp = true;
+		memcpy(param.read.bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+		postGatts(stack, stack.latencyUs, ESP_GATTS_READ_EVT, param);
+		return;
+	}
+	if (request.executing) {
+		param.exec_write.conn_id         = connId;
+		param.exec_write.trans_id        = request.transId;
+		param.exec_write.exec_write_flag = ESP_GATT_PREP_WRITE_EXEC;
+		memcpy(param.exec_write.bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+		postGatts(stack, stack.latencyUs, ESP_GATTS_EXEC_WRITE_EVT, param);
+		return;
+	}
+	std::string part = request.value;
+	param.write.is_prep = request.value.size() > (size_t)connection.mtu - 3;
+	if (param.write.is_prep) {
+		part = request.value.substr(request.offset, connection.mtu - 5);
+		param.write.offset = request.offset;
+		request.offset += part.size();
+	}
+	param.write.conn_id  = connId;
+	param.write.trans_id = request.transId;
+	param.write.handle   = request.handle;
+	param.write.need_rsp = true;
+	param.write.len      = part.size();
+	memcpy(param.write.bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+	postGatts(stack, stack.latencyUs, ESP_GATTS_WRITE_EVT, param, part);
+} // startRequest
+
+
+esp_err_t queueRequest(esp_gatt_if_t gattcIf, uint16_t connId, const Request& request) {
+	Locked   locked;
+	Stack&   stack       = *g_pStack;
+	Connection* pConnection = findConnection(stack, gattcIf, connId);
+	if (pConnection == nullptr) {
+		return ESP_FAIL;
+	}
+	pConnection->requests.push_back(request);
+	if (pConnection->requests.size() == 1) {
+		startRequest(stack, connId);
+	}
+	return ESP_OK;
+} // queueRequest
+
+
+esp_err_t write(esp_gatt_if_t gattcIf, uint16_t connId, uint16_t handle, uint16_t length, uint8_t* pValue, esp_gatt_write_type_t writeType, bool isDescriptor) {
+	if (writeType == ESP_GATT_WRITE_TYPE_RSP) {
+		Request request;
+		request.isWrite      = true;
+		request.isDescriptor = isDescriptor;
+		request.handle       = handle;
+		request.value.assign((const char*)pValue, length);
+		request.offset       = 0;
+		request.executing    = false;
+		request.transId      = 0;
+		{
+			Locked locked;
+			g_pStack->stats.writes++;
+		}
+		return queueRequest(gattcIf, connId, request);
+	}
+
+	// A write command is not a request: it goes straight out and the stack reports it sent at once.
+	Locked locked;
+	Stack& stack = *g_pStack;
+	Connection* pConnection = findConnection(stack, gattcIf, connId);
+	if (pConnection == nullptr || length > pConnection->mtu - 3) {
+		return ESP_FAIL;
+	}
+	stack.stats.writesNoResponse++;
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.write.conn_id = connId;
+	param.write.handle  = handle;
+	param.write.len     = length;
+	memcpy(param.write.bda, pConnection->clientAddress, sizeof(esp_bd_addr_t));
+	postGatts(stack, stack.latencyUs, ESP_GATTS_WRITE_EVT, param, std::string((const char*)pValue, length));
+
+	esp_ble_gattc_cb_param_t sent;
+	memset(&sent, 0, sizeof(sent));
+	sent.write.status  = ESP_GATT_OK;
+	sent.write.conn_id = connId;
+	sent.write.handle  = handle;
+	postGattc(stack, 0, isDescriptor ? ESP_GATTC_WRITE_DESCR_EVT : ESP_GATTC_WRITE_CHAR_EVT, gattcIf, sent);
+	return ESP_OK;
+} // write
+
+
+esp_err_t read(esp_gatt_if_t gattcIf, uint16_t connId, uint16_t handle, bool isDescriptor) {
+	Request request;
+	request.isWrite      = false;
+	request.isDescriptor = isDescriptor;
+	request.handle       = handle;
+	request.offset       = 0;
+	request.executing    = false;
+	request.transId      = 0;
+	{
+		Locked locked;
+		g_pStack->stats.reads++;
+	}
+	return queueRequest(gattcIf, connId, request);
+} // read
+
+
+// Both ends learn that the link has gone.  What the client had asked for is never answered.
+void disconnect(Stack& stack, uint16_t connId, esp_gatt_conn_reason_t clientReason, esp_gatt_conn_reason_t serverReason, uint32_t serverDelayUs) {
+	auto it = stack.connections.find(connId);
+	if (it == stack.connections.end()) {
+		return;
+	}
+	Connection connection = it->second;
+	stack.connections.erase(it);
+
+	esp_ble_gatts_cb_param_t serverParam;
+	memset(&serverParam, 0, sizeof(serverParam));
+	serverParam.disconnect.conn_id = connId;
+	serverParam.disconnect.reason  = serverReason;
+	memcpy(serverParam.disconnect.remote_bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+	postGatts(stack, serverDelayUs, ESP_GATTS_DISCONNECT_EVT, serverParam);
+
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.disconnect.reason  = clientReason;
+	param.disconnect.conn_id = connId;
+	memcpy(param.disconnect.remote_bda, stack.localAddress, sizeof(esp_bd_addr_t));
+	postGattc(stack, 0, ESP_GATTC_DISCONNECT_EVT, connection.gattcIf, param);
+
+	memset(&param, 0, sizeof(param));
+	param.close.status  = ESP_GATT_OK;
+	param.close.conn_id = connId;
+	param.close.reason  = clientReason;
+	memcpy(param.close.remote_bda, stack.localAddress, sizeof(esp_bd_addr_t));
+	postGattc(stack, 0, ESP_GATTC_CLOSE_EVT, connection.gattcIf, param);
+} // disconnect
+
+
+void postScanResult(Stack& stack, uint32_t delayUs, const Advertisement& advertisement) {
+	esp_ble_gap_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.scan_rst.search_evt    = ESP_GAP_SEARCH_INQ_RES_EVT;
+	param.scan_rst.dev_type      = ESP_BT_DEVICE_TYPE_BLE;
+	param.scan_rst.ble_addr_type = BLE_ADDR_TYPE_PUBLIC;
+	param.scan_rst.ble_evt_type  = ESP_BLE_EVT_CONN_ADV;
+	param.scan_rst.rssi          = advertisement.rssi;
+	param.scan_rst.adv_data_len  = advertisement.data.size();
+	memcpy(param.scan_rst.bda, advertisement.address, sizeof(esp_bd_addr_t));
+	memcpy(param.scan_rst.ble_adv, advertisement.data.data(), advertisement.data.size());
+	stack.stats.scanResults++;
+	postGap(stack, delayUs, ESP_GAP_BLE_SCAN_RESULT_EVT, param);
+} // postScanResult
+
+
+void postStatus(esp_gap_ble_cb_event_t event) {
+	Locked locked;
+	esp_ble_gap_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.adv_data_cmpl.status = ESP_BT_STATUS_SUCCESS;   // Every completion starts with its status.
+	postGap(*g_pStack, 0, event, param);
+} // postStatus
+
+
+void runBTC(void* pArg) {
+	Stack& stack = *g_pStack;
+	pthread_mutex_lock(&stack.lock);
+	for (;;) {
+		if (stack.events.empty()) {
+			pthread_cond_wait(&stack.changed, &stack.lock);
+			continue;
+		}
+		uint64_t dueUs = stack.events.top().dueUs;
+		uint64_t now   = nowUs();
+		if (dueUs > now) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_MONOTONIC, &deadline);
+			uint64_t waitNs = (dueUs - now) * 1000 + deadline.tv_nsec;
+			deadline.tv_sec  += waitNs / 1000000000;
+			deadline.tv_nsec  = waitNs % 1000000000;
+			pthread_cond_timedwait(&stack.changed, &stack.lock, &deadline);
+			continue;
+		}
+		std::function<void()> deliver = stack.events.top().deliver;
+		if (!stack.events.top().timer) {
+			stack.pending--;
+		}
+		stack.events.pop();
+		stack.busy = true;
+		pthread_mutex_unlock(&stack.lock);
+		deliver();
+		pthread_mutex_lock(&stack.lock);
+		stack.busy = false;
+		pthread_cond_broadcast(&stack.changed);
+	}
+} // runBTC
+
+
+/**
+ * @brief Create the stack the first time it is used, which may be before main.
+ */
+Stack& getStack() {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, []() {
+		Stack* pStack = new Stack;
+		pthread_mutex_init(&pStack->lock, nullptr);
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&pStack->changed, &attr);
+		pthread_condattr_destroy(&attr);
+		pStack->seq              = 0;
+		pStack->pending          = 0;
+		pStack->busy             = false;
+		pStack->initialized      = false;
+		pStack->enabled          = false;
+		pStack->btcStarted       = false;
+		pStack->gapCallback      = nullptr;
+		pStack->gattsCallback    = nullptr;
+		pStack->gattcCallback    = nullptr;
+		pStack->latencyUs        = 1000;
+		pStack->connectTimeoutUs = 50000;
+		pStack->peerMtu          = ESP_GATT_MAX_MTU_SIZE;
+		pStack->localMtu         = ESP_GATT_DEF_BLE_MTU_SIZE;
+		pStack->lossPerMille     = 0;
+		pStack->random           = 1;
+		pStack->peerPresent      = true;
+		const uint8_t address[] = { 0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01 };
+		memcpy(pStack->localAddress, address, sizeof(esp_bd_addr_t));
+		pStack->nextIf           = 3;
+		pStack->gattsIf          = ESP_GATT_IF_NONE;
+		pStack->nextHandle       = 1;
+		pStack->nextTransId      = 1;
+		pStack->scanning         = false;
+		pStack->scanGeneration   = 0;
+		pStack->nextNvsHandle    = 1;
+		memset(&pStack->stats, 0, sizeof(pStack->stats));
+		addBuiltInServices(*pStack);
+		pStack->nextHandle       = FIRST_APP_HANDLE;
+		g_pStack = pStack;
+	});
+	return *g_pStack;
+} // getStack
+
+} // namespace
+
+
+void FakeBluedroid::setLatency(uint32_t latencyUs) {
+	Locked locked;
+	g_pStack->latencyUs = latencyUs;
+} // setLatency
+
+
+/**
+ * @brief Set the largest MTU the peer will agree to in an exchange.
+ */
+void FakeBluedroid::setPeerMTU(uint16_t mtu) {
+	Locked locked;
+	g_pStack->peerMtu = mtu;
+} // setPeerMTU
+
+
+/**
+ * @brief Set how many notifications in a thousand are lost on the air.
+ */
+void FakeBluedroid::setLoss(uint32_t perMille) {
+	Locked locked;
+	g_pStack->lossPerMille = perMille;
+} // setLoss
+
+
+/**
+ * @brief Set whether the local server can be connected to.  One that is absent is never found.
+ */
+void FakeBluedroid::setPeerPresent(bool present) {
+	Locked locked;
+	g_pStack->peerPresent = present;
+} // setPeerPresent
+
+
+/**
+ * @brief Set how long a connection attempt to an absent server lasts before it fails.
+ */
+void FakeBluedroid::setConnectTimeout(uint32_t timeoutUs) {
+	Locked locked;
+	g_pStack->connectTimeoutUs = timeoutUs;
+} // setConnectTimeout
+
+
+/**
+ * @brief Lose the link of a connection, as when the peer goes out of range.
+ */
+void FakeBluedroid::dropLink(uint16_t connId, esp_gatt_conn_reason_t reason) {
+	Locked locked;
+	disconnect(*g_pStack, connId, reason, reason, 0);
+} // dropLink
+
+
+/**
+ * @brief Add a device that every scan finds.
+ */
+void FakeBluedroid::addAdvertisement(esp_bd_addr_t address, const uint8_t* pData, uint8_t length, int rssi) {
+	Locked locked;
+	Advertisement advertisement;
+	memcpy(advertisement.address, address, sizeof(esp_bd_addr_t));
+	advertisement.data.assign((const char*)pData, length);
+	advertisement.rssi = rssi;
+	g_pStack->advertisements.push_back(advertisement);
+} // addAdvertisement
+
+
+/**
+ * @brief Report an advertisement to the scan in progress.
+ * @return False if there is no scan in progress.
+ */
+bool FakeBluedroid::injectScanResult(esp_bd_addr_t address, const uint8_t* pData, uint8_t length, int rssi) {
+	Locked locked;
+	if (!g_pStack->scanning) {
+		return false;
+	}
+	Advertisement advertisement;
+	memcpy(advertisement.address, address, sizeof(esp_bd_addr_t));
+	advertisement.data.assign((const char*)pData, length);
+	advertisement.rssi = rssi;
+	postScanResult(*g_pStack, 0, advertisement);
+	return true;
+} // injectScanResult
+
+
+/**
+ * @brief Wait until every callback the stack has queued, including those queued by callbacks, has been made.
+ *
+ * The end of a scan still running is not waited for, so results fed to a long scan can be waited for.
+ */
+void FakeBluedroid::waitIdle() {
+	Stack& stack = getStack();
+	pthread_mutex_lock(&stack.lock);
+	while (stack.pending > 0 || stack.busy) {
+		pthread_cond_wait(&stack.changed, &stack.lock);
+	}
+	pthread_mutex_unlock(&stack.lock);
+} // waitIdle
+
+
+FakeBluedroid::Stats FakeBluedroid::getStats() {
+	Locked locked;
+	return g_pStack->stats;
+} // getStats
+
+
+/**
+ * @brief Get the MTU of a connection.
+ * @return The MTU, or 0 if there is no such connection.
+ */
+uint16_t FakeBluedroid::getConnectionMTU(uint16_t connId) {
+	Locked locked;
+	Connection* pConnection = findConnection(*g_pStack, ESP_GATT_IF_NONE, connId);
+	return pConnection == nullptr ? 0 : pConnection->mtu;
+} // getConnectionMTU
+
+
+void FakeBluedroid::deliverServerEvent(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t* pParam) {
+	esp_gatts_cb_t callback;
+	esp_gatt_if_t  gattsIf;
+	{
+		Locked locked;
+		callback = g_pStack->gattsCallback;
+		gattsIf  = g_pStack->gattsIf;
+	}
+	if (callback == nullptr || gattsIf == ESP_GATT_IF_NONE) {
+		return;
+	}
+	t_inServerCallback = true;
+	callback(event, gattsIf, pParam);
+	t_inServerCallback = false;
+} // deliverServerEvent
+
+
+bool FakeBluedroid::inServerCallback() {
+	return t_inServerCallback;
+} // inServerCallback
+
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t* cfg) {
+	getStack();
+	return ESP_OK;
+} // esp_bt_controller_init
+
+
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode) {
+	return ESP_OK;
+} // esp_bt_controller_enable
+
+
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode) {
+	return ESP_OK;
+} // esp_bt_controller_mem_release
+
+
+esp_err_t esp_ble_tx_power_set(esp_ble_power_type_t power_type, esp_power_level_t power_level) {
+	return ESP_OK;
+} // esp_ble_tx_power_set
+
+
+esp_bluedroid_status_t esp_bluedroid_get_status() {
+	Locked locked;
+	if (g_pStack->enabled) {
+		return ESP_BLUEDROID_STATUS_ENABLED;
+	}
+	return g_pStack->initialized ? ESP_BLUEDROID_STATUS_INITIALIZED : ESP_BLUEDROID_STATUS_UNINITIALIZED;
+} // esp_bluedroid_get_status
+
+
+esp_err_t esp_bluedroid_init() {
+	Locked locked;
+	g_pStack->initialized = true;
+	return ESP_OK;
+} // esp_bluedroid_init
+
+
+esp_err_t esp_bluedroid_enable() {
+	Stack& stack = getStack();
+	{
+		Locked locked;
+		if (!stack.initialized || stack.enabled) {
+			return ESP_ERR_INVALID_STATE;
+		}
+		stack.enabled = true;
+		if (stack.btcStarted) {
+			return ESP_OK;
+		}
+		stack.btcStarted = true;
+	}
+	return ::xTaskCreate(runBTC, "BTC", 8192, nullptr, 19, nullptr) == pdPASS ? ESP_OK : ESP_FAIL;
+} // esp_bluedroid_enable
+
+
+/**
+ * @brief Stop the stack calling back.
+ *
+ * Events still queued are dropped, and none are delivered until the stack is enabled again.  Connections
+ * and registrations are kept.
+ */
+esp_err_t esp_bluedroid_disable() {
+	Stack& stack = getStack();
+	Locked locked;
+	if (!stack.enabled) {
+		return ESP_ERR_INVALID_STATE;
+	}
+	stack.enabled = false;
+	while (!stack.events.empty()) {
+		stack.events.pop();
+	}
+	stack.pending = 0;
+	pthread_cond_broadcast(&stack.changed);
+	return ESP_OK;
+} // esp_bluedroid_disable
+
+
+const uint8_t* esp_bt_dev_get_address() {
+	return getStack().localAddress;
+} // esp_bt_dev_get_address
+
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu) {
+	if (mtu < ESP_GATT_DEF_BLE_MTU_SIZE || mtu > ESP_GATT_MAX_MTU_SIZE) {
+		return ESP_ERR_INVALID_ARG;
+	}
+	Locked locked;
+	g_pStack->localMtu = mtu;
+	return ESP_OK;
+} // esp_ble_gatt_set_local_mtu
+
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback) {
+	Locked locked;
+	g_pStack->gapCallback = callback;
+	return ESP_OK;
+} // esp_ble_gap_register_callback
+
+
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t* adv_data) {
+	postStatus(adv_data->set_scan_rsp ? ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT : ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_config_adv_data
+
+
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t* raw_data, uint32_t raw_data_len) {
+	postStatus(ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_config_adv_data_raw
+
+
+esp_err_t esp_ble_gap_config_scan_rsp_data_raw(uint8_t* raw_data, uint32_t raw_data_len) {
+	postStatus(ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_config_scan_rsp_data_raw
+
+
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t* adv_params) {
+	postStatus(ESP_GAP_BLE_ADV_START_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_start_advertising
+
+
+esp_err_t esp_ble_gap_stop_advertising() {
+	postStatus(ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_stop_advertising
+
+
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t* scan_params) {
+	postStatus(ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_set_scan_params
+
+
+/**
+ * @brief Start a scan, which finds each added advertisement once and completes after the duration.
+ */
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration) {
+	postStatus(ESP_GAP_BLE_SCAN_START_COMPLETE_EVT);
+	Locked locked;
+	Stack& stack = *g_pStack;
+	stack.scanning = true;
+	uint32_t generation = ++stack.scanGeneration;
+	for (size_t i = 0; i < stack.advertisements.size(); i++) {
+		postScanResult(stack, stack.latencyUs, stack.advertisements[i]);
+	}
+
+	// The scan completes unless it has been stopped or restarted meanwhile.
+	esp_gap_ble_cb_t callback = stack.gapCallback;
+	post(stack, duration * 1000000, [=]() {
+		{
+			Locked locked;
+			if (!g_pStack->scanning || g_pStack->scanGeneration != generation) {
+				return;
+			}
+			g_pStack->scanning = false;
+		}
+		esp_ble_gap_cb_param_t param;
+		memset(&param, 0, sizeof(param));
+		param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_CMPL_EVT;
+		if (callback != nullptr) {
+			callback(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+		}
+	}, true);
+	return ESP_OK;
+} // esp_ble_gap_start_scanning
+
+
+esp_err_t esp_ble_gap_stop_scanning() {
+	{
+		Locked locked;
+		g_pStack->scanning = false;
+	}
+	postStatus(ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT);
+	return ESP_OK;
+} // esp_ble_gap_stop_scanning
+
+
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params) {
+	Locked locked;
+	esp_ble_gap_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.update_conn_params.status   = ESP_BT_STATUS_SUCCESS;
+	param.update_conn_params.min_int  = params->min_int;
+	param.update_conn_params.max_int  = params->max_int;
+	param.update_conn_params.latency  = params->latency;
+	param.update_conn_params.conn_int = params->max_int;
+	param.update_conn_params.timeout  = params->timeout;
+	memcpy(param.update_conn_params.bda, params->bda, sizeof(esp_bd_addr_t));
+	postGap(*g_pStack, 2 * g_pStack->latencyUs, ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT, param);
+	return ESP_OK;
+} // esp_ble_gap_update_conn_params
+
+
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length) {
+	Locked locked;
+	esp_ble_gap_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.pkt_data_lenth_cmpl.status        = ESP_BT_STATUS_SUCCESS;
+	param.pkt_data_lenth_cmpl.params.tx_len = tx_data_length;
+	param.pkt_data_lenth_cmpl.params.rx_len = 251;
+	postGap(*g_pStack, 2 * g_pStack->latencyUs, ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT, param);
+	return ESP_OK;
+} // esp_ble_gap_set_pkt_data_len
+
+
+esp_err_t esp_ble_gap_set_device_name(const char* name) {
+	return ESP_OK;
+} // esp_ble_gap_set_device_name
+
+
+esp_err_t esp_ble_gap_read_rssi(esp_bd_addr_t remote_addr) {
+	Locked locked;
+	esp_ble_gap_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.read_rssi_cmpl.status = ESP_BT_STATUS_SUCCESS;
+	param.read_rssi_cmpl.rssi   = -40;
+	memcpy(param.read_rssi_cmpl.remote_addr, remote_addr, sizeof(esp_bd_addr_t));
+	postGap(*g_pStack, 0, ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT, param);
+	return ESP_OK;
+} // esp_ble_gap_read_rssi
+
+
+esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda) {
+	return ESP_OK;
+} // esp_ble_gap_update_whitelist
+
+
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t bd_addr, bool accept) {
+	return ESP_OK;
+} // esp_ble_gap_security_rsp
+
+
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void* value, uint8_t len) {
+	return ESP_OK;
+} // esp_ble_gap_set_security_param
+
+
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act) {
+	return ESP_OK;
+} // esp_ble_set_encryption
+
+
+esp_err_t esp_ble_passkey_reply(esp_bd_addr_t bd_addr, bool accept, uint32_t passkey) {
+	return ESP_OK;
+} // esp_ble_passkey_reply
+
+
+esp_err_t esp_ble_confirm_reply(esp_bd_addr_t bd_addr, bool accept) {
+	return ESP_OK;
+} // esp_ble_confirm_reply
+
+
+esp_err_t esp_ble_gatts_register_callback(esp_gatts_cb_t callback) {
+	Locked locked;
+	g_pStack->gattsCallback = callback;
+	return ESP_OK;
+} // esp_ble_gatts_register_callback
+
+
+esp_err_t esp_ble_gatts_app_register(uint16_t app_id) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	stack.gattsIf = stack.nextIf++;
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.reg.status = ESP_GATT_OK;
+	param.reg.app_id = app_id;
+	postGatts(stack, 0, ESP_GATTS_REG_EVT, param);
+	return ESP_OK;
+} // esp_ble_gatts_app_register
+
+
+esp_err_t esp_ble_gatts_create_service(esp_gatt_if_t gatts_if, esp_gatt_srvc_id_t* service_id, uint16_t num_handle) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.create.status         = ESP_GATT_OK;
+	param.create.service_handle = addService(stack, *service_id, num_handle).start;
+	param.create.service_id     = *service_id;
+	postGatts(stack, 0, ESP_GATTS_CREATE_EVT, param);
+	return ESP_OK;
+} // esp_ble_gatts_create_service
+
+
+esp_err_t esp_ble_gatts_add_char(uint16_t service_handle, esp_bt_uuid_t* char_uuid, esp_gatt_perm_t perm,
+	esp_gatt_char_prop_t property, esp_attr_value_t* char_val, esp_attr_control_t* control) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	auto it = stack.services.find(service_handle);
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.add_char.service_handle = service_handle;
+	param.add_char.char_uuid      = *char_uuid;
+	if (it == stack.services.end() || it->second.next + 1 > it->second.end) {
+		param.add_char.status = ESP_GATT_NO_RESOURCES;
+	} else {
+		bool        autoResponse = control != nullptr && control->auto_rsp == ESP_GATT_AUTO_RSP;
+		std::string value        = char_val != nullptr ? std::string((const char*)char_val->attr_value, char_val->attr_len) : "";
+		addAttribute(stack, it->second, ATTR_DECLARATION, uuid16(0x2803), 0, true, "");
+		param.add_char.status      = ESP_GATT_OK;
+		param.add_char.attr_handle = addAttribute(stack, it->second, ATTR_VALUE, *char_uuid, property, autoResponse, value);
+	}
+	postGatts(stack, 0, ESP_GATTS_ADD_CHAR_EVT, param);
+	return ESP_OK;
+} // esp_ble_gatts_add_char
+
+
+esp_err_t esp_ble_gatts_add_char_descr(uint16_t service_handle, esp_bt_uuid_t* descr_uuid, esp_gatt_perm_t perm,
+	esp_attr_value_t* char_descr_val, esp_attr_control_t* control) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	auto it = stack.services.find(service_handle);
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.add_char_descr.service_handle = service_handle;
+	param.add_char_descr.char_uuid      = *descr_uuid;
+	if (it == stack.services.end() || it->second.next > it->second.end) {
+		param.add_char_descr.status = ESP_GATT_NO_RESOURCES;
+	} else {
+		bool        autoResponse = control != nullptr && control->auto_rsp == ESP_GATT_AUTO_RSP;
+		std::string value        = char_descr_val != nullptr ? std::string((const char*)char_descr_val->attr_value, char_descr_val->attr_len) : "";
+		param.add_char_descr.status      = ESP_GATT_OK;
+		param.add_char_descr.attr_handle = addAttribute(stack, it->second, ATTR_DESCRIPTOR, *descr_uuid, 0, autoResponse, value);
+	}
+	postGatts(stack, 0, ESP_GATTS_ADD_CHAR_DESCR_EVT, param);
+	return ESP_OK;
+} // esp_ble_gatts_add_char_descr
+
+
+esp_err_t esp_ble_gatts_start_service(uint16_t service_handle) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	auto it = stack.services.find(service_handle);
+	esp_ble_gatts_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.start.status         = it != stack.services.end() ? ESP_GATT_OK : ESP_GATT_INVALID_HANDLE;
+	param.start.service_handle = service_handle;
+	if (it != stack.services.end()) {
+		it->second.started = true;
+	}
+	postGatts(stack, 0, ESP_GATTS_START_EVT, param);
+	return ESP_OK;
+} // esp_ble_gatts_start_service
+
+
+/**
+ * @brief Send a notification or indication.  A value longer than the connection allows is cut short, and a
+ * client only hears of a handle it has registered for.
+ */
+esp_err_t esp_ble_gatts_send_indicate(esp_gatt_if_t gatts_if, uint16_t conn_id, uint16_t attr_handle,
+	uint16_t value_len, uint8_t* value, bool need_confirm) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	Connection* pConnection = findConnection(stack, ESP_GATT_IF_NONE, conn_id);
+	if (pConnection == nullptr) {
+		return ESP_FAIL;
+	}
+	if (value_len > pConnection->mtu - 3) {
+		value_len = pConnection->mtu - 3;
+	}
+	std::string data((const char*)value, value_len);
+	bool registered = stack.registrations.count(std::make_pair(pConnection->gattcIf, attr_handle)) > 0;
+	bool lost       = false;
+	if (need_confirm) {
+		stack.stats.indications++;
+	} else {
+		stack.stats.notifications++;
+		lost = lose(stack);
+		if (lost) {
+			stack.stats.notificationsLost++;
+		}
+	}
+	if (registered && !lost) {
+		esp_ble_gattc_cb_param_t param;
+		memset(&param, 0, sizeof(param));
+		param.notify.conn_id   = conn_id;
+		param.notify.handle    = attr_handle;
+		param.notify.value_len = value_len;
+		param.notify.is_notify = !need_confirm;
+		memcpy(param.notify.remote_bda, stack.localAddress, sizeof(esp_bd_addr_t));
+		postGattc(stack, stack.latencyUs, ESP_GATTC_NOTIFY_EVT, pConnection->gattcIf, param, data);
+	}
+
+	// A notification is confirmed once it has been sent and an indication once the client has confirmed it.
+	esp_ble_gatts_cb_param_t conf;
+	memset(&conf, 0, sizeof(conf));
+	conf.conf.status  = ESP_GATT_OK;
+	conf.conf.conn_id = conn_id;
+	conf.conf.handle  = attr_handle;
+	conf.conf.len     = value_len;
+	postGatts(stack, need_confirm ? 2 * stack.latencyUs : 0, ESP_GATTS_CONF_EVT, conf, data);
+	return ESP_OK;
+} // esp_ble_gatts_send_indicate
+
+
+esp_err_t esp_ble_gatts_send_response(esp_gatt_if_t gatts_if, uint16_t conn_id, uint32_t trans_id,
+	esp_gatt_status_t status, esp_gatt_rsp_t* rsp) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	Connection* pConnection = findConnection(stack, ESP_GATT_IF_NONE, conn_id);
+	if (pConnection == nullptr || pConnection->requests.empty() || pConnection->requests.front().transId != trans_id) {
+		return ESP_OK;   // The request has gone with its connection, or was the cancel of a long write.
+	}
+	const uint8_t* pValue = rsp != nullptr ? rsp->attr_value.value : nullptr;
+	uint16_t       length = rsp != nullptr ? rsp->attr_value.len : 0;
+	handleResponse(stack, conn_id, status, pValue, length);
+	return ESP_OK;
+} // esp_ble_gatts_send_response
+
+
+esp_err_t esp_ble_gattc_register_callback(esp_gattc_cb_t callback) {
+	Locked locked;
+	g_pStack->gattcCallback = callback;
+	return ESP_OK;
+} // esp_ble_gattc_register_callback
+
+
+esp_err_t esp_ble_gattc_app_register(uint16_t app_id) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	esp_gatt_if_t gattcIf = stack.nextIf++;
+	stack.clientApps[gattcIf] = app_id;
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.reg.status = ESP_GATT_OK;
+	param.reg.app_id = app_id;
+	postGattc(stack, 0, ESP_GATTC_REG_EVT, gattcIf, param);
+	return ESP_OK;
+} // esp_ble_gattc_app_register
+
+
+esp_err_t esp_ble_gattc_app_unregister(esp_gatt_if_t gattc_if) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	if (stack.clientApps.erase(gattc_if) == 0) {
+		return ESP_FAIL;
+	}
+	for (auto it = stack.registrations.begin(); it != stack.registrations.end(); ) {
+		if (it->first == gattc_if) {
+			it = stack.registrations.erase(it);
+		} else {
+			++it;
+		}
+	}
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	postGattc(stack, 0, ESP_GATTC_UNREG_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_app_unregister
+
+
+/**
+ * @brief Open a connection to the local server, which the server sees as coming from an address of the client's own.
+ */
+esp_err_t esp_ble_gattc_open(esp_gatt_if_t gattc_if, esp_bd_addr_t remote_bda, bool is_direct) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	if (stack.clientApps.count(gattc_if) == 0) {
+		return ESP_FAIL;
+	}
+	stack.stats.opens++;
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	memcpy(param.open.remote_bda, remote_bda, sizeof(esp_bd_addr_t));
+	param.open.mtu = ESP_GATT_DEF_BLE_MTU_SIZE;
+
+	uint16_t connId = 0;
+	while (connId < MAX_CONNECTIONS && stack.connections.count(connId) > 0) {
+		connId++;
+	}
+	bool found = stack.peerPresent && stack.gattsIf != ESP_GATT_IF_NONE &&
+		memcmp(remote_bda, stack.localAddress, sizeof(esp_bd_addr_t)) == 0;
+	if (!found || connId == MAX_CONNECTIONS) {
+		param.open.status = ESP_GATT_ERROR;
+		postGattc(stack, found ? 0 : stack.connectTimeoutUs, ESP_GATTC_OPEN_EVT, gattc_if, param);
+		return ESP_OK;
+	}
+
+	Connection& connection = stack.connections[connId];
+	connection.gattcIf = gattc_if;
+	connection.mtu     = ESP_GATT_DEF_BLE_MTU_SIZE;
+	memcpy(connection.clientAddress, stack.localAddress, sizeof(esp_bd_addr_t));
+	connection.clientAddress[5] = 0x10 + gattc_if;
+
+	esp_ble_gatts_cb_param_t serverParam;
+	memset(&serverParam, 0, sizeof(serverParam));
+	serverParam.connect.conn_id = connId;
+	memcpy(serverParam.connect.remote_bda, connection.clientAddress, sizeof(esp_bd_addr_t));
+	postGatts(stack, stack.latencyUs, ESP_GATTS_CONNECT_EVT, serverParam);
+
+	esp_ble_gattc_cb_param_t connect;
+	memset(&connect, 0, sizeof(connect));
+	connect.connect.conn_id = connId;
+	memcpy(connect.connect.remote_bda, remote_bda, sizeof(esp_bd_addr_t));
+	postGattc(stack, stack.latencyUs, ESP_GATTC_CONNECT_EVT, gattc_if, connect);
+
+	param.open.status  = ESP_GATT_OK;
+	param.open.conn_id = connId;
+	postGattc(stack, stack.latencyUs, ESP_GATTC_OPEN_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_open
+
+
+esp_err_t esp_ble_gattc_close(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	if (findConnection(stack, gattc_if, conn_id) == nullptr) {
+		return ESP_FAIL;
+	}
+	disconnect(stack, conn_id, ESP_GATT_CONN_TERMINATE_LOCAL_HOST, ESP_GATT_CONN_TERMINATE_PEER_USER, stack.latencyUs);
+	return ESP_OK;
+} // esp_ble_gattc_close
+
+
+esp_err_t esp_ble_gattc_send_mtu_req(esp_gatt_if_t gattc_if, uint16_t conn_id) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	Connection* pConnection = findConnection(stack, gattc_if, conn_id);
+	if (pConnection == nullptr) {
+		return ESP_FAIL;
+	}
+	pConnection->mtu = stack.localMtu < stack.peerMtu ? stack.localMtu : stack.peerMtu;
+
+	esp_ble_gatts_cb_param_t serverParam;
+	memset(&serverParam, 0, sizeof(serverParam));
+	serverParam.mtu.conn_id = conn_id;
+	serverParam.mtu.mtu     = pConnection->mtu;
+	postGatts(stack, stack.latencyUs, ESP_GATTS_MTU_EVT, serverParam);
+
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.cfg_mtu.status  = ESP_GATT_OK;
+	param.cfg_mtu.conn_id = conn_id;
+	param.cfg_mtu.mtu     = pConnection->mtu;
+	postGattc(stack, 2 * stack.latencyUs, ESP_GATTC_CFG_MTU_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_send_mtu_req
+
+
+esp_err_t esp_ble_gattc_search_service(esp_gatt_if_t gattc_if, uint16_t conn_id, esp_bt_uuid_t* filter_uuid) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	if (findConnection(stack, gattc_if, conn_id) == nullptr) {
+		return ESP_FAIL;
+	}
+	stack.stats.searches++;
+	for (auto it = stack.services.begin(); it != stack.services.end(); ++it) {
+		const Service& service = it->second;
+		if (!service.started) {
+			continue;
+		}
+		esp_ble_gattc_cb_param_t param;
+		memset(&param, 0, sizeof(param));
+		param.search_res.conn_id      = conn_id;
+		param.search_res.start_handle = service.start;
+		param.search_res.end_handle   = service.end;
+		param.search_res.srvc_id      = service.id.id;
+		param.search_res.is_primary   = service.id.is_primary;
+		postGattc(stack, 2 * stack.latencyUs, ESP_GATTC_SEARCH_RES_EVT, gattc_if, param);
+	}
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.search_cmpl.status  = ESP_GATT_OK;
+	param.search_cmpl.conn_id = conn_id;
+	postGattc(stack, 2 * stack.latencyUs, ESP_GATTC_SEARCH_CMPL_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_search_service
+
+
+esp_gatt_status_t esp_ble_gattc_get_all_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t start_handle,
+	uint16_t end_handle, esp_gattc_char_elem_t* result, uint16_t* count, uint16_t offset) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	uint16_t found  = 0;
+	uint16_t copied = 0;
+	for (auto it = stack.attributes.lower_bound(start_handle); it != stack.attributes.end() && it->first <= end_handle; ++it) {
+		if (it->second.kind != ATTR_VALUE) {
+			continue;
+		}
+		if (found++ < offset || copied == *count) {
+			continue;
+		}
+		result[copied].char_handle = it->first;
+		result[copied].properties  = it->second.properties;
+		result[copied].uuid        = it->second.uuid;
+		copied++;
+	}
+	*count = copied;
+	return found <= offset ? ESP_GATT_INVALID_OFFSET : ESP_GATT_OK;
+} // esp_ble_gattc_get_all_char
+
+
+esp_gatt_status_t esp_ble_gattc_get_all_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t char_handle,
+	esp_gattc_descr_elem_t* result, uint16_t* count, uint16_t offset) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	uint16_t found  = 0;
+	uint16_t copied = 0;
+	for (auto it = stack.attributes.upper_bound(char_handle); it != stack.attributes.end() && it->second.kind == ATTR_DESCRIPTOR; ++it) {
+		if (found++ < offset || copied == *count) {
+			continue;
+		}
+		result[copied].handle = it->first;
+		result[copied].uuid   = it->second.uuid;
+		copied++;
+	}
+	*count = copied;
+	return found <= offset ? ESP_GATT_INVALID_OFFSET : ESP_GATT_OK;
+} // esp_ble_gattc_get_all_descr
+
+
+esp_err_t esp_ble_gattc_read_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, esp_gatt_auth_req_t auth_req) {
+	return read(gattc_if, conn_id, handle, false);
+} // esp_ble_gattc_read_char
+
+
+esp_err_t esp_ble_gattc_read_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle,
+	esp_gatt_auth_req_t auth_req) {
+	return read(gattc_if, conn_id, handle, true);
+} // esp_ble_gattc_read_char_descr
+
+
+esp_err_t esp_ble_gattc_write_char(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+	uint8_t* value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+	return write(gattc_if, conn_id, handle, value_len, value, write_type, false);
+} // esp_ble_gattc_write_char
+
+
+esp_err_t esp_ble_gattc_write_char_descr(esp_gatt_if_t gattc_if, uint16_t conn_id, uint16_t handle, uint16_t value_len,
+	uint8_t* value, esp_gatt_write_type_t write_type, esp_gatt_auth_req_t auth_req) {
+	return write(gattc_if, conn_id, handle, value_len, value, write_type, true);
+} // esp_ble_gattc_write_char_descr
+
+
+esp_err_t esp_ble_gattc_register_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	stack.registrations.insert(std::make_pair(gattc_if, handle));
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.reg_for_notify.status = ESP_GATT_OK;
+	param.reg_for_notify.handle = handle;
+	postGattc(stack, 0, ESP_GATTC_REG_FOR_NOTIFY_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_register_for_notify
+
+
+esp_err_t esp_ble_gattc_unregister_for_notify(esp_gatt_if_t gattc_if, esp_bd_addr_t server_bda, uint16_t handle) {
+	Locked locked;
+	Stack& stack = *g_pStack;
+	stack.registrations.erase(std::make_pair(gattc_if, handle));
+	esp_ble_gattc_cb_param_t param;
+	memset(&param, 0, sizeof(param));
+	param.unreg_for_notify.status = ESP_GATT_OK;
+	param.unreg_for_notify.handle = handle;
+	postGattc(stack, 0, ESP_GATTC_UNREG_FOR_NOTIFY_EVT, gattc_if, param);
+	return ESP_OK;
+} // esp_ble_gattc_unregister_for_notify
+
+
+esp_err_t nvs_flash_init() {
+	getStack();
+	return ESP_OK;
+} // nvs_flash_init
+
+
+esp_err_t nvs_open(const char* name, nvs_open_mode open_mode, nvs_handle* out_handle) {
+	Locked locked;
+	*out_handle = g_pStack->nextNvsHandle++;
+	g_pStack->nvsHandles[*out_handle] = name;
+	return ESP_OK;
+} // nvs_open
+
+
+void nvs_close(nvs_handle handle) {
+	Locked locked;
+	g_pStack->nvsHandles.erase(handle);
+} // nvs_close
+
+
+esp_err_t nvs_commit(nvs_handle handle) {
+	return ESP_OK;
+} // nvs_commit
+
+
+namespace {
+
+std::map<std::string, NvsEntry>* findNamespace(nvs_handle handle) {
+	auto it = g_pStack->nvsHandles.find(handle);
+	return it == g_pStack->nvsHandles.end() ? nullptr : &g_pStack->nvs[it->second];
+} // findNamespace
+
+
+esp_err_t getEntry(nvs_handle handle, const char* key, char type, std::string* pData) {
+	Locked locked;
+	std::map<std::string, NvsEntry>* pNamespace = findNamespace(handle);
+	if (pNamespace == nullptr) {
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	auto it = pNamespace->find(key);
+	if (it == pNamespace->end() || it->second.type != type) {
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+	*pData = it->second.data;
+	return ESP_OK;
+} // getEntry
+
+
+esp_err_t setEntry(nvs_handle handle, const char* key, char type, const std::string& data) {
+	Locked locked;
+	std::map<std::string, NvsEntry>* pNamespace = findNamespace(handle);
+	if (pNamespace == nullptr) {
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	NvsEntry& entry = (*pNamespace)[key];
+	entry.type = type;
+	entry.data = data;
+	return ESP_OK;
+} // setEntry
+
+
+esp_err_t getBytes(nvs_handle handle, const char* key, char type, void* out_value, size_t* length) {
+	std::string data;
+	esp_err_t errRc = getEntry(handle, key, type, &data);
+	if (errRc != ESP_OK) {
+		return errRc;
+	}
+	if (out_value == nullptr) {
+		*length = data.size();
+		return ESP_OK;
+	}
+	if (*length < data.size()) {
+		return ESP_ERR_NVS_INVALID_LENGTH;
+	}
+	memcpy(out_value, data.data(), data.size());
+	*length = data.size();
+	return ESP_OK;
+} // getBytes
+
+} // namespace
+
+
+esp_err_t nvs_erase_all(nvs_handle handle) {
+	Locked locked;
+	std::map<std::string, NvsEntry>* pNamespace = findNamespace(handle);
+	if (pNamespace == nullptr) {
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	pNamespace->clear();
+	return ESP_OK;
+} // nvs_erase_all
+
+
+esp_err_t nvs_erase_key(nvs_handle handle, const char* key) {
+	Locked locked;
+	std::map<std::string, NvsEntry>* pNamespace = findNamespace(handle);
+	if (pNamespace == nullptr) {
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	return pNamespace->erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+} // nvs_erase_key
+
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char* key, void* out_value, size_t* length) {
+	return getBytes(handle, key, 'b', out_value, length);
+} // nvs_get_blob
+
+
+esp_err_t nvs_get_str(nvs_handle handle, const char* key, char* out_value, size_t* length) {
+	return getBytes(handle, key, 's', out_value, length);
+} // nvs_get_str
+
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char* key, uint32_t* out_value) {
+	std::string data;
+	esp_err_t errRc = getEntry(handle, key, 'u', &data);
+	if (errRc == ESP_OK) {
+		memcpy(out_value, data.data(), sizeof(uint32_t));
+	}
+	return errRc;
+} // nvs_get_u32
+
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char* key, const void* value, size_t length) {
+	return setEntry(handle, key, 'b', std::string((const char*)value, length));
+} // nvs_set_blob
+
+
+esp_err_t nvs_set_str(nvs_handle handle, const char* key, const char* value) {
+	return setEntry(handle, key, 's', std::string(value, strlen(value) + 1));
+} // nvs_set_str
+
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char* key, uint32_t value) {
+	return setEntry(handle, key, 'u', std::string((const char*)&value, sizeof(value)));
+} // nvs_set_u32
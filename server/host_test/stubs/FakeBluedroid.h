@@ -0,0 +1,53 @@
+/*
+ * FakeBluedroid.h
+ *
+ * An in-process stand-in for the Bluetooth host stack behind esp_ble_gap_*, esp_ble_gatts_* and
+ * esp_ble_gattc_*, for host tests that run a BLEServer and a BLEClient in the same process.
+ *
+ * The stack has one GATT database, that of the local server, and a client connects to it by opening the
+ * local address.  Callbacks are made from a BTC task of their own, in the order the stack would make them.
+ * Events that cross the air are delivered one link latency after the call that caused them, and a request
+ * waits for its response as on the air, so a round trip takes two.  Each connection serves one request at a
+ * time.  Notifications may be lost at a configured rate; everything else arrives.
+ */
+
+#ifndef HOST_TEST_STUBS_FAKEBLUEDROID_H_
+#define HOST_TEST_STUBS_FAKEBLUEDROID_H_
+#include <stdint.h>
+#include <esp_bt_defs.h>
+#include <esp_gatt_defs.h>
+#include <esp_gatts_api.h>
+
+class FakeBluedroid {
+public:
+	/**
+	 * @brief What the stack has done since it started.
+	 */
+	struct Stats {
+		uint32_t writes;                 // Writes with response, counting a long write once.
+		uint32_t writesNoResponse;
+		uint32_t reads;
+		uint32_t notifications;          // Notifications sent by the server, lost ones included.
+		uint32_t notificationsLost;
+		uint32_t indications;
+		uint32_t scanResults;
+		uint32_t opens;                  // Connections asked for by clients.
+		uint32_t searches;               // Service searches asked for by clients.
+	};
+
+	static void     setLatency(uint32_t latencyUs);
+	static void     setPeerMTU(uint16_t mtu);
+	static void     setLoss(uint32_t perMille);
+	static void     setPeerPresent(bool present);
+	static void     setConnectTimeout(uint32_t timeoutUs);
+	static void     dropLink(uint16_t connId, esp_gatt_conn_reason_t reason = ESP_GATT_CONN_TIMEOUT);
+	static void     addAdvertisement(esp_bd_addr_t address, const uint8_t* pData, uint8_t length, int rssi);
+	static bool     injectScanResult(esp_bd_addr_t address, const uint8_t* pData, uint8_t length, int rssi);
+	static void     waitIdle();
+	static Stats    getStats();
+	static uint16_t getConnectionMTU(uint16_t connId);
+	static void     deliverServerEvent(esp_gatts_cb_event_t event, esp_ble_gatts_cb_param_t* pParam);   // At once, on the calling task.
+	static bool     inServerCallback();   // On the server's GATTS callback, not counting calls it makes into the stack.
+}; // FakeBluedroid
+
+#endif /* HOST_TEST_STUBS_FAKEBLUEDROID_H_ */
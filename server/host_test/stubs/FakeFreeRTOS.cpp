@@ -0,0 +1,476 @@
+/*
+ * FakeFreeRTOS.cpp
+ *
+ * The FreeRTOS kernel objects behind the stand-in headers in stubs/freertos, built on pthreads.
+ *
+ * A task is a detached thread that can only be cancelled while it blocks in one of the calls below, so
+ * deleting another task never stops it half way through its own code.  Task records are never freed:
+ * code under test may still notify a task it has just deleted, as it may on the ESP32.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <deque>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+struct HostTask {
+	pthread_t      thread;
+	std::string    name;
+	TaskFunction_t code;
+	void*          param;
+	pthread_mutex_t lock;
+	pthread_cond_t  notified;
+	uint32_t       notifyCount;
+};
+
+struct HostSemaphore {
+	pthread_mutex_t lock;
+	pthread_cond_t  given;
+	UBaseType_t     count;
+	UBaseType_t     maxCount;
+	HostTask*       owner;
+	UBaseType_t     depth;
+};
+
+struct HostEventGroup {
+	pthread_mutex_t lock;
+	pthread_cond_t  changed;
+	EventBits_t     bits;
+};
+
+struct HostRingbuffer {
+	pthread_mutex_t    lock;
+	pthread_cond_t     changed;
+	size_t             capacity;
+	size_t             used;
+	std::deque<void*>  items;
+};
+
+static __thread HostTask* t_currentTask = nullptr;
+
+
+/**
+ * @brief The storage an item of the given length takes in a ring buffer.
+ */
+static size_t itemSize(size_t length) {
+	return 8 + ((length + 3) & ~(size_t)3);
+} // itemSize
+
+
+static void initCond(pthread_cond_t* pCond) {
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(pCond, &attr);
+	pthread_condattr_destroy(&attr);
+} // initCond
+
+
+/**
+ * @brief Holds a mutex for a scope in which the task may be cancelled.
+ * Cancellation unwinds the stack, so the mutex is released on the way out either way.
+ */
+class Blocking {
+public:
+	Blocking(pthread_mutex_t* pLock) : m_pLock(pLock) {
+		pthread_mutex_lock(m_pLock);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &m_oldState);
+	}
+	~Blocking() {
+		int ignored;
+		pthread_setcancelstate(m_oldState, &ignored);
+		pthread_mutex_unlock(m_pLock);
+	}
+
+	/**
+	 * @brief Wait on the condition until the deadline.
+	 * @return False if the deadline passed.
+	 */
+	bool wait(pthread_cond_t* pCond, TickType_t ticks, const struct timespec& deadline) {
+		if (ticks == portMAX_DELAY) {
+			pthread_cond_wait(pCond, m_pLock);
+			return true;
+		}
+		return pthread_cond_timedwait(pCond, m_pLock, &deadline) != ETIMEDOUT;
+	}
+
+private:
+	pthread_mutex_t* m_pLock;
+	int              m_oldState;
+};
+
+
+static struct timespec deadlineAfter(TickType_t ticks) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	if (ticks != portMAX_DELAY) {
+		deadline.tv_sec  += ticks / 1000;
+		deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+	return deadline;
+} // deadlineAfter
+
+
+static HostTask* newTask(const char* name) {
+	HostTask* pTask = new HostTask;
+	pTask->name        = name;
+	pTask->code        = nullptr;
+	pTask->param       = nullptr;
+	pTask->notifyCount = 0;
+	pthread_mutex_init(&pTask->lock, nullptr);
+	initCond(&pTask->notified);
+	return pTask;
+} // newTask
+
+
+static void* runTask(void* pArg) {
+	HostTask* pTask = (HostTask*)pArg;
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+	t_currentTask = pTask;
+	pTask->code(pTask->param);
+	return nullptr;
+} // runTask
+
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth, void* param, UBaseType_t priority, TaskHandle_t* pHandle) {
+	HostTask* pTask = newTask(name);
+	pTask->code  = code;
+	pTask->param = param;
+	if (pHandle != nullptr) {
+		*pHandle = pTask;
+	}
+	if (pthread_create(&pTask->thread, nullptr, runTask, pTask) != 0) {
+		return pdFAIL;
+	}
+	pthread_detach(pTask->thread);
+	return pdPASS;
+} // xTaskCreate
+
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* param, UBaseType_t priority, TaskHandle_t* pHandle, BaseType_t core) {
+	return xTaskCreate(code, name, stackDepth, param, priority, pHandle);
+} // xTaskCreatePinnedToCore
+
+
+void vTaskDelete(TaskHandle_t task) {
+	if (task == nullptr || task == xTaskGetCurrentTaskHandle()) {
+		pthread_exit(nullptr);
+	}
+	pthread_cancel(task->thread);
+} // vTaskDelete
+
+
+void vTaskDelay(TickType_t ticks) {
+	struct timespec delay;
+	delay.tv_sec  = ticks / 1000;
+	delay.tv_nsec = (long)(ticks % 1000) * 1000000;
+	int oldState;
+	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &oldState);
+	while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+	}
+	pthread_setcancelstate(oldState, &oldState);
+} // vTaskDelay
+
+
+TickType_t xTaskGetTickCount() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (TickType_t)((uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000);
+} // xTaskGetTickCount
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+	if (t_currentTask == nullptr) {   // A thread the test started itself, such as main.
+		t_currentTask = newTask("main");
+		t_currentTask->thread = pthread_self();
+	}
+	return t_currentTask;
+} // xTaskGetCurrentTaskHandle
+
+
+char* pcTaskGetTaskName(TaskHandle_t task) {
+	if (task == nullptr) {
+		task = xTaskGetCurrentTaskHandle();
+	}
+	return (char*)task->name.c_str();
+} // pcTaskGetTaskName
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+	pthread_mutex_lock(&task->lock);
+	task->notifyCount++;
+	pthread_cond_signal(&task->notified);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+} // xTaskNotifyGive
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+	HostTask* pTask = xTaskGetCurrentTaskHandle();
+	struct timespec deadline = deadlineAfter(ticks);
+	Blocking blocking(&pTask->lock);
+	while (pTask->notifyCount == 0) {
+		if (!blocking.wait(&pTask->notified, ticks, deadline)) {
+			return 0;
+		}
+	}
+	uint32_t count = pTask->notifyCount;
+	pTask->notifyCount = clearOnExit ? 0 : count - 1;
+	return count;
+} // ulTaskNotifyTake
+
+
+static SemaphoreHandle_t newSemaphore(UBaseType_t maxCount, UBaseType_t initialCount) {
+	HostSemaphore* pSemaphore = new HostSemaphore;
+	pthread_mutex_init(&pSemaphore->lock, nullptr);
+	initCond(&pSemaphore->given);
+	pSemaphore->count    = initialCount;
+	pSemaphore->maxCount = maxCount;
+	pSemaphore->owner    = nullptr;
+	pSemaphore->depth    = 0;
+	return pSemaphore;
+} // newSemaphore
+
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+	return newSemaphore(1, 0);
+} // xSemaphoreCreateBinary
+
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+	return newSemaphore(maxCount, initialCount);
+} // xSemaphoreCreateCounting
+
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+	return newSemaphore(1, 1);
+} // xSemaphoreCreateMutex
+
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {
+	return newSemaphore(1, 1);
+} // xSemaphoreCreateRecursiveMutex
+
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+	HostTask* pTask = xTaskGetCurrentTaskHandle();
+	struct timespec deadline = deadlineAfter(ticks);
+	Blocking blocking(&semaphore->lock);
+	while (semaphore->count == 0) {
+		if (ticks == 0 || !blocking.wait(&semaphore->given, ticks, deadline)) {
+			return pdFALSE;
+		}
+	}
+	semaphore->count--;
+	semaphore->owner = pTask;
+	return pdTRUE;
+} // xSemaphoreTake
+
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+	pthread_mutex_lock(&semaphore->lock);
+	BaseType_t rc = pdFALSE;
+	if (semaphore->count < semaphore->maxCount) {
+		semaphore->count++;
+		semaphore->owner = nullptr;
+		pthread_cond_signal(&semaphore->given);
+		rc = pdTRUE;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+	return rc;
+} // xSemaphoreGive
+
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* pHigherPriorityTaskWoken) {
+	if (pHigherPriorityTaskWoken != nullptr) {
+		*pHigherPriorityTaskWoken = pdFALSE;
+	}
+	return xSemaphoreGive(semaphore);
+} // xSemaphoreGiveFromISR
+
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) {
+	HostTask* pTask = xTaskGetCurrentTaskHandle();
+	pthread_mutex_lock(&semaphore->lock);
+	bool held = semaphore->owner == pTask && semaphore->depth > 0;
+	if (held) {
+		semaphore->depth++;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+	if (held) {
+		return pdTRUE;
+	}
+	if (!xSemaphoreTake(semaphore, ticks)) {
+		return pdFALSE;
+	}
+	pthread_mutex_lock(&semaphore->lock);
+	semaphore->depth = 1;
+	pthread_mutex_unlock(&semaphore->lock);
+	return pdTRUE;
+} // xSemaphoreTakeRecursive
+
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) {
+	HostTask* pTask = xTaskGetCurrentTaskHandle();
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->owner != pTask || semaphore->depth == 0) {
+		pthread_mutex_unlock(&semaphore->lock);
+		return pdFALSE;
+	}
+	bool released = --semaphore->depth == 0;
+	pthread_mutex_unlock(&semaphore->lock);
+	return released ? xSemaphoreGive(semaphore) : pdTRUE;
+} // xSemaphoreGiveRecursive
+
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) {
+	pthread_mutex_lock(&semaphore->lock);
+	UBaseType_t count = semaphore->count;
+	pthread_mutex_unlock(&semaphore->lock);
+	return count;
+} // uxSemaphoreGetCount
+
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+	pthread_cond_destroy(&semaphore->given);
+	pthread_mutex_destroy(&semaphore->lock);
+	delete semaphore;
+} // vSemaphoreDelete
+
+
+EventGroupHandle_t xEventGroupCreate() {
+	HostEventGroup* pGroup = new HostEventGroup;
+	pthread_mutex_init(&pGroup->lock, nullptr);
+	initCond(&pGroup->changed);
+	pGroup->bits = 0;
+	return pGroup;
+} // xEventGroupCreate
+
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+	pthread_mutex_lock(&group->lock);
+	group->bits |= bits;
+	EventBits_t result = group->bits;
+	pthread_cond_broadcast(&group->changed);
+	pthread_mutex_unlock(&group->lock);
+	return result;
+} // xEventGroupSetBits
+
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+	pthread_mutex_lock(&group->lock);
+	EventBits_t result = group->bits;
+	group->bits &= ~bits;
+	pthread_mutex_unlock(&group->lock);
+	return result;
+} // xEventGroupClearBits
+
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+	pthread_mutex_lock(&group->lock);
+	EventBits_t result = group->bits;
+	pthread_mutex_unlock(&group->lock);
+	return result;
+} // xEventGroupGetBits
+
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticks) {
+	struct timespec deadline = deadlineAfter(ticks);
+	Blocking blocking(&group->lock);
+	for (;;) {
+		EventBits_t current = group->bits;
+		if (waitForAll ? (current & bits) == bits : (current & bits) != 0) {
+			if (clearOnExit) {
+				group->bits &= ~bits;
+			}
+			return current;
+		}
+		if (ticks == 0 || !blocking.wait(&group->changed, ticks, deadline)) {
+			return group->bits;
+		}
+	}
+} // xEventGroupWaitBits
+
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+	pthread_cond_destroy(&group->changed);
+	pthread_mutex_destroy(&group->lock);
+	delete group;
+} // vEventGroupDelete
+
+
+RingbufHandle_t xRingbufferCreate(size_t length, ringbuf_type_t type) {
+	HostRingbuffer* pRingbuf = new HostRingbuffer;
+	pthread_mutex_init(&pRingbuf->lock, nullptr);
+	initCond(&pRingbuf->changed);
+	pRingbuf->capacity = length;
+	pRingbuf->used     = 0;
+	return pRingbuf;
+} // xRingbufferCreate
+
+
+BaseType_t xRingbufferSend(RingbufHandle_t ringbuf, const void* data, size_t length, TickType_t ticks) {
+	struct timespec deadline = deadlineAfter(ticks);
+	Blocking blocking(&ringbuf->lock);
+	while (ringbuf->used + itemSize(length) > ringbuf->capacity) {
+		if (ticks == 0 || !blocking.wait(&ringbuf->changed, ticks, deadline)) {
+			return pdFALSE;
+		}
+	}
+	// The length is kept in front of the data, where the item header would be.
+	size_t* pItem = (size_t*)malloc(sizeof(size_t) + length);
+	pItem[0] = length;
+	memcpy(pItem + 1, data, length);
+	ringbuf->items.push_back(pItem);
+	ringbuf->used += itemSize(length);
+	pthread_cond_broadcast(&ringbuf->changed);
+	return pdTRUE;
+} // xRingbufferSend
+
+
+void* xRingbufferReceive(RingbufHandle_t ringbuf, size_t* pLength, TickType_t ticks) {
+	struct timespec deadline = deadlineAfter(ticks);
+	Blocking blocking(&ringbuf->lock);
+	while (ringbuf->items.empty()) {
+		if (ticks == 0 || !blocking.wait(&ringbuf->changed, ticks, deadline)) {
+			return nullptr;
+		}
+	}
+	size_t* pItem = (size_t*)ringbuf->items.front();
+	ringbuf->items.pop_front();
+	*pLength = pItem[0];
+	return pItem + 1;
+} // xRingbufferReceive
+
+
+void vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item) {
+	size_t* pItem = (size_t*)item - 1;
+	pthread_mutex_lock(&ringbuf->lock);
+	ringbuf->used -= itemSize(pItem[0]);
+	pthread_cond_broadcast(&ringbuf->changed);
+	pthread_mutex_unlock(&ringbuf->lock);
+	free(pItem);
+} // vRingbufferReturnItem
+
+
+void vRingbufferDelete(RingbufHandle_t ringbuf) {
+	for (size_t i = 0; i < ringbuf->items.size(); i++) {
+		free(ringbuf->items[i]);
+	}
+	pthread_cond_destroy(&ringbuf->changed);
+	pthread_mutex_destroy(&ringbuf->lock);
+	delete ringbuf;
+} // vRingbufferDelete
@@ -0,0 +1,48 @@
+/*
+ * esp_bt.h
+ *
+ * Host stand-in for the ESP-IDF Bluetooth controller.  The fake stack in FakeBluedroid.cpp accepts
+ * every call.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_BT_H_
+#define HOST_TEST_STUBS_ESP_BT_H_
+#include "esp_err.h"
+
+typedef enum {
+	ESP_BT_MODE_IDLE       = 0x00,
+	ESP_BT_MODE_BLE        = 0x01,
+	ESP_BT_MODE_CLASSIC_BT = 0x02,
+	ESP_BT_MODE_BTDM       = 0x03
+} esp_bt_mode_t;
+
+typedef enum {
+	ESP_PWR_LVL_N14 = 0,
+	ESP_PWR_LVL_N11,
+	ESP_PWR_LVL_N8,
+	ESP_PWR_LVL_N5,
+	ESP_PWR_LVL_N2,
+	ESP_PWR_LVL_P1,
+	ESP_PWR_LVL_P4,
+	ESP_PWR_LVL_P7
+} esp_power_level_t;
+
+typedef enum {
+	ESP_BLE_PWR_TYPE_CONN_HDL0 = 0,
+	ESP_BLE_PWR_TYPE_ADV       = 9,
+	ESP_BLE_PWR_TYPE_SCAN      = 10,
+	ESP_BLE_PWR_TYPE_DEFAULT   = 11
+} esp_ble_power_type_t;
+
+typedef struct {
+	int reserved;
+} esp_bt_controller_config_t;
+
+#define BT_CONTROLLER_INIT_CONFIG_DEFAULT() { 0 }
+
+esp_err_t esp_bt_controller_init(esp_bt_controller_config_t* cfg);
+esp_err_t esp_bt_controller_enable(esp_bt_mode_t mode);
+esp_err_t esp_bt_controller_mem_release(esp_bt_mode_t mode);
+esp_err_t esp_ble_tx_power_set(esp_ble_power_type_t power_type, esp_power_level_t power_level);
+
+#endif /* HOST_TEST_STUBS_ESP_BT_H_ */
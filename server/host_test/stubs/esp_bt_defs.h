@@ -0,0 +1,49 @@
+/*
+ * esp_bt_defs.h
+ *
+ * Host stand-in for the common definitions of the ESP-IDF Bluetooth stack.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_BT_DEFS_H_
+#define HOST_TEST_STUBS_ESP_BT_DEFS_H_
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define ESP_BD_ADDR_LEN  6
+#define ESP_UUID_LEN_16  2
+#define ESP_UUID_LEN_32  4
+#define ESP_UUID_LEN_128 16
+
+typedef uint8_t esp_bd_addr_t[ESP_BD_ADDR_LEN];
+typedef uint8_t esp_bt_octet16_t[16];
+typedef uint8_t esp_link_key[16];
+
+typedef struct {
+	uint16_t len;
+	union {
+		uint16_t uuid16;
+		uint32_t uuid32;
+		uint8_t  uuid128[ESP_UUID_LEN_128];
+	} uuid;
+} __attribute__((packed)) esp_bt_uuid_t;
+
+typedef enum {
+	ESP_BT_STATUS_SUCCESS = 0,
+	ESP_BT_STATUS_FAIL
+} esp_bt_status_t;
+
+typedef uint8_t esp_bt_dev_type_t;
+
+#define ESP_BT_DEVICE_TYPE_BREDR 0x01
+#define ESP_BT_DEVICE_TYPE_BLE   0x02
+#define ESP_BT_DEVICE_TYPE_DUMO  0x03
+
+typedef enum {
+	BLE_ADDR_TYPE_PUBLIC     = 0x00,
+	BLE_ADDR_TYPE_RANDOM     = 0x01,
+	BLE_ADDR_TYPE_RPA_PUBLIC = 0x02,
+	BLE_ADDR_TYPE_RPA_RANDOM = 0x03
+} esp_ble_addr_type_t;
+
+#endif /* HOST_TEST_STUBS_ESP_BT_DEFS_H_ */
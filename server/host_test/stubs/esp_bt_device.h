@@ -0,0 +1,13 @@
+/*
+ * esp_bt_device.h
+ *
+ * Host stand-in for the ESP-IDF Bluetooth device queries.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_BT_DEVICE_H_
+#define HOST_TEST_STUBS_ESP_BT_DEVICE_H_
+#include "esp_bt_defs.h"
+
+const uint8_t* esp_bt_dev_get_address();
+
+#endif /* HOST_TEST_STUBS_ESP_BT_DEVICE_H_ */
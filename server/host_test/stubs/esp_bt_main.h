@@ -0,0 +1,22 @@
+/*
+ * esp_bt_main.h
+ *
+ * Host stand-in for the ESP-IDF Bluetooth host stack start up.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_BT_MAIN_H_
+#define HOST_TEST_STUBS_ESP_BT_MAIN_H_
+#include "esp_err.h"
+
+typedef enum {
+	ESP_BLUEDROID_STATUS_UNINITIALIZED = 0,
+	ESP_BLUEDROID_STATUS_INITIALIZED,
+	ESP_BLUEDROID_STATUS_ENABLED
+} esp_bluedroid_status_t;
+
+esp_bluedroid_status_t esp_bluedroid_get_status();
+esp_err_t              esp_bluedroid_init();
+esp_err_t              esp_bluedroid_enable();
+esp_err_t              esp_bluedroid_disable();
+
+#endif /* HOST_TEST_STUBS_ESP_BT_MAIN_H_ */
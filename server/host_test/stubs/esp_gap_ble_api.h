@@ -0,0 +1,365 @@
+/*
+ * esp_gap_ble_api.h
+ *
+ * Host stand-in for the GAP API of the ESP-IDF Bluetooth stack.  The calls are served by the fake stack
+ * in FakeBluedroid.cpp.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_GAP_BLE_API_H_
+#define HOST_TEST_STUBS_ESP_GAP_BLE_API_H_
+#include "esp_bt.h"
+#include "esp_bt_defs.h"
+
+typedef enum {
+	ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT          = 0,
+	ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT,
+	ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+	ESP_GAP_BLE_SCAN_RESULT_EVT,
+	ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT,
+	ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT,
+	ESP_GAP_BLE_ADV_START_COMPLETE_EVT,
+	ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+	ESP_GAP_BLE_AUTH_CMPL_EVT,
+	ESP_GAP_BLE_KEY_EVT,
+	ESP_GAP_BLE_SEC_REQ_EVT,
+	ESP_GAP_BLE_PASSKEY_NOTIF_EVT,
+	ESP_GAP_BLE_PASSKEY_REQ_EVT,
+	ESP_GAP_BLE_OOB_REQ_EVT,
+	ESP_GAP_BLE_LOCAL_IR_EVT,
+	ESP_GAP_BLE_LOCAL_ER_EVT,
+	ESP_GAP_BLE_NC_REQ_EVT,
+	ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT,
+	ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT,
+	ESP_GAP_BLE_SET_STATIC_RAND_ADDR_EVT,
+	ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT,
+	ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT,
+	ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT,
+	ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT,
+	ESP_GAP_BLE_CLEAR_BOND_DEV_COMPLETE_EVT,
+	ESP_GAP_BLE_GET_BOND_DEV_COMPLETE_EVT,
+	ESP_GAP_BLE_READ_RSSI_COMPLETE_EVT,
+	ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT,
+	ESP_GAP_BLE_EVT_MAX
+} esp_gap_ble_cb_event_t;
+
+typedef enum {
+	ESP_GAP_SEARCH_INQ_RES_EVT            = 0,
+	ESP_GAP_SEARCH_INQ_CMPL_EVT           = 1,
+	ESP_GAP_SEARCH_DISC_RES_EVT           = 2,
+	ESP_GAP_SEARCH_DISC_BLE_RES_EVT       = 3,
+	ESP_GAP_SEARCH_DISC_CMPL_EVT          = 4,
+	ESP_GAP_SEARCH_DI_DISC_CMPL_EVT       = 5,
+	ESP_GAP_SEARCH_SEARCH_CANCEL_CMPL_EVT = 6
+} esp_gap_search_evt_t;
+
+typedef enum {
+	ESP_BLE_EVT_CONN_ADV     = 0x00,
+	ESP_BLE_EVT_CONN_DIR_ADV = 0x01,
+	ESP_BLE_EVT_DISC_ADV     = 0x02,
+	ESP_BLE_EVT_NON_CONN_ADV = 0x03,
+	ESP_BLE_EVT_SCAN_RSP     = 0x04
+} esp_ble_evt_type_t;
+
+#define ESP_BLE_ADV_DATA_LEN_MAX               31
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX          31
+
+#define ESP_BLE_AD_TYPE_FLAG                   0x01
+#define ESP_BLE_AD_TYPE_16SRV_PART             0x02
+#define ESP_BLE_AD_TYPE_16SRV_CMPL             0x03
+#define ESP_BLE_AD_TYPE_32SRV_PART             0x04
+#define ESP_BLE_AD_TYPE_32SRV_CMPL             0x05
+#define ESP_BLE_AD_TYPE_128SRV_PART            0x06
+#define ESP_BLE_AD_TYPE_128SRV_CMPL            0x07
+#define ESP_BLE_AD_TYPE_NAME_SHORT             0x08
+#define ESP_BLE_AD_TYPE_NAME_CMPL              0x09
+#define ESP_BLE_AD_TYPE_TX_PWR                 0x0a
+#define ESP_BLE_AD_TYPE_DEV_CLASS              0x0d
+#define ESP_BLE_AD_TYPE_SM_TK                  0x10
+#define ESP_BLE_AD_TYPE_SM_OOB_FLAG            0x11
+#define ESP_BLE_AD_TYPE_INT_RANGE              0x12
+#define ESP_BLE_AD_TYPE_SOL_SRV_UUID           0x14
+#define ESP_BLE_AD_TYPE_128SOL_SRV_UUID        0x15
+#define ESP_BLE_AD_TYPE_SERVICE_DATA           0x16
+#define ESP_BLE_AD_TYPE_PUBLIC_TARGET          0x17
+#define ESP_BLE_AD_TYPE_RANDOM_TARGET          0x18
+#define ESP_BLE_AD_TYPE_APPEARANCE             0x19
+#define ESP_BLE_AD_TYPE_ADV_INT                0x1a
+#define ESP_BLE_AD_TYPE_32SOL_SRV_UUID         0x1f
+#define ESP_BLE_AD_TYPE_32SERVICE_DATA         0x20
+#define ESP_BLE_AD_TYPE_128SERVICE_DATA        0x21
+#define ESP_BLE_AD_MANUFACTURER_SPECIFIC_TYPE  0xff
+
+#define ESP_BLE_ADV_FLAG_LIMIT_DISC            (0x01 << 0)
+#define ESP_BLE_ADV_FLAG_GEN_DISC              (0x01 << 1)
+#define ESP_BLE_ADV_FLAG_BREDR_NOT_SPT         (0x01 << 2)
+#define ESP_BLE_ADV_FLAG_DMT_CONTROLLER_SPT    (0x01 << 3)
+#define ESP_BLE_ADV_FLAG_DMT_HOST_SPT          (0x01 << 4)
+#define ESP_BLE_ADV_FLAG_NON_LIMIT_DISC        (0x00)
+
+typedef uint8_t esp_ble_key_type_t;
+
+#define ESP_LE_KEY_NONE                        0
+#define ESP_LE_KEY_PENC                        (1 << 0)
+#define ESP_LE_KEY_PID                         (1 << 1)
+#define ESP_LE_KEY_PCSRK                       (1 << 2)
+#define ESP_LE_KEY_PLK                         (1 << 3)
+#define ESP_LE_KEY_LLK                         (ESP_LE_KEY_PLK << 4)
+#define ESP_LE_KEY_LENC                        (ESP_LE_KEY_PENC << 4)
+#define ESP_LE_KEY_LID                         (ESP_LE_KEY_PID << 4)
+#define ESP_LE_KEY_LCSRK                       (ESP_LE_KEY_PCSRK << 4)
+
+typedef uint8_t esp_ble_auth_req_t;
+
+#define ESP_LE_AUTH_NO_BOND                    0x00
+#define ESP_LE_AUTH_BOND                       0x01
+#define ESP_LE_AUTH_REQ_MITM                   (1 << 2)
+#define ESP_LE_AUTH_REQ_SC_ONLY                (1 << 3)
+#define ESP_LE_AUTH_REQ_SC_BOND                (ESP_LE_AUTH_BOND | ESP_LE_AUTH_REQ_SC_ONLY)
+#define ESP_LE_AUTH_REQ_SC_MITM                (ESP_LE_AUTH_REQ_MITM | ESP_LE_AUTH_REQ_SC_ONLY)
+#define ESP_LE_AUTH_REQ_SC_MITM_BOND           (ESP_LE_AUTH_REQ_MITM | ESP_LE_AUTH_REQ_SC_ONLY | ESP_LE_AUTH_BOND)
+
+typedef uint8_t esp_ble_io_cap_t;
+
+#define ESP_IO_CAP_OUT                         0
+#define ESP_IO_CAP_IO                          1
+#define ESP_IO_CAP_IN                          2
+#define ESP_IO_CAP_NONE                        3
+#define ESP_IO_CAP_KBDISP                      4
+
+typedef enum {
+	ADV_TYPE_IND             = 0x00,
+	ADV_TYPE_DIRECT_IND_HIGH = 0x01,
+	ADV_TYPE_SCAN_IND        = 0x02,
+	ADV_TYPE_NONCONN_IND     = 0x03,
+	ADV_TYPE_DIRECT_IND_LOW  = 0x04
+} esp_ble_adv_type_t;
+
+typedef enum {
+	ADV_CHNL_37  = 0x01,
+	ADV_CHNL_38  = 0x02,
+	ADV_CHNL_39  = 0x04,
+	ADV_CHNL_ALL = 0x07
+} esp_ble_adv_channel_t;
+
+typedef enum {
+	ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY = 0x00,
+	ADV_FILTER_ALLOW_SCAN_WLST_CON_ANY,
+	ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST,
+	ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST
+} esp_ble_adv_filter_t;
+
+typedef enum {
+	BLE_SCAN_TYPE_PASSIVE = 0x0,
+	BLE_SCAN_TYPE_ACTIVE  = 0x1
+} esp_ble_scan_type_t;
+
+typedef enum {
+	BLE_SCAN_FILTER_ALLOW_ALL         = 0x0,
+	BLE_SCAN_FILTER_ALLOW_ONLY_WLST   = 0x1,
+	BLE_SCAN_FILTER_ALLOW_UND_RPA_DIR = 0x2,
+	BLE_SCAN_FILTER_ALLOW_WLIST_PRA_DIR = 0x3
+} esp_ble_scan_filter_t;
+
+typedef enum {
+	BLE_SCAN_DUPLICATE_DISABLE = 0x0,
+	BLE_SCAN_DUPLICATE_ENABLE  = 0x1
+} esp_ble_scan_duplicate_t;
+
+typedef enum {
+	ESP_BLE_SEC_NONE = 0,
+	ESP_BLE_SEC_ENCRYPT,
+	ESP_BLE_SEC_ENCRYPT_NO_MITM,
+	ESP_BLE_SEC_ENCRYPT_MITM
+} esp_ble_sec_act_t;
+
+typedef enum {
+	ESP_BLE_SM_PASSKEY = 0,
+	ESP_BLE_SM_AUTHEN_REQ_MODE,
+	ESP_BLE_SM_IOCAP_MODE,
+	ESP_BLE_SM_SET_INIT_KEY,
+	ESP_BLE_SM_SET_RSP_KEY,
+	ESP_BLE_SM_MAX_KEY_SIZE
+} esp_ble_sm_param_t;
+
+typedef struct {
+	uint16_t              adv_int_min;
+	uint16_t              adv_int_max;
+	esp_ble_adv_type_t    adv_type;
+	esp_ble_addr_type_t   own_addr_type;
+	esp_bd_addr_t         peer_addr;
+	esp_ble_addr_type_t   peer_addr_type;
+	esp_ble_adv_channel_t channel_map;
+	esp_ble_adv_filter_t  adv_filter_policy;
+} esp_ble_adv_params_t;
+
+typedef struct {
+	bool     set_scan_rsp;
+	bool     include_name;
+	bool     include_txpower;
+	int      min_interval;
+	int      max_interval;
+	int      appearance;
+	uint16_t manufacturer_len;
+	uint8_t* p_manufacturer_data;
+	uint16_t service_data_len;
+	uint8_t* p_service_data;
+	uint16_t service_uuid_len;
+	uint8_t* p_service_uuid;
+	uint8_t  flag;
+} esp_ble_adv_data_t;
+
+typedef struct {
+	esp_ble_scan_type_t      scan_type;
+	esp_ble_addr_type_t      own_addr_type;
+	esp_ble_scan_filter_t    scan_filter_policy;
+	uint16_t                 scan_interval;
+	uint16_t                 scan_window;
+	esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+
+typedef struct {
+	esp_bd_addr_t bda;
+	uint16_t      min_int;
+	uint16_t      max_int;
+	uint16_t      latency;
+	uint16_t      timeout;
+} esp_ble_conn_update_params_t;
+
+typedef struct {
+	esp_bd_addr_t bd_addr;
+	uint32_t      passkey;
+} esp_ble_sec_key_notif_t;
+
+typedef struct {
+	esp_bd_addr_t bd_addr;
+} esp_ble_sec_req_t;
+
+typedef struct {
+	esp_bd_addr_t      bd_addr;
+	esp_ble_key_type_t key_type;
+} esp_ble_key_t;
+
+typedef struct {
+	esp_bd_addr_t       bd_addr;
+	bool                key_present;
+	esp_link_key        key;
+	uint8_t             key_type;
+	bool                success;
+	uint8_t             fail_reason;
+	esp_ble_addr_type_t addr_type;
+	esp_bt_dev_type_t   dev_type;
+	esp_ble_auth_req_t  auth_mode;
+} esp_ble_auth_cmpl_t;
+
+typedef union {
+	esp_ble_sec_key_notif_t key_notif;
+	esp_ble_sec_req_t       ble_req;
+	esp_ble_key_t           ble_key;
+	esp_ble_auth_cmpl_t     auth_cmpl;
+} esp_ble_sec_t;
+
+typedef union {
+	struct ble_adv_data_cmpl_evt_param {
+		esp_bt_status_t status;
+	} adv_data_cmpl;
+
+	struct ble_scan_rsp_data_cmpl_evt_param {
+		esp_bt_status_t status;
+	} scan_rsp_data_cmpl;
+
+	struct ble_scan_param_cmpl_evt_param {
+		esp_bt_status_t status;
+	} scan_param_cmpl;
+
+	struct ble_scan_result_evt_param {
+		esp_gap_search_evt_t search_evt;
+		esp_bd_addr_t        bda;
+		esp_bt_dev_type_t    dev_type;
+		esp_ble_addr_type_t  ble_addr_type;
+		esp_ble_evt_type_t   ble_evt_type;
+		int                  rssi;
+		uint8_t              ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+		int                  flag;
+		int                  num_resps;
+		uint8_t              adv_data_len;
+		uint8_t              scan_rsp_len;
+	} scan_rst;
+
+	struct ble_adv_data_raw_cmpl_evt_param {
+		esp_bt_status_t status;
+	} adv_data_raw_cmpl;
+
+	struct ble_scan_rsp_data_raw_cmpl_evt_param {
+		esp_bt_status_t status;
+	} scan_rsp_data_raw_cmpl;
+
+	struct ble_adv_start_cmpl_evt_param {
+		esp_bt_status_t status;
+	} adv_start_cmpl;
+
+	struct ble_scan_start_cmpl_evt_param {
+		esp_bt_status_t status;
+	} scan_start_cmpl;
+
+	esp_ble_sec_t ble_security;
+
+	struct ble_scan_stop_cmpl_evt_param {
+		esp_bt_status_t status;
+	} scan_stop_cmpl;
+
+	struct ble_adv_stop_cmpl_evt_param {
+		esp_bt_status_t status;
+	} adv_stop_cmpl;
+
+	struct ble_update_conn_params_evt_param {
+		esp_bt_status_t status;
+		esp_bd_addr_t   bda;
+		uint16_t        min_int;
+		uint16_t        max_int;
+		uint16_t        latency;
+		uint16_t        conn_int;
+		uint16_t        timeout;
+	} update_conn_params;
+
+	struct ble_pkt_data_length_cmpl_evt_param {
+		esp_bt_status_t status;
+		struct {
+			uint16_t rx_len;
+			uint16_t tx_len;
+		} params;
+	} pkt_data_lenth_cmpl;
+
+	struct ble_clear_bond_dev_cmpl_evt_param {
+		esp_bt_status_t status;
+	} clear_bond_dev_cmpl;
+
+	struct ble_read_rssi_cmpl_evt_param {
+		esp_bt_status_t status;
+		int8_t          rssi;
+		esp_bd_addr_t   remote_addr;
+	} read_rssi_cmpl;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_config_adv_data(esp_ble_adv_data_t* adv_data);
+esp_err_t esp_ble_gap_config_adv_data_raw(uint8_t* raw_data, uint32_t raw_data_len);
+esp_err_t esp_ble_gap_config_scan_rsp_data_raw(uint8_t* raw_data, uint32_t raw_data_len);
+esp_err_t esp_ble_gap_start_advertising(esp_ble_adv_params_t* adv_params);
+esp_err_t esp_ble_gap_stop_advertising();
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t* scan_params);
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration);
+esp_err_t esp_ble_gap_stop_scanning();
+esp_err_t esp_ble_gap_update_conn_params(esp_ble_conn_update_params_t* params);
+esp_err_t esp_ble_gap_set_pkt_data_len(esp_bd_addr_t remote_device, uint16_t tx_data_length);
+esp_err_t esp_ble_gap_set_device_name(const char* name);
+esp_err_t esp_ble_gap_read_rssi(esp_bd_addr_t remote_addr);
+esp_err_t esp_ble_gap_update_whitelist(bool add_remove, esp_bd_addr_t remote_bda);
+esp_err_t esp_ble_gap_security_rsp(esp_bd_addr_t bd_addr, bool accept);
+esp_err_t esp_ble_gap_set_security_param(esp_ble_sm_param_t param_type, void* value, uint8_t len);
+esp_err_t esp_ble_set_encryption(esp_bd_addr_t bd_addr, esp_ble_sec_act_t sec_act);
+esp_err_t esp_ble_passkey_reply(esp_bd_addr_t bd_addr, bool accept, uint32_t passkey);
+esp_err_t esp_ble_confirm_reply(esp_bd_addr_t bd_addr, bool accept);
+
+#endif /* HOST_TEST_STUBS_ESP_GAP_BLE_API_H_ */
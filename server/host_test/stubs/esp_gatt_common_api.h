@@ -0,0 +1,14 @@
+/*
+ * esp_gatt_common_api.h
+ *
+ * Host stand-in for the GATT calls that the ESP-IDF Bluetooth stack shares between client and server.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_GATT_COMMON_API_H_
+#define HOST_TEST_STUBS_ESP_GATT_COMMON_API_H_
+#include <stdint.h>
+#include "esp_err.h"
+
+esp_err_t esp_ble_gatt_set_local_mtu(uint16_t mtu);
+
+#endif /* HOST_TEST_STUBS_ESP_GATT_COMMON_API_H_ */
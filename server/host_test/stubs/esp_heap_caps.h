@@ -0,0 +1,16 @@
+/*
+ * esp_heap_caps.h
+ *
+ * Host stand-in for the ESP-IDF heap queries.  The host heap has no fixed size, so none is reported.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_HEAP_CAPS_H_
+#define HOST_TEST_STUBS_ESP_HEAP_CAPS_H_
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+static inline size_t heap_caps_get_free_size(uint32_t caps) { return 0; }
+
+#endif /* HOST_TEST_STUBS_ESP_HEAP_CAPS_H_ */
@@ -0,0 +1,38 @@
+/*
+ * esp_log.h
+ *
+ * Host stand-in for the ESP-IDF logging macros.  Nothing is printed, but as in ESP-IDF the arguments of
+ * every message at or below LOG_LOCAL_LEVEL are evaluated whatever the level set at run time.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_LOG_H_
+#define HOST_TEST_STUBS_ESP_LOG_H_
+#include "sdkconfig.h"
+
+typedef enum {
+	ESP_LOG_NONE,
+	ESP_LOG_ERROR,
+	ESP_LOG_WARN,
+	ESP_LOG_INFO,
+	ESP_LOG_DEBUG,
+	ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#ifndef LOG_LOCAL_LEVEL
+#define LOG_LOCAL_LEVEL ((esp_log_level_t) CONFIG_LOG_DEFAULT_LEVEL)
+#endif
+
+static inline void esp_log_level_set(const char* tag, esp_log_level_t level) {}
+static inline void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {}
+
+#define ESP_LOG_LEVEL_LOCAL(level, tag, format, ...) do { \
+	if (LOG_LOCAL_LEVEL >= (level)) esp_log_write(level, tag, format, ##__VA_ARGS__); \
+} while(0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_ERROR,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_WARN,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_INFO,    tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_DEBUG,   tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL_LOCAL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif /* HOST_TEST_STUBS_ESP_LOG_H_ */
@@ -0,0 +1,27 @@
+/*
+ * esp_system.h
+ *
+ * Host stand-in for the ESP-IDF system queries.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_SYSTEM_H_
+#define HOST_TEST_STUBS_ESP_SYSTEM_H_
+#include <stdint.h>
+
+typedef struct {
+	int      model;
+	uint32_t features;
+	uint8_t  cores;
+	uint8_t  revision;
+} esp_chip_info_t;
+
+static inline void esp_chip_info(esp_chip_info_t* out_info) {
+	out_info->model    = 0;
+	out_info->features = 0;
+	out_info->cores    = 1;
+	out_info->revision = 0;
+}
+
+static inline const char* esp_get_idf_version() { return "host"; }
+
+#endif /* HOST_TEST_STUBS_ESP_SYSTEM_H_ */
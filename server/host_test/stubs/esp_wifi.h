@@ -0,0 +1,25 @@
+/*
+ * esp_wifi.h
+ *
+ * Host stand-in for the ESP-IDF WiFi API.  Only the error codes are used.
+ */
+
+#ifndef HOST_TEST_STUBS_ESP_WIFI_H_
+#define HOST_TEST_STUBS_ESP_WIFI_H_
+#include "esp_err.h"
+
+#define ESP_ERR_WIFI_BASE      0x3000
+#define ESP_ERR_WIFI_NOT_INIT  (ESP_ERR_WIFI_BASE + 1)
+#define ESP_ERR_WIFI_NOT_STARTED (ESP_ERR_WIFI_BASE + 2)
+#define ESP_ERR_WIFI_IF        (ESP_ERR_WIFI_BASE + 4)
+#define ESP_ERR_WIFI_MODE      (ESP_ERR_WIFI_BASE + 5)
+#define ESP_ERR_WIFI_STATE     (ESP_ERR_WIFI_BASE + 6)
+#define ESP_ERR_WIFI_CONN      (ESP_ERR_WIFI_BASE + 7)
+#define ESP_ERR_WIFI_NVS       (ESP_ERR_WIFI_BASE + 8)
+#define ESP_ERR_WIFI_MAC       (ESP_ERR_WIFI_BASE + 9)
+#define ESP_ERR_WIFI_SSID      (ESP_ERR_WIFI_BASE + 10)
+#define ESP_ERR_WIFI_PASSWORD  (ESP_ERR_WIFI_BASE + 11)
+#define ESP_ERR_WIFI_TIMEOUT   (ESP_ERR_WIFI_BASE + 12)
+#define ESP_ERR_WIFI_WAKE_FAIL (ESP_ERR_WIFI_BASE + 13)
+
+#endif /* HOST_TEST_STUBS_ESP_WIFI_H_ */
@@ -0,0 +1,34 @@
+/*
+ * FreeRTOS.h
+ *
+ * Host stand-in for the FreeRTOS base definitions.  Tasks are threads and a tick is a millisecond of the
+ * host's monotonic clock; the kernel objects are implemented in FakeFreeRTOS.cpp.
+ */
+
+#ifndef HOST_TEST_STUBS_FREERTOS_FREERTOS_H_
+#define HOST_TEST_STUBS_FREERTOS_FREERTOS_H_
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define portMAX_DELAY      ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t) 1)
+#define portTICK_RATE_MS   portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)  ((TickType_t) (ms))
+#define pdTRUE             ((BaseType_t) 1)
+#define pdFALSE            ((BaseType_t) 0)
+#define pdPASS             pdTRUE
+#define pdFAIL             pdFALSE
+#define tskNO_AFFINITY     0x7fffffff
+#define configMAX_PRIORITIES 25
+
+#define portYIELD_FROM_ISR()
+#define IRAM_ATTR
+
+#endif /* HOST_TEST_STUBS_FREERTOS_FREERTOS_H_ */
@@ -0,0 +1,20 @@
+/*
+ * event_groups.h
+ *
+ * Host stand-in for the FreeRTOS event groups.
+ */
+
+#ifndef HOST_TEST_STUBS_FREERTOS_EVENT_GROUPS_H_
+#define HOST_TEST_STUBS_FREERTOS_EVENT_GROUPS_H_
+#include "FreeRTOS.h"
+
+typedef struct HostEventGroup* EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t        xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t        xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t        xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t        xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticks);
+void               vEventGroupDelete(EventGroupHandle_t group);
+
+#endif /* HOST_TEST_STUBS_FREERTOS_EVENT_GROUPS_H_ */
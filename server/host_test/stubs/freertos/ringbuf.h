@@ -0,0 +1,26 @@
+/*
+ * ringbuf.h
+ *
+ * Host stand-in for the ESP-IDF ring buffer.  Every type keeps whole items, and an item takes its
+ * length rounded up to four bytes plus an eight byte header from the capacity, as a no-split buffer does.
+ */
+
+#ifndef HOST_TEST_STUBS_FREERTOS_RINGBUF_H_
+#define HOST_TEST_STUBS_FREERTOS_RINGBUF_H_
+#include "FreeRTOS.h"
+
+typedef enum {
+	RINGBUF_TYPE_NOSPLIT = 0,
+	RINGBUF_TYPE_ALLOWSPLIT,
+	RINGBUF_TYPE_BYTEBUF
+} ringbuf_type_t;
+
+typedef struct HostRingbuffer* RingbufHandle_t;
+
+RingbufHandle_t xRingbufferCreate(size_t length, ringbuf_type_t type);
+BaseType_t      xRingbufferSend(RingbufHandle_t ringbuf, const void* data, size_t length, TickType_t ticks);
+void*           xRingbufferReceive(RingbufHandle_t ringbuf, size_t* pLength, TickType_t ticks);
+void            vRingbufferReturnItem(RingbufHandle_t ringbuf, void* item);
+void            vRingbufferDelete(RingbufHandle_t ringbuf);
+
+#endif /* HOST_TEST_STUBS_FREERTOS_RINGBUF_H_ */
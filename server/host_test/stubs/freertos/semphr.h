@@ -0,0 +1,25 @@
+/*
+ * semphr.h
+ *
+ * Host stand-in for the FreeRTOS semaphores and mutexes.
+ */
+
+#ifndef HOST_TEST_STUBS_FREERTOS_SEMPHR_H_
+#define HOST_TEST_STUBS_FREERTOS_SEMPHR_H_
+#include "FreeRTOS.h"
+
+typedef struct HostSemaphore* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex();
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t        xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* pHigherPriorityTaskWoken);
+BaseType_t        xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t        xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore);
+UBaseType_t       uxSemaphoreGetCount(SemaphoreHandle_t semaphore);
+void              vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif /* HOST_TEST_STUBS_FREERTOS_SEMPHR_H_ */
@@ -0,0 +1,25 @@
+/*
+ * task.h
+ *
+ * Host stand-in for the FreeRTOS tasks.  A task is a thread.  Deleting another task cancels its thread
+ * at its next blocking call, which is where the code under test deletes its tasks from.
+ */
+
+#ifndef HOST_TEST_STUBS_FREERTOS_TASK_H_
+#define HOST_TEST_STUBS_FREERTOS_TASK_H_
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef TaskHandle_t     xTaskHandle;
+
+BaseType_t   xTaskCreate(TaskFunction_t code, const char* name, uint32_t stackDepth, void* param, UBaseType_t priority, TaskHandle_t* pHandle);
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t code, const char* name, uint32_t stackDepth, void* param, UBaseType_t priority, TaskHandle_t* pHandle, BaseType_t core);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+TickType_t   xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+char*        pcTaskGetTaskName(TaskHandle_t task);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+uint32_t     ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks);
+
+#endif /* HOST_TEST_STUBS_FREERTOS_TASK_H_ */
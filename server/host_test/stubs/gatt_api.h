@@ -0,0 +1,10 @@
+/*
+ * gatt_api.h
+ *
+ * Host stand-in for the internal GATT header of the ESP-IDF Bluetooth stack.  Nothing from it is used.
+ */
+
+#ifndef HOST_TEST_STUBS_GATT_API_H_
+#define HOST_TEST_STUBS_GATT_API_H_
+
+#endif /* HOST_TEST_STUBS_GATT_API_H_ */
@@ -0,0 +1,13 @@
+/*
+ * nvs_flash.h
+ *
+ * Host stand-in for the ESP-IDF non volatile storage start up.
+ */
+
+#ifndef HOST_TEST_STUBS_NVS_FLASH_H_
+#define HOST_TEST_STUBS_NVS_FLASH_H_
+#include "nvs.h"
+
+esp_err_t nvs_flash_init();
+
+#endif /* HOST_TEST_STUBS_NVS_FLASH_H_ */
@@ -0,0 +1,16 @@
+/*
+ * sdkconfig.h
+ *
+ * Host stand-in for the project configuration.
+ */
+
+#ifndef HOST_TEST_STUBS_SDKCONFIG_H_
+#define HOST_TEST_STUBS_SDKCONFIG_H_
+
+#define CONFIG_BT_ENABLED 1
+#define CONFIG_GATTC_ENABLE 1
+#define CONFIG_GATTS_ENABLE 1
+#define CONFIG_CXX_EXCEPTIONS 1
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+
+#endif /* HOST_TEST_STUBS_SDKCONFIG_H_ */
@@ -0,0 +1,142 @@
+/*
+ * test_ble_event_trace.cpp
+ *
+ * Records the events of a write and a notification between a client and a server on the fake Bluetooth
+ * stack, then stops the stack and replays the recording through the same classes, checking that the
+ * server sees the write and the client the notification again.  Also swaps traces in and out while events
+ * are being recorded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <esp_bt_main.h>
+#include "BLE2902.h"
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLEEventTrace.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+#define SWAPS 200
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLECharacteristic*       pCharacteristic       = nullptr;
+static BLERemoteCharacteristic* pRemoteCharacteristic = nullptr;
+static int                      writes = 0;
+static std::string              notified;
+
+
+class WriteCounter: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic* pCharacteristic) {
+		writes++;
+	}
+};
+
+
+static void notifyCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	notified.assign((const char*)pData, length);
+}
+
+
+// Serve a writable, notifying characteristic and subscribe a client to it.
+static bool connect() {
+	BLEDevice::init("host");
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID),
+		BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_NOTIFY);
+	pCharacteristic->setCallbacks(new WriteCounter());
+	pCharacteristic->addDescriptor(new BLE2902());
+	pService->start();
+
+	BLEClient* pClient = BLEDevice::createClient();
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	pRemoteCharacteristic = pRemoteService == nullptr ? nullptr : pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	if (pRemoteCharacteristic == nullptr) {
+		return false;
+	}
+	pRemoteCharacteristic->registerForNotify(notifyCallback);
+	uint8_t enable[] = { 0x01, 0x00 };
+	pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902))->writeValue(enable, sizeof(enable), true);
+	FakeBluedroid::waitIdle();
+	return true;
+}
+
+
+// Traces can be set, cleared and deleted while the stack's task is recording into them.
+static void test_swap() {
+	for (int i = 0; i < SWAPS; i++) {
+		BLEEventTrace* pTrace = new BLEEventTrace(1024);
+		BLEDevice::setEventTrace(pTrace);
+		pCharacteristic->setValue("swap");
+		pCharacteristic->notifyAsync();
+		BLEDevice::setEventTrace(nullptr);
+		delete pTrace;
+	}
+	FakeBluedroid::waitIdle();
+	CHECK(notified == "swap");
+}
+
+
+// A recorded write and notification replayed through the classes reach the server and the client again.
+static void test_replay() {
+	BLEEventTrace trace(16 * 1024);
+	BLEDevice::setEventTrace(&trace);
+	pRemoteCharacteristic->writeValue("hello", true);
+	pCharacteristic->setValue("n1");
+	pCharacteristic->notify();
+	FakeBluedroid::waitIdle();
+	BLEDevice::setEventTrace(nullptr);
+
+	std::string recording = trace.dump();
+	CHECK(trace.getRecorded() > 0 && trace.getLost() == 0);
+	CHECK(writes == 1 && pCharacteristic->getValue() == "n1" && notified == "n1");
+
+	// The stack is still live, so the replay is refused and nothing is handed on.
+	notified.clear();
+	CHECK(!BLEEventTrace::replay(recording, 0));
+	CHECK(writes == 1 && notified.empty());
+
+	// The trace is put aside during the replay, so the replay is not recorded into it.
+	CHECK(::esp_bluedroid_disable() == ESP_OK);
+	pCharacteristic->setValue("reset");
+	uint32_t recorded = trace.getRecorded();
+	BLEDevice::setEventTrace(&trace);
+	CHECK(BLEEventTrace::replay(recording, 0));
+	BLEDevice::setEventTrace(nullptr);
+	CHECK(writes == 2);
+	CHECK(pCharacteristic->getValue() == "hello");
+	CHECK(notified == "n1");
+	CHECK(trace.getRecorded() == recorded);
+
+	CHECK(!BLEEventTrace::replay(recording.substr(0, recording.size() - 1), 0));
+	CHECK(!BLEEventTrace::replay("BLET", 0));
+}
+
+
+int main() {
+	if (connect()) {
+		test_swap();
+		test_replay();
+	}
+	printf("test_ble_event_trace: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
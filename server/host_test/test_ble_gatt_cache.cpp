@@ -0,0 +1,168 @@
+/*
+ * test_ble_gatt_cache.cpp
+ *
+ * Connects a client with a BLEGattCache to a server on the fake Bluetooth stack, which has no Database
+ * Hash, and checks that the record kept without a hash is used on reconnection but is dropped, and the
+ * server discovered again, once it is caught out by a service it lacks or a handle the server rejects.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <nvs.h>
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLEGattCache.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define LATE_SERVICE_UUID   "6d124ed1-50f5-4ebf-b490-c3db81cbaa8c"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLEServer*   pServer = nullptr;
+static BLEClient*   pClient = nullptr;
+static BLEGattCache gattCache;
+
+
+// The NVS key of the record of our own server.
+static std::string recordKey() {
+	uint8_t* pAddress = *BLEDevice::getAddress().getNative();
+	char key[ESP_BD_ADDR_LEN * 2 + 1];
+	for (int i = 0; i < ESP_BD_ADDR_LEN; i++) {
+		snprintf(&key[i * 2], 3, "%02x", pAddress[i]);
+	}
+	return std::string(key);
+}
+
+
+static std::string getRecord() {
+	nvs_handle handle;
+	nvs_open("blegattc", NVS_READWRITE, &handle);
+	size_t length = 0;
+	std::string record;
+	if (nvs_get_blob(handle, recordKey().c_str(), nullptr, &length) == ESP_OK) {
+		record.resize(length);
+		nvs_get_blob(handle, recordKey().c_str(), &record[0], &length);
+	}
+	nvs_close(handle);
+	return record;
+}
+
+
+static void setRecord(const std::string& record) {
+	nvs_handle handle;
+	nvs_open("blegattc", NVS_READWRITE, &handle);
+	nvs_set_blob(handle, recordKey().c_str(), record.data(), record.length());
+	nvs_commit(handle);
+	nvs_close(handle);
+}
+
+
+// Connect afresh and read the characteristic, returning the number of searches the client asked for.
+static uint32_t reconnectAndRead(std::string* pValue) {
+	uint32_t searches = FakeBluedroid::getStats().searches;
+	if (pClient->isConnected()) {
+		pClient->disconnect();
+		FakeBluedroid::waitIdle();
+	}
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	BLERemoteCharacteristic* pRemoteCharacteristic = pClient->getService(BLEUUID(SERVICE_UUID))->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	*pValue = pRemoteCharacteristic->readValue();
+	FakeBluedroid::waitIdle();
+	return FakeBluedroid::getStats().searches - searches;
+}
+
+
+static void startServer() {
+	BLEDevice::init("host");
+	pServer = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	BLECharacteristic* pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID), BLECharacteristic::PROPERTY_READ);
+	pCharacteristic->setValue("cached");
+	pService->start();
+
+	gattCache.eraseAll();
+	pClient = BLEDevice::createClient();
+	pClient->setGattCache(&gattCache);
+}
+
+
+// The first connection discovers and records the server, and the next is served from the record.
+static void test_record_used() {
+	std::string value;
+	CHECK(reconnectAndRead(&value) == 1);
+	CHECK(value == "cached");
+	CHECK(!getRecord().empty());
+	CHECK(reconnectAndRead(&value) == 0);
+	CHECK(value == "cached");
+}
+
+
+// A handle from the record that the server rejects drops the record, and the next lookup discovers again.
+static void test_stale_handle() {
+	std::string record = getRecord();
+	const uint8_t* pUUID = BLEUUID(CHARACTERISTIC_UUID).getNative()->uuid.uuid128;
+	size_t offset = record.find(std::string((const char*)pUUID, 16));
+	CHECK(offset != std::string::npos);
+	if (offset == std::string::npos) {
+		return;
+	}
+	record[offset + 16] = (char)0xff;   // The characteristic's handle, least significant byte first.
+	record[offset + 17] = (char)0x0f;
+	setRecord(record);
+
+	std::string value;
+	CHECK(reconnectAndRead(&value) == 0);
+	CHECK(value.empty());
+	CHECK(getRecord().empty());
+
+	BLERemoteCharacteristic* pRemoteCharacteristic = pClient->getService(BLEUUID(SERVICE_UUID))->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic->readValue() == "cached");
+	CHECK(!getRecord().empty());
+}
+
+
+// A service added to the server since it was recorded is found by discovering the server again.
+static void test_missing_service() {
+	std::string value;
+	CHECK(reconnectAndRead(&value) == 0);
+	BLEService* pService = pServer->createService(BLEUUID(LATE_SERVICE_UUID));
+	pService->start();
+	FakeBluedroid::waitIdle();
+
+	uint32_t searches = FakeBluedroid::getStats().searches;
+	BLERemoteService* pRemoteService = nullptr;
+	try {
+		pRemoteService = pClient->getService(BLEUUID(LATE_SERVICE_UUID));
+	} catch (BLEUuidNotFoundException* pException) {
+		delete pException;
+	}
+	CHECK(pRemoteService != nullptr);
+	CHECK(FakeBluedroid::getStats().searches - searches == 1);
+	CHECK(reconnectAndRead(&value) == 0);
+	CHECK(value == "cached");
+}
+
+
+int main() {
+	startServer();
+	test_record_used();
+	test_stale_handle();
+	test_missing_service();
+	printf("test_ble_gatt_cache: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,226 @@
+/*
+ * test_ble_link.cpp
+ *
+ * Connects a BLEClient to a BLEServer in the same process through the fake Bluetooth stack and runs a
+ * characteristic through discovery, short and long writes and reads, writes with and without response
+ * mixed, notifications and a lost link, and then lets the link be lost again with reconnection on.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "BLE2902.h"
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLEFuture.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "BLEScan.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLEServer*         pServer         = nullptr;
+static BLECharacteristic* pCharacteristic = nullptr;
+static int                writes          = 0;
+static std::string        notified;
+static int                notifications   = 0;
+static int                connects        = 0;   // Calls to onConnect() that found the client connected.
+
+
+class WriteCounter: public BLECharacteristicCallbacks {
+	void onWrite(BLECharacteristic* pCharacteristic) {
+		writes++;
+	}
+};
+
+
+class ConnectCounter: public BLEClientCallbacks {
+	void onConnect(BLEClient* pClient) {
+		if (pClient->isConnected()) {
+			connects++;
+		}
+	}
+
+	void onDisconnect(BLEClient* pClient) {
+	}
+};
+
+
+static void notifyCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	notified.assign((const char*)pData, length);
+	notifications++;
+}
+
+
+static void startServer() {
+	BLEDevice::init("host");
+	BLEDevice::setMTU(185);
+	pServer = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pCharacteristic = pService->createCharacteristic(
+		BLEUUID(CHARACTERISTIC_UUID),
+		BLECharacteristic::PROPERTY_READ   | BLECharacteristic::PROPERTY_WRITE |
+		BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_WRITE_NR
+	);
+	pCharacteristic->setCallbacks(new WriteCounter());
+	pCharacteristic->addDescriptor(new BLE2902());
+	pCharacteristic->setValue("Hello World");
+	pService->start();
+}
+
+
+// The client finds the server's service and characteristic and the MTU is the smaller of the two ends'.
+// The client's callbacks are told of the connection once it can be used.
+static BLERemoteCharacteristic* test_connect(BLEClient* pClient) {
+	FakeBluedroid::setPeerMTU(247);
+	pClient->setClientCallbacks(new ConnectCounter());
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	CHECK(pClient->isConnected());
+	CHECK(connects == 1);
+	CHECK(pClient->getMTU() == 185);
+	CHECK(pServer->getConnectedCount() == 1);
+
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	CHECK(pRemoteService != nullptr);
+	BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	CHECK(pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902)) != nullptr);
+	return pRemoteCharacteristic;
+}
+
+
+// Values longer than a packet are written with prepared writes and read back in chunks.
+static void test_read_write(BLERemoteCharacteristic* pRemoteCharacteristic) {
+	CHECK(pRemoteCharacteristic->readValue() == "Hello World");
+
+	pRemoteCharacteristic->writeValue("short", true);
+	CHECK(pCharacteristic->getValue() == "short");
+	CHECK(writes == 1);
+
+	std::string longValue;
+	for (int i = 0; i < 400; i++) {
+		longValue += (char)('a' + i % 26);
+	}
+	pRemoteCharacteristic->writeValue(longValue, true);
+	CHECK(pCharacteristic->getValue() == longValue);
+	CHECK(writes == 2);
+	CHECK(pRemoteCharacteristic->readValue() == longValue);
+
+	CHECK(pRemoteCharacteristic->writeNoResponse("fast"));
+	FakeBluedroid::waitIdle();
+	CHECK(pCharacteristic->getValue() == "fast");
+}
+
+
+// A write with response queued behind writes without response completes only once the server has it.
+static void test_mixed_writes(BLERemoteCharacteristic* pRemoteCharacteristic) {
+	for (int i = 0; i < 3; i++) {
+		CHECK(pRemoteCharacteristic->writeNoResponse("quick"));
+	}
+	BLEFuture future;
+	CHECK(pRemoteCharacteristic->writeValueAsync("queued", &future));
+	CHECK(pRemoteCharacteristic->writeNoResponse("after"));
+	CHECK(future.wait(1000));
+	CHECK(future.getStatus() == ESP_GATT_OK);
+	CHECK(pCharacteristic->getValue() == "queued");
+	FakeBluedroid::waitIdle();
+	CHECK(pCharacteristic->getValue() == "after");
+	CHECK(pRemoteCharacteristic->flush(1000));
+}
+
+
+// Notifications reach a client once it has registered for them and enabled them in the 0x2902 descriptor.
+static void test_notify(BLERemoteCharacteristic* pRemoteCharacteristic) {
+	pCharacteristic->setValue("unheard");
+	pCharacteristic->notify();
+	FakeBluedroid::waitIdle();
+	CHECK(notifications == 0);
+
+	pRemoteCharacteristic->registerForNotify(notifyCallback);
+	uint8_t enable[] = { 0x01, 0x00 };
+	pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902))->writeValue(enable, sizeof(enable), true);
+	FakeBluedroid::waitIdle();
+
+	pCharacteristic->setValue("heard");
+	pCharacteristic->notify();
+	FakeBluedroid::waitIdle();
+	CHECK(notifications == 1);
+	CHECK(notified == "heard");
+}
+
+
+// Both ends see a lost link.
+static void test_link_lost(BLEClient* pClient) {
+	FakeBluedroid::dropLink(0);   // The only connection.
+	FakeBluedroid::waitIdle();
+	CHECK(!pClient->isConnected());
+	CHECK(pServer->getConnectedCount() == 0);
+}
+
+
+// While the client scans for a server it has lost, the application's scan filter is left alone, and a
+// disconnect asked for during the scan stops the client opening a connection once the server is heard.
+static void test_reconnect_scan(BLEClient* pClient) {
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	pClient->setAutoReconnect(true);
+	FakeBluedroid::setConnectTimeout(20000);
+	FakeBluedroid::setPeerPresent(false);
+	uint8_t flags[] = { 0x02, 0x01, 0x06 };
+	FakeBluedroid::addAdvertisement(*BLEDevice::getAddress().getNative(), flags, sizeof(flags), -50);
+	FakeBluedroid::dropLink(0);
+
+	// The direct attempts fail and the client scans for the server, which it hears.
+	BLEScan* pScan = BLEDevice::getScan();
+	for (int i = 0; i < 500 && pScan->getResults().getCount() == 0; i++) {
+		::vTaskDelay(pdMS_TO_TICKS(10));
+	}
+	CHECK(pClient->getConnectionStats().scans == 1);
+	CHECK(pScan->getResults().getCount() == 1);
+
+	BLEScanFilter filter;
+	filter.addManufacturerId(0x02e5);
+	pScan->setFilter(filter);
+	uint32_t opens = FakeBluedroid::getStats().opens;
+	pClient->disconnect();
+	pScan->stop();
+	::vTaskDelay(pdMS_TO_TICKS(100));
+	FakeBluedroid::waitIdle();
+
+	CHECK(FakeBluedroid::getStats().opens == opens);
+	CHECK(!pClient->isConnected());
+	filter = pScan->getFilter();
+	CHECK(!filter.isEmpty() && filter.getAddresses().empty());
+	FakeBluedroid::setPeerPresent(true);
+}
+
+
+int main() {
+	startServer();
+	BLEClient* pClient = BLEDevice::createClient();
+	BLERemoteCharacteristic* pRemoteCharacteristic = test_connect(pClient);
+	if (pRemoteCharacteristic != nullptr) {
+		test_read_write(pRemoteCharacteristic);
+		test_mixed_writes(pRemoteCharacteristic);
+		test_notify(pRemoteCharacteristic);
+	}
+	test_link_lost(pClient);
+	test_reconnect_scan(pClient);
+	FakeBluedroid::waitIdle();
+	printf("test_ble_link: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * test_ble_mtu.cpp
+ *
+ * Connects two clients to one server through the fake Bluetooth stack, one whose end allows an MTU of 23
+ * and one that allows 247, and checks that each connection's reads and notifications are sized by its own
+ * MTU and not by the other's.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "BLE2902.h"
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+#define SMALL_MTU 23
+#define LARGE_MTU 247
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLECharacteristic* pCharacteristic = nullptr;
+static std::string        value;            // As long as the larger MTU lets a notification be.
+static std::string        smallNotified;
+static std::string        largeNotified;
+
+
+static void smallCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	smallNotified.assign((const char*)pData, length);
+}
+
+
+static void largeCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	largeNotified.assign((const char*)pData, length);
+}
+
+
+static void startServer() {
+	BLEDevice::init("host");
+	BLEDevice::setMTU(LARGE_MTU);
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID),
+		BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY);
+	pCharacteristic->addDescriptor(new BLE2902());
+	for (int i = 0; i < LARGE_MTU - 3; i++) {
+		value += (char)('a' + i % 26);
+	}
+	pCharacteristic->setValue(value);
+	pService->start();
+}
+
+
+// Connect a client whose end allows at most peerMTU, and subscribe it to the characteristic.
+static BLERemoteCharacteristic* connect(uint16_t peerMTU,
+	void (*callback)(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify)) {
+	FakeBluedroid::setPeerMTU(peerMTU);
+	BLEClient* pClient = BLEDevice::createClient();
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	CHECK(pClient->getMTU() == peerMTU);
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService == nullptr ? nullptr :
+		pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	if (pRemoteCharacteristic == nullptr) {
+		return nullptr;
+	}
+	pRemoteCharacteristic->registerForNotify(callback);
+	uint8_t enable[] = { 0x01, 0x00 };
+	pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902))->writeValue(enable, sizeof(enable), true);
+	FakeBluedroid::waitIdle();
+	return pRemoteCharacteristic;
+}
+
+
+// Both clients read the whole value, the small one in many chunks and the large one in one.  The stack cuts
+// a chunk down to the connection's MTU, so chunks sized by the wrong MTU would leave gaps in the value.
+static void test_read(BLERemoteCharacteristic* pSmall, BLERemoteCharacteristic* pLarge) {
+	CHECK(pSmall->readValue() == value);
+	CHECK(pLarge->readValue() == value);
+	CHECK(pSmall->readValue() == value);
+}
+
+
+// Each client is notified with as much of the value as its own MTU carries, by either kind of notify.
+static void test_notify() {
+	pCharacteristic->notify();
+	FakeBluedroid::waitIdle();
+	CHECK(smallNotified == value.substr(0, SMALL_MTU - 3));
+	CHECK(largeNotified == value);
+
+	smallNotified.clear();
+	largeNotified.clear();
+	CHECK(pCharacteristic->notifyAll() == 2);
+	FakeBluedroid::waitIdle();
+	CHECK(smallNotified == value.substr(0, SMALL_MTU - 3));
+	CHECK(largeNotified == value);
+}
+
+
+int main() {
+	startServer();
+	BLERemoteCharacteristic* pSmall = connect(SMALL_MTU, smallCallback);
+	BLERemoteCharacteristic* pLarge = connect(LARGE_MTU, largeCallback);
+	if (pSmall != nullptr && pLarge != nullptr) {
+		test_read(pSmall, pLarge);
+		test_notify();
+	}
+	FakeBluedroid::waitIdle();
+	printf("test_ble_mtu: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
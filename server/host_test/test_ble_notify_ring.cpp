@@ -0,0 +1,222 @@
+/*
+ * test_ble_notify_ring.cpp
+ *
+ * Sends 100000 notifications from a server to a client whose notifications go through a BLENotifyRing, and
+ * checks that every one is either delivered, in the order sent, or counted as dropped.  Then keeps sending
+ * while the client throws its characteristics away and finds them again, so that notifications arrive for
+ * characteristics being deleted.  Last, changes the value while it is being notified and checks that every
+ * value arrives whole.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include "BLE2902.h"
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLENotifyRing.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteDescriptor.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "FakeBluedroid.h"
+
+#define SERVICE_UUID        "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define CHARACTERISTIC_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+
+#define NOTIFICATIONS 100000
+#define REDISCOVERIES 50
+#define WHOLE_VALUES  20000
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+
+static BLENotifyRing         notifyRing(64, 20);
+static BLECharacteristic*    pCharacteristic = nullptr;
+static BLEClient*            pClient         = nullptr;
+static std::atomic<uint32_t> received(0);
+static std::atomic<uint32_t> outOfOrder(0);
+static std::atomic<uint32_t> strangers(0);    // Notifications handed a characteristic that is not ours.
+static uint32_t              lastReceived = 0;   // Only the ring's task uses it.
+static SemaphoreHandle_t     sendDone;
+static std::atomic<uint32_t> torn(0);         // Values that arrived part old and part new.
+static std::atomic<bool>     changing(false);
+
+
+static void notifyCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	uint32_t value = 0;
+	memcpy(&value, pData, length < sizeof(value) ? length : sizeof(value));
+	if (value <= lastReceived) {
+		outOfOrder++;
+	}
+	lastReceived = value;
+	if (!pRemoteCharacteristic->getUUID().equals(BLEUUID(CHARACTERISTIC_UUID))) {
+		strangers++;
+	}
+	received++;
+}
+
+
+// Each value is all 'a's, 20 of them, or all 'b's, 10 of them.
+static void wholeCallback(BLERemoteCharacteristic* pRemoteCharacteristic, uint8_t* pData, size_t length, bool isNotify) {
+	bool whole = length == (pData[0] == 'a' ? 20u : 10u);
+	for (size_t i = 1; i < length; i++) {
+		whole = whole && pData[i] == pData[0];
+	}
+	if (!whole) {
+		torn++;
+	}
+}
+
+
+static uint64_t nowUs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+// Find the characteristic again and have its notifications passed to us.
+static BLERemoteCharacteristic* subscribe() {
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	BLERemoteCharacteristic* pRemoteCharacteristic = pRemoteService == nullptr ? nullptr :
+		pRemoteService->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	CHECK(pRemoteCharacteristic != nullptr);
+	if (pRemoteCharacteristic != nullptr) {
+		pRemoteCharacteristic->registerForNotify(notifyCallback);
+	}
+	return pRemoteCharacteristic;
+}
+
+
+// Serve a notifying characteristic and subscribe a client to it through the ring.
+static bool connect() {
+	BLEDevice::init("host");
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pCharacteristic = pService->createCharacteristic(BLEUUID(CHARACTERISTIC_UUID), BLECharacteristic::PROPERTY_NOTIFY);
+	pCharacteristic->addDescriptor(new BLE2902());
+	pService->start();
+
+	pClient = BLEDevice::createClient();
+	pClient->setNotifyRing(&notifyRing);
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	BLERemoteCharacteristic* pRemoteCharacteristic = subscribe();
+	if (pRemoteCharacteristic == nullptr) {
+		return false;
+	}
+	uint8_t enable[] = { 0x01, 0x00 };
+	pRemoteCharacteristic->getDescriptor(BLEUUID((uint16_t)0x2902))->writeValue(enable, sizeof(enable), true);
+	FakeBluedroid::waitIdle();
+	return true;
+}
+
+
+// Send count numbered notifications, continuing from first.
+static void send(uint32_t first, uint32_t count) {
+	for (uint32_t i = first; i < first + count; i++) {
+		pCharacteristic->setValue((uint8_t*)&i, sizeof(i));
+		CHECK(pCharacteristic->notifyAsync());
+	}
+	FakeBluedroid::waitIdle();
+	notifyRing.waitIdle();
+}
+
+
+static void sendTask(void* pArg) {
+	send(NOTIFICATIONS + 1, NOTIFICATIONS / 10);
+	::xSemaphoreGive(sendDone);
+	::vTaskDelete(nullptr);
+}
+
+
+static void changeTask(void* pArg) {
+	std::string a(20, 'a');
+	std::string b(10, 'b');
+	while (changing) {
+		pCharacteristic->setValue(a);
+		pCharacteristic->setValue(b);
+	}
+	::xSemaphoreGive(sendDone);
+	::vTaskDelete(nullptr);
+}
+
+
+// Every notification is delivered in order or counted as dropped, and the ring's count of those delivered
+// agrees with the callback's.
+static void test_stress() {
+	uint64_t startUs = nowUs();
+	send(1, NOTIFICATIONS);
+	uint64_t elapsedUs = nowUs() - startUs;
+
+	printf("%u notifications in %.2f s: %u delivered, %u dropped, ring full %u times\n", NOTIFICATIONS,
+		elapsedUs / 1e6, notifyRing.getDelivered(), notifyRing.getDropped(), notifyRing.getFull());
+	CHECK(received == notifyRing.getDelivered());
+	CHECK(notifyRing.getDelivered() + notifyRing.getDropped() == NOTIFICATIONS);
+	CHECK(received > 0);
+	CHECK(outOfOrder == 0);
+	CHECK(strangers == 0);
+}
+
+
+// Characteristics deleted while notifications for them are arriving are never handed to a callback
+// afterwards.
+static void test_rediscovery() {
+	uint32_t deliveredBefore = notifyRing.getDelivered();
+	uint32_t droppedBefore   = notifyRing.getDropped();
+	sendDone = ::xSemaphoreCreateBinary();
+	::xTaskCreate(sendTask, "send", 8192, nullptr, 5, nullptr);
+	for (int i = 0; i < REDISCOVERIES; i++) {
+		subscribe();
+	}
+	::xSemaphoreTake(sendDone, portMAX_DELAY);
+	notifyRing.waitIdle();
+
+	// Those that arrive while the characteristic is not yet found again, or found but not yet registered for,
+	// reach neither the ring nor the callback.
+	CHECK(notifyRing.getDelivered() - deliveredBefore + notifyRing.getDropped() - droppedBefore <= NOTIFICATIONS / 10);
+	CHECK(received <= notifyRing.getDelivered());
+	CHECK(outOfOrder == 0);
+	CHECK(strangers == 0);
+}
+
+
+// A value changed by another task while it is being notified is copied whole, never part old and part new.
+static void test_whole_values() {
+	BLERemoteCharacteristic* pRemoteCharacteristic = pClient->getService(BLEUUID(SERVICE_UUID))->getCharacteristic(BLEUUID(CHARACTERISTIC_UUID));
+	pRemoteCharacteristic->registerForNotify(wholeCallback);
+	pCharacteristic->setValue(std::string(20, 'a'));
+	uint32_t deliveredBefore = notifyRing.getDelivered();
+	changing = true;
+	::xTaskCreate(changeTask, "change", 8192, nullptr, 5, nullptr);
+	for (int i = 0; i < WHOLE_VALUES; i++) {
+		pCharacteristic->notifyAsync();
+	}
+	changing = false;
+	::xSemaphoreTake(sendDone, portMAX_DELAY);
+	FakeBluedroid::waitIdle();
+	notifyRing.waitIdle();
+
+	CHECK(notifyRing.getDelivered() > deliveredBefore);
+	CHECK(torn == 0);
+}
+
+
+int main() {
+	if (connect()) {
+		test_stress();
+		test_rediscovery();
+		test_whole_values();
+	}
+	printf("test_ble_notify_ring: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
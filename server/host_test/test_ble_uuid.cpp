@@ -0,0 +1,145 @@
+/*
+ * test_ble_uuid.cpp
+ *
+ * Checks that a UUID given in its 16, 32 or 128 bit form compares, orders and hashes the same whichever
+ * form it came in, that malformed text gives the null UUID, and times comparisons and lookups of each form.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "BLEUUID.h"
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+#define HEART_RATE "0000180d-0000-1000-8000-00805f9b34fb"
+#define LOOKUPS    1000000
+
+// Parsed by the compiler.
+static constexpr BLEUUID s_literal(HEART_RATE);
+static constexpr BLEUUID s_badDigit("0000180d-0000-1000-8000-00805f9b34fg");
+static constexpr BLEUUID s_badDash("0000180d-0000-1000-8000_00805f9b34fb");
+
+
+static uint64_t nowNs() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+// The same UUID in each form is equal to itself in the others, but keeps the size it was given in.
+static void test_forms_equal() {
+	BLEUUID short16((uint16_t)0x180d);
+	BLEUUID short32((uint32_t)0x180d);
+	BLEUUID literal = s_literal;
+	BLEUUID parsed(std::string(HEART_RATE));
+	CHECK(short16 == short32 && short16 == literal && short16 == parsed);
+	CHECK(short16.equals(short32) && short32.equals(literal) && literal.equals(parsed));
+	CHECK(short16.hash() == literal.hash());
+	CHECK(short16.bitSize() == 16 && short32.bitSize() == 32 && literal.bitSize() == 128);
+	CHECK(short16 != BLEUUID((uint16_t)0x180f));
+	CHECK(!short16.equals(BLEUUID((uint16_t)0x180f)));
+	CHECK(BLEUUID::fromString("180d") == literal);
+	CHECK(BLEUUID::fromString("0x0000180d") == literal);
+	CHECK(BLEUUID::fromString("0x" HEART_RATE) == literal);
+}
+
+
+// Text that is not a UUID gives the null UUID rather than a UUID made of whatever the junk mapped to.
+static void test_malformed() {
+	BLEUUID badDigit = s_badDigit;
+	BLEUUID badDash  = s_badDash;
+	CHECK(badDigit.bitSize() == 0 && badDash.bitSize() == 0);
+	CHECK(BLEUUID(std::string("0000180d-0000-1000-8000-00805f9b34f!")).bitSize() == 0);
+	CHECK(BLEUUID(std::string("0000180d00000-1000-8000-00805f9b34fb")).bitSize() == 0);
+	CHECK(BLEUUID::fromString("18zd").bitSize() == 0);
+	CHECK(BLEUUID::fromString("0x180d2").bitSize() == 0);
+	CHECK(BLEUUID::fromString("180d0x").bitSize() == 0);
+	CHECK(BLEUUID::fromString(std::string(260, '1')).bitSize() == 0);
+	CHECK(BLEUUID::fromString(HEART_RATE "-").bitSize() == 0);
+}
+
+
+// Two null UUIDs are equal by equals() as by operator==, and a null UUID equals no other.
+static void test_null() {
+	BLEUUID null1;
+	BLEUUID null2("0000180d-0000-1000-8000-00805f9b34fx");
+	CHECK(null1 == null2);
+	CHECK(null1.equals(null2));
+	CHECK(null1 != BLEUUID((uint16_t)0x180d));
+	CHECK(!null1.equals(BLEUUID((uint16_t)0x180d)));
+}
+
+
+// The i'th of a set of UUIDs of one form.
+static BLEUUID makeUUID(int form, uint8_t i) {
+	if (form == 0) {
+		return BLEUUID((uint16_t)(0x2a00 + i));
+	}
+	if (form == 1) {
+		return BLEUUID((uint32_t)(0x12342a00 + i));
+	}
+	uint8_t bytes[16] = { 0xbe, 0xb5, 0x48, 0x3e, 0x36, 0xe1, 0x46, 0x88, 0xb7, 0xf5, 0xea, 0x07, 0x36, 0x1b, 0x26, i };
+	return BLEUUID(bytes, sizeof(bytes), true);
+}
+
+
+// Time equals() and lookups keyed by each form, among 64 UUIDs of that form.
+static void test_lookup_timing() {
+	const char* names[] = { "16 bit", "32 bit", "128 bit" };
+	for (int form = 0; form < 3; form++) {
+		std::vector<BLEUUID>             uuids;
+		std::map<BLEUUID, int>           ordered;
+		std::unordered_map<BLEUUID, int> hashed;
+		for (int i = 0; i < 64; i++) {
+			uuids.push_back(makeUUID(form, i));
+			ordered[uuids[i]] = i;
+			hashed[uuids[i]]  = i;
+		}
+		CHECK(ordered.size() == 64 && hashed.size() == 64);
+
+		int equal = 0;
+		uint64_t startNs = nowNs();
+		for (int i = 0; i < LOOKUPS; i++) {
+			equal += uuids[i & 63].equals(uuids[(i * 7) & 63]);   // Equal when i is a multiple of 32.
+		}
+		uint64_t equalsNs = nowNs() - startNs;
+
+		int found = 0;
+		startNs = nowNs();
+		for (int i = 0; i < LOOKUPS; i++) {
+			found += ordered.find(uuids[i & 63])->second == (i & 63);
+		}
+		uint64_t orderedNs = nowNs() - startNs;
+		startNs = nowNs();
+		for (int i = 0; i < LOOKUPS; i++) {
+			found += hashed.find(uuids[i & 63])->second == (i & 63);
+		}
+		uint64_t hashedNs = nowNs() - startNs;
+
+		CHECK(equal == (LOOKUPS + 31) / 32);
+		CHECK(found == 2 * LOOKUPS);
+		printf("%-7s equals %5.1f ns, map find %5.1f ns, unordered_map find %5.1f ns\n", names[form],
+			(double)equalsNs / LOOKUPS, (double)orderedNs / LOOKUPS, (double)hashedNs / LOOKUPS);
+	}
+}
+
+
+int main() {
+	test_forms_equal();
+	test_malformed();
+	test_null();
+	test_lookup_timing();
+	printf("test_ble_uuid: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,184 @@
+/*
+ * test_ble_value.cpp
+ *
+ * Writes a 512 byte value to a characteristic with prepared writes and an execute write and reads it back
+ * with a long read, all at the default MTU of 23, through the fake Bluetooth stack so that it is
+ * BLECharacteristic's own handlers that serve the requests.  The heap allocations made while the server
+ * handles those events are counted.  The prepared write is built up in the connection's buffer, each read
+ * chunk is copied straight from the value and the long read's progress is kept in a slot of the
+ * connection, so there should be none.  The allocations per short write are also counted at INFO and DEBUG,
+ * which shows what the log level guards save.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include "BLEClient.h"
+#include "BLEDevice.h"
+#include "BLERemoteCharacteristic.h"
+#include "BLERemoteService.h"
+#include "BLEServer.h"
+#include "BLEValue.h"
+#include "FakeBluedroid.h"
+#include "GeneralUtils.h"
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void  __libc_free(void* ptr);
+
+// Only the allocations made while the server handles an event count, not those of the fake or the client.
+static int allocations = 0;
+
+extern "C" void* malloc(size_t size) {
+	if (FakeBluedroid::inServerCallback()) allocations++;
+	return __libc_malloc(size);
+}
+extern "C" void* realloc(void* ptr, size_t size) {
+	if (FakeBluedroid::inServerCallback()) allocations++;
+	return __libc_realloc(ptr, size);
+}
+extern "C" void* calloc(size_t count, size_t size) {
+	if (FakeBluedroid::inServerCallback()) allocations++;
+	return __libc_calloc(count, size);
+}
+extern "C" void free(void* ptr) {
+	__libc_free(ptr);
+}
+void* operator new(size_t size) {
+	if (FakeBluedroid::inServerCallback()) allocations++;
+	return __libc_malloc(size);
+}
+void operator delete(void* ptr) noexcept {
+	__libc_free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+	__libc_free(ptr);
+}
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+#define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
+#define LONG_UUID    "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+#define SHORT_UUID   "beb5483e-36e1-4688-b7f5-ea07361b26a9"
+#define VALUE_LENGTH 512
+
+
+static BLECharacteristic*       pLong        = nullptr;
+static BLERemoteCharacteristic* pRemoteLong  = nullptr;
+static BLERemoteCharacteristic* pRemoteShort = nullptr;
+
+
+// Serve a long and a short characteristic and connect a client to them at the default MTU.
+static bool connect() {
+	BLEDevice::init("host");
+	BLEServer*  pServer  = BLEDevice::createServer();
+	BLEService* pService = pServer->createService(BLEUUID(SERVICE_UUID));
+	pLong = pService->createCharacteristic(BLEUUID(LONG_UUID),
+		BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_WRITE);
+	BLECharacteristic* pShort = pService->createCharacteristic(BLEUUID(SHORT_UUID), BLECharacteristic::PROPERTY_READ);
+	pShort->setValue("short");
+	pService->start();
+
+	BLEClient* pClient = BLEDevice::createClient();
+	CHECK(pClient->connect(BLEDevice::getAddress()));
+	FakeBluedroid::waitIdle();
+	CHECK(FakeBluedroid::getConnectionMTU(0) == 23);
+	BLERemoteService* pRemoteService = pClient->getService(BLEUUID(SERVICE_UUID));
+	CHECK(pRemoteService != nullptr);
+	if (pRemoteService == nullptr) {
+		return false;
+	}
+	pRemoteLong  = pRemoteService->getCharacteristic(BLEUUID(LONG_UUID));
+	pRemoteShort = pRemoteService->getCharacteristic(BLEUUID(SHORT_UUID));
+	CHECK(pRemoteLong != nullptr && pRemoteShort != nullptr);
+	return pRemoteLong != nullptr && pRemoteShort != nullptr;
+}
+
+
+// A prepared write, an execute and a long read of the result allocate nothing on the server and read back
+// what was written.  A read of another characteristic between two long reads does not disturb either.
+static void test_prepared_write_and_long_read() {
+	std::string written;
+	for (int i = 0; i < VALUE_LENGTH; i++) {
+		written += (char)(i * 7 + 3);
+	}
+
+	allocations = 0;
+	pRemoteLong->writeValue(written, true);   // ESP_GATTS_WRITE_EVT with is_prep for each part, then ESP_GATTS_EXEC_WRITE_EVT.
+	std::string read = pRemoteLong->readValue();   // ESP_GATTS_READ_EVT, the first without is_long and the rest with it.
+	CHECK(pRemoteShort->readValue() == "short");
+	std::string again = pRemoteLong->readValue();
+	FakeBluedroid::waitIdle();
+
+	CHECK(allocations == 0);
+	CHECK(pLong->getValue() == written);
+	CHECK(read == written);
+	CHECK(again == written);
+}
+
+
+// Counts the allocations the server makes per short write at INFO and at DEBUG.  Every level is compiled in,
+// so it is LOG_LEVEL_ENABLED() alone that keeps INFO free of them.
+static void test_write_allocations() {
+	const int       writes   = 1000;
+	esp_log_level_t levels[] = { ESP_LOG_INFO, ESP_LOG_DEBUG };
+	int             counts[2];
+	for (int i = 0; i < 2; i++) {
+		GeneralUtils::setLogLevel(levels[i]);
+		allocations = 0;
+		for (int j = 0; j < writes; j++) {
+			pRemoteLong->writeValue("0123456789", true);
+		}
+		FakeBluedroid::waitIdle();
+		counts[i] = allocations;
+	}
+	GeneralUtils::setLogLevel(ESP_LOG_INFO);
+	printf("allocations per write: %.2f at INFO, %.2f at DEBUG\n", (double)counts[0] / writes, (double)counts[1] / writes);
+	CHECK(counts[0] == 0);
+	CHECK(counts[1] > 0);   // Else the count misses what the guards skip.
+}
+
+
+// Parts may arrive out of order and the value ends at the furthest part.
+static void test_parts_out_of_order() {
+	BLEValue prepared;
+	uint8_t  a[] = { 1, 2, 3 };
+	uint8_t  b[] = { 4, 5 };
+	CHECK(prepared.addPart(3, b, sizeof(b)));
+	CHECK(prepared.addPart(0, a, sizeof(a)));
+	CHECK(prepared.getLength() == 5);
+	CHECK(memcmp(prepared.getData(), "\1\2\3\4\5", 5) == 0);
+}
+
+
+// A part that runs past the buffer is refused and leaves the value alone.
+static void test_part_beyond_capacity() {
+	uint8_t  storage[8];
+	BLEValue prepared(storage, sizeof(storage));
+	uint8_t  part[4] = { 9, 9, 9, 9 };
+	CHECK(prepared.addPart(0, part, sizeof(part)));
+	CHECK(!prepared.addPart(6, part, sizeof(part)));
+	CHECK(!prepared.addPart(9, part, 0));
+	CHECK(prepared.getLength() == 4);
+}
+
+
+int main() {
+	if (connect()) {
+		test_prepared_write_and_long_read();
+		test_write_allocations();
+	}
+	test_parts_out_of_order();
+	test_part_beyond_capacity();
+	printf("test_ble_value: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
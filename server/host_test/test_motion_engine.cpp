@@ -0,0 +1,187 @@
+/*
+ * test_motion_engine.cpp
+ *
+ * Drives MotionEngine::tick() by hand against a mock sink and checks on which tick each pulse width
+ * comes out.  The calibration maps position p to a pulse of 1000 + p µs on both channels, so a pulse
+ * read back gives the position directly.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "MotionEngine.h"
+#include "ServoCalibration.h"
+
+#define TICK_MS 10
+
+static int failures = 0;
+
+#define CHECK(condition) do { \
+	if (!(condition)) { \
+		printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+		failures++; \
+	} \
+} while(0)
+
+// Within a microsecond, as interpolation truncates a float.
+#define CHECK_PULSE(actual, expected) CHECK(abs((int)(actual) - (int)(expected)) <= 1)
+
+
+/**
+ * @brief A sink that records what it is sent and on which tick.
+ */
+class MockSink: public MotionSink {
+public:
+	struct Event {
+		uint32_t tick;
+		uint8_t  channel;
+		bool     enable;   // An enable change rather than a pulse.
+		uint32_t value;
+	};
+
+	void setEnabled(uint8_t channel, bool enabled) override {
+		m_events.push_back({ m_tick, channel, true, enabled });
+		m_enabled[channel] = enabled;
+	}
+	void setPulse(uint8_t channel, uint32_t us) override {
+		m_events.push_back({ m_tick, channel, false, us });
+	}
+
+	std::vector<Event> m_events;
+	bool               m_enabled[MOTION_MAX_CHANNELS] = { false, false };
+	uint32_t           m_tick = 0;
+};
+
+
+class Rig {
+public:
+	Rig(): m_engine(&m_sink, &m_calibration, TICK_MS) {
+		static const ServoCalibration::Point points[] = { { 0, 1000 }, { SERVO_POSITION_MAX, 1000 + SERVO_POSITION_MAX } };
+		for (uint8_t channel = 0; channel < MOTION_MAX_CHANNELS; channel++) {
+			m_calibration.setPoints(channel, points, 2);
+		}
+	}
+
+	// Tick until the engine is idle or the limit is reached.  Returns the ticks taken.
+	uint32_t runToIdle(uint32_t limit) {
+		uint32_t ticks = 0;
+		while (m_engine.isBusy() && ticks < limit) {
+			tick();
+			ticks++;
+		}
+		return ticks;
+	}
+
+	void tick() {
+		m_sink.m_tick++;
+		m_engine.tick();
+	}
+
+	MockSink         m_sink;
+	ServoCalibration m_calibration;
+	MotionEngine     m_engine;
+};
+
+
+static const MotionKeyframe sweep_frames[] = {
+	{ 0, 0,    0,   MotionKeyframe::STEP },
+	{ 0, 1000, 100, MotionKeyframe::LINEAR }
+};
+static const MotionTrajectory sweep = { "sweep", sweep_frames, 2 };
+
+static const MotionKeyframe steps_frames[] = {
+	{ 1, 500,            30, MotionKeyframe::STEP },
+	{ 1, 700,            20, MotionKeyframe::STEP },
+	{ 1, MOTION_RELEASE, 0,  MotionKeyframe::STEP }
+};
+static const MotionTrajectory steps = { "steps", steps_frames, 3 };
+
+static const MotionKeyframe home_frames[] = {
+	{ 0, 0, 0, MotionKeyframe::STEP }
+};
+static const MotionTrajectory home = { "home", home_frames, 1 };
+
+
+// A linear keyframe moves a tenth of the way each tick and finishes on the tenth.
+static void test_linear_timing() {
+	Rig rig;
+	rig.m_engine.play(&sweep);
+	for (uint32_t tick = 1; tick <= 10; tick++) {
+		rig.tick();
+		CHECK_PULSE(rig.m_engine.getPulse(0), 1000 + 100 * tick);
+		CHECK(rig.m_engine.isBusy() == (tick < 10));
+	}
+	CHECK(rig.m_sink.m_enabled[0]);
+}
+
+
+// STEP keyframes set their target on the tick they begin and hold for their duration.
+static void test_step_timing() {
+	Rig rig;
+	rig.m_engine.play(&steps);
+	rig.runToIdle(100);
+
+	std::vector<MockSink::Event>& events = rig.m_sink.m_events;
+	CHECK(events.size() == 4);
+	if (events.size() == 4) {
+		CHECK(events[0].tick == 1 && events[0].enable && events[0].value == 1);
+		CHECK(events[1].tick == 1 && !events[1].enable && events[1].value == 1500);
+		CHECK(events[2].tick == 3 && !events[2].enable && events[2].value == 1700);   // 30 ms in
+		CHECK(events[3].tick == 5 && events[3].enable && events[3].value == 0);       // 50 ms in
+	}
+	CHECK(!rig.m_sink.m_enabled[1]);
+}
+
+
+// A speed below 10% advances less than a millisecond a tick but still reaches the end on time.
+static void test_slow_speed() {
+	Rig rig;
+	rig.m_engine.play(&sweep, 5);
+	uint32_t ticks = rig.runToIdle(1000);
+	CHECK(ticks == 200);
+	CHECK_PULSE(rig.m_engine.getPulse(0), 2000);
+
+	Rig fast;
+	fast.m_engine.play(&sweep, 200);
+	CHECK(fast.runToIdle(1000) == 5);
+}
+
+
+// A new trajectory replaces the one playing on the very next tick, from where the channel had got to.
+static void test_preempt_within_one_tick() {
+	Rig rig;
+	rig.m_engine.play(&sweep);
+	for (int i = 0; i < 4; i++) {
+		rig.tick();
+	}
+	CHECK_PULSE(rig.m_engine.getPulse(0), 1400);
+
+	rig.m_engine.play(&home);
+	CHECK(rig.m_engine.getLast() == &home);
+	rig.tick();
+	CHECK(rig.m_engine.getPulse(0) == 1000);
+	CHECK(rig.m_sink.m_events.back().tick == 5);
+	CHECK(!rig.m_engine.isBusy());
+}
+
+
+// A pulse that has not changed is not sent again.
+static void test_unchanged_pulse_not_resent() {
+	Rig rig;
+	rig.m_engine.play(&home);
+	rig.runToIdle(10);
+	size_t count = rig.m_sink.m_events.size();
+	rig.m_engine.play(&home);
+	rig.runToIdle(10);
+	CHECK(rig.m_sink.m_events.size() == count);
+}
+
+
+int main() {
+	test_linear_timing();
+	test_step_timing();
+	test_slow_speed();
+	test_preempt_within_one_tick();
+	test_unchanged_pulse_not_resent();
+	printf("test_motion_engine: %s (%d failures)\n", failures == 0 ? "passed" : "FAILED", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,237 @@
+/*
+ * MotionEngine.cpp
+ */
+#include <esp_log.h>
+#include <esp_err.h>
+#include "MotionEngine.h"
+#include "ServoCalibration.h"
+
+static const char* LOG_TAG = "MotionEngine";
+
+
+/**
+ * @brief Construct an engine.
+ * @param [in] pSink Where to send pulse widths.
+ * @param [in] pCalibration The pulse width of each position of each channel.
+ * @param [in] periodMs The time between ticks.
+ */
+MotionEngine::MotionEngine(MotionSink* pSink, ServoCalibration* pCalibration, uint32_t periodMs) {
+	m_pSink     = pSink;
+	m_pCalibration = pCalibration;
+	m_periodMs  = periodMs == 0 ? 1 : periodMs;
+	m_timer     = nullptr;
+	m_pending   = nullptr;
+	m_pCurrent  = nullptr;
+	m_pLast     = nullptr;
+	m_pendingSpeed = 100;
+	m_speed     = 100;
+	m_frame     = 0;
+	m_from      = 0;
+	m_elapsed   = 0;
+	for (int i = 0; i < MOTION_MAX_CHANNELS; i++) {
+		m_channels[i].position = 0;
+		m_channels[i].pulseUs  = 0;
+		m_channels[i].known    = false;
+		m_channels[i].enabled  = false;
+	}
+} // MotionEngine
+
+
+MotionEngine::~MotionEngine() {
+	stop();
+} // ~MotionEngine
+
+
+/**
+ * @brief Begin the keyframe m_frame of the current trajectory.
+ *
+ * Starts or stops the keyframe's channel as needed and, for a STEP keyframe, sets the target at once.
+ */
+void MotionEngine::beginFrame() {
+	const MotionKeyframe& frame = m_pCurrent.load()->pFrames[m_frame];
+	if (frame.channel >= MOTION_MAX_CHANNELS) {
+		return;
+	}
+	Channel& channel = m_channels[frame.channel];
+	m_from = channel.known ? channel.position : frame.position;   // A channel never driven jumps.
+
+	if (frame.position == MOTION_RELEASE) {
+		if (channel.enabled) {
+			m_pSink->setEnabled(frame.channel, false);
+			channel.enabled = false;
+		}
+		return;
+	}
+	if (!channel.enabled) {
+		m_pSink->setEnabled(frame.channel, true);
+		channel.enabled = true;
+	}
+	if (frame.easing == MotionKeyframe::STEP) {
+		moveTo(frame.channel, frame.position);
+	}
+} // beginFrame
+
+
+/**
+ * @brief Get the trajectory most recently passed to play(), whether or not it is still playing.
+ * @return The trajectory or nullptr if none has been played.
+ */
+const MotionTrajectory* MotionEngine::getLast() {
+	return m_pLast.load();
+} // getLast
+
+
+/**
+ * @brief Get the pulse width last sent for a channel.
+ * @param [in] channel The channel.
+ * @return The pulse width in microseconds or zero if none has been sent.
+ */
+uint32_t MotionEngine::getPulse(uint8_t channel) {
+	return channel < MOTION_MAX_CHANNELS ? m_channels[channel].pulseUs : 0;
+} // getPulse
+
+
+/**
+ * @brief Is a trajectory playing or waiting to be played?
+ * @return True if the engine is busy.
+ */
+bool MotionEngine::isBusy() {
+	return m_pCurrent.load() != nullptr || m_pending.load() != nullptr;
+} // isBusy
+
+
+/**
+ * @brief Drive a channel to a position, sending its pulse width to the sink if that has changed.
+ * @param [in] channel The channel.
+ * @param [in] position The position.
+ */
+void MotionEngine::moveTo(uint8_t channel, uint16_t position) {
+	Channel& state = m_channels[channel];
+	state.position = position;
+	state.known    = true;
+	uint16_t pulseUs = m_pCalibration->toPulse(channel, position);
+	if (pulseUs != state.pulseUs) {
+		m_pSink->setPulse(channel, pulseUs);
+		state.pulseUs = pulseUs;
+	}
+} // moveTo
+
+
+/**
+ * @brief Play a trajectory, replacing any that is playing at the next tick.
+ *
+ * Safe to call from any task.  The trajectory must outlive its playing.
+ *
+ * @param [in] pTrajectory The trajectory to play.
+ * @param [in] speedPercent How fast to play it in percent of its own pace.
+ */
+void MotionEngine::play(const MotionTrajectory* pTrajectory, uint16_t speedPercent) {
+	ESP_LOGD(LOG_TAG, "play: %s at %d%%", pTrajectory->name, speedPercent);
+	m_pLast         = pTrajectory;
+	m_pendingSpeed  = speedPercent == 0 ? 100 : speedPercent;
+	m_pending       = pTrajectory;   // Last, so the tick that takes it sees its speed.
+} // play
+
+
+/**
+ * @brief Start ticking from a periodic timer.
+ * @return True if the timer was started.
+ */
+bool MotionEngine::start() {
+	esp_timer_create_args_t args;
+	args.callback        = &timerCallback;
+	args.arg             = this;
+	args.dispatch_method = ESP_TIMER_TASK;
+	args.name            = "MotionEngine";
+	esp_err_t errRc = ::esp_timer_create(&args, &m_timer);
+	if (errRc != ESP_OK) {
+		ESP_LOGE(LOG_TAG, "esp_timer_create: rc=%d", errRc);
+		m_timer = nullptr;
+		return false;
+	}
+	errRc = ::esp_timer_start_periodic(m_timer, m_periodMs * 1000);
+	if (errRc != ESP_OK) {
+		ESP_LOGE(LOG_TAG, "esp_timer_start_periodic: rc=%d", errRc);
+		::esp_timer_delete(m_timer);
+		m_timer = nullptr;
+		return false;
+	}
+	return true;
+} // start
+
+
+/**
+ * @brief Stop ticking.  The servos hold wherever they have got to.
+ */
+void MotionEngine::stop() {
+	if (m_timer != nullptr) {
+		::esp_timer_stop(m_timer);
+		::esp_timer_delete(m_timer);
+		m_timer = nullptr;
+	}
+} // stop
+
+
+/**
+ * @brief Advance the current trajectory by one tick period.
+ *
+ * A trajectory passed to play() since the last tick is started first.  Keyframes that end within the
+ * tick are finished and the next begun with the time left over, so the trajectory keeps to its timing
+ * whatever the tick period.
+ */
+void MotionEngine::tick() {
+	const MotionTrajectory* pPending = m_pending.load();
+	if (pPending != nullptr) {
+		m_pCurrent  = pPending;
+		m_speed     = m_pendingSpeed.load();
+		m_pending.compare_exchange_strong(pPending, nullptr);   // Unless play() has been called again.
+		m_frame     = 0;
+		m_elapsed   = 0;
+		if (m_pCurrent.load()->count == 0) {
+			m_pCurrent = nullptr;
+			return;
+		}
+		beginFrame();
+	}
+
+	const MotionTrajectory* pCurrent = m_pCurrent.load();
+	if (pCurrent == nullptr) {
+		return;
+	}
+
+	m_elapsed += m_periodMs * m_speed;   // Hundredths of a millisecond, so slow speeds still advance.
+	while(true) {
+		const MotionKeyframe& frame = pCurrent->pFrames[m_frame];
+		uint32_t duration = (uint32_t)frame.durationMs * 100;
+		if (frame.channel < MOTION_MAX_CHANNELS && frame.position != MOTION_RELEASE && frame.easing != MotionKeyframe::STEP) {
+			float progress = 1.0;
+			if (m_elapsed < duration) {
+				progress = (float)m_elapsed / duration;
+				if (frame.easing == MotionKeyframe::EASE_IN_OUT) {
+					progress = progress * progress * (3 - 2 * progress);
+				}
+			}
+			moveTo(frame.channel, m_from + (int32_t)((frame.position - m_from) * progress));
+		}
+
+		if (m_elapsed < duration) {
+			break;
+		}
+		m_elapsed -= duration;
+		m_frame++;
+		if (m_frame >= pCurrent->count) {
+			ESP_LOGD(LOG_TAG, "finished: %s", pCurrent->name);
+			m_pCurrent = nullptr;
+			break;
+		}
+		beginFrame();
+	}
+} // tick
+
+
+/**
+ * @brief Tick from the esp_timer task.
+ */
+void MotionEngine::timerCallback(void* pArg) {
+	((MotionEngine*)pArg)->tick();
+} // timerCallback
@@ -0,0 +1,124 @@
+/*
+ * MotionEngine.h
+ */
+
+#ifndef MAIN_MOTIONENGINE_H_
+#define MAIN_MOTIONENGINE_H_
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <esp_timer.h>
+
+/**
+ * The number of servo channels an engine drives.
+ */
+#define MOTION_MAX_CHANNELS 2
+
+/**
+ * The far end of a servo's travel.  Positions run from 0, where the servo rests, to here.
+ */
+#define SERVO_POSITION_MAX 1000
+
+/**
+ * The keyframe target that stops a channel's output.
+ */
+#define MOTION_RELEASE 0xffff
+
+class ServoCalibration;
+
+/**
+ * @brief Where an engine sends the pulse widths it computes.
+ *
+ * On the device the sink drives the MCPWM units.  On a host a mock sink records what it is given.
+ */
+class MotionSink {
+public:
+	virtual ~MotionSink() {};
+	virtual void setEnabled(uint8_t channel, bool enabled) = 0;  // Start or stop a channel's output.
+	virtual void setPulse(uint8_t channel, uint32_t us) = 0;     // Set a channel's pulse width.
+};
+
+
+/**
+ * @brief One step of a trajectory.
+ *
+ * A keyframe moves one channel from wherever it is to a target position over a duration.  A STEP
+ * keyframe sets the target at once and then holds for the duration.  A target of MOTION_RELEASE stops
+ * the channel's output and any other target on a stopped channel starts it again.
+ */
+struct MotionKeyframe {
+	enum Easing : uint8_t {
+		STEP,
+		LINEAR,
+		EASE_IN_OUT
+	};
+
+	uint8_t  channel;
+	uint16_t position;
+	uint16_t durationMs;
+	Easing   easing;
+};
+
+
+/**
+ * @brief A sequence of keyframes played one after another.
+ */
+struct MotionTrajectory {
+	const char*           name;
+	const MotionKeyframe* pFrames;
+	uint16_t              count;
+};
+
+
+/**
+ * @brief Plays servo trajectories on a fixed-rate tick.
+ *
+ * play() may be called from any task.  The trajectory it is given replaces the one playing at the next
+ * tick, starting from wherever each channel has got to, so no command waits longer than one tick period
+ * for the servos to respond.  Between keyframes nothing blocks: each tick works out every channel's
+ * position for the time elapsed, looks up the pulse width for it in the servo calibration and passes any
+ * that have changed to the sink.
+ *
+ * On the device start() drives tick() from a periodic esp_timer.  On a host tick() may be called directly.
+ */
+class MotionEngine {
+public:
+	MotionEngine(MotionSink* pSink, ServoCalibration* pCalibration, uint32_t periodMs);
+	~MotionEngine();
+
+	const MotionTrajectory* getLast();
+	uint32_t                getPulse(uint8_t channel);
+	bool                    isBusy();
+	void                    play(const MotionTrajectory* pTrajectory, uint16_t speedPercent = 100);
+	bool                    start();
+	void                    stop();
+	void                    tick();
+
+private:
+	struct Channel {
+		uint16_t position;
+		uint16_t pulseUs;   // The last pulse width sent or zero if none has been.
+		bool     known;     // Has the channel been driven to a position?
+		bool     enabled;
+	};
+
+	void        beginFrame();
+	void        moveTo(uint8_t channel, uint16_t position);
+	static void timerCallback(void* pArg);
+
+	MotionSink*                          m_pSink;
+	ServoCalibration*                    m_pCalibration;
+	uint32_t                             m_periodMs;
+	esp_timer_handle_t                   m_timer;
+	Channel                              m_channels[MOTION_MAX_CHANNELS];
+	std::atomic<const MotionTrajectory*> m_pending;   // Set by play(), taken by the next tick.
+	std::atomic<const MotionTrajectory*> m_pCurrent;  // The trajectory playing.  Only the tick writes it.
+	std::atomic<const MotionTrajectory*> m_pLast;     // The trajectory most recently passed to play().
+	std::atomic<uint16_t>                m_pendingSpeed;
+	uint16_t                             m_speed;     // Percent of the trajectory's own pace at which it plays.
+	uint16_t                             m_frame;     // The keyframe of m_pCurrent playing.
+	uint16_t                             m_from;      // Where the keyframe's channel was when it began.
+	uint32_t                             m_elapsed;   // Trajectory time since the keyframe began in hundredths of a ms.
+}; // MotionEngine
+
+#endif /* MAIN_MOTIONENGINE_H_ */
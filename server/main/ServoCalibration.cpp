@@ -0,0 +1,141 @@
+/*
+ * ServoCalibration.cpp
+ */
+#include <esp_log.h>
+#include <string.h>
+#include "CPPNVS.h"
+#include "ServoCalibration.h"
+
+static const char* LOG_TAG = "ServoCalibration";
+
+static const uint8_t  CALIBRATION_VERSION = 1;
+static const uint16_t MIN_PULSE_US        = 400;
+static const uint16_t MAX_PULSE_US        = 2600;
+
+/*
+ * Each channel is saved as a blob under the key "ch<n>": the version, the number of points and then the
+ * points, each a position and a pulse width in the byte order of the ESP32.
+ */
+static std::string key(uint8_t channel) {
+	std::string key = "ch";
+	key += (char)('0' + channel);
+	return key;
+} // key
+
+
+/**
+ * @brief Construct a calibration in which every position of every channel is the middle of a servo's range.
+ */
+ServoCalibration::ServoCalibration() {
+	for (int channel = 0; channel < MOTION_MAX_CHANNELS; channel++) {
+		m_points[channel][0] = { 0, 1500 };
+		m_count[channel]     = 1;
+		build(channel);
+	}
+} // ServoCalibration
+
+
+/**
+ * @brief Expand a channel's points into its lookup table.
+ *
+ * Positions before the first point or after the last take the pulse width of that point.
+ *
+ * @param [in] channel The channel.
+ */
+void ServoCalibration::build(uint8_t channel) {
+	const Point* pPoints = m_points[channel];
+	uint8_t      count   = m_count[channel];
+	uint8_t      next    = 0;    // The first point at or beyond the position.
+
+	for (uint16_t position = 0; position <= SERVO_POSITION_MAX; position++) {
+		while (next < count && pPoints[next].position < position) {
+			next++;
+		}
+		if (next == 0) {
+			m_table[channel][position] = pPoints[0].pulseUs;
+		} else if (next == count) {
+			m_table[channel][position] = pPoints[count - 1].pulseUs;
+		} else {
+			const Point& a = pPoints[next - 1];
+			const Point& b = pPoints[next];
+			int32_t span = b.position - a.position;
+			int32_t rise = (int32_t)b.pulseUs - a.pulseUs;
+			m_table[channel][position] = a.pulseUs + (rise * (position - a.position) + (rise < 0 ? -span : span) / 2) / span;
+		}
+	}
+} // build
+
+
+/**
+ * @brief Load the calibration of every channel saved in %NVS.
+ *
+ * A channel with no saved calibration, or one that is not valid, keeps the calibration it has.
+ *
+ * @param [in] nvsNamespace The %NVS namespace to load from.
+ * @return True if every channel was loaded.
+ */
+bool ServoCalibration::load(std::string nvsNamespace) {
+	NVS  nvs(nvsNamespace, NVS_READONLY);
+	bool loaded = true;
+	for (int channel = 0; channel < MOTION_MAX_CHANNELS; channel++) {
+		uint8_t blob[2 + MAX_POINTS * sizeof(Point)];
+		size_t  length = sizeof(blob);
+		memset(blob, 0, sizeof(blob));
+		nvs.get(key(channel), blob, length);
+		if (blob[0] != CALIBRATION_VERSION || length != 2 + blob[1] * sizeof(Point)) {
+			ESP_LOGD(LOG_TAG, "No calibration saved for channel %d", channel);
+			loaded = false;
+			continue;
+		}
+		Point points[MAX_POINTS];
+		memcpy(points, blob + 2, blob[1] * sizeof(Point));
+		if (!setPoints(channel, points, blob[1])) {
+			loaded = false;
+		}
+	}
+	return loaded;
+} // load
+
+
+/**
+ * @brief Save the calibration of every channel to %NVS.
+ * @param [in] nvsNamespace The %NVS namespace to save to.
+ */
+void ServoCalibration::save(std::string nvsNamespace) {
+	NVS nvs(nvsNamespace);
+	for (int channel = 0; channel < MOTION_MAX_CHANNELS; channel++) {
+		uint8_t blob[2 + MAX_POINTS * sizeof(Point)];
+		blob[0] = CALIBRATION_VERSION;
+		blob[1] = m_count[channel];
+		memcpy(blob + 2, m_points[channel], m_count[channel] * sizeof(Point));
+		nvs.set(key(channel), blob, 2 + m_count[channel] * sizeof(Point));
+	}
+	nvs.commit();
+} // save
+
+
+/**
+ * @brief Set the calibration of a channel.
+ * @param [in] channel The channel.
+ * @param [in] pPoints The measured points, in order of increasing position.
+ * @param [in] count The number of points, at least one and at most MAX_POINTS.
+ * @return True if the points were valid and have been set.
+ */
+bool ServoCalibration::setPoints(uint8_t channel, const Point* pPoints, uint8_t count) {
+	if (channel >= MOTION_MAX_CHANNELS || count == 0 || count > MAX_POINTS) {
+		ESP_LOGE(LOG_TAG, "Invalid calibration: channel=%d, count=%d", channel, count);
+		return false;
+	}
+	for (int i = 0; i < count; i++) {
+		if (pPoints[i].position > SERVO_POSITION_MAX || pPoints[i].pulseUs < MIN_PULSE_US || pPoints[i].pulseUs > MAX_PULSE_US ||
+				(i > 0 && pPoints[i].position <= pPoints[i - 1].position)) {
+			ESP_LOGE(LOG_TAG, "Invalid calibration point %d for channel %d: position=%d, pulse=%d",
+				i, channel, pPoints[i].position, pPoints[i].pulseUs);
+			return false;
+		}
+	}
+	memcpy(m_points[channel], pPoints, count * sizeof(Point));
+	m_count[channel] = count;
+	build(channel);
+	return true;
+} // setPoints
@@ -0,0 +1,55 @@
+/*
+ * ServoCalibration.h
+ */
+
+#ifndef MAIN_SERVOCALIBRATION_H_
+#define MAIN_SERVOCALIBRATION_H_
+#include <stdint.h>
+#include <string>
+#include "MotionEngine.h"
+
+/**
+ * @brief How far each servo must be driven to reach each point of its travel.
+ *
+ * Positions run from 0, where a servo rests, to SERVO_POSITION_MAX, the far end of its travel.  Each
+ * channel's calibration is a short table of measured points, each a position and the pulse width that
+ * reaches it, with straight lines between them.  Whenever a table is set it is expanded into a lookup table
+ * holding the pulse width of every position, so converting a position is a single array access.
+ *
+ * The tables can be saved to and loaded from %NVS, so fitting different servos means measuring them
+ * again rather than changing code.
+ */
+class ServoCalibration {
+public:
+	static const uint8_t MAX_POINTS = 8;
+
+	struct Point {
+		uint16_t position;
+		uint16_t pulseUs;
+	};
+
+	ServoCalibration();
+
+	bool load(std::string nvsNamespace);
+	void save(std::string nvsNamespace);
+	bool setPoints(uint8_t channel, const Point* pPoints, uint8_t count);
+
+	/**
+	 * @brief Get the pulse width that drives a channel to a position.
+	 * @param [in] channel The channel.
+	 * @param [in] position The position, clamped to SERVO_POSITION_MAX.
+	 * @return The pulse width in microseconds.
+	 */
+	uint16_t toPulse(uint8_t channel, uint16_t position) {
+		return m_table[channel][position > SERVO_POSITION_MAX ? SERVO_POSITION_MAX : position];
+	}
+
+private:
+	void build(uint8_t channel);
+
+	Point    m_points[MOTION_MAX_CHANNELS][MAX_POINTS];
+	uint8_t  m_count[MOTION_MAX_CHANNELS];
+	uint16_t m_table[MOTION_MAX_CHANNELS][SERVO_POSITION_MAX + 1];
+}; // ServoCalibration
+
+#endif /* MAIN_SERVOCALIBRATION_H_ */
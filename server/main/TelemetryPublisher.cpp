@@ -0,0 +1,94 @@
+/*
+ * TelemetryPublisher.cpp
+ */
+#include <esp_log.h>
+#include "BLE2902.h"
+#include "TelemetryPublisher.h"
+
+static const char* LOG_TAG = "TelemetryPublisher";
+
+
+/**
+ * @brief Construct a publisher.
+ * @param [in] pServer The server whose clients are sent the samples.
+ * @param [in] pCharacteristic The characteristic notified.  Clients subscribe through its 0x2902 descriptor.
+ * @param [in] periodMs The time between samples.
+ * @param [in] minIntervalMs The least time between notifications to one client.
+ * @param [in] maxAgeMs The longest a sample waits for a notification to fill.
+ */
+TelemetryPublisher::TelemetryPublisher(BLEServer* pServer, BLECharacteristic* pCharacteristic, uint16_t periodMs, uint32_t minIntervalMs, uint32_t maxAgeMs) {
+	m_pServer         = pServer;
+	m_pCharacteristic = pCharacteristic;
+	m_periodMs        = periodMs;
+	m_minIntervalMs   = minIntervalMs;
+	m_maxAgeMs        = maxAgeMs;
+	m_taken           = 0;
+	for (int i = 0; i < BLE_SERVER_MAX_CONNECTIONS; i++) {
+		m_subscribers[i].subscribed = false;
+		m_subscribers[i].next       = 0;
+		m_subscribers[i].sentMs     = 0;
+	}
+} // TelemetryPublisher
+
+
+/**
+ * @brief Add the sample just taken and send any notifications that are now due.
+ * @param [in] sample The sample.
+ * @param [in] nowMs The current time.
+ */
+void TelemetryPublisher::add(const TelemetrySample& sample, uint32_t nowMs) {
+	m_samples[m_taken & (DEPTH - 1)] = sample;
+	m_taken++;
+
+	BLE2902* p2902 = (BLE2902*)m_pCharacteristic->getDescriptorByUUID((uint16_t)0x2902);
+	for (uint16_t connId = 0; connId < BLE_SERVER_MAX_CONNECTIONS; connId++) {
+		Subscriber& subscriber = m_subscribers[connId];
+		bool subscribed = p2902 != nullptr && p2902->getNotifications(connId);
+		if (subscribed && !subscriber.subscribed) {
+			ESP_LOGD(LOG_TAG, "conn_id %d subscribed", connId);
+			subscriber.next   = m_taken - 1;
+			subscriber.sentMs = nowMs - m_minIntervalMs;
+		}
+		subscriber.subscribed = subscribed;
+		if (subscribed) {
+			publish(connId, nowMs);
+		}
+	}
+} // add
+
+
+/**
+ * @brief Send a client the samples it has not yet had, if they are due.
+ * @param [in] connId The connection of the client.
+ * @param [in] nowMs The current time.
+ */
+void TelemetryPublisher::publish(uint16_t connId, uint32_t nowMs) {
+	Subscriber& subscriber = m_subscribers[connId];
+	uint32_t unsent   = m_taken - subscriber.next;
+	uint8_t  capacity = TelemetryFrame::capacity(m_pServer->getPeerMTU(connId));
+	if (unsent == 0 || nowMs - subscriber.sentMs < m_minIntervalMs ||
+			(unsent < capacity && (unsent - 1) * m_periodMs < m_maxAgeMs)) {
+		return;
+	}
+	if (unsent > capacity) {
+		ESP_LOGD(LOG_TAG, "Skipping %d samples for conn_id %d", unsent - capacity, connId);
+		subscriber.next = m_taken - capacity;
+		unsent          = capacity;
+	}
+
+	TelemetryFrame frame;
+	frame.sequence = subscriber.next;
+	frame.periodMs = m_periodMs;
+	frame.count    = unsent;
+	for (int i = 0; i < frame.count; i++) {
+		frame.samples[i] = m_samples[(subscriber.next + i) & (DEPTH - 1)];
+	}
+	uint8_t data[TelemetryFrame::MAX_LENGTH];
+	m_pCharacteristic->setValue(data, frame.encode(data));
+
+	// A client whose queue is full is tried again at the next sample.
+	if (m_pCharacteristic->notifyAsync(connId, 0)) {
+		subscriber.next  += frame.count;
+		subscriber.sentMs = nowMs;
+	}
+} // publish
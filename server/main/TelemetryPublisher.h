@@ -0,0 +1,53 @@
+/*
+ * TelemetryPublisher.h
+ */
+
+#ifndef MAIN_TELEMETRYPUBLISHER_H_
+#define MAIN_TELEMETRYPUBLISHER_H_
+#include <stdint.h>
+#include "BLECharacteristic.h"
+#include "BLEServer.h"
+#include "TelemetryFrame.h"
+
+/**
+ * @brief Sends telemetry samples to subscribed clients, many to a notification.
+ *
+ * Samples are kept in a ring as they are taken.  Each client that has enabled notifications is sent the
+ * samples it has not yet had once they fill a notification at its MTU, or once the oldest of them is
+ * maxAgeMs old, but never sooner than minIntervalMs after the last notification sent to it.  When more
+ * samples are waiting than fit, because the client's MTU is small or its link was congested, the newest are
+ * sent and the rest skipped rather than sent in a burst.  The client sees those as a gap in the numbering.
+ *
+ * A client that subscribes is sent samples taken from then on.  Clients that have not subscribed cost
+ * nothing on the air.
+ *
+ * add() must always be called from the same task.
+ */
+class TelemetryPublisher {
+public:
+	static const uint32_t DEPTH = TelemetryFrame::MAX_SAMPLES;   // A power of two.
+
+	TelemetryPublisher(BLEServer* pServer, BLECharacteristic* pCharacteristic, uint16_t periodMs, uint32_t minIntervalMs, uint32_t maxAgeMs);
+
+	void add(const TelemetrySample& sample, uint32_t nowMs);
+
+private:
+	struct Subscriber {
+		bool     subscribed;
+		uint32_t next;       // The first sample not yet sent.
+		uint32_t sentMs;     // When the last notification was queued.
+	};
+
+	void publish(uint16_t connId, uint32_t nowMs);
+
+	BLEServer*         m_pServer;
+	BLECharacteristic* m_pCharacteristic;
+	uint16_t           m_periodMs;
+	uint32_t           m_minIntervalMs;
+	uint32_t           m_maxAgeMs;
+	TelemetrySample    m_samples[DEPTH];
+	uint32_t           m_taken;          // Samples added since construction.
+	Subscriber         m_subscribers[BLE_SERVER_MAX_CONNECTIONS];
+}; // TelemetryPublisher
+
+#endif /* MAIN_TELEMETRYPUBLISHER_H_ */
@@ -7,11 +7,20 @@
 #include "BLEUtils.h"
 #include "BLEServer.h"
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <atomic>
 #include <string>
 #include <string.h>
 //#include <sys/time.h>
 #include <sstream>
 #include "BLEDevice.h"
+#include "BLE2902.h"
+#include "CommandFrame.h"
+#include "GeneralUtils.h"
+#include "MotionEngine.h"
+#include "ServoCalibration.h"
+#include "TelemetryPublisher.h"
 
 // Servo PWM stuff
 #include <stdio.h>
@@ -33,20 +42,20 @@ extern "C" {
 void app_main(void);
 }
 
-#define SERVO_MIN_PULSEWIDTH 700 //Minimum pulse width in microsecond
-#define SERVO_MAX_PULSEWIDTH 2250 //Maximum pulse width in microsecond
-#define SERVO_MAX_DEGREE 2000 //Maximum angle in degree upto which servo can rotate
-
-#define SERVO_TIP_MIN_PULSEWIDTH 500 //Minimum pulse width in microsecond
-#define SERVO_TIP_MAX_PULSEWIDTH 2000 //Maximum pulse width in microsecond
-#define SERVO_TIP_MAX_DEGREE 1000 //Maximum angle in degree upto which servo can rotate
-
 static xQueueHandle ble_to_servo_queue = NULL;
-static xQueueHandle sequence_interrupt_queue = NULL;
+static BLEServer* ble_server = NULL;
 
 #define SERVICE_UUID        "6d124ed1-50f5-4ebf-b490-c3db81cbaa8c"
 #define CHARACTERISTIC_UUID "4c7a3456-6ac2-4e16-9951-028dc32c443c"
 
+#define TELEMETRY_SERVICE_UUID        "0b6e3a52-9d41-4c0e-8f0a-51c2e7d4a610"
+#define TELEMETRY_CHARACTERISTIC_UUID "0b6e3a53-9d41-4c0e-8f0a-51c2e7d4a610"
+
+#define TELEMETRY_PERIOD_MS       100  // Time between telemetry samples
+#define TELEMETRY_MIN_INTERVAL_MS 250  // Least time between telemetry notifications to one client
+#define TELEMETRY_MAX_AGE_MS      1000 // Longest a sample waits for a notification to fill
+#define TELEMETRY_MTU             185  // Lets a notification carry thirteen samples
+
 #define MAIN_SERVO_GPIO 18 //green, right on the front
 #define TIP_SERVO_GPIO 19  //white, left on the front
 
@@ -78,211 +87,182 @@ static void mcpwm_example_gpio_initialize()
  *
  */
 
-/**
- * @brief Use this function to calcute pulse width for per degree rotation
- *
- * @param  degree_of_rotation the angle in degree to which servo has to rotate
- *
- * @return
- *     - calculated pulse width
- */
-static uint32_t main_servo_per_degree_init(uint32_t degree_of_rotation)
-{
-    uint32_t cal_pulsewidth = 0;
-    cal_pulsewidth = (SERVO_MIN_PULSEWIDTH + (((SERVO_MAX_PULSEWIDTH - SERVO_MIN_PULSEWIDTH) * (degree_of_rotation)) / (SERVO_MAX_DEGREE)));
-    // 986 = (700 + (((2250 - 700) * (degree_of_rotation)) / (2000)))
-    return cal_pulsewidth;
-}
-
-static uint32_t tip_servo_per_degree_init(uint32_t degree_of_rotation)
-{
-    uint32_t cal_pulsewidth = 0;
-    cal_pulsewidth = (SERVO_TIP_MIN_PULSEWIDTH + (((SERVO_TIP_MAX_PULSEWIDTH - SERVO_TIP_MIN_PULSEWIDTH) * (degree_of_rotation)) / (SERVO_TIP_MAX_DEGREE)));
-    return cal_pulsewidth;
-}
+#define MAIN_SERVO 0
+#define TIP_SERVO  1
 
-static void start_tip()
-{
-	mcpwm_start(MCPWM_UNIT_1, MCPWM_TIMER_0);
-}
+#define CALIBRATION_NAMESPACE "servo_cal" // NVS namespace holding calibration measured on the device
 
-static void stop_tip()
-{
-	mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
-}
+// Calibration used until one is saved in NVS, from the measurements above
+static const ServoCalibration::Point main_default_points[] = {
+	{ 0,                  2151 }, // flat, number based on testing
+	{ SERVO_POSITION_MAX, 986  }  // up
+};
 
-static void set_tip_in_us(uint32_t us)
-{
-	mcpwm_set_duty_in_us(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, us);
-}
+static const ServoCalibration::Point tip_default_points[] = {
+	{ 0,                  550  }, // down
+	{ SERVO_POSITION_MAX, 1455 }  // up
+};
 
-static void set_main_in_us(uint32_t us)
-{
-	mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, us);
-}
+// Named poses, as positions on the calibrated scale
+#define POSE_MAIN_FLAT     0
+#define POSE_MAIN_UP       SERVO_POSITION_MAX
+#define POSE_MAIN_TREMOR_A 301  // 1800us with the default calibration
+#define POSE_MAIN_TREMOR_B 130  // 2000us
+#define POSE_MAIN_TREMOR_C 215  // 1900us
+
+#define POSE_TIP_DOWN      0
+#define POSE_TIP_UP        SERVO_POSITION_MAX
+#define POSE_TIP_FLICK_A   718  // 1200us
+#define POSE_TIP_FLICK_B   55   // 600us
+#define POSE_TIP_TREMOR_A  442  // 950us
+#define POSE_TIP_TREMOR_B  110  // 650us
+#define POSE_TIP_TREMOR_C  276  // 800us
+
+#define MOTION_TICK_MS 10 // Period of the motion engine's tick, and so the longest a command waits to take effect
+
+// Drives the servos from the motion engine through the two MCPWM units
+class McpwmSink: public MotionSink {
+	void setEnabled(uint8_t channel, bool enabled) {
+		mcpwm_unit_t unit = channel == TIP_SERVO ? MCPWM_UNIT_1 : MCPWM_UNIT_0;
+		if (enabled) {
+			mcpwm_start(unit, MCPWM_TIMER_0);
+		} else {
+			mcpwm_stop(unit, MCPWM_TIMER_0);
+		}
+	}
 
-//TODO active should probably something more sophisticated and thread-safe but whatever
-static int active = false;
-// Integer to track the current behavior state
-static int state = -1;
+	void setPulse(uint8_t channel, uint32_t us) {
+		mcpwm_unit_t unit = channel == TIP_SERVO ? MCPWM_UNIT_1 : MCPWM_UNIT_0;
+		mcpwm_set_duty_in_us(unit, MCPWM_TIMER_0, MCPWM_OPR_A, us);
+	}
+};
 
+static McpwmSink servo_sink;
+static ServoCalibration calibration;
+static MotionEngine motion(&servo_sink, &calibration, MOTION_TICK_MS);
 
-static void sequence_tip_down()
-{
-	start_tip();
-//	mcpwm_start(MCPWM_UNIT_1, MCPWM_TIMER_0);
-	set_tip_in_us(550);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 550); //guessing at tweaking taht value
-	vTaskDelay(200);
-	stop_tip();
-//	mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
-}
+// The tip is only driven while it moves and is let go once it gets there.
+#define TIP_DOWN_FRAMES \
+	{ TIP_SERVO,  POSE_TIP_DOWN,     200, MotionKeyframe::STEP }, \
+	{ TIP_SERVO,  MOTION_RELEASE,    0,   MotionKeyframe::STEP }
 
 // go home
-static void sequence_home()
-{
-	state = 0;
-
-	printf("Trying to run back\n");
-//	uint32_t angle;
-//	angle = main_servo_per_degree_init(10);
-	set_main_in_us(2151);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 2151); //number based on testing
-	vTaskDelay(5);
-	sequence_tip_down();
-}
+#define HOME_FRAMES \
+	{ MAIN_SERVO, POSE_MAIN_FLAT,    5,   MotionKeyframe::STEP }, /* number based on testing */ \
+	TIP_DOWN_FRAMES
 
-static bool check_if_i_should_go_home()
-{
-	if (uxQueueMessagesWaiting(sequence_interrupt_queue) > 0)
-	{
-		// emergency interrupt
-		printf("interrupting to go home!\n");
-		sequence_home();
-		// consume that message from the queue
-		char value[1];
-		xQueueReceive(sequence_interrupt_queue, &value, portMAX_DELAY);
-		return true;
-	}
-	return false;
-}
-
-// raise up, slow
-static void sequence_up_slow()
-{
-	state = 10;
-
-	printf("Trying to go up slow\n");
-	// needs to go from 2151us to 986us in some kind of normal amount, possibly just step in five degree increments?
-	uint32_t angle;//, count;
-	for (angle = 2151; angle >= 986; angle -= 5) {
-		if (check_if_i_should_go_home()) {
-			break;
-		}
-		set_main_in_us(angle);
-//		mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, angle);
-		vTaskDelay(5);     //Add delay, since it takes time for servo to rotate, generally 100ms/60degree rotation at 5V
-	}
+static const MotionKeyframe home_frames[] = {
+	HOME_FRAMES
+};
 
-}
+// raise up, slow: from flat to up at the pace the old five microsecond steps every 5ms had
+static const MotionKeyframe up_slow_frames[] = {
+	{ MAIN_SERVO, POSE_MAIN_UP,      1165, MotionKeyframe::LINEAR }
+};
 
 // raise up, fast
-static void sequence_up_fast()
-{
-	state = 20;
-	printf("Trying to go up fast\n");
-	set_main_in_us(986);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_OPR_A, 986); //arbitrary based on testing
-}
+static const MotionKeyframe up_fast_frames[] = {
+	{ MAIN_SERVO, POSE_MAIN_UP,      0,   MotionKeyframe::STEP }  // arbitrary based on testing
+};
 
-static void sequence_tip_up()
-{
-	state = 12;
-	printf("Trying to flip the tip up v5\n");
-	start_tip();
-//	mcpwm_start(MCPWM_UNIT_1, MCPWM_TIMER_0);
-	set_tip_in_us(1200);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 1200);
-	vTaskDelay(200);
-	set_tip_in_us(600);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 600);
-	vTaskDelay(200);
-	set_tip_in_us(1455);
-//	mcpwm_set_duty_in_us(MCPWM_UNIT_1, MCPWM_TIMER_0, MCPWM_OPR_A, 1455);
-	vTaskDelay(200); //give time for value to be written before shutting down
-	stop_tip();
-//	mcpwm_stop(MCPWM_UNIT_1, MCPWM_TIMER_0);
-}
+static const MotionKeyframe tip_up_frames[] = {
+	{ TIP_SERVO,  POSE_TIP_FLICK_A,  200, MotionKeyframe::STEP },
+	{ TIP_SERVO,  POSE_TIP_FLICK_B,  200, MotionKeyframe::STEP },
+	{ TIP_SERVO,  POSE_TIP_UP,       200, MotionKeyframe::STEP }, // give time for value to be written before shutting down
+	{ TIP_SERVO,  MOTION_RELEASE,    0,   MotionKeyframe::STEP }
+};
 
-static void tremor_block()
-{
-	set_main_in_us(1800);
-	vTaskDelay(100);
-	set_tip_in_us(950);
-	vTaskDelay(100);
-
-	set_main_in_us(2000);
-	vTaskDelay(100);
-	set_tip_in_us(650);
-	vTaskDelay(100);
-
-	set_main_in_us(1900);
-	vTaskDelay(100);
-	set_tip_in_us(800);
-	vTaskDelay(100);
-}
+#define TREMOR_BLOCK_FRAMES \
+	{ MAIN_SERVO, POSE_MAIN_TREMOR_A, 100, MotionKeyframe::STEP }, \
+	{ TIP_SERVO,  POSE_TIP_TREMOR_A,  100, MotionKeyframe::STEP }, \
+	{ MAIN_SERVO, POSE_MAIN_TREMOR_B, 100, MotionKeyframe::STEP }, \
+	{ TIP_SERVO,  POSE_TIP_TREMOR_B,  100, MotionKeyframe::STEP }, \
+	{ MAIN_SERVO, POSE_MAIN_TREMOR_C, 100, MotionKeyframe::STEP }, \
+	{ TIP_SERVO,  POSE_TIP_TREMOR_C,  100, MotionKeyframe::STEP }
+
+// tremors: first go home, then a periodic wave through main and tip, then finish by restoring
+static const MotionKeyframe tremors_frames[] = {
+	HOME_FRAMES,
+	{ MAIN_SERVO, POSE_MAIN_FLAT,    100, MotionKeyframe::STEP },
+	TREMOR_BLOCK_FRAMES,
+	TREMOR_BLOCK_FRAMES,
+	TREMOR_BLOCK_FRAMES,
+	TREMOR_BLOCK_FRAMES,
+	TREMOR_BLOCK_FRAMES,
+	{ TIP_SERVO,  MOTION_RELEASE,    0,   MotionKeyframe::STEP },
+	HOME_FRAMES
+};
 
-// tremors
-static void sequence_tremors()
-{
-	state = 30;
-	//first go home, then try for some sort of periodic wave through main and tip
-	sequence_home();
-	vTaskDelay(100);
-
-	start_tip();
-	for (int i = 0; i<5; i++)
-	{
-		tremor_block();
-	}
-	stop_tip();
+#define TRAJECTORY(name, frames) { name, frames, sizeof(frames) / sizeof(frames[0]) }
+
+static const MotionTrajectory sequence_home    = TRAJECTORY("home",    home_frames);
+static const MotionTrajectory sequence_up_slow = TRAJECTORY("up_slow", up_slow_frames);
+static const MotionTrajectory sequence_up_fast = TRAJECTORY("up_fast", up_fast_frames);
+static const MotionTrajectory sequence_tip_up  = TRAJECTORY("tip_up",  tip_up_frames);
+static const MotionTrajectory sequence_tremors = TRAJECTORY("tremors", tremors_frames);
+
+// Telemetry numbers the trajectories from one in this order
+static const MotionTrajectory* const trajectories[] = {
+	&sequence_home, &sequence_up_slow, &sequence_up_fast, &sequence_tip_up, &sequence_tremors
+};
+
+// A command waiting for the servo controller, stamped with when it arrived
+struct QueuedCommand {
+	CommandFrame command;
+	int64_t      receivedUs;
+};
 
-	//finish by restoring
-	sequence_home();
+// From the last command arriving to its trajectory being played, for telemetry
+static std::atomic<uint16_t> last_latency_ms(0);
+
+static void record_latency(int64_t receivedUs)
+{
+	int64_t latencyMs = (esp_timer_get_time() - receivedUs) / 1000;
+	last_latency_ms = latencyMs > UINT16_MAX ? UINT16_MAX : latencyMs;
 }
 
 static void servo_controller(void *arg)
 {
 
-	// Manages the operation graph
+	// Manages the operation graph.  A new command replaces whatever is moving within one motion tick.
 	printf("servo_controller started up\n");
-//	int state = -1; //tracks last executed state for operation graph
 
-//	std::string value;
-	char value[1];
+	QueuedCommand queued;
+	CommandFrame& command = queued.command;
+	bool moving = false;
 	while(1) {
 
-		xQueueReceive(ble_to_servo_queue, &value, portMAX_DELAY);
-		printf("servo_controller message received:  %s\n", value);
-		//interpret the signal and call the appropriate method
-		printf("I think state is: %d\n", state);
-		if ( value[0] == 'A' )  {
-			sequence_home();
-		} else if ( value[0] == 'B' ) {
-			active = true;
-			if ( state == 10 || state == 20 ) { // meaning it's already in up_slow or up_fast
-				sequence_tip_up();
+		// While the tie moves, look in now and then to relax the connection again once it has stopped.
+		if (xQueueReceive(ble_to_servo_queue, &queued, moving ? pdMS_TO_TICKS(50) : portMAX_DELAY) != pdTRUE) {
+			if (!motion.isBusy()) {
+				moving = false;
+				ble_server->setConnectionProfile(BLEConnectionProfile::Balanced);
+			}
+			continue;
+		}
+		printf("servo_controller command received:  %s\n", command.toString().c_str());
+		//interpret the command and play the appropriate trajectory
+		const MotionTrajectory* last = motion.getLast();
+		printf("I think state is: %s\n", last == nullptr ? "none" : last->name);
+		if ( command.opcode == CommandFrame::HOME )  {
+			motion.play(&sequence_home, command.speed);
+		} else if ( command.opcode == CommandFrame::RAISE ) {
+			if ( last == &sequence_up_slow || last == &sequence_up_fast ) { // meaning it's already up
+				motion.play(&sequence_tip_up, command.speed);
 			} else {
-				sequence_up_slow();
+				motion.play(&sequence_up_slow, command.speed);
 			}
-		} else if ( value[0] == 'C' ) {
-			active = true;
-			sequence_up_fast();
-		} else if ( value[0] == 'D' ) {
-			active = true;
-			sequence_tremors();
+		} else if ( command.opcode == CommandFrame::RAISE_FAST ) {
+			motion.play(&sequence_up_fast, command.speed);
+		} else if ( command.opcode == CommandFrame::TREMORS ) {
+			motion.play(&sequence_tremors, command.speed);
+		}
+		record_latency(queued.receivedUs);
+		// While the tie moves, an 'A' from the controller must interrupt it as soon as possible.
+		if (!moving) {
+			moving = true;
+			ble_server->setConnectionProfile(BLEConnectionProfile::LowLatency);
 		}
-		active = false;
 	}
 }
 /*
@@ -300,38 +280,100 @@ D(30)	1 button press and hold- this sends the tie into “tremors” for appx 3
  */
 
 
+// The newest command accepted on each connection, so that repeated and overtaken commands are dropped.
+static uint16_t last_sequence[BLE_SERVER_MAX_CONNECTIONS];
+static bool have_sequence[BLE_SERVER_MAX_CONNECTIONS];
+
 class MyCallbacks: public BLECharacteristicCallbacks {
-	void onWrite(BLECharacteristic *pCharacteristic) {
+	void onWrite(BLECharacteristic *pCharacteristic, uint16_t connId) {
+		int64_t receivedUs = esp_timer_get_time();
 		std::string value = pCharacteristic->getValue();
-		if (value.length() > 0) {
-			ESP_LOGD(LOG_TAG, "*********");
-			ESP_LOGD(LOG_TAG, "New value: %.2x", value[0]);
-			ESP_LOGD(LOG_TAG, "*********");
-//			char val_clone[1];
-//			strncpy(val_clone, value.c_str(), 1);
-
-//			std::string val_clone = value.c_str();
-			char val_array[1];
-			strncpy(val_array, value.c_str(), 1);
-			printf("Trying to deal with value: %s\n", val_array);
-			// Sequence A should override all other sequences and goes into a special queue
-			if ( value.compare("A") == 0 ) {
-				if (active) {
-					xQueueSendToBack(sequence_interrupt_queue, &val_array, portMAX_DELAY);
-				} else {
-					sequence_home();
-				}
-			} else {
-				xQueueSendToBack(ble_to_servo_queue, &val_array, portMAX_DELAY);
+		CommandFrame command;
+		if (connId >= BLE_SERVER_MAX_CONNECTIONS || !command.decode((uint8_t*)value.data(), value.length())) {
+			ESP_LOGD(LOG_TAG, "Ignoring %d bytes from conn_id %d", value.length(), connId);
+			return;
+		}
+		ESP_LOGD(LOG_TAG, "Command from conn_id %d: %s", connId, command.toString().c_str());
+
+		CommandFrame::Status status = CommandFrame::OK;
+		if (have_sequence[connId] && !command.isNewerThan(last_sequence[connId])) {
+			status = command.sequence == last_sequence[connId] ? CommandFrame::DUPLICATE : CommandFrame::STALE;
+		} else if (command.opcode < CommandFrame::HOME || command.opcode > CommandFrame::TREMORS) {
+			status = CommandFrame::REJECTED;
+		} else {
+			QueuedCommand queued = { command, receivedUs };
+			// HOME should override all other sequences so it goes straight to the motion engine,
+			// which takes it up at its next tick whatever is playing.
+			if (command.opcode == CommandFrame::HOME) {
+				motion.play(&sequence_home, command.speed);
+				record_latency(receivedUs);
+			} else if (xQueueSendToBack(ble_to_servo_queue, &queued, 0) != pdTRUE) {
+				status = CommandFrame::REJECTED;
+			}
+			// Only a command taken up uses its sequence number, so the controller may retry one that was not.
+			if (status == CommandFrame::OK) {
+				have_sequence[connId] = true;
+				last_sequence[connId] = command.sequence;
 			}
 		}
+
+		// Acknowledge to the writer alone.  The value now holds the acknowledgement, which a read also returns.
+		uint8_t frame[CommandFrame::MAX_LENGTH];
+		pCharacteristic->setValue(frame, command.ack(status).encode(frame));
+		pCharacteristic->notifyAsync(connId, 0);
 	}
 };
 
 
+// Several controllers may drive the tie at once.  The stack stops advertising when a client connects so
+// start it again while there is room for another.
+class MyServerCallbacks: public BLEServerCallbacks {
+	void onConnect(BLEServer *pServer) {
+		if (pServer->getConnId() < BLE_SERVER_MAX_CONNECTIONS) {
+			have_sequence[pServer->getConnId()] = false;   // A new controller numbers its commands afresh.
+		}
+		if (pServer->getConnectedCount() + 1 < BLE_SERVER_MAX_CONNECTIONS) {
+			pServer->startAdvertising();
+		}
+	}
+};
+
+
+// Samples the tie on a fixed cadence for the clients subscribed to telemetry.
+static void telemetry_task(void* arg)
+{
+	TelemetryPublisher* pPublisher = (TelemetryPublisher*)arg;
+	TickType_t wake = xTaskGetTickCount();
+	while(1) {
+		vTaskDelayUntil(&wake, pdMS_TO_TICKS(TELEMETRY_PERIOD_MS));
+
+		TelemetrySample sample;
+		sample.pulseUs[MAIN_SERVO] = motion.getPulse(MAIN_SERVO);
+		sample.pulseUs[TIP_SERVO]  = motion.getPulse(TIP_SERVO);
+		sample.trajectory = 0;
+		const MotionTrajectory* last = motion.getLast();
+		for (size_t i = 0; i < sizeof(trajectories) / sizeof(trajectories[0]); i++) {
+			if (trajectories[i] == last) {
+				sample.trajectory = i + 1;
+			}
+		}
+		sample.flags      = motion.isBusy() ? TelemetrySample::FLAG_BUSY : 0;
+		sample.queueDepth = uxQueueMessagesWaiting(ble_to_servo_queue);
+		sample.latencyMs  = last_latency_ms;
+		sample.freeHeap   = esp_get_free_heap_size();
+		pPublisher->add(sample, (uint32_t)(esp_timer_get_time() / 1000));
+	}
+}
+
+
 static void run() {
 	BLEDevice::init("MYDEVICE");
+	BLEDevice::setMTU(TELEMETRY_MTU);   // Clients that ask for a larger MTU get their telemetry in fewer notifications.
 	BLEServer *pServer = BLEDevice::createServer();
+	pServer->setCallbacks(new MyServerCallbacks());
+	pServer->setConnectionProfile(BLEConnectionProfile::Balanced);
+	pServer->setNotifyQueue(4, 2);   // Acknowledgements are sent from the stack's task and must not wait.
+	ble_server = pServer;
 
 	BLEService *pService = pServer->createService(BLEUUID(SERVICE_UUID));
 
@@ -339,15 +381,28 @@ static void run() {
 		BLEUUID(CHARACTERISTIC_UUID),
 		BLECharacteristic::PROPERTY_BROADCAST | BLECharacteristic::PROPERTY_READ  |
 		BLECharacteristic::PROPERTY_NOTIFY    | BLECharacteristic::PROPERTY_WRITE |
-		BLECharacteristic::PROPERTY_INDICATE
+		BLECharacteristic::PROPERTY_INDICATE  | BLECharacteristic::PROPERTY_WRITE_NR
 	);
 
 	pCharacteristic->setCallbacks(new MyCallbacks());
+	pCharacteristic->addDescriptor(new BLE2902());   // Controllers subscribe here for acknowledgements.
 
 	pCharacteristic->setValue("Hello World");
 
 	pService->start();
 
+	// Telemetry is a service of its own, read only and subscribed to through its 0x2902 descriptor.
+	BLEService *pTelemetryService = pServer->createService(BLEUUID(TELEMETRY_SERVICE_UUID));
+	BLECharacteristic *pTelemetryCharacteristic = pTelemetryService->createCharacteristic(
+		BLEUUID(TELEMETRY_CHARACTERISTIC_UUID),
+		BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+	);
+	pTelemetryCharacteristic->addDescriptor(new BLE2902());
+	pTelemetryService->start();
+	TelemetryPublisher* pPublisher = new TelemetryPublisher(pServer, pTelemetryCharacteristic,
+		TELEMETRY_PERIOD_MS, TELEMETRY_MIN_INTERVAL_MS, TELEMETRY_MAX_AGE_MS);
+	xTaskCreate(telemetry_task, "telemetry_task", 3072, pPublisher, 5, NULL);
+
 	BLEAdvertising *pAdvertising = pServer->getAdvertising();
 	// As it turns out, the default Advertising Object from the Service, even with the UUID set doesn't form all of the Ad Types that the Client was expecting
 	// Manually constructing the advertisement data does set the expected Ad types and then everything seems to work.
@@ -363,12 +418,12 @@ static void run() {
 
 void app_main(void)
 {
-
+	// Log levels are set here and through GeneralUtils so that the guards on debug output see them
+	GeneralUtils::setLogLevel((esp_log_level_t) CONFIG_LOG_DEFAULT_LEVEL);
 
 	//1. mcpwm gpio initialization
 	mcpwm_example_gpio_initialize();
-	sequence_interrupt_queue = xQueueCreate(10, sizeof(uint32_t));
-	ble_to_servo_queue = xQueueCreate(10, sizeof(uint32_t));
+	ble_to_servo_queue = xQueueCreate(10, sizeof(QueuedCommand));
 	xTaskCreate(servo_controller, "servo_controller", 2048, NULL, 10, NULL);
 
 	//2. initial mcpwm configuration
@@ -382,6 +437,14 @@ void app_main(void)
 	mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &pwm_config);    //Configure first servo with above settings
 	mcpwm_init(MCPWM_UNIT_1, MCPWM_TIMER_0, &pwm_config);    //Configure second servo with above settings
 
+	// A calibration measured on this device and saved in NVS replaces the defaults
+	calibration.setPoints(MAIN_SERVO, main_default_points, sizeof(main_default_points) / sizeof(main_default_points[0]));
+	calibration.setPoints(TIP_SERVO, tip_default_points, sizeof(tip_default_points) / sizeof(tip_default_points[0]));
+	if (!calibration.load(CALIBRATION_NAMESPACE)) {
+		ESP_LOGI(LOG_TAG, "Using the default servo calibration");
+	}
+	motion.start();
+
 	run();
 } // app_main
 